@@ -0,0 +1,57 @@
+/* ======================================================================
+
+check.c
+
+Reporting for the self-checking drivers of "make check".
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "check.h"
+
+static int cChecked;
+static int cFailed;
+
+/* **********************************************************************
+
+Check(bOk, szFormat, ...)
+
+Count a condition and report it on stderr, if it does not hold.
+
+********************************************************************** */
+
+void Check(int bOk, const char *szFormat, ...)
+{
+  va_list va;
+  cChecked++;
+  if (bOk) return;
+  cFailed++;
+  fputs("FAILED: ",stderr);
+  va_start(va,szFormat);
+  vfprintf(stderr,szFormat,va);
+  va_end(va);
+  fputc('\n',stderr);
+}
+
+/* **********************************************************************
+
+CheckResult()
+
+Report the summary.
+
+Return code: 0 if every check held, 1 otherwise.
+
+********************************************************************** */
+
+int CheckResult(void)
+{
+  fprintf(stderr,"%d of %d checks failed\n",cFailed,cChecked);
+  return cFailed ? 1 : 0;
+}
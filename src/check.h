@@ -0,0 +1,27 @@
+/* ======================================================================
+
+check.h
+
+Reporting for the self-checking drivers of "make check".
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A driver calls Check() for every condition and ends with
+CheckResult(), which is its exit code. Every failure is reported with
+its description, so that one run shows all of them.
+
+   ====================================================================== */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+void  Check(int bOk, const char *szFormat, ...)
+  __attribute__ ((format (printf, 2, 3)));
+int   CheckResult(void);
+
+#endif
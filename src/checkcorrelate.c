@@ -0,0 +1,254 @@
+/* ======================================================================
+
+checkcorrelate.c
+
+Self-checking driver for correlate.c, run by "make check".
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Random triggers and lookups of a few times more ids than the table
+holds are compared with a plain list: a new id goes to its end, a
+triggered one moves there, and a full table drops its head (within a
+TTL every id expires in the order of its last trigger). After every
+step the hash table must be sound: each id reachable from its home
+slot, and the free list as long as the unused entries. This exercises
+the backward shift of Remove() in a tiny table, where the probes wrap
+around, and in a large one.
+
+Expiry needs the clock: it is checked with a TTL of 2 seconds, starting
+at the beginning of a second, and takes three seconds.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "correlate.h"
+#include "check.h"
+
+static char achLine[256];
+
+/* **********************************************************************
+
+NewTable(pcr, sTTL, cMax)
+
+Set up the correlation of "id=N" lines, triggered by "id=N to=x".
+
+********************************************************************** */
+
+static void NewTable(TCorrelate *pcr, long sTTL, long cMax)
+{
+  CorrelateInit(pcr);
+  pcr->sTTL=sTTL;
+  pcr->cMax=cMax;
+  if (CorrelateTrigger(pcr,"id=([0-9]+) to=x")
+      || CorrelateId(pcr,"id=([0-9]+)") || CorrelateAllocate(pcr))
+    {
+      fprintf(stderr,"cannot set up a table\n");
+      exit(1);
+    }
+}
+
+/* **********************************************************************
+
+Trigger(pcr, id) / Keep(pcr, id)
+
+Pass a trigger line of an id, or ask for another line of it.
+
+Return code: true, if the line is kept.
+
+********************************************************************** */
+
+static int Trigger(TCorrelate *pcr, long id)
+{
+  snprintf(achLine,sizeof(achLine),"queued id=%ld to=x\n",id);
+  return CorrelateKeep(pcr,achLine);
+}
+
+static int Keep(TCorrelate *pcr, long id)
+{
+  snprintf(achLine,sizeof(achLine),"sent id=%ld status=ok\n",id);
+  return CorrelateKeep(pcr,achLine);
+}
+
+/* **********************************************************************
+
+Sound(pcr)
+
+Return code: true, if every used slot is reachable by probing from the
+home of its id, the slots hold cUsed entries and the free list the
+remaining ones.
+
+********************************************************************** */
+
+static int Sound(const TCorrelate *pcr)
+{
+  long    c=0,iSlot;
+  int32_t i;
+  for (iSlot=0; iSlot<=(long)pcr->ulMask; iSlot++)
+    {
+      uint32_t iProbe;
+      if (pcr->aiSlot[iSlot]<0) continue;
+      c++;
+      iProbe=(uint32_t)pcr->aentry[pcr->aiSlot[iSlot]].ullHash&pcr->ulMask;
+      while (iProbe!=(uint32_t)iSlot)
+	{
+	  if (pcr->aiSlot[iProbe]<0) return 0;
+	  iProbe=(iProbe+1)&pcr->ulMask;
+	}
+    }
+  if (c!=pcr->cUsed) return 0;
+  for (i=pcr->iFree; i>=0 && c<=pcr->cMax; i=pcr->aentry[i].iNext)
+    c++;
+  return c==pcr->cMax;
+}
+
+/* **********************************************************************
+
+CheckModel(cMax, cSteps)
+
+Compare random steps on ids 0..3*cMax-1 with the list.
+
+Return code: true, if the table stayed sound.
+
+********************************************************************** */
+
+static int CheckModel(long cMax, long cSteps)
+{
+  TCorrelate cr;
+  long      *aidList=malloc(cMax*sizeof(long)),cList=0,iStep,cWrong=0;
+  int        bSound=1;
+  unsigned   ulRandom=12345;
+  if (!aidList) exit(1);
+  NewTable(&cr,600,cMax);
+  for (iStep=0; iStep<cSteps && bSound; iStep++)
+    {
+      long id,i;
+      int  bListed;
+      ulRandom=ulRandom*1103515245+12345;
+      id=(ulRandom>>8)%(3*cMax);
+      for (i=0; i<cList && aidList[i]!=id; i++)
+	;
+      bListed=i<cList;
+      if ((ulRandom>>28)<11)
+	{
+	  Trigger(&cr,id);
+	  if (bListed)
+	    memmove(aidList+i,aidList+i+1,(--cList-i)*sizeof(long));
+	  else if (cList==cMax)
+	    memmove(aidList,aidList+1,(--cList)*sizeof(long));
+	  aidList[cList++]=id;
+	}
+      else if (Keep(&cr,id)!=bListed)
+	cWrong++;
+      if (cr.cUsed!=cList) cWrong++;
+      bSound=Sound(&cr); /* else the next probe may never end */
+    }
+  Check(!cWrong,"%ld of %ld steps wrong with %ld ids",cWrong,cSteps,cMax);
+  Check(bSound,"table broken at step %ld with %ld ids",iStep,cMax);
+  Check(cr.ulEvicted>0,"nothing evicted with %ld ids",cMax);
+  CorrelateFree(&cr);
+  free(aidList);
+  return bSound;
+}
+
+/* **********************************************************************
+
+CheckSaved()
+
+Save a table and load it into an equal and into a smaller one.
+
+********************************************************************** */
+
+static void CheckSaved(void)
+{
+  TCorrelate cr,crLoaded;
+  FILE      *fh=tmpfile();
+  long       c,id,cWrong=0;
+  if (!fh) exit(1);
+  NewTable(&cr,600,1000);
+  for (id=0; id<1000; id+=2)
+    Trigger(&cr,id);
+  c=CorrelateSave(&cr,fh);
+  Check(c==500,"%ld of 500 ids saved",c);
+  rewind(fh);
+  NewTable(&crLoaded,600,1000);
+  Check(CorrelateLoad(&crLoaded,fh,c)==0,"ids loaded");
+  Check(crLoaded.cUsed==500 && Sound(&crLoaded),"loaded table sound");
+  for (id=0; id<1000; id++)
+    if (Keep(&crLoaded,id)!=!(id%2)) cWrong++;
+  Check(!cWrong,"%ld ids wrong after loading",cWrong);
+  CorrelateFree(&crLoaded);
+  rewind(fh);
+  NewTable(&crLoaded,600,100);
+  Check(CorrelateLoad(&crLoaded,fh,c)==0,"ids loaded into a small table");
+  Check(crLoaded.cUsed==100 && crLoaded.ulEvicted==400
+	&& Sound(&crLoaded),"small table full and sound");
+  Check(CorrelateLoad(&crLoaded,fh,1)<0,"loading past the end fails");
+  fclose(fh);
+  CorrelateFree(&crLoaded);
+  CorrelateFree(&cr);
+}
+
+/* **********************************************************************
+
+CheckExpiry()
+
+Let ids expire, one of them extended by a second trigger.
+
+********************************************************************** */
+
+static void CheckExpiry(void)
+{
+  TCorrelate      cr;
+  struct timespec ts;
+  time_t          tiStart;
+  NewTable(&cr,2,100);
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  tiStart=ts.tv_sec;
+  while (ts.tv_sec==tiStart)
+    {
+      usleep(1000);
+      clock_gettime(CLOCK_MONOTONIC,&ts);
+    }
+  Trigger(&cr,1);
+  Trigger(&cr,2);
+  Trigger(&cr,3);
+  Check(Keep(&cr,1) && Keep(&cr,2) && Keep(&cr,3) && !Keep(&cr,4),
+	"triggered ids kept");
+  sleep(1);
+  Trigger(&cr,1);
+  sleep(1);
+  Check(Keep(&cr,1),"extended id kept");
+  Check(!Keep(&cr,2) && !Keep(&cr,3),"ids expired");
+  Check(cr.cUsed==1 && Sound(&cr),"expired ids removed");
+  sleep(1);
+  Check(!Keep(&cr,1),"extended id expired");
+  Check(cr.cUsed==0 && Sound(&cr),"table empty");
+  CorrelateFree(&cr);
+}
+
+int main(void)
+{
+  TCorrelate cr;
+  CorrelateInit(&cr);
+  Check(CorrelateAllocate(&cr)==0 && !CorrelateEnabled(&cr)
+	&& Keep(&cr,1),"no expressions, every line kept");
+  CorrelateTrigger(&cr,"id=([0-9]+) to=x");
+  Check(CorrelateAllocate(&cr)<0,"trigger without id refused");
+  CorrelateFree(&cr);
+  if (CheckModel(8,20000) && CheckModel(1000,100000))
+    {
+      CheckSaved(); /* a broken table might probe forever */
+      CheckExpiry();
+    }
+  return CheckResult();
+}
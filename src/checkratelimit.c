@@ -0,0 +1,264 @@
+/* ======================================================================
+
+checkratelimit.c
+
+Self-checking driver for ratelimit.c, run by "make check".
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Lines of varying length are queued beyond the memory queue and taken
+back, partly in between, so that the queue is compacted and grows,
+and new lines go to the spool while it is in use. They must come back
+complete, in order and with their positions, also after a save and a
+load. Without the spool, the lines beyond the queue are dropped.
+
+A rate of 0 (the limit removed) hands out a token for every line, so
+the queues drain without waiting.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ratelimit.h"
+#include "check.h"
+
+static char achLine[256];
+
+/* **********************************************************************
+
+MakeLine(i)
+
+Format the test line number i, its length changing with i.
+
+Return code: The length of the line in achLine.
+
+********************************************************************** */
+
+static int MakeLine(long i)
+{
+  int cch=snprintf(achLine,sizeof(achLine),"line %ld ",i);
+  memset(achLine+cch,'x',i%97);
+  cch+=i%97;
+  achLine[cch++]='\n';
+  achLine[cch]='\0';
+  return cch;
+}
+
+/* **********************************************************************
+
+Queue(prl, iFirst, iEnd)
+
+Queue the lines iFirst..iEnd-1, at the position 100*i.
+
+Return code: The number of lines not queued.
+
+********************************************************************** */
+
+static long Queue(TRateLimit *prl, long iFirst, long iEnd)
+{
+  long c=0;
+  for (; iFirst<iEnd; iFirst++)
+    if (RateLimitQueue(prl,achLine,MakeLine(iFirst),100*iFirst)!=0) c++;
+  return c;
+}
+
+/* **********************************************************************
+
+Take(prl, iFirst, iEnd, szWhat)
+
+Take the lines iFirst..iEnd-1 and check them.
+
+********************************************************************** */
+
+static void Take(TRateLimit *prl, long iFirst, long iEnd,
+		 const char *szWhat)
+{
+  long cWrong=0;
+  for (; iFirst<iEnd; iFirst++)
+    {
+      const char *pch;
+      long        lPosition;
+      int         cch,cchWanted=MakeLine(iFirst);
+      if (RateLimitOldest(prl)!=100*iFirst)
+	cWrong++;
+      pch=RateLimitNext(prl,&cch,&lPosition);
+      if (!pch)
+	{
+	  Check(0,"%s: line %ld missing",szWhat,iFirst);
+	  return;
+	}
+      if (cch!=cchWanted || memcmp(pch,achLine,cch)
+	  || lPosition!=100*iFirst)
+	cWrong++;
+    }
+  Check(!cWrong,"%s: %ld lines wrong",szWhat,cWrong);
+}
+
+/* **********************************************************************
+
+CheckParse()
+
+Accept the limits, reject everything else.
+
+********************************************************************** */
+
+static void CheckParse(void)
+{
+  TRateLimit rl;
+  RateLimitInit(&rl);
+  Check(!RateLimitEnabled(&rl),"a new limit is disabled");
+  Check(RateLimitParse(&rl,"10/s,5")==0 && rl.dRate==10 && rl.dBurst==5,
+	"limit 10/s,5");
+  Check(RateLimitParse(&rl,"20")==0 && rl.dRate==20 && rl.dBurst==20,
+	"limit 20");
+  Check(RateLimitParse(&rl,"0.5/s")==0 && rl.dBurst==1,"limit 0.5/s");
+  Check(RateLimitParse(&rl,"0")<0,"limit 0 refused");
+  Check(RateLimitParse(&rl,"10/m")<0,"limit 10/m refused");
+  Check(RateLimitParse(&rl,"10,x")<0,"limit 10,x refused");
+  RateLimitFree(&rl);
+}
+
+/* **********************************************************************
+
+CheckRate()
+
+Take the burst, then wait for the next token.
+
+********************************************************************** */
+
+static void CheckRate(void)
+{
+  TRateLimit rl;
+  long       ms;
+  RateLimitInit(&rl);
+  RateLimitParse(&rl,"100/s,3");
+  Check(RateLimitTake(&rl) && RateLimitTake(&rl) && RateLimitTake(&rl),
+	"burst taken");
+  Check(!RateLimitTake(&rl),"no token beyond the burst");
+  Check(RateLimitMsLeft(&rl)==-1,"nothing queued");
+  Check(Queue(&rl,0,2)==0,"lines queued");
+  Check(!RateLimitTake(&rl) && rl.cQueued==2,"no token before queued lines");
+  ms=RateLimitMsLeft(&rl);
+  Check(ms>=0 && ms<=11,"%ld ms for the next token at 100/s",ms);
+  usleep(11000);
+  Take(&rl,0,1,"after waiting");
+  RateLimitFree(&rl);
+}
+
+/* **********************************************************************
+
+CheckDrop()
+
+Drop the lines beyond a queue of 10.
+
+********************************************************************** */
+
+static void CheckDrop(void)
+{
+  TRateLimit rl;
+  long       c;
+  int        cch;
+  RateLimitInit(&rl);
+  RateLimitParse(&rl,"1/s,1");
+  rl.cMaxQueued=10;
+  c=Queue(&rl,0,100);
+  Check(c==90 && rl.ulDropped==90 && rl.ulThrottled==10,
+	"%ld of 90 lines dropped",c);
+  Check(rl.cQueued==10 && !rl.cSpooled,"10 lines queued");
+  rl.dRate=0;
+  Take(&rl,0,10,"drop");
+  Check(!RateLimitNext(&rl,&cch,&c),"nothing left");
+  RateLimitFree(&rl);
+}
+
+/* **********************************************************************
+
+CheckSpool()
+
+Spool the lines beyond a queue of 10, take some in between, save and
+load the rest.
+
+********************************************************************** */
+
+static void CheckSpool(void)
+{
+  TRateLimit rl,rlLoaded;
+  FILE      *fh=tmpfile();
+  long       c;
+  int        cch;
+  if (!fh) exit(1);
+  RateLimitInit(&rl);
+  RateLimitParse(&rl,"1/s,1");
+  rl.cMaxQueued=10;
+  rl.bSpool=1;
+  Check(Queue(&rl,0,1000)==0,"no line dropped");
+  Check(rl.cQueued==10 && rl.cSpooled==990 && rl.ulThrottled==1000,
+	"%d lines queued, %lu spooled",rl.cQueued,rl.cSpooled);
+  rl.dRate=0;
+  Take(&rl,0,5,"memory");
+  Queue(&rl,1000,1010);
+  Check(rl.cQueued==5 && rl.cSpooled==1000,"new lines behind the spool");
+  c=RateLimitSave(&rl,fh);
+  Check(c==1005,"%ld of 1005 lines saved",c);
+  Take(&rl,5,1010,"spool");
+  Check(!rl.cSpooled && !rl.lSpoolWrite,"spool emptied");
+  Check(RateLimitOldest(&rl)==-1 && !RateLimitNext(&rl,&cch,&c),
+	"nothing left");
+  Queue(&rl,0,1);
+  Check(rl.cQueued==1 && !rl.cSpooled,"memory used again");
+  rewind(fh);
+  RateLimitInit(&rlLoaded);
+  rlLoaded.cMaxQueued=10;
+  Check(RateLimitLoad(&rlLoaded,fh,1005)==0,"lines loaded");
+  Check(rlLoaded.cQueued==10 && rlLoaded.cSpooled==995,
+	"loaded lines spooled beyond the queue");
+  Take(&rlLoaded,5,1010,"loaded");
+  Check(RateLimitLoad(&rlLoaded,fh,1)<0,"loading past the end fails");
+  fclose(fh);
+  RateLimitFree(&rlLoaded);
+  RateLimitFree(&rl);
+}
+
+/* **********************************************************************
+
+CheckCompaction()
+
+Queue and take lines in turns in a large memory queue, which has to
+move its records and grow.
+
+********************************************************************** */
+
+static void CheckCompaction(void)
+{
+  TRateLimit rl;
+  long       i,c=0;
+  RateLimitInit(&rl);
+  rl.cMaxQueued=100000;
+  for (i=0; i<20; i++)
+    {
+      c+=Queue(&rl,i*1000,(i+1)*1000);
+      Take(&rl,i*500,(i+1)*500,"compaction");
+    }
+  Check(!c && rl.cQueued==10000 && !rl.cSpooled && rl.cchAlloc>65536,
+	"%d lines queued in %d bytes",rl.cQueued,rl.cchAlloc);
+  Take(&rl,10000,20000,"compaction");
+  RateLimitFree(&rl);
+}
+
+int main(void)
+{
+  CheckParse();
+  CheckRate();
+  CheckDrop();
+  CheckSpool();
+  CheckCompaction();
+  return CheckResult();
+}
@@ -0,0 +1,160 @@
+/* ======================================================================
+
+checksample.c
+
+Self-checking driver for sample.c, run by "make check".
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The choice must be deterministic: the same for the same line in every
+run, and the same for all lines sharing a key. The number of lines
+kept out of a fixed set is compared with the value of the first
+version, so that a changed hash is noticed (old and new samples would
+no longer match).
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sample.h"
+#include "check.h"
+
+#define LINES      100000
+#define LINES_KEPT 9975            /* of LINES at 1/10, must not change */
+
+static char achLine[256];
+
+/* **********************************************************************
+
+MakeLine(i)
+
+Format the test line number i, with a key "user=" taking 97 values.
+
+Return code: The length of the line in achLine.
+
+********************************************************************** */
+
+static int MakeLine(int i)
+{
+  return snprintf(achLine,sizeof(achLine),
+		  "Oct 19 12:00:00 host app[42]: user=u%d request %d\n",
+		  i%97,i);
+}
+
+/* **********************************************************************
+
+CheckParse()
+
+Accept the rates, reject everything else.
+
+********************************************************************** */
+
+static void CheckParse(void)
+{
+  TSample s;
+  SampleInit(&s);
+  Check(!SampleEnabled(&s),"a new sample is disabled");
+  Check(SampleKeep(&s,"x\n",2),"a disabled sample keeps every line");
+  Check(SampleParse(&s,"1/10")==0 && s.ulModulus==10,"rate 1/10");
+  Check(SampleParse(&s,"7")==0 && s.ulModulus==7,"rate 7");
+  Check(SampleParse(&s,"1")==0 && !SampleEnabled(&s),"rate 1 keeps all");
+  Check(SampleParse(&s,"1/0")<0,"rate 1/0 rejected");
+  Check(SampleParse(&s,"1/x")<0,"rate 1/x rejected");
+  Check(SampleParse(&s,"2/10")<0,"rate 2/10 rejected");
+  Check(SampleParse(&s,"")<0,"empty rate rejected");
+  Check(SampleKey(&s,"user=(")<0,"bad key rejected");
+  SampleFree(&s);
+}
+
+/* **********************************************************************
+
+CheckLines()
+
+Sample whole lines twice: same decisions, and about a tenth kept.
+
+********************************************************************** */
+
+static void CheckLines(void)
+{
+  static char abKeep[LINES];
+  TSample s;
+  int     i,cSame=0;
+  SampleInit(&s);
+  SampleParse(&s,"1/10");
+  for (i=0; i<LINES; i++)
+    abKeep[i]=SampleKeep(&s,achLine,MakeLine(i));
+  Check(s.ulKept+s.ulRejected==LINES,"every line counted");
+  Check(s.ulKept==LINES_KEPT,"%lu lines of %d kept, not %d",
+	s.ulKept,LINES,LINES_KEPT);
+  Check(s.ulKept>LINES/10*9/10 && s.ulKept<LINES/10*11/10,
+	"%lu lines of %d kept, not about a tenth",s.ulKept,LINES);
+  SampleFree(&s);
+  SampleInit(&s);
+  SampleParse(&s,"1/10");
+  for (i=0; i<LINES; i++)
+    if (SampleKeep(&s,achLine,MakeLine(i))==abKeep[i]) cSame++;
+  Check(cSame==LINES,"%d of %d lines decided again alike",cSame,LINES);
+  i=MakeLine(0);
+  Check(SampleKeep(&s,achLine,i)==SampleKeep(&s,achLine,i-1),
+	"the final newline is not hashed");
+  SampleFree(&s);
+}
+
+/* **********************************************************************
+
+CheckKey()
+
+Sample by the user: all lines of a user go together, lines without
+the key are hashed as a whole.
+
+********************************************************************** */
+
+static void CheckKey(void)
+{
+  TSample s,sWhole;
+  int     abUser[97],cUsers=0,cSplit=0,i;
+  SampleInit(&sWhole);
+  SampleParse(&sWhole,"1/10");
+  SampleInit(&s);
+  SampleParse(&s,"1/10");
+  Check(SampleKey(&s,"user=([a-z0-9]+)")==0,"key accepted");
+  for (i=0; i<LINES; i++)
+    {
+      int bKeep=SampleKeep(&s,achLine,MakeLine(i));
+      if (i<97)
+	{
+	  abUser[i]=bKeep;
+	  cUsers+=bKeep;
+	}
+      else if (bKeep!=abUser[i%97])
+	cSplit++;
+    }
+  Check(!cSplit,"%d lines decided apart from their user",cSplit);
+  Check(cUsers>0 && cUsers<97,"%d of 97 users kept",cUsers);
+  Check(SampleKeep(&s,"user=u1 other\n",14)==abUser[1],
+	"same key, same decision");
+  cSplit=0;
+  for (i=0; i<1000; i++)
+    {
+      int cch=snprintf(achLine,sizeof(achLine),"no key %d\n",i);
+      if (SampleKeep(&s,achLine,cch)!=SampleKeep(&sWhole,achLine,cch))
+	cSplit++;
+    }
+  Check(!cSplit,"%d lines without the key not hashed as a whole",cSplit);
+  SampleFree(&sWhole);
+  SampleFree(&s);
+}
+
+int main(void)
+{
+  CheckParse();
+  CheckLines();
+  CheckKey();
+  return CheckResult();
+}
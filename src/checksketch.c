@@ -0,0 +1,274 @@
+/* ======================================================================
+
+checksketch.c
+
+Self-checking driver for sketch.c, run by "make check".
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A top sketch is fed a few heavy fields among many rare ones, in a
+fixed order, and must find them in order, never below their counts.
+A distinct sketch must stay within 5% (about three standard errors).
+Snapshots must merge into an empty sketch unchanged, and into a full
+one by summing the counters (top) or taking the larger registers
+(distinct). Snapshots of another size are refused.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sketch.h"
+#include "check.h"
+
+#define HEAVY   5
+
+static const char  *aszHeavy[HEAVY]={ "alice", "bob", "carol", "dave",
+				      "eve" };
+static const int    acHeavy[HEAVY]={ 1000, 500, 200, 100, 50 };
+
+static char achLine[256];
+static char achResult[4096];
+
+/* **********************************************************************
+
+NewSketch(ps, idKind, cWidth, cTop, cBits)
+
+Set up a sketch "users" of the field "user=", depth 4.
+
+********************************************************************** */
+
+static void NewSketch(TSketch *ps, int idKind, int cWidth, int cTop,
+		      int cBits)
+{
+  if (SketchInit(ps,idKind,"users:user=([a-z0-9]+)")
+      || SketchAllocate(ps,cWidth,4,cTop,cBits))
+    {
+      fprintf(stderr,"cannot set up a sketch\n");
+      exit(1);
+    }
+}
+
+/* **********************************************************************
+
+Feed(ps, szUser)
+
+Feed a line of a user.
+
+********************************************************************** */
+
+static void Feed(TSketch *ps, const char *szUser)
+{
+  snprintf(achLine,sizeof(achLine),
+	   "Oct 19 12:00:00 host app[42]: user=%s login\n",szUser);
+  SketchFeed(ps,achLine);
+}
+
+/* **********************************************************************
+
+FeedTop(ps)
+
+Feed the heavy users (each at an even pace) and 2000 rare ones.
+
+********************************************************************** */
+
+static void FeedTop(TSketch *ps)
+{
+  char ach[16];
+  int  i,j;
+  for (i=0; i<1000; i++)
+    {
+      for (j=0; j<HEAVY; j++)
+	if (i%(1000/acHeavy[j])==0) Feed(ps,aszHeavy[j]);
+      for (j=0; j<2; j++)
+	{
+	  snprintf(ach,sizeof(ach),"x%d",2*i+j);
+	  Feed(ps,ach);
+	}
+    }
+  SketchFeed(ps,"a line without the field\n");
+}
+
+/* **********************************************************************
+
+TopCount(szResult, szKey)
+
+Return code: The count of a field in a formatted top, or -1.
+
+********************************************************************** */
+
+static long TopCount(const char *szResult, const char *szKey)
+{
+  int         cchKey=strlen(szKey);
+  const char *pch=szResult;
+  while ((pch=strstr(pch,szKey)))
+    {
+      if ((pch[-1]=='=' || pch[-1]==',') && pch[cchKey]==':')
+	return atol(pch+cchKey+1);
+      pch+=cchKey;
+    }
+  return -1;
+}
+
+/* **********************************************************************
+
+Distinct(ps)
+
+Return code: The formatted estimate of a distinct sketch.
+
+********************************************************************** */
+
+static double Distinct(TSketch *ps)
+{
+  double d=-1;
+  SketchFormat(ps,achResult,sizeof(achResult));
+  sscanf(achResult," users=%lf",&d);
+  return d;
+}
+
+/* **********************************************************************
+
+Snapshot(ps)
+
+Return code: A snapshot of ps behind a counter's prefix, to be freed.
+
+********************************************************************** */
+
+static char *Snapshot(const TSketch *ps)
+{
+  int   cch=SketchSnapshotSize(ps);
+  char *pch=malloc(cch+32);
+  if (!pch) exit(1);
+  strcpy(pch,"1760875200 60 web ");
+  Check(SketchSnapshot(ps,pch+18,cch)>0,"snapshot written");
+  Check(SketchSnapshot(ps,pch+18,cch-1)<0,"short buffer refused");
+  return pch;
+}
+
+/* **********************************************************************
+
+CheckTop()
+
+Find the heavy users, merge snapshots.
+
+********************************************************************** */
+
+static void CheckTop(void)
+{
+  TSketch s,sCopy,sOther;
+  char    achFirst[sizeof(achResult)],*pchSnapshot;
+  long    ul;
+  int     i;
+  NewSketch(&s,SKETCH_TOPK,2048,HEAVY,0);
+  FeedTop(&s);
+  Check(s.ulFields==3850,"%lu fields taken, not 3850",s.ulFields);
+  SketchFormat(&s,achFirst,sizeof(achFirst));
+  Check(!strncmp(achFirst," users=alice:",13),"top is %s",achFirst);
+  for (i=0; i<HEAVY; i++)
+    {
+      ul=TopCount(achFirst,aszHeavy[i]);
+      Check(ul>=acHeavy[i] && ul<=acHeavy[i]+20,
+	    "%s counted %ld, not %d",aszHeavy[i],ul,acHeavy[i]);
+      if (i)
+	Check(strstr(achFirst,aszHeavy[i-1])<strstr(achFirst,aszHeavy[i]),
+	      "%s before %s",aszHeavy[i-1],aszHeavy[i]);
+    }
+  pchSnapshot=Snapshot(&s);
+  NewSketch(&sCopy,SKETCH_TOPK,2048,HEAVY,0);
+  Check(SketchMerge(&sCopy,pchSnapshot)==0,"snapshot merged");
+  Check(sCopy.ulFields==s.ulFields,"fields merged");
+  Check(!memcmp(sCopy.aulCells,s.aulCells,2048*4*sizeof(uint32_t)),
+	"counters merged unchanged");
+  SketchFormat(&sCopy,achResult,sizeof(achResult));
+  Check(!strcmp(achResult,achFirst),"merged top %s, not %s",
+	achResult,achFirst);
+  Check(SketchMerge(&sCopy,pchSnapshot)==0,"snapshot merged again");
+  SketchFormat(&sCopy,achResult,sizeof(achResult));
+  for (i=0; i<HEAVY; i++)
+    Check(TopCount(achResult,aszHeavy[i])
+	  ==2*TopCount(achFirst,aszHeavy[i]),
+	  "%s not summed in %s",aszHeavy[i],achResult);
+  NewSketch(&sOther,SKETCH_TOPK,1024,HEAVY,0);
+  Check(SketchMerge(&sOther,pchSnapshot)<0,"other width refused");
+  Check(sOther.ulFields==0,"nothing merged from another width");
+  SketchFree(&sOther);
+  pchSnapshot[strlen(pchSnapshot)/2]='\0';
+  Check(SketchMerge(&sCopy,pchSnapshot)<0,"cut snapshot refused");
+  Check(SketchMerge(&sCopy,"sketch user topk 1 4 2048 ")==1,
+	"other name ignored");
+  Check(SketchMerge(&sCopy,"no snapshot")==1,"line without snapshot");
+  free(pchSnapshot);
+  SketchReset(&sCopy);
+  SketchFormat(&sCopy,achResult,sizeof(achResult));
+  Check(!strcmp(achResult," users="),"reset top is %s",achResult);
+  SketchFree(&sCopy);
+  SketchFree(&s);
+}
+
+/* **********************************************************************
+
+CheckDistinct()
+
+Estimate small and large numbers of users, merge overlapping sets.
+
+********************************************************************** */
+
+static void CheckDistinct(void)
+{
+  TSketch s,sOther,sCopy;
+  char    ach[16],*pchSnapshot;
+  double  d;
+  int     i;
+  NewSketch(&s,SKETCH_DISTINCT,0,0,12);
+  for (i=0; i<200; i++)
+    {
+      snprintf(ach,sizeof(ach),"u%d",i%100);
+      Feed(&s,ach);
+    }
+  d=Distinct(&s);
+  Check(fabs(d-100)<=3,"%.0f of 100 users",d);
+  for (i=0; i<50000; i++)
+    {
+      snprintf(ach,sizeof(ach),"u%d",i);
+      Feed(&s,ach);
+    }
+  d=Distinct(&s);
+  Check(fabs(d-50000)<=2500,"%.0f of 50000 users",d);
+  NewSketch(&sOther,SKETCH_DISTINCT,0,0,12);
+  for (i=25000; i<75000; i++)
+    {
+      snprintf(ach,sizeof(ach),"u%d",i);
+      Feed(&sOther,ach);
+    }
+  pchSnapshot=Snapshot(&sOther);
+  NewSketch(&sCopy,SKETCH_DISTINCT,0,0,12);
+  Check(SketchMerge(&sCopy,pchSnapshot)==0,"snapshot merged");
+  Check(!memcmp(sCopy.abRegisters,sOther.abRegisters,4096),
+	"registers merged unchanged");
+  Check(SketchMerge(&s,pchSnapshot)==0,"snapshot merged into a full one");
+  d=Distinct(&s);
+  Check(fabs(d-75000)<=3750,"%.0f of 75000 users merged",d);
+  Check(SketchMerge(&s,pchSnapshot)==0 && Distinct(&s)==d,
+	"merging twice changes nothing");
+  SketchFree(&sCopy);
+  NewSketch(&sCopy,SKETCH_DISTINCT,0,0,10);
+  Check(SketchMerge(&sCopy,pchSnapshot)<0,"other size refused");
+  SketchFree(&sCopy);
+  free(pchSnapshot);
+  SketchFree(&sOther);
+  SketchFree(&s);
+}
+
+int main(void)
+{
+  CheckTop();
+  CheckDistinct();
+  return CheckResult();
+}
@@ -0,0 +1,258 @@
+/* ======================================================================
+
+childspawn.c
+
+Child process launch for tailfd, tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The daemons used to start their slaves through popen() or fork() and
+execvp(). Both copy the whole process, and popen() additionally runs
+a /bin/sh for every slave. Here posix_spawn() is used, which the C
+library implements with vfork semantics, and the argument vector is
+passed directly.
+
+Descriptor hygiene: Every descriptor created here is close-on-exec
+and above 2. The child gets its STDIN (and optionally its STDOUT)
+through explicit dup2() actions, and nothing else leaks into it.
+
+   ====================================================================== */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  /* pipe2(), POSIX_SPAWN_USEVFORK */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "childspawn.h"
+
+extern char **environ;
+
+/* characters, that make us hand a command line to the shell */
+#define SHELL_META_CHARS "$&*(){}[]'\";\\|?<>~`#\n"
+
+/* **********************************************************************
+
+SpawnCloseOnExec(h)
+
+Move a descriptor above the standard descriptors and mark it
+close-on-exec.
+
+Return code: The new descriptor, or -1 on error.
+
+********************************************************************** */
+
+int SpawnCloseOnExec(int hFile)
+{
+  int hNew;
+  if (hFile<0) return -1;
+  if (hFile>2)
+    return (fcntl(hFile,F_SETFD,FD_CLOEXEC)<0) ? -1 : hFile;
+  hNew=fcntl(hFile,F_DUPFD_CLOEXEC,3);
+  close(hFile);
+  return hNew;
+}
+
+/* **********************************************************************
+
+SpawnPipe(&hRead, &hWrite)
+
+Create a pipe with both ends close-on-exec and above 2.
+
+Return code: 0 on success, -1 otherwise.
+
+********************************************************************** */
+
+int SpawnPipe(int *phRead, int *phWrite)
+{
+  int afdPipe[2];
+  if (pipe2(afdPipe,O_CLOEXEC)<0)
+    return -1;
+  *phRead =SpawnCloseOnExec(afdPipe[0]);
+  *phWrite=SpawnCloseOnExec(afdPipe[1]);
+  if (*phRead<0 || *phWrite<0)
+    {
+      if (*phRead>=0)  close(*phRead);
+      if (*phWrite>=0) close(*phWrite);
+      return -1;
+    }
+  return 0;
+}
+
+/* **********************************************************************
+
+aszArgs=SpawnSplitCommand(szCommand)
+
+Split a plain command line at whitespace into an argument vector.
+
+Commands containing quotes, redirections, variables or any other
+shell syntax are not touched, as well as commands starting with a
+variable assignment.
+
+FREEable with SpawnFreeArgs().
+
+Return code: The NULL terminated vector, or NULL if the command needs
+a shell.
+
+********************************************************************** */
+
+char **SpawnSplitCommand(const char *szCommand)
+{
+  char  *pchBuffer,*pch;
+  char **aszArgs;
+  int    cArg;
+
+  while (isspace((unsigned char)*szCommand)) szCommand++;
+  if (!*szCommand || strpbrk(szCommand,SHELL_META_CHARS))
+    return NULL;
+  for (pch=(char*)szCommand; *pch && !isspace((unsigned char)*pch); pch++)
+    if (*pch=='=') return NULL;  /* VAR=value command */
+
+  pchBuffer=strdup(szCommand);
+  aszArgs=calloc(strlen(szCommand)/2+2,sizeof(char*));
+  if (!pchBuffer || !aszArgs)
+    {
+      free(pchBuffer);
+      free(aszArgs);
+      return NULL;
+    }
+  cArg=0;
+  pch=pchBuffer;
+  while (*pch)
+    {
+      aszArgs[cArg++]=pch;
+      while (*pch && !isspace((unsigned char)*pch)) pch++;
+      if (*pch) *pch++='\0';
+      while (isspace((unsigned char)*pch)) pch++;
+    }
+  aszArgs[cArg]=NULL;
+  return aszArgs;
+}
+
+/* **********************************************************************
+
+SpawnFreeArgs(aszArgs)
+
+Free a vector allocated by SpawnSplitCommand().
+
+********************************************************************** */
+
+void SpawnFreeArgs(char **aszArgs)
+{
+  if (aszArgs)
+    {
+      free(aszArgs[0]); /* arg space copy */
+      free(aszArgs);
+    }
+}
+
+/* **********************************************************************
+
+id=SpawnProcess(szPath, aszArgs, hStdIn, hStdOut)
+
+Start szPath (searched in PATH) with the given argument vector.
+hStdIn becomes the STDIN of the child. hStdOut becomes its STDOUT,
+unless it is negative; then STDOUT is inherited. STDERR is always
+inherited.
+
+Signal dispositions and the signal mask are reset in the child, so
+the handlers of the daemon do not leak into it.
+
+Return code: The pid of the child, or -1 (with errno set) if the
+child cannot be started. Exec errors are reported here, too.
+
+********************************************************************** */
+
+pid_t SpawnProcess(const char *szPath, char * const aszArgs[],
+		   int hStdIn, int hStdOut)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t          attr;
+  sigset_t                   set;
+  pid_t                      idProcess;
+  short                      nFlags;
+  int                        rc;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+  if (hStdIn>=0)
+    posix_spawn_file_actions_adddup2(&actions,hStdIn,0);
+  if (hStdOut>=0)
+    posix_spawn_file_actions_adddup2(&actions,hStdOut,1);
+
+  nFlags=POSIX_SPAWN_SETSIGMASK|POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+  nFlags|=POSIX_SPAWN_USEVFORK;
+#endif
+  posix_spawnattr_setflags(&attr,nFlags);
+  sigemptyset(&set);
+  posix_spawnattr_setsigmask(&attr,&set);
+  sigaddset(&set,SIGPIPE);
+  sigaddset(&set,SIGCHLD);
+  sigaddset(&set,SIGHUP);
+  sigaddset(&set,SIGINT);
+  sigaddset(&set,SIGTERM);
+  posix_spawnattr_setsigdefault(&attr,&set);
+
+  rc=posix_spawnp(&idProcess,szPath,&actions,&attr,aszArgs,environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  if (rc)
+    {
+      errno=rc;
+      return -1;
+    }
+  return idProcess;
+}
+
+/* **********************************************************************
+
+id=SpawnCommand(szCommand, nShellMode, hStdIn, hStdOut)
+
+Start a command line. With SPAWN_SHELL_AUTO a plain command is
+executed directly, and only command lines with shell syntax (or
+commands, that cannot be found, like shell builtins) go through
+/bin/sh -c. SPAWN_SHELL_ALWAYS behaves like popen().
+
+Return code: See SpawnProcess().
+
+********************************************************************** */
+
+pid_t SpawnCommand(const char *szCommand, int nShellMode,
+		   int hStdIn, int hStdOut)
+{
+  char  *aszShell[4];
+  pid_t  idProcess;
+
+  if (nShellMode==SPAWN_SHELL_AUTO)
+    {
+      char **aszArgs=SpawnSplitCommand(szCommand);
+      if (aszArgs)
+	{
+	  idProcess=SpawnProcess(aszArgs[0],aszArgs,hStdIn,hStdOut);
+	  SpawnFreeArgs(aszArgs);
+	  if (idProcess>0 || errno!=ENOENT)
+	    return idProcess;
+	  /* not found: may be a builtin, let the shell decide */
+	}
+    }
+  aszShell[0]="sh";
+  aszShell[1]="-c";
+  aszShell[2]=(char*)szCommand;
+  aszShell[3]=NULL;
+  return SpawnProcess(SPAWN_SHELL,aszShell,hStdIn,hStdOut);
+}
@@ -0,0 +1,42 @@
+/* ======================================================================
+
+childspawn.h
+
+Child process launch for tailfd, tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The children are started with posix_spawn() instead of fork() and
+popen(). The daemon is not copied, and /bin/sh is only started, if
+the command line really needs a shell.
+
+All descriptors handed out by this module are close-on-exec. A child
+sees exactly the descriptors it is given explicitly.
+
+   ====================================================================== */
+
+#ifndef CHILDSPAWN_H
+#define CHILDSPAWN_H
+
+#include <sys/types.h>
+
+#define SPAWN_SHELL_AUTO    0   /* shell only for shell syntax */
+#define SPAWN_SHELL_ALWAYS  1   /* always use /bin/sh -c, like popen() */
+
+#define SPAWN_SHELL         "/bin/sh"
+
+int    SpawnPipe(int *phRead, int *phWrite);
+int    SpawnCloseOnExec(int hFile);
+char **SpawnSplitCommand(const char *szCommand);
+void   SpawnFreeArgs(char **aszArgs);
+pid_t  SpawnProcess(const char *szPath, char * const aszArgs[],
+		    int hStdIn, int hStdOut);
+pid_t  SpawnCommand(const char *szCommand, int nShellMode,
+		    int hStdIn, int hStdOut);
+
+#endif
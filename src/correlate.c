@@ -0,0 +1,473 @@
+/* ======================================================================
+
+correlate.c
+
+Routing by correlated ids (e.g. Postfix queue ids) for the
+destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The entries never move, so the wheel can link them by number. The
+hash table probes linearly and deletes by shifting the following
+entries back, so there are no tombstones to clean up. The wheel has
+more slots than sTTL seconds, so a slot only holds entries expiring in
+the same second. The clock is CLOCK_MONOTONIC, which goes on across
+the exec() of an upgrade, so saved entries keep their expiry.
+
+   ====================================================================== */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "correlate.h"
+#include "hash.h"
+
+/* **********************************************************************
+
+CorrelateInit(pcr)
+
+Set up without correlation: every line is kept.
+
+********************************************************************** */
+
+void CorrelateInit(TCorrelate *pcr)
+{
+  memset(pcr,0,sizeof(*pcr));
+  pcr->sTTL=CORRELATE_DEFAULT_TTL;
+  pcr->cMax=CORRELATE_DEFAULT_MAX;
+  pcr->iFree=-1;
+}
+
+/* **********************************************************************
+
+CorrelateFree(pcr)
+
+Release the expressions and the table. Every line is kept afterwards.
+
+********************************************************************** */
+
+void CorrelateFree(TCorrelate *pcr)
+{
+  if (pcr->szTrigger)
+    {
+      regfree(&pcr->reTrigger);
+      free(pcr->szTrigger);
+    }
+  if (pcr->szId)
+    {
+      regfree(&pcr->reId);
+      free(pcr->szId);
+    }
+  free(pcr->aentry);
+  free(pcr->aiSlot);
+  free(pcr->aiWheel);
+  CorrelateInit(pcr);
+}
+
+/* **********************************************************************
+
+Compile(pre, &sz, szRegex)
+
+Compile an extended regular expression and keep its text.
+
+Return code: 0 on success, -1 for a bad expression (or no memory).
+
+********************************************************************** */
+
+static int Compile(regex_t *pre, char **psz, const char *szRegex)
+{
+  if (*psz)
+    {
+      regfree(pre);
+      free(*psz);
+      *psz=NULL;
+    }
+  if (regcomp(pre,szRegex,REG_EXTENDED|REG_NEWLINE))
+    return -1;
+  *psz=strdup(szRegex);
+  if (!*psz)
+    {
+      regfree(pre);
+      return -1;
+    }
+  return 0;
+}
+
+/* **********************************************************************
+
+CorrelateTrigger(pcr, szTrigger)
+CorrelateId(pcr, szId)
+
+Take the expression of the trigger lines, or the one finding the id in
+any line. The id is the first subexpression, or the whole match.
+
+Return code: 0 on success, -1 for a bad expression.
+
+********************************************************************** */
+
+int CorrelateTrigger(TCorrelate *pcr, const char *szTrigger)
+{
+  return Compile(&pcr->reTrigger,&pcr->szTrigger,szTrigger);
+}
+
+int CorrelateId(TCorrelate *pcr, const char *szId)
+{
+  return Compile(&pcr->reId,&pcr->szId,szId);
+}
+
+/* **********************************************************************
+
+CorrelateAllocate(pcr)
+
+Get the fixed memory for cMax ids of sTTL seconds, if there is a
+trigger and an id expression.
+
+Return code: 0 on success, -1 if one of the expressions is missing,
+the sizes are bad or there is no memory.
+
+********************************************************************** */
+
+int CorrelateAllocate(TCorrelate *pcr)
+{
+  uint32_t cSlots=2;
+  long     i;
+  if (!pcr->szTrigger && !pcr->szId) return 0;
+  if (!pcr->szTrigger || !pcr->szId || pcr->sTTL<1 || pcr->cMax<1
+      || pcr->cMax>(1L<<28))
+    return -1;
+  while (cSlots<2*(uint32_t)pcr->cMax) cSlots*=2;
+  pcr->cWheel=pcr->sTTL+2;
+  pcr->aentry=malloc(pcr->cMax*sizeof(TCorrelateEntry));
+  pcr->aiSlot=malloc(cSlots*sizeof(int32_t));
+  pcr->aiWheel=malloc(pcr->cWheel*sizeof(int32_t));
+  if (!pcr->aentry || !pcr->aiSlot || !pcr->aiWheel)
+    return -1;
+  memset(pcr->aiSlot,0xff,cSlots*sizeof(int32_t)); /* all -1 */
+  memset(pcr->aiWheel,0xff,pcr->cWheel*sizeof(int32_t));
+  for (i=0; i<pcr->cMax; i++)
+    pcr->aentry[i].iNext=i+1<pcr->cMax ? i+1 : -1;
+  pcr->iFree=0;
+  pcr->ulMask=cSlots-1;
+  return 0;
+}
+
+/* **********************************************************************
+
+CorrelateEnabled(pcr)
+
+Return code: true, if lines are routed by their ids.
+
+********************************************************************** */
+
+int CorrelateEnabled(const TCorrelate *pcr)
+{
+  return pcr->aentry!=NULL;
+}
+
+/* **********************************************************************
+
+CorrelateSame(pcr1, pcr2)
+
+Return code: true, if both have the same expressions and sizes, so
+the active ids may stay.
+
+********************************************************************** */
+
+int CorrelateSame(const TCorrelate *pcr1, const TCorrelate *pcr2)
+{
+  if (!pcr1->szTrigger || !pcr2->szTrigger)
+    return !pcr1->szTrigger && !pcr2->szTrigger;
+  return !strcmp(pcr1->szTrigger,pcr2->szTrigger)
+    && !strcmp(pcr1->szId,pcr2->szId)
+    && pcr1->sTTL==pcr2->sTTL && pcr1->cMax==pcr2->cMax;
+}
+
+/* **********************************************************************
+
+ti=Now()
+
+Return code: The monotonic clock in seconds.
+
+********************************************************************** */
+
+static long Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec;
+}
+
+/* **********************************************************************
+
+iSlot=Find(pcr, ullHash)
+
+Return code: The slot of the id, or the empty slot, where it belongs.
+
+********************************************************************** */
+
+static uint32_t Find(const TCorrelate *pcr, uint64_t ullHash)
+{
+  uint32_t iSlot=(uint32_t)ullHash&pcr->ulMask;
+  while (pcr->aiSlot[iSlot]>=0
+	 && pcr->aentry[pcr->aiSlot[iSlot]].ullHash!=ullHash)
+    iSlot=(iSlot+1)&pcr->ulMask;
+  return iSlot;
+}
+
+/* **********************************************************************
+
+Link(pcr, i) / Unlink(pcr, i)
+
+Put an entry into the wheel slot of its expiry, or take it out. A slot
+is a circular list, its first entry is the oldest, new ones are linked
+in before it (at the end).
+
+********************************************************************** */
+
+static void Link(TCorrelate *pcr, int32_t i)
+{
+  int32_t *pi=pcr->aiWheel+pcr->aentry[i].tiExpire%pcr->cWheel;
+  if (*pi<0)
+    {
+      pcr->aentry[i].iNext=pcr->aentry[i].iPrev=i;
+      *pi=i;
+      return;
+    }
+  pcr->aentry[i].iNext=*pi;
+  pcr->aentry[i].iPrev=pcr->aentry[*pi].iPrev;
+  pcr->aentry[pcr->aentry[*pi].iPrev].iNext=i;
+  pcr->aentry[*pi].iPrev=i;
+}
+
+static void Unlink(TCorrelate *pcr, int32_t i)
+{
+  TCorrelateEntry *pentry=pcr->aentry+i;
+  int32_t         *pi=pcr->aiWheel+pentry->tiExpire%pcr->cWheel;
+  if (pentry->iNext==i)
+    {
+      *pi=-1;
+      return;
+    }
+  pcr->aentry[pentry->iPrev].iNext=pentry->iNext;
+  pcr->aentry[pentry->iNext].iPrev=pentry->iPrev;
+  if (*pi==i) *pi=pentry->iNext;
+}
+
+/* **********************************************************************
+
+Remove(pcr, i)
+
+Drop an entry: out of the wheel, out of the table (shifting back the
+entries probed past its slot), onto the free list.
+
+********************************************************************** */
+
+static void Remove(TCorrelate *pcr, int32_t i)
+{
+  uint32_t iSlot=Find(pcr,pcr->aentry[i].ullHash),iNext=iSlot;
+  Unlink(pcr,i);
+  while (1)
+    {
+      uint32_t iHome;
+      iNext=(iNext+1)&pcr->ulMask;
+      if (pcr->aiSlot[iNext]<0) break;
+      iHome=(uint32_t)pcr->aentry[pcr->aiSlot[iNext]].ullHash&pcr->ulMask;
+      if (iSlot<=iNext ? (iSlot<iHome && iHome<=iNext)
+	  : (iSlot<iHome || iHome<=iNext))
+	continue; /* still reachable from its home */
+      pcr->aiSlot[iSlot]=pcr->aiSlot[iNext];
+      iSlot=iNext;
+    }
+  pcr->aiSlot[iSlot]=-1;
+  pcr->aentry[i].iNext=pcr->iFree;
+  pcr->iFree=i;
+  pcr->cUsed--;
+}
+
+/* **********************************************************************
+
+Expire(pcr, tiNow)
+
+Drop the entries of the wheel slots passed since the last call.
+
+********************************************************************** */
+
+static void Expire(TCorrelate *pcr, long tiNow)
+{
+  long c=0;
+  if (!pcr->tiWheel || !pcr->cUsed)
+    {
+      pcr->tiWheel=tiNow;
+      return;
+    }
+  while (pcr->tiWheel<tiNow && c++<pcr->cWheel)
+    {
+      int32_t *pi;
+      pcr->tiWheel++;
+      pi=pcr->aiWheel+pcr->tiWheel%pcr->cWheel;
+      while (*pi>=0 && pcr->aentry[*pi].tiExpire<=tiNow)
+	Remove(pcr,*pi);
+    }
+  pcr->tiWheel=tiNow;
+}
+
+/* **********************************************************************
+
+Activate(pcr, ullHash, tiExpire)
+
+Make an id active until tiExpire, or extend it. A full table drops the
+id expiring next (the oldest of its second).
+
+********************************************************************** */
+
+static void Activate(TCorrelate *pcr, uint64_t ullHash, long tiExpire)
+{
+  uint32_t iSlot=Find(pcr,ullHash);
+  int32_t  i=pcr->aiSlot[iSlot];
+  if (i>=0)
+    {
+      Unlink(pcr,i);
+      pcr->aentry[i].tiExpire=tiExpire;
+      Link(pcr,i);
+      return;
+    }
+  if (pcr->iFree<0)
+    {
+      long ti;
+      for (ti=pcr->tiWheel+1; pcr->aiWheel[ti%pcr->cWheel]<0; ti++)
+	;
+      Remove(pcr,pcr->aiWheel[ti%pcr->cWheel]);
+      pcr->ulEvicted++;
+      iSlot=Find(pcr,ullHash); /* the removal may have shifted it */
+    }
+  i=pcr->iFree;
+  pcr->iFree=pcr->aentry[i].iNext;
+  pcr->aentry[i].ullHash=ullHash;
+  pcr->aentry[i].tiExpire=tiExpire;
+  pcr->aiSlot[iSlot]=i;
+  Link(pcr,i);
+  pcr->cUsed++;
+}
+
+/* **********************************************************************
+
+ullHash=MatchId(pre, szLine)
+
+Return code: The hash of the id found by the expression, or 0 if there
+is none.
+
+********************************************************************** */
+
+static uint64_t MatchId(const regex_t *pre, const char *szLine)
+{
+  regmatch_t amatch[2];
+  uint64_t   ullHash;
+  int        i;
+  if (regexec(pre,szLine,2,amatch,0))
+    return 0;
+  i=(amatch[1].rm_so>=0) ? 1 : 0;
+  ullHash=HashBytes(szLine+amatch[i].rm_so,
+		    amatch[i].rm_eo-amatch[i].rm_so);
+  return ullHash ? ullHash : 1; /* 0 means none */
+}
+
+/* **********************************************************************
+
+CorrelateKeep(pcr, szLine)
+
+Decide about a line (NUL terminated): Keep a trigger line and activate
+its id, or keep a line with an active id.
+
+Return code: true, if the line is kept.
+
+********************************************************************** */
+
+int CorrelateKeep(TCorrelate *pcr, const char *szLine)
+{
+  long     tiNow;
+  uint64_t ullHash;
+  if (!CorrelateEnabled(pcr)) return 1;
+  tiNow=Now();
+  Expire(pcr,tiNow);
+  if ((ullHash=MatchId(&pcr->reTrigger,szLine))!=0)
+    {
+      Activate(pcr,ullHash,tiNow+pcr->sTTL);
+      pcr->ulTriggered++;
+      pcr->ulKept++;
+      return 1;
+    }
+  if (pcr->cUsed && (ullHash=MatchId(&pcr->reId,szLine))!=0
+      && pcr->aiSlot[Find(pcr,ullHash)]>=0)
+    {
+      pcr->ulKept++;
+      return 1;
+    }
+  pcr->ulRejected++;
+  return 0;
+}
+
+/* **********************************************************************
+
+CorrelateSave(pcr, fh)
+
+Write the active ids (hash and expiry) to fh, e.g. for an upgrade.
+There are cUsed of them, expired ones are dropped by CorrelateLoad().
+
+Return code: The number of ids written, or -1 on failure (errno).
+
+********************************************************************** */
+
+long CorrelateSave(TCorrelate *pcr, FILE *fh)
+{
+  long i,c=0;
+  if (!CorrelateEnabled(pcr)) return 0;
+  for (i=0; i<=(long)pcr->ulMask; i++)
+    if (pcr->aiSlot[i]>=0)
+      {
+	const TCorrelateEntry *pentry=pcr->aentry+pcr->aiSlot[i];
+	if (fwrite(&pentry->ullHash,sizeof(pentry->ullHash),1,fh)!=1
+	    || fwrite(&pentry->tiExpire,sizeof(pentry->tiExpire),1,fh)!=1)
+	  return -1;
+	c++;
+      }
+  return c;
+}
+
+/* **********************************************************************
+
+CorrelateLoad(pcr, fh, cIds)
+
+Activate cIds ids written by CorrelateSave(). Without a table they are
+skipped.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+int CorrelateLoad(TCorrelate *pcr, FILE *fh, long cIds)
+{
+  long tiNow=Now();
+  Expire(pcr,tiNow);
+  while (cIds-->0)
+    {
+      uint64_t ullHash;
+      long     tiExpire;
+      if (fread(&ullHash,sizeof(ullHash),1,fh)!=1
+	  || fread(&tiExpire,sizeof(tiExpire),1,fh)!=1)
+	{
+	  errno=EPROTO;
+	  return -1;
+	}
+      if (CorrelateEnabled(pcr) && tiExpire>tiNow)
+	Activate(pcr,ullHash,
+		 tiExpire<=tiNow+pcr->sTTL ? tiExpire : tiNow+pcr->sTTL);
+    }
+  return 0;
+}
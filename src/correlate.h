@@ -0,0 +1,81 @@
+/* ======================================================================
+
+correlate.h
+
+Routing by correlated ids (e.g. Postfix queue ids) for the
+destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A correlating destination gets only the lines of the ids, which have
+been triggered within the last sTTL seconds. A line matching the
+trigger expression (e.g. one about a certain recipient) makes the id
+in its first subexpression active, and is passed. Any other line is
+passed only if the id expression finds an active id in it, e.g.
+
+  trigger  "postfix/[a-z]+\[[0-9]+\]: ([0-9A-F]+): to=<x@example\.com>"
+  id       "postfix/[a-z]+\[[0-9]+\]: ([0-9A-F]+):"
+
+The active ids are kept as 64 bit hashes in a table of fixed size
+(cMax ids): an open addressing hash table of entry numbers, and a time
+wheel with a slot per second, which links the entries expiring in
+that second. Expiry costs nothing per line but a look at the clock.
+If the table is full, the id expiring next is dropped for a new one.
+
+   ====================================================================== */
+
+#ifndef CORRELATE_H
+#define CORRELATE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <regex.h>
+
+#define CORRELATE_DEFAULT_TTL  600          /* seconds */
+#define CORRELATE_DEFAULT_MAX  100000       /* ids */
+
+typedef struct {
+  uint64_t        ullHash;          /* of the id */
+  long            tiExpire;         /* monotonic seconds */
+  int32_t         iNext;            /* in the wheel slot (circular), or free list */
+  int32_t         iPrev;
+} TCorrelateEntry;
+
+typedef struct {
+  char           *szTrigger;        /* the expressions, NULL if none */
+  char           *szId;
+  regex_t         reTrigger;
+  regex_t         reId;
+  long            sTTL;
+  long            cMax;
+  TCorrelateEntry *aentry;          /* cMax of them */
+  int32_t         iFree;            /* first free entry */
+  long            cUsed;
+  int32_t        *aiSlot;           /* hash table of entry numbers */
+  uint32_t        ulMask;           /* slots-1 */
+  int32_t        *aiWheel;          /* first entry per second */
+  long            cWheel;           /* sTTL+2 slots */
+  long            tiWheel;          /* expired up to this second */
+  unsigned long   ulTriggered;      /* statistics */
+  unsigned long   ulKept;
+  unsigned long   ulRejected;
+  unsigned long   ulEvicted;
+} TCorrelate;
+
+void  CorrelateInit(TCorrelate *pcr);
+void  CorrelateFree(TCorrelate *pcr);
+int   CorrelateTrigger(TCorrelate *pcr, const char *szTrigger);
+int   CorrelateId(TCorrelate *pcr, const char *szId);
+int   CorrelateAllocate(TCorrelate *pcr);
+int   CorrelateEnabled(const TCorrelate *pcr);
+int   CorrelateSame(const TCorrelate *pcr1, const TCorrelate *pcr2);
+int   CorrelateKeep(TCorrelate *pcr, const char *szLine);
+long  CorrelateSave(TCorrelate *pcr, FILE *fh);
+int   CorrelateLoad(TCorrelate *pcr, FILE *fh, long cIds);
+
+#endif
@@ -0,0 +1,318 @@
+/* ======================================================================
+
+counter.c
+
+Interval counters, a built-in destination type of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "counter.h"
+
+/* **********************************************************************
+
+CounterInit(pc)
+
+Set up a counter without patterns and with the default interval.
+
+********************************************************************** */
+
+void CounterInit(TCounter *pc)
+{
+  memset(pc,0,sizeof(*pc));
+  pc->sInterval=COUNTER_DEFAULT_INTERVAL;
+}
+
+/* **********************************************************************
+
+CounterFree(pc)
+
+Release the patterns and the sketches.
+
+********************************************************************** */
+
+void CounterFree(TCounter *pc)
+{
+  int i;
+  for (i=0; i<pc->cPatterns; i++)
+    {
+      free(pc->apat[i].szName);
+      free(pc->apat[i].szRegex);
+      regfree(&pc->apat[i].re);
+    }
+  free(pc->apat);
+  for (i=0; i<pc->cSketches; i++)
+    SketchFree(&pc->asketch[i]);
+  free(pc->asketch);
+  CounterInit(pc);
+}
+
+/* **********************************************************************
+
+CounterAddPattern(pc, szSpec)
+
+Add a pattern "name:regex" (an extended regular expression).
+
+Return code: 0 on success, -1 for a bad specification (or no memory).
+
+********************************************************************** */
+
+int CounterAddPattern(TCounter *pc, const char *szSpec)
+{
+  const char      *pchColon=strchr(szSpec,':');
+  TCounterPattern *apat;
+  if (!pchColon || pchColon==szSpec) return -1;
+  apat=realloc(pc->apat,(pc->cPatterns+1)*sizeof(TCounterPattern));
+  if (!apat) return -1;
+  pc->apat=apat;
+  apat+=pc->cPatterns;
+  memset(apat,0,sizeof(*apat));
+  if (regcomp(&apat->re,pchColon+1,REG_EXTENDED|REG_NOSUB|REG_NEWLINE))
+    return -1;
+  apat->szName=strndup(szSpec,pchColon-szSpec);
+  apat->szRegex=strdup(pchColon+1);
+  if (!apat->szName || !apat->szRegex)
+    {
+      free(apat->szName);
+      free(apat->szRegex);
+      regfree(&apat->re);
+      return -1;
+    }
+  pc->cPatterns++;
+  return 0;
+}
+
+/* **********************************************************************
+
+CounterAddSketch(pc, idKind, szSpec)
+
+Add a sketch "name:regex" of a kind of sketch.h. Its memory is taken
+by CounterAllocate(), when all sizes are known.
+
+Return code: 0 on success, -1 for a bad specification (or no memory).
+
+********************************************************************** */
+
+int CounterAddSketch(TCounter *pc, int idKind, const char *szSpec)
+{
+  TSketch *asketch=realloc(pc->asketch,(pc->cSketches+1)*sizeof(TSketch));
+  if (!asketch) return -1;
+  pc->asketch=asketch;
+  if (SketchInit(asketch+pc->cSketches,idKind,szSpec)<0)
+    return -1;
+  pc->cSketches++;
+  return 0;
+}
+
+/* **********************************************************************
+
+CounterAllocate(pc)
+
+Get the fixed memory of the sketches.
+
+Return code: 0 on success, -1 for bad sizes or no memory.
+
+********************************************************************** */
+
+int CounterAllocate(TCounter *pc)
+{
+  int i;
+  for (i=0; i<pc->cSketches; i++)
+    if (SketchAllocate(&pc->asketch[i],pc->cSketchWidth,pc->cSketchDepth,
+		       pc->cSketchTop,pc->cSketchBits)<0)
+      return -1;
+  return 0;
+}
+
+/* **********************************************************************
+
+CounterSame(pc1, pc2)
+
+Compare the interval, the patterns (names and expressions) and the
+sketches.
+
+Return code: true, if both count the same.
+
+********************************************************************** */
+
+int CounterSame(const TCounter *pc1, const TCounter *pc2)
+{
+  int i;
+  if (pc1->sInterval!=pc2->sInterval || pc1->cPatterns!=pc2->cPatterns)
+    return 0;
+  for (i=0; i<pc1->cPatterns; i++)
+    if (strcmp(pc1->apat[i].szName,pc2->apat[i].szName)
+	|| strcmp(pc1->apat[i].szRegex,pc2->apat[i].szRegex))
+      return 0;
+  if (pc1->cSketches!=pc2->cSketches || pc1->bMerge!=pc2->bMerge)
+    return 0;
+  for (i=0; i<pc1->cSketches; i++)
+    if (!SketchSame(&pc1->asketch[i],&pc2->asketch[i]))
+      return 0;
+  return 1;
+}
+
+/* **********************************************************************
+
+CounterFeed(pc, szLine)
+
+Count a line (NUL terminated). With bMerge, it is merged as a snapshot
+into the sketches instead of being their input.
+
+********************************************************************** */
+
+void CounterFeed(TCounter *pc, const char *szLine)
+{
+  int i;
+  if (!pc->tiStart)
+    CounterMsLeft(pc); /* starts the first interval */
+  pc->ulLines++;
+  for (i=0; i<pc->cPatterns; i++)
+    if (!regexec(&pc->apat[i].re,szLine,0,NULL,0))
+      pc->apat[i].ulCount++;
+  if (pc->bMerge)
+    CounterMerge(pc,szLine);
+  else
+    for (i=0; i<pc->cSketches; i++)
+      SketchFeed(&pc->asketch[i],szLine);
+}
+
+/* **********************************************************************
+
+CounterMerge(pc, szLine)
+
+Merge a snapshot line (see CounterSnapshot()) into the sketch of the
+same name. Other lines, and snapshots of another size, are ignored.
+
+********************************************************************** */
+
+void CounterMerge(TCounter *pc, const char *szLine)
+{
+  int i;
+  if (!strstr(szLine,"sketch ")) return;
+  for (i=0; i<pc->cSketches; i++)
+    if (!SketchMerge(&pc->asketch[i],szLine))
+      break; /* one snapshot per line */
+}
+
+/* **********************************************************************
+
+CounterMsLeft(pc)
+
+Return code: The milliseconds until the current interval ends, 0 if it
+has ended.
+
+********************************************************************** */
+
+long CounterMsLeft(TCounter *pc)
+{
+  struct timespec ts;
+  long ms;
+  clock_gettime(CLOCK_REALTIME,&ts);
+  if (pc->sInterval<1) pc->sInterval=1;
+  if (!pc->tiStart)
+    pc->tiStart=ts.tv_sec-ts.tv_sec%pc->sInterval;
+  ms=(pc->tiStart+pc->sInterval-ts.tv_sec)*1000-ts.tv_nsec/1000000;
+  return ms>0 ? ms : 0;
+}
+
+/* **********************************************************************
+
+CounterFormatSize(pc, szAlias)
+
+Return code: The buffer size needed for CounterFormat().
+
+********************************************************************** */
+
+int CounterFormatSize(const TCounter *pc, const char *szAlias)
+{
+  int i,cch=strlen(szAlias)+72;
+  for (i=0; i<pc->cPatterns; i++)
+    cch+=strlen(pc->apat[i].szName)+24;
+  for (i=0; i<pc->cSketches; i++)
+    cch+=SketchFormatSize(&pc->asketch[i]);
+  return cch;
+}
+
+/* **********************************************************************
+
+CounterFormat(pc, szAlias, pch, cchMax, bReset)
+
+Write the result line of the current interval (see counter.h), which
+is cut to fit cchMax (see CounterFormatSize()). With bReset the
+counts start again, in the next interval (or the current one, if
+intervals have passed without a result).
+
+Return code: The length of the line.
+
+********************************************************************** */
+
+int CounterFormat(TCounter *pc, const char *szAlias, char *pch, int cchMax,
+		  int bReset)
+{
+  struct timespec ts;
+  long   sCovered;
+  int    i,cch;
+  if (!pc->tiStart) CounterMsLeft(pc);
+  clock_gettime(CLOCK_REALTIME,&ts); /* the clock of CounterMsLeft() */
+  sCovered=ts.tv_sec-pc->tiStart;
+  if (sCovered>pc->sInterval) sCovered=pc->sInterval;
+  cch=snprintf(pch,cchMax,"%ld %ld %s lines=%lu",(long)pc->tiStart,
+	       sCovered,szAlias,pc->ulLines);
+  for (i=0; i<pc->cPatterns && cch<cchMax; i++)
+    cch+=snprintf(pch+cch,cchMax-cch," %s=%lu",pc->apat[i].szName,
+		  pc->apat[i].ulCount);
+  for (i=0; i<pc->cSketches && cch<cchMax-1; i++)
+    cch+=SketchFormat(&pc->asketch[i],pch+cch,cchMax-cch);
+  if (cch>=cchMax-1) cch=cchMax-2;
+  pch[cch++]='\n';
+  pch[cch]='\0';
+  if (bReset)
+    {
+      pc->ulLines=0;
+      for (i=0; i<pc->cPatterns; i++)
+	pc->apat[i].ulCount=0;
+      for (i=0; i<pc->cSketches; i++)
+	SketchReset(&pc->asketch[i]);
+      pc->tiStart+=pc->sInterval;
+      if (pc->tiStart+pc->sInterval<=ts.tv_sec)
+	pc->tiStart=ts.tv_sec-ts.tv_sec%pc->sInterval;
+    }
+  return cch;
+}
+
+/* **********************************************************************
+
+CounterSnapshot(pc, szAlias, iSketch, &cch)
+
+Build the snapshot line of a sketch in the current interval (see
+counter.h), before CounterFormat() resets it.
+
+Return code: The line (malloc()ed), or NULL without memory.
+
+********************************************************************** */
+
+char *CounterSnapshot(TCounter *pc, const char *szAlias, int iSketch,
+		      int *pcch)
+{
+  const TSketch *ps=&pc->asketch[iSketch];
+  int            cchMax=SketchSnapshotSize(ps)+strlen(szAlias)+48;
+  char          *pch=malloc(cchMax);
+  int            cch;
+  if (!pch) return NULL;
+  if (!pc->tiStart) CounterMsLeft(pc);
+  cch=sprintf(pch,"%ld %ld %s ",(long)pc->tiStart,pc->sInterval,szAlias);
+  cch+=SketchSnapshot(ps,pch+cch,cchMax-cch);
+  pch[cch++]='\n';
+  pch[cch]='\0';
+  *pcch=cch;
+  return pch;
+}
@@ -0,0 +1,89 @@
+/* ======================================================================
+
+counter.h
+
+Interval counters, a built-in destination type of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A counter destination counts the lines, and the lines matching each
+of its patterns, in intervals aligned to the clock (e.g. every full
+minute). At the end of an interval the owner takes a result line
+like
+
+  1760000000 60 mail lines=5230 rejected=17 deferred=3
+
+(start of the interval, its seconds, the alias and the counts) and
+the counts start again from 0. No process, pipe or copy of the lines
+is involved.
+
+A counter may have sketches (see sketch.h) as well, which add the top
+fields or the number of different fields to the result line:
+
+  1760000000 60 mail lines=5230 senders=a.com:812,b.org:97 rcpts=1630
+
+With bSnapshot, the owner writes a snapshot line of every sketch
+before the result, like
+
+  1760000000 60 mail sketch senders topk ...
+
+and a counter with bMerge takes such lines (e.g. of other hosts)
+instead of log lines, and merges them into its sketches of the same
+name.
+
+   ====================================================================== */
+
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <regex.h>
+#include <time.h>
+
+#include "sketch.h"
+
+typedef struct {
+  char           *szName;
+  char           *szRegex;          /* the text of re */
+  regex_t         re;
+  unsigned long   ulCount;
+} TCounterPattern;
+
+typedef struct {
+  TCounterPattern *apat;            /* the patterns */
+  int             cPatterns;
+  long            sInterval;        /* seconds */
+  time_t          tiStart;          /* of the current interval */
+  unsigned long   ulLines;
+  TSketch        *asketch;          /* the sketches */
+  int             cSketches;
+  int             cSketchWidth;     /* their sizes, 0 = default */
+  int             cSketchDepth;
+  int             cSketchTop;
+  int             cSketchBits;
+  int             bSnapshot;        /* snapshots before the results */
+  int             bMerge;           /* takes snapshots, not lines */
+} TCounter;
+
+#define COUNTER_DEFAULT_INTERVAL 60         /* seconds */
+
+void  CounterInit(TCounter *pc);
+void  CounterFree(TCounter *pc);
+int   CounterAddPattern(TCounter *pc, const char *szSpec);
+int   CounterAddSketch(TCounter *pc, int idKind, const char *szSpec);
+int   CounterAllocate(TCounter *pc);
+int   CounterSame(const TCounter *pc1, const TCounter *pc2);
+void  CounterFeed(TCounter *pc, const char *szLine);
+long  CounterMsLeft(TCounter *pc);
+int   CounterFormatSize(const TCounter *pc, const char *szAlias);
+int   CounterFormat(TCounter *pc, const char *szAlias, char *pch, int cchMax,
+		    int bReset);
+char *CounterSnapshot(TCounter *pc, const char *szAlias, int iSketch,
+		      int *pcch);
+void  CounterMerge(TCounter *pc, const char *szLine);
+
+#endif
@@ -0,0 +1,196 @@
+/* ======================================================================
+
+dedup.c
+
+Collapsing of repeated lines for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+   ====================================================================== */
+
+#include <string.h>
+#include <ctype.h>
+
+#include "dedup.h"
+#include "hash.h"
+
+/* **********************************************************************
+
+DedupInit(pd)
+
+Set up without collapsing, and with the default window.
+
+********************************************************************** */
+
+void DedupInit(TDedup *pd)
+{
+  memset(pd,0,sizeof(*pd));
+  pd->msWindow=DEDUP_DEFAULT_WINDOW;
+}
+
+/* **********************************************************************
+
+DedupParse(pd, szMode)
+
+Take a mode: "exact", "digits" or "off".
+
+Return code: 0 on success, -1 for an unknown mode.
+
+********************************************************************** */
+
+int DedupParse(TDedup *pd, const char *szMode)
+{
+  if (!strcmp(szMode,"exact"))
+    pd->idMode=DEDUP_EXACT;
+  else if (!strcmp(szMode,"digits"))
+    pd->idMode=DEDUP_DIGITS;
+  else if (!strcmp(szMode,"off"))
+    pd->idMode=DEDUP_NONE;
+  else
+    return -1;
+  return 0;
+}
+
+/* **********************************************************************
+
+DedupEnabled(pd)
+
+Return code: true, if repeated lines are collapsed.
+
+********************************************************************** */
+
+int DedupEnabled(const TDedup *pd)
+{
+  return pd->idMode!=DEDUP_NONE;
+}
+
+/* **********************************************************************
+
+ullHash=Hash(idMode, pch, cch)
+
+FNV-1a over the line (see hash.h). With DEDUP_DIGITS, a run of digits
+counts as a single '#'.
+
+********************************************************************** */
+
+static uint64_t Hash(TDedupMode idMode, const char *pch, int cch)
+{
+  uint64_t    ullHash=HASH_START;
+  const char *pchEnd=pch+cch,*pchRun;
+  if (idMode!=DEDUP_DIGITS)
+    return HashAdd(ullHash,pch,cch);
+  while (pch<pchEnd)
+    {
+      for (pchRun=pch; pch<pchEnd && !isdigit((unsigned char)*pch); )
+	pch++;
+      ullHash=HashAdd(ullHash,pchRun,pch-pchRun);
+      if (pch==pchEnd) break;
+      while (pch<pchEnd && isdigit((unsigned char)*pch)) pch++;
+      ullHash=HashAdd(ullHash,"#",1);
+    }
+  return ullHash;
+}
+
+/* **********************************************************************
+
+MsSince(pts)
+
+Return code: The milliseconds since *pts.
+
+********************************************************************** */
+
+static long MsSince(const struct timespec *pts)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return (ts.tv_sec-pts->tv_sec)*1000+(ts.tv_nsec-pts->tv_nsec)/1000000;
+}
+
+/* **********************************************************************
+
+DedupCheck(pd, pchLine, cch, lPosition, &cRepeats)
+
+Look at a line. A repeat within the window is counted and suppressed.
+Otherwise the line passes and starts a new run; cRepeats tells the
+repeats of the run before, which must be reported before the line.
+
+Return code: true, if the line is suppressed.
+
+********************************************************************** */
+
+int DedupCheck(TDedup *pd, const char *pchLine, int cch, long lPosition,
+	       unsigned long *pcRepeats)
+{
+  uint64_t ullHash;
+  *pcRepeats=0;
+  if (!DedupEnabled(pd)) return 0;
+  if (cch && pchLine[cch-1]=='\n') cch--;
+  ullHash=Hash(pd->idMode,pchLine,cch);
+  if (pd->bLast && ullHash==pd->ullLast
+      && MsSince(&pd->tsFirst)<pd->msWindow)
+    {
+      if (!pd->cRepeats++) pd->lPosition=lPosition;
+      pd->ulSuppressed++;
+      return 1;
+    }
+  *pcRepeats=pd->cRepeats;
+  pd->cRepeats=0;
+  pd->ullLast=ullHash;
+  pd->bLast=1;
+  clock_gettime(CLOCK_MONOTONIC,&pd->tsFirst);
+  return 0;
+}
+
+/* **********************************************************************
+
+DedupFlush(pd, &lPosition)
+
+End the current run, e.g. when its window is over. The next line
+passes in any case.
+
+Return code: The repeats to be reported, lPosition is the position of
+the first one.
+
+********************************************************************** */
+
+unsigned long DedupFlush(TDedup *pd, long *plPosition)
+{
+  unsigned long cRepeats=pd->cRepeats;
+  *plPosition=pd->lPosition;
+  pd->cRepeats=0;
+  pd->bLast=0;
+  return cRepeats;
+}
+
+/* **********************************************************************
+
+DedupMsLeft(pd)
+
+Return code: The milliseconds until the window of the current run is
+over, 0 if it is, or -1 if there are no repeats to report.
+
+********************************************************************** */
+
+long DedupMsLeft(const TDedup *pd)
+{
+  long ms;
+  if (!pd->cRepeats) return -1;
+  ms=pd->msWindow-MsSince(&pd->tsFirst);
+  return ms>0 ? ms : 0;
+}
+
+/* **********************************************************************
+
+DedupOldest(pd)
+
+Return code: The file position of the first unreported repeat, or -1.
+
+********************************************************************** */
+
+long DedupOldest(const TDedup *pd)
+{
+  return pd->cRepeats ? pd->lPosition : -1;
+}
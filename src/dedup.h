@@ -0,0 +1,56 @@
+/* ======================================================================
+
+dedup.h
+
+Collapsing of repeated lines for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A line equal to the line before is suppressed and counted, like
+syslogd does. The repeats are reported by one summary line, when
+another line comes, or when the window since the first line of the
+run is over. Lines are compared by a 64 bit hash, either exactly or
+with every run of digits masked, so that lines differing only in
+timestamps, counters or ids count as equal. A new line costs a hash
+and a compare, nothing is copied.
+
+   ====================================================================== */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <time.h>
+
+typedef enum { DEDUP_NONE, DEDUP_EXACT, DEDUP_DIGITS } TDedupMode;
+
+typedef struct {
+  TDedupMode      idMode;
+  long            msWindow;         /* length of a run */
+  uint64_t        ullLast;          /* hash of the last line passed */
+  int             bLast;            /* ullLast is valid */
+  struct timespec tsFirst;          /* when the last line passed */
+  unsigned long   cRepeats;         /* suppressed since */
+  long            lPosition;        /* file position of the first repeat */
+  unsigned long   ulSuppressed;     /* statistics */
+} TDedup;
+
+#define DEDUP_DEFAULT_WINDOW     30000      /* ms */
+/* takes the count, and "s" unless it is 1 */
+#define DEDUP_FORMAT             "last message repeated %lu time%s\n"
+
+void          DedupInit(TDedup *pd);
+int           DedupParse(TDedup *pd, const char *szMode);
+int           DedupEnabled(const TDedup *pd);
+int           DedupCheck(TDedup *pd, const char *pchLine, int cch,
+			 long lPosition, unsigned long *pcRepeats);
+unsigned long DedupFlush(TDedup *pd, long *plPosition);
+long          DedupMsLeft(const TDedup *pd);
+long          DedupOldest(const TDedup *pd);
+
+#endif
@@ -0,0 +1,123 @@
+/* ======================================================================
+
+follow.c
+
+Following a growing file for tailfd and tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Without inotify (old kernels, exotic file systems) FollowWatch()
+fails, and FollowWait() simply sleeps. The callers still check the
+file by stat() after every wait, so events are an accelerator, not a
+requirement.
+
+   ====================================================================== */
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#include "follow.h"
+
+#define WATCH_EVENTS (IN_MODIFY|IN_ATTRIB|IN_MOVE_SELF|IN_DELETE_SELF)
+
+/* **********************************************************************
+
+hWatch=FollowWatch(szPath)
+
+Start watching a file for changes.
+
+Return code: The watch descriptor (close-on-exec, non blocking) or -1,
+if the file cannot be watched.
+
+********************************************************************** */
+
+int FollowWatch(const char *szPath)
+{
+  int hWatch=inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  if (hWatch<0) return -1;
+  if (inotify_add_watch(hWatch,szPath,WATCH_EVENTS)<0)
+    {
+      close(hWatch);
+      return -1;
+    }
+  return hWatch;
+}
+
+/* **********************************************************************
+
+FollowUnwatch(hWatch)
+
+Stop watching.
+
+********************************************************************** */
+
+void FollowUnwatch(int hWatch)
+{
+  if (hWatch>=0) close(hWatch);
+}
+
+/* **********************************************************************
+
+FollowWait(hWatch, ms)
+
+Wait up to ms milliseconds for a change of the watched file. Signals
+end the wait early, too.
+
+Return code: 1, if the file has changed, 0 otherwise.
+
+********************************************************************** */
+
+int FollowWait(int hWatch, long ms)
+{
+  struct pollfd pfd;
+  char          achEvents[4096];
+  int           rc;
+  if (hWatch<0)
+    {
+      poll(NULL,0,(int)ms);
+      return 0;
+    }
+  pfd.fd=hWatch;
+  pfd.events=POLLIN;
+  rc=poll(&pfd,1,(int)ms);
+  if (rc<=0) return 0;
+  while (read(hWatch,achEvents,sizeof(achEvents))>0); /* drain */
+  return 1;
+}
+
+/* **********************************************************************
+
+idMode=FollowMode(idMode, lGap)
+
+Choose the reading mode from the number of bytes, that are still to
+be read.
+
+********************************************************************** */
+
+TFollowMode FollowMode(TFollowMode idMode, long long lGap)
+{
+  if (idMode==FOLLOW_LIVE && lGap>=FOLLOW_CATCHUP_ENTER)
+    return FOLLOW_CATCHUP;
+  if (idMode==FOLLOW_CATCHUP && lGap<=FOLLOW_CATCHUP_LEAVE)
+    return FOLLOW_LIVE;
+  return idMode;
+}
+
+/* **********************************************************************
+
+FollowModeName(idMode)
+
+Return code: A printable name of the mode.
+
+********************************************************************** */
+
+const char *FollowModeName(TFollowMode idMode)
+{
+  return idMode==FOLLOW_CATCHUP ? "catch-up" : "live";
+}
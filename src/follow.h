@@ -0,0 +1,44 @@
+/* ======================================================================
+
+follow.h
+
+Following a growing file for tailfd and tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Two things are shared here: The wait for new data, which is driven by
+inotify events where available, and the choice between "live" and
+"catch-up" mode.
+
+Far behind the end of the file, the daemons read big blocks, write big
+batches and checkpoint rarely. Near the end of the file, they read
+small blocks and deliver every line at once. The gap between the
+file size and the reading position decides, with some hysteresis.
+
+   ====================================================================== */
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+typedef enum { FOLLOW_LIVE, FOLLOW_CATCHUP } TFollowMode;
+
+#define FOLLOW_LIVE_READ         8192       /* read size near EOF */
+#define FOLLOW_CATCHUP_READ      262144     /* read size far behind */
+#define FOLLOW_CATCHUP_ENTER     (4L<<20)   /* gap to enter catch-up */
+#define FOLLOW_CATCHUP_LEAVE     65536      /* gap to go live again */
+#define FOLLOW_CATCHUP_BATCH     65536      /* batch bytes in catch-up */
+#define FOLLOW_CATCHUP_DELAY     1000       /* batch delay in catch-up */
+#define FOLLOW_CATCHUP_STATUS    15         /* seconds between checkpoints */
+
+int         FollowWatch(const char *szPath);
+void        FollowUnwatch(int hWatch);
+int         FollowWait(int hWatch, long ms);
+TFollowMode FollowMode(TFollowMode idMode, long long lGap);
+const char *FollowModeName(TFollowMode idMode);
+
+#endif
@@ -0,0 +1,61 @@
+/* ======================================================================
+
+hash.c
+
+The hash of lines and keys for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+   ====================================================================== */
+
+#include "hash.h"
+
+/* **********************************************************************
+
+ullHash=HashAdd(ullHash, pch, cch)
+
+Return code: The FNV-1a hash continued over the bytes.
+
+********************************************************************** */
+
+uint64_t HashAdd(uint64_t ullHash, const char *pch, int cch)
+{
+  while (cch-->0)
+    {
+      ullHash^=(unsigned char)*pch++;
+      ullHash*=1099511628211ULL;
+    }
+  return ullHash;
+}
+
+/* **********************************************************************
+
+ullHash=HashMix(ullHash)
+
+Return code: The hash after the final mix of murmur3.
+
+********************************************************************** */
+
+uint64_t HashMix(uint64_t ullHash)
+{
+  ullHash^=ullHash>>33;
+  ullHash*=0xff51afd7ed558ccdULL;
+  ullHash^=ullHash>>33;
+  return ullHash;
+}
+
+/* **********************************************************************
+
+ullHash=HashBytes(pch, cch)
+
+Return code: The mixed hash of the bytes.
+
+********************************************************************** */
+
+uint64_t HashBytes(const char *pch, int cch)
+{
+  return HashMix(HashAdd(HASH_START,pch,cch));
+}
@@ -0,0 +1,36 @@
+/* ======================================================================
+
+hash.h
+
+The hash of lines and keys for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+One 64 bit hash serves sampling, dedup, correlation and sketches:
+FNV-1a over the bytes, with the final mix of murmur3 for the users,
+which take bits from both ends (sketch.h needs two independent 32 bit
+halves). It has no seed, so a line hashes the same in every run and
+on every host.
+
+HashAdd() continues the plain FNV-1a for pieces of a key, starting at
+HASH_START. HashMix() finishes it, HashBytes() does both at once.
+
+   ====================================================================== */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+#define HASH_START 14695981039346656037ULL  /* FNV offset basis */
+
+uint64_t HashAdd(uint64_t ullHash, const char *pch, int cch);
+uint64_t HashMix(uint64_t ullHash);
+uint64_t HashBytes(const char *pch, int cch);
+
+#endif
@@ -0,0 +1,236 @@
+/* ======================================================================
+
+linearena.c
+
+Growable line storage for tailfd, tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Most lines never touch the arena: LineArenaFeed() passes runs of
+complete lines straight from the read buffer. Only a line, that spans
+two reads or has to be cut, is collected here. tailfdx, which strips
+CR characters, builds every line here with LineArenaAppend() and
+LineArenaClose() and resets the arena after each read block.
+
+   ====================================================================== */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "linearena.h"
+
+#define LINEARENA_MARKER_SIZE  (sizeof(LINEARENA_MARKER)-1)
+
+/* **********************************************************************
+
+LineArenaInit(pa, cchMaxLine)
+
+Set up an empty arena. Memory is allocated on the first line.
+cchMaxLine<=0 chooses LINEARENA_DEFAULT_MAX.
+
+Return code: Always 0
+
+********************************************************************** */
+
+int LineArenaInit(TLineArena *pa, int cchMaxLine)
+{
+  memset(pa,0,sizeof(*pa));
+  pa->cchMaxLine=(cchMaxLine>0) ? cchMaxLine : LINEARENA_DEFAULT_MAX;
+  return 0;
+}
+
+/* **********************************************************************
+
+LineArenaFree(pa)
+
+Release the memory. The settings and counters are kept.
+
+********************************************************************** */
+
+void LineArenaFree(TLineArena *pa)
+{
+  free(pa->pchBuffer);
+  pa->pchBuffer=NULL;
+  pa->cchAlloc=pa->cchUsed=pa->iLine=0;
+  pa->cchRawLine=0;
+}
+
+/* **********************************************************************
+
+Reserve(pa, cch)
+
+Make room for cch more bytes, doubling the arena.
+
+Return code: 0 on success, -1 if there is no memory.
+
+********************************************************************** */
+
+static int Reserve(TLineArena *pa, int cch)
+{
+  int   cchAlloc;
+  char *pch;
+  if (pa->cchUsed+cch<=pa->cchAlloc) return 0;
+  cchAlloc=pa->cchAlloc ? pa->cchAlloc : 4096;
+  while (pa->cchUsed+cch>cchAlloc) cchAlloc*=2;
+  pch=realloc(pa->pchBuffer,cchAlloc);
+  if (!pch) return -1;
+  pa->pchBuffer=pch;
+  pa->cchAlloc=cchAlloc;
+  return 0;
+}
+
+/* **********************************************************************
+
+LineArenaAppend(pa, pch, cch)
+
+Add bytes (without the newline) to the open line. Bytes beyond
+cchMaxLine are counted, but dropped.
+
+Return code: 0 on success, -1 if there is no memory.
+
+********************************************************************** */
+
+int LineArenaAppend(TLineArena *pa, const char *pch, int cch)
+{
+  int cchKeep=pa->cchMaxLine-(pa->cchUsed-pa->iLine);
+  pa->cchRawLine+=cch;
+  if (cch<cchKeep) cchKeep=cch;
+  if (cchKeep<=0) return 0;
+  /* keep room for the marker and the newline */
+  if (Reserve(pa,cchKeep+LINEARENA_MARKER_SIZE+2)<0) return -1;
+  memcpy(pa->pchBuffer+pa->cchUsed,pch,cchKeep);
+  pa->cchUsed+=cchKeep;
+  return 0;
+}
+
+/* **********************************************************************
+
+pchLine=LineArenaClose(pa, &cch, &cchRaw)
+
+Terminate the open line with a newline (and the marker, if it has
+been cut). The line stays valid until the next reset. cchRaw gets the
+number of input bytes, including the newline, if not NULL.
+
+Return code: The NUL terminated line, NULL if there is no memory.
+
+********************************************************************** */
+
+const char *LineArenaClose(TLineArena *pa, int *pcch, long *pcchRaw)
+{
+  const char *pchLine;
+  if (Reserve(pa,LINEARENA_MARKER_SIZE+2)<0) return NULL;
+  if (pa->cchRawLine>pa->cchUsed-pa->iLine)
+    {
+      memcpy(pa->pchBuffer+pa->cchUsed,LINEARENA_MARKER,
+	     LINEARENA_MARKER_SIZE);
+      pa->cchUsed+=LINEARENA_MARKER_SIZE;
+      pa->ulTruncated++;
+    }
+  pa->pchBuffer[pa->cchUsed++]='\n';
+  pa->pchBuffer[pa->cchUsed]='\0';
+  pchLine=pa->pchBuffer+pa->iLine;
+  *pcch=pa->cchUsed-pa->iLine;
+  if (pcchRaw) *pcchRaw=pa->cchRawLine+1;
+  pa->iLine=pa->cchUsed;
+  pa->cchRawLine=0;
+  return pchLine;
+}
+
+/* **********************************************************************
+
+LineArenaOpen(pa)
+
+Return code: The number of input bytes in the open line.
+
+********************************************************************** */
+
+int LineArenaOpen(const TLineArena *pa)
+{
+  return (int)pa->cchRawLine;
+}
+
+/* **********************************************************************
+
+LineArenaReset(pa)
+
+Drop all closed lines. The open line moves to the start of the arena.
+
+********************************************************************** */
+
+void LineArenaReset(TLineArena *pa)
+{
+  if (!pa->iLine) return;
+  memmove(pa->pchBuffer,pa->pchBuffer+pa->iLine,pa->cchUsed-pa->iLine);
+  pa->cchUsed-=pa->iLine;
+  pa->iLine=0;
+}
+
+/* **********************************************************************
+
+LineArenaClear(pa)
+
+Drop everything, including the open line. The memory is kept.
+
+********************************************************************** */
+
+void LineArenaClear(TLineArena *pa)
+{
+  pa->cchUsed=pa->iLine=0;
+  pa->cchRawLine=0;
+}
+
+/* **********************************************************************
+
+LineArenaFeed(pa, pch, cch, pfnSink)
+
+Split a read buffer into lines and hand them to pfnSink(). Runs of
+complete lines go out unchanged in one call. Lines, which continue
+the open line or have to be cut, go out on their own through the
+arena. A trailing partial line stays in the arena for the next read.
+
+Return code: 0 on success, -1 if there is no memory.
+
+********************************************************************** */
+
+int LineArenaFeed(TLineArena *pa, const char *pch, int cch,
+		  TLineArenaSink pfnSink)
+{
+  const char *pchRun=pch; /* complete lines to pass unchanged */
+  while (cch>0)
+    {
+      const char *pchNL=memchr(pch,'\n',cch);
+      int cchLine=pchNL ? pchNL-pch : cch;
+      if (pchNL && !pa->cchRawLine && cchLine<=pa->cchMaxLine)
+	{
+	  pch+=cchLine+1;
+	  cch-=cchLine+1;
+	  continue;
+	}
+      if (pch>pchRun)
+	pfnSink(pchRun,pch-pchRun,pch-pchRun);
+      if (LineArenaAppend(pa,pch,cchLine)<0) return -1;
+      pch+=cchLine;
+      cch-=cchLine;
+      if (pchNL)
+	{
+	  const char *pchLine;
+	  int         cchOut;
+	  long        cchRaw;
+	  pchLine=LineArenaClose(pa,&cchOut,&cchRaw);
+	  if (!pchLine) return -1;
+	  pfnSink(pchLine,cchOut,cchRaw);
+	  LineArenaReset(pa);
+	  pch++;
+	  cch--;
+	}
+      pchRun=pch;
+    }
+  if (pch>pchRun)
+    pfnSink(pchRun,pch-pchRun,pch-pchRun);
+  return 0;
+}
@@ -0,0 +1,53 @@
+/* ======================================================================
+
+linearena.h
+
+Growable line storage for tailfd, tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The arena is a single buffer, which grows geometrically up to the
+longest line allowed and is kept for the whole run. Lines are added
+at the end (bump allocation) and stay valid until the arena is reset,
+which drops all closed lines at once. So there is no allocation per
+line. A line longer than cchMaxLine is cut there; the rest up to the
+newline is dropped, and the line gets LINEARENA_MARKER before its
+newline.
+
+   ====================================================================== */
+
+#ifndef LINEARENA_H
+#define LINEARENA_H
+
+typedef struct {
+  char           *pchBuffer;        /* the arena */
+  int             cchAlloc;         /* size of the arena, kept */
+  int             cchUsed;          /* end of the data (bump pointer) */
+  int             iLine;            /* start of the open line */
+  int             cchMaxLine;       /* longest line kept, without NL */
+  long            cchRawLine;       /* input bytes of the open line */
+  unsigned long   ulTruncated;      /* statistics: lines cut */
+} TLineArena;
+
+#define LINEARENA_DEFAULT_MAX    (1L<<20)
+#define LINEARENA_MARKER         " [truncated]"
+
+/* receives lines as they go out, and the input bytes they stand for */
+typedef void (*TLineArenaSink)(const char *pchLines, int cch, long cchRaw);
+
+int         LineArenaInit(TLineArena *pa, int cchMaxLine);
+void        LineArenaFree(TLineArena *pa);
+int         LineArenaAppend(TLineArena *pa, const char *pch, int cch);
+const char *LineArenaClose(TLineArena *pa, int *pcch, long *pcchRaw);
+int         LineArenaOpen(const TLineArena *pa);
+void        LineArenaReset(TLineArena *pa);
+void        LineArenaClear(TLineArena *pa);
+int         LineArenaFeed(TLineArena *pa, const char *pch, int cch,
+			  TLineArenaSink pfnSink);
+
+#endif
@@ -0,0 +1,169 @@
+/* ======================================================================
+
+linebatch.c
+
+Latency bounded line batches for tailfd, tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Bulk consumers want big writes, alert consumers want every line at
+once. A batch lets every destination choose. The owner appends
+complete lines and flushes the batch, when LineBatchAppend() says so,
+when the next line does not fit, or when LineBatchMsLeft() drops to 0.
+The latter is the job of the main loop, even if the input is quiet.
+
+   ====================================================================== */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "linebatch.h"
+
+/* **********************************************************************
+
+ms=ElapsedMs(pts)
+
+Milliseconds since the (monotonic) time stamp.
+
+********************************************************************** */
+
+static long ElapsedMs(const struct timespec *pts)
+{
+  struct timespec tsNow;
+  clock_gettime(CLOCK_MONOTONIC,&tsNow);
+  return (tsNow.tv_sec-pts->tv_sec)*1000L
+    + (tsNow.tv_nsec-pts->tv_nsec)/1000000L;
+}
+
+/* **********************************************************************
+
+LineBatchInit(pb, cchMaxBytes, cMaxLines, msMaxDelay)
+
+Set up the batch. Without any bound the batch stays disabled and
+allocates nothing.
+
+Return code: 0 on success, -1 if there is no memory.
+
+********************************************************************** */
+
+int LineBatchInit(TLineBatch *pb, int cchMaxBytes, int cMaxLines,
+		  long msMaxDelay)
+{
+  int cchAlloc;
+  memset(pb,0,sizeof(*pb));
+  if (cchMaxBytes<0) cchMaxBytes=0;
+  if (cMaxLines<0)   cMaxLines=0;
+  if (msMaxDelay<0)  msMaxDelay=0;
+  pb->cMaxLines=cMaxLines;
+  pb->msMaxDelay=msMaxDelay;
+  if (!cchMaxBytes && !cMaxLines && !msMaxDelay)
+    return 0; /* disabled */
+  cchAlloc=cchMaxBytes ? cchMaxBytes : LINEBATCH_DEFAULT_BYTES;
+  pb->cchMaxBytes=cchAlloc;
+  pb->pchBuffer=malloc(cchAlloc+1);
+  if (!pb->pchBuffer) return -1;
+  pb->pchBuffer[0]='\0';
+  return 0;
+}
+
+/* **********************************************************************
+
+LineBatchFree(pb)
+
+Release the buffer. The batch is disabled afterwards.
+
+********************************************************************** */
+
+void LineBatchFree(TLineBatch *pb)
+{
+  if (pb->pchBuffer) free(pb->pchBuffer);
+  memset(pb,0,sizeof(*pb));
+}
+
+/* **********************************************************************
+
+LineBatchEnabled(pb)
+
+Return code: true, if the batch has any bound.
+
+********************************************************************** */
+
+int LineBatchEnabled(const TLineBatch *pb)
+{
+  return pb->pchBuffer!=NULL;
+}
+
+/* **********************************************************************
+
+LineBatchFits(pb, cch)
+
+Return code: true, if cch more bytes fit into the buffer.
+
+********************************************************************** */
+
+int LineBatchFits(const TLineBatch *pb, int cch)
+{
+  return pb->cchBuffer+cch <= pb->cchMaxBytes;
+}
+
+/* **********************************************************************
+
+LineBatchAppend(pb, pchLine, cch)
+
+Append a line, which must fit (see LineBatchFits()).
+
+Return code: true, if the byte or line bound is hit and the batch has
+to be flushed now.
+
+********************************************************************** */
+
+int LineBatchAppend(TLineBatch *pb, const char *pchLine, int cch)
+{
+  if (!pb->cchBuffer)
+    clock_gettime(CLOCK_MONOTONIC,&pb->tsFirst);
+  memcpy(pb->pchBuffer+pb->cchBuffer,pchLine,cch);
+  pb->cchBuffer+=cch;
+  pb->pchBuffer[pb->cchBuffer]='\0';
+  pb->cLines++;
+  return pb->cchBuffer>=pb->cchMaxBytes
+    || (pb->cMaxLines && pb->cLines>=pb->cMaxLines)
+    || (pb->msMaxDelay && !LineBatchMsLeft(pb));
+}
+
+/* **********************************************************************
+
+LineBatchClear(pb)
+
+Forget the content, after it has been written.
+
+********************************************************************** */
+
+void LineBatchClear(TLineBatch *pb)
+{
+  pb->cchBuffer=0;
+  pb->cLines=0;
+  if (pb->pchBuffer) pb->pchBuffer[0]='\0';
+}
+
+/* **********************************************************************
+
+ms=LineBatchMsLeft(pb)
+
+Return code: The milliseconds until the oldest line is due, 0 if it
+is due now, or -1 if the batch is empty or has no time bound.
+
+********************************************************************** */
+
+long LineBatchMsLeft(const TLineBatch *pb)
+{
+  long ms;
+  if (!pb->cchBuffer || !pb->msMaxDelay) return -1;
+  ms=pb->msMaxDelay-ElapsedMs(&pb->tsFirst);
+  return ms>0 ? ms : 0;
+}
@@ -0,0 +1,48 @@
+/* ======================================================================
+
+linebatch.h
+
+Latency bounded line batches for tailfd, tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A batch collects complete lines for one destination. It must be
+flushed, as soon as any of its bounds is hit: the number of bytes,
+the number of lines, or the age of the oldest line. A bound of 0 is
+not used. A batch without any bound is disabled, and every line is
+written on its own.
+
+   ====================================================================== */
+
+#ifndef LINEBATCH_H
+#define LINEBATCH_H
+
+#include <time.h>
+
+typedef struct {
+  char           *pchBuffer;        /* collected lines, NUL terminated */
+  int             cchBuffer;        /* bytes in buffer */
+  int             cLines;           /* lines in buffer */
+  int             cchMaxBytes;      /* bound: bytes (and buffer size) */
+  int             cMaxLines;        /* bound: lines */
+  long            msMaxDelay;       /* bound: age of the oldest line */
+  struct timespec tsFirst;          /* arrival of the oldest line */
+} TLineBatch;
+
+#define LINEBATCH_DEFAULT_BYTES  65536 /* if only lines or delay are set */
+
+int   LineBatchInit(TLineBatch *pb, int cchMaxBytes, int cMaxLines,
+		    long msMaxDelay);
+void  LineBatchFree(TLineBatch *pb);
+int   LineBatchEnabled(const TLineBatch *pb);
+int   LineBatchFits(const TLineBatch *pb, int cch);
+int   LineBatchAppend(TLineBatch *pb, const char *pchLine, int cch);
+void  LineBatchClear(TLineBatch *pb);
+long  LineBatchMsLeft(const TLineBatch *pb);
+
+#endif
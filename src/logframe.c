@@ -0,0 +1,141 @@
+/* ======================================================================
+
+logframe.c
+
+Binary framing of lines, as written by tailfdx with framing="binary",
+and a small reader for the consumers (liblogframe).
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The reader uses plain read() calls on a file descriptor, so it can
+be used on the stdin of a destination command without stdio. See
+logframe.h for the format.
+
+   ====================================================================== */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logframe.h"
+
+/* **********************************************************************
+
+LogFrameEncode(phdr, cchPayload, ullOffset, ullInode, ullTime)
+
+Fill in a header for a payload of cchPayload bytes.
+
+********************************************************************** */
+
+void LogFrameEncode(TLogFrameHeader *phdr, int cchPayload,
+		    uint64_t ullOffset, uint64_t ullInode, uint64_t ullTime)
+{
+  memset(phdr,0,sizeof(*phdr));
+  phdr->usMagic=LOGFRAME_MAGIC;
+  phdr->usVersion=LOGFRAME_VERSION;
+  phdr->ulLength=(uint32_t)cchPayload;
+  phdr->ullOffset=ullOffset;
+  phdr->ullInode=ullInode;
+  phdr->ullTime=ullTime;
+}
+
+/* **********************************************************************
+
+ReadFully(h, pch, cch)
+
+read() exactly cch bytes, unless the stream ends.
+
+Return code: The number of bytes read, -1 on error.
+
+********************************************************************** */
+
+static int ReadFully(int h, char *pch, int cch)
+{
+  int cchDone=0;
+  while (cchDone<cch)
+    {
+      int cchRead=read(h,pch+cchDone,cch-cchDone);
+      if (cchRead<0 && errno==EINTR) continue;
+      if (cchRead<0) return -1;
+      if (!cchRead) break;
+      cchDone+=cchRead;
+    }
+  return cchDone;
+}
+
+/* **********************************************************************
+
+cch=LogFrameRead(h, phdr, pchPayload, cchMax)
+
+Read the next frame. At most cchMax bytes of the payload are stored,
+the rest of it is skipped. The payload is not NUL terminated.
+
+Return code: The number of payload bytes stored (>0, or 0 for an
+empty line), -1 at the end of the stream, and -2 on read errors or
+on a broken stream (errno is EPROTO then).
+
+********************************************************************** */
+
+int LogFrameRead(int h, TLogFrameHeader *phdr, char *pchPayload,
+		 int cchMax)
+{
+  long cchRest;
+  int  cch;
+  cch=ReadFully(h,(char*)phdr,LOGFRAME_HEADER_SIZE);
+  if (cch==0) return -1;
+  if (cch<0) return -2;
+  if (cch<LOGFRAME_HEADER_SIZE || phdr->usMagic!=LOGFRAME_MAGIC)
+    {
+      errno=EPROTO;
+      return -2;
+    }
+  cch=(phdr->ulLength<(uint32_t)cchMax) ? (int)phdr->ulLength : cchMax;
+  if (ReadFully(h,pchPayload,cch)!=cch)
+    {
+      errno=EPROTO;
+      return -2;
+    }
+  for (cchRest=(long)phdr->ulLength-cch; cchRest>0; )
+    {
+      char ach[4096];
+      int  cchSkip=(cchRest<(long)sizeof(ach))
+	? (int)cchRest : (int)sizeof(ach);
+      if (ReadFully(h,ach,cchSkip)!=cchSkip)
+	{
+	  errno=EPROTO;
+	  return -2;
+	}
+      cchRest-=cchSkip;
+    }
+  return cch;
+}
+
+/* **********************************************************************
+
+pch=LogFrameField(pchPayload, cchPayload, &i, pfld)
+
+Take the next field of a payload of version LOGFRAME_VERSION_FIELDS,
+starting at byte i (0 for the first one), and advance i behind it.
+
+Return code: The text of the field (pfld->ulLength bytes, not NUL
+terminated), or NULL at the end of the payload. i is short of
+cchPayload then, if the payload is broken (e.g. cut by LogFrameRead).
+
+********************************************************************** */
+
+const char *LogFrameField(const char *pchPayload, int cchPayload, int *pi,
+			  TLogFrameField *pfld)
+{
+  if (*pi<0 || cchPayload-*pi<LOGFRAME_FIELD_SIZE)
+    return NULL;
+  memcpy(pfld,pchPayload+*pi,LOGFRAME_FIELD_SIZE); /* unaligned */
+  if (pfld->ulLength>(uint32_t)(cchPayload-*pi-LOGFRAME_FIELD_SIZE))
+    return NULL;
+  *pi+=LOGFRAME_FIELD_SIZE+pfld->ulLength;
+  return pchPayload+*pi-pfld->ulLength;
+}
@@ -0,0 +1,94 @@
+/* ======================================================================
+
+logframe.h
+
+Binary framing of lines, as written by tailfdx with framing="binary",
+and a small reader for the consumers (liblogframe).
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Every line (or multiline record) is written as a fixed header,
+followed by ulLength bytes of payload. The payload is the line without
+its final newline and without any terminating NUL. All header fields
+are in host byte order, since producer and consumer share the host.
+
+A consumer reads frames like this:
+
+  TLogFrameHeader hdr;
+  char            ach[65536];
+  int             cch;
+  while ((cch=LogFrameRead(0,&hdr,ach,sizeof(ach)))>=0)
+    ... process cch bytes in ach, found at hdr.ullOffset ...
+
+Payloads longer than the buffer are cut to the buffer size, the rest
+is skipped. hdr.ulLength always tells the full length.
+
+With format="binary" (see logparse.h), tailfdx writes frames of
+version LOGFRAME_VERSION_FIELDS: the payload is not the line, but the
+chosen fields of its syslog header, each as a TLogFrameField followed
+by ulLength bytes of text. Missing fields are left out, so a consumer
+loops over what is there:
+
+  TLogFrameField fld;
+  const char    *pch;
+  int            i=0;
+  while ((pch=LogFrameField(ach,cch,&i,&fld))!=NULL)
+    ... fld.ulLength bytes at pch are field fld.usField ...
+
+   ====================================================================== */
+
+#ifndef LOGFRAME_H
+#define LOGFRAME_H
+
+#include <stdint.h>
+
+#define LOGFRAME_MAGIC      0x464c     /* "LF" */
+#define LOGFRAME_VERSION    1
+
+typedef struct {
+  uint16_t        usMagic;          /* LOGFRAME_MAGIC */
+  uint16_t        usVersion;        /* LOGFRAME_VERSION */
+  uint32_t        ulLength;         /* bytes of payload after the header */
+  uint64_t        ullOffset;        /* file position of the line */
+  uint64_t        ullInode;         /* inode of the monitored file */
+  uint64_t        ullTime;          /* receive time, us since the epoch */
+} TLogFrameHeader;
+
+#define LOGFRAME_HEADER_SIZE  ((int)sizeof(TLogFrameHeader)) /* 32 */
+
+#define LOGFRAME_VERSION_FIELDS 2      /* payload of TLogFrameField */
+
+#define LOGFRAME_FIELD_TIME       1    /* the timestamp, as in the line */
+#define LOGFRAME_FIELD_EPOCH      2    /* of the timestamp, in seconds */
+#define LOGFRAME_FIELD_HOST       3
+#define LOGFRAME_FIELD_PROGRAM    4    /* the tag, or APP-NAME */
+#define LOGFRAME_FIELD_PID        5    /* or PROCID */
+#define LOGFRAME_FIELD_MSGID      6    /* RFC 5424 only */
+#define LOGFRAME_FIELD_SD         7    /* structured data, RFC 5424 only */
+#define LOGFRAME_FIELD_FACILITY   8    /* from <PRI> */
+#define LOGFRAME_FIELD_SEVERITY   9
+#define LOGFRAME_FIELD_MESSAGE   10
+#define LOGFRAME_FIELD_LINE      11    /* the whole line */
+#define LOGFRAME_FIELDS          11
+
+typedef struct {
+  uint16_t        usField;          /* LOGFRAME_FIELD_* */
+  uint16_t        usReserved;       /* 0 */
+  uint32_t        ulLength;         /* bytes of text after the header */
+} TLogFrameField;
+
+#define LOGFRAME_FIELD_SIZE   ((int)sizeof(TLogFrameField)) /* 8 */
+
+void  LogFrameEncode(TLogFrameHeader *phdr, int cchPayload,
+		     uint64_t ullOffset, uint64_t ullInode, uint64_t ullTime);
+int   LogFrameRead(int h, TLogFrameHeader *phdr, char *pchPayload,
+		   int cchMax);
+const char *LogFrameField(const char *pchPayload, int cchPayload, int *pi,
+			  TLogFrameField *pfld);
+
+#endif
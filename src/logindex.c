@@ -0,0 +1,292 @@
+/* ======================================================================
+
+logindex.c
+
+A sparse index of a log file, kept by tailfd and tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Only the lines due for a record are parsed, and a record is a single
+append, so the index costs the follower next to nothing. The line
+numbers are counted by the owner's calls of LogIndexLine(), only when
+an index is reopened at some position, the lines since the last record
+(at most LOGINDEX_MAX_GAP bytes) are counted in the file itself.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "logindex.h"
+#include "replay.h"
+
+typedef struct {
+  char            achMagic[8];
+  uint64_t        ullInode;
+  int64_t         llBase;           /* offset of line 0 */
+} THeader;
+
+/* **********************************************************************
+
+szName=LogIndexName(szFile, iNode)
+
+Return code: The name of the sidecar (malloc()ed), or NULL.
+
+********************************************************************** */
+
+char *LogIndexName(const char *szFile, ino_t iNode)
+{
+  char *szName=malloc(strlen(szFile)+32);
+  if (szName)
+    sprintf(szName,"%s.%lu.idx",szFile,(unsigned long)iNode);
+  return szName;
+}
+
+/* **********************************************************************
+
+CountLines(h, llFrom, llTo)
+
+Return code: The number of newlines between both offsets, negative if
+llTo is before llFrom, or 0 on a read error.
+
+********************************************************************** */
+
+static long long CountLines(int h, long long llFrom, long long llTo)
+{
+  char      ach[65536];
+  long long llLines=0;
+  int       iSign=1;
+  if (llTo<llFrom)
+    {
+      long long ll=llFrom;
+      llFrom=llTo;
+      llTo=ll;
+      iSign=-1;
+    }
+  while (llFrom<llTo)
+    {
+      size_t  cchWanted=llTo-llFrom<(long long)sizeof(ach)
+	? (size_t)(llTo-llFrom) : sizeof(ach);
+      ssize_t cch=pread(h,ach,cchWanted,llFrom);
+      char   *pch=ach;
+      if (cch<=0) return 0;
+      llFrom+=cch;
+      while ((pch=memchr(pch,'\n',ach+cch-pch))!=NULL)
+	{
+	  llLines++;
+	  pch++;
+	}
+    }
+  return iSign*llLines;
+}
+
+/* **********************************************************************
+
+LogIndexOpen(pi, szFile, hFile, cchInterval, llPosition)
+
+Open (or create) the sidecar of the file open as hFile, which is read
+from llPosition on. Records at or after it are not written again. The
+records of a truncated file are dropped, so are those too far behind
+llPosition (see LOGINDEX_MAX_GAP). A new index starts at llPosition.
+
+Return code: 0 on success, -1 on failure (errno), the index is not
+used then.
+
+********************************************************************** */
+
+int LogIndexOpen(TLogIndex *pi, const char *szFile, int hFile,
+		 long cchInterval, long long llPosition)
+{
+  struct stat     st,stIndex;
+  THeader         hdr;
+  TLogIndexRecord rec;
+  off_t           lSize;
+  char           *szName;
+  memset(pi,0,sizeof(*pi));
+  pi->hIndex=-1;
+  pi->llLastOffset=-1;
+  if (fstat(hFile,&st)<0 || !(szName=LogIndexName(szFile,st.st_ino)))
+    return -1;
+  pi->hIndex=open(szName,O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC,0644);
+  free(szName);
+  if (pi->hIndex<0 || fstat(pi->hIndex,&stIndex)<0)
+    goto failed;
+  lSize=stIndex.st_size;
+  if (lSize>(off_t)sizeof(hdr))
+    lSize-=(lSize-sizeof(hdr))%sizeof(rec); /* torn by a crash */
+  if (lSize<(off_t)sizeof(hdr)
+      || pread(pi->hIndex,&hdr,sizeof(hdr),0)!=sizeof(hdr)
+      || memcmp(hdr.achMagic,LOGINDEX_MAGIC,sizeof(hdr.achMagic))
+      || hdr.ullInode!=(uint64_t)st.st_ino)
+    lSize=0;
+  else if (lSize==(off_t)sizeof(hdr))
+    lSize=0; /* no record yet, start at llPosition */
+  else if (pread(pi->hIndex,&rec,sizeof(rec),lSize-sizeof(rec))!=sizeof(rec)
+	   || rec.llOffset>=st.st_size)
+    lSize=0; /* the file has been truncated */
+  else if (llPosition-rec.llOffset>LOGINDEX_MAX_GAP)
+    lSize=0; /* not followed with an index for long */
+  if (!lSize)
+    {
+      memcpy(hdr.achMagic,LOGINDEX_MAGIC,sizeof(hdr.achMagic));
+      hdr.ullInode=st.st_ino;
+      hdr.llBase=llPosition;
+      if (ftruncate(pi->hIndex,0)<0
+	  || write(pi->hIndex,&hdr,sizeof(hdr))!=sizeof(hdr))
+	goto failed;
+      lSize=sizeof(hdr);
+    }
+  else if (ftruncate(pi->hIndex,lSize)<0)
+    goto failed;
+  if (lSize>(off_t)sizeof(hdr))
+    {
+      pi->llLastOffset=rec.llOffset;
+      pi->llLines=rec.llLine+CountLines(hFile,rec.llOffset,llPosition);
+    }
+  else
+    pi->llLines=0; /* llPosition is the base */
+  pi->cchInterval=cchInterval>0 ? cchInterval : 1;
+  pi->llNext=pi->llLastOffset>=0
+    ? pi->llLastOffset+pi->cchInterval : llPosition;
+  pi->tiNext=time(NULL)+LOGINDEX_PERIOD;
+  return 0;
+
+ failed:
+  {
+    int idError=errno;
+    LogIndexClose(pi);
+    errno=idError;
+  }
+  return -1;
+}
+
+/* **********************************************************************
+
+LogIndexClose(pi)
+
+Close the sidecar. Repeatable.
+
+********************************************************************** */
+
+void LogIndexClose(TLogIndex *pi)
+{
+  if (pi->hIndex>=0) close(pi->hIndex);
+  pi->hIndex=-1;
+}
+
+/* **********************************************************************
+
+LogIndexTick(pi)
+
+Check the clock, once per block read: the next stamped line gets a
+record, if LOGINDEX_PERIOD has passed.
+
+********************************************************************** */
+
+void LogIndexTick(TLogIndex *pi)
+{
+  if (pi->hIndex>=0 && time(NULL)>=pi->tiNext)
+    pi->bDue=1;
+}
+
+/* **********************************************************************
+
+LogIndexLine(pi, pch, cch, llOffset)
+
+Count a line starting at llOffset, and record it, if a record is due
+and it has a timestamp.
+
+Return code: 0 on success, -1 if the record cannot be written (errno),
+the index is closed then.
+
+********************************************************************** */
+
+int LogIndexLine(TLogIndex *pi, const char *pch, int cch, long long llOffset)
+{
+  if (pi->hIndex<0) return 0;
+  if ((llOffset>=pi->llNext || pi->bDue) && llOffset>pi->llLastOffset)
+    {
+      time_t ti=ReplayTimestamp(pch,cch);
+      if (ti)
+	{
+	  TLogIndexRecord rec;
+	  rec.llTime=ti;
+	  rec.llOffset=llOffset;
+	  rec.llLine=pi->llLines;
+	  if (write(pi->hIndex,&rec,sizeof(rec))!=sizeof(rec))
+	    {
+	      int idError=errno;
+	      LogIndexClose(pi);
+	      errno=idError;
+	      return -1;
+	    }
+	  pi->llLastOffset=llOffset;
+	  pi->llNext=llOffset+pi->cchInterval;
+	  pi->tiNext=time(NULL)+LOGINDEX_PERIOD;
+	  pi->bDue=0;
+	  pi->ulRecords++;
+	}
+    }
+  pi->llLines++;
+  return 0;
+}
+
+/* **********************************************************************
+
+LogIndexFind(szFile, iNode, ti, &llOffset)
+
+Binary search the sidecar of the file for the last record before ti.
+Its offset is a line start, before which there are older lines only
+(if the file is in order), or 0, if there is no such record.
+
+Return code: 0 on success, -1 if there is no usable index.
+
+********************************************************************** */
+
+int LogIndexFind(const char *szFile, ino_t iNode, time_t ti,
+		 long long *pllOffset)
+{
+  struct stat     st;
+  THeader         hdr;
+  TLogIndexRecord rec;
+  long            iLow=0,iHigh,c;
+  char           *szName=LogIndexName(szFile,iNode);
+  int             h=szName ? open(szName,O_RDONLY|O_CLOEXEC) : -1;
+  free(szName);
+  if (h<0) return -1;
+  if (fstat(h,&st)<0 || pread(h,&hdr,sizeof(hdr),0)!=sizeof(hdr)
+      || memcmp(hdr.achMagic,LOGINDEX_MAGIC,sizeof(hdr.achMagic))
+      || hdr.ullInode!=(uint64_t)iNode)
+    {
+      close(h);
+      return -1;
+    }
+  c=(st.st_size-sizeof(hdr))/sizeof(rec);
+  *pllOffset=0;
+  iHigh=c; /* the answer is in [iLow-1, iHigh) */
+  while (iLow<iHigh)
+    {
+      long i=iLow+(iHigh-iLow)/2;
+      if (pread(h,&rec,sizeof(rec),sizeof(hdr)+i*sizeof(rec))!=sizeof(rec))
+	break;
+      if (rec.llTime<ti)
+	{
+	  *pllOffset=rec.llOffset;
+	  iLow=i+1;
+	}
+      else
+	iHigh=i;
+    }
+  close(h);
+  return 0;
+}
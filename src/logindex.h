@@ -0,0 +1,69 @@
+/* ======================================================================
+
+logindex.h
+
+A sparse index of a log file, kept by tailfd and tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+While a file is followed, every cchInterval bytes and at least every
+LOGINDEX_PERIOD seconds a record (time, offset, number) of the next
+stamped line (see ReplayTimestamp() in replay.h) is appended to the
+sidecar "FILE.<inode>.idx". The inode ties the index to the file, so
+a rotated FILE.1 still finds its own one. A replay looks up the last
+record before a time and seeks there, instead of reading the file
+from its start.
+
+The sidecar is binary: a header with LOGINDEX_MAGIC, the inode and
+the base offset, then records of three 64 bit numbers in host byte
+order. Offsets grow from record to record. Line numbers count from
+the base, where the index was started, so the file before it is never
+read. An index, whose last record is more than LOGINDEX_MAX_GAP
+bytes behind the position it is opened at, is started anew there.
+
+   ====================================================================== */
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef struct {
+  int64_t         llTime;           /* of the line, in seconds */
+  int64_t         llOffset;         /* where the line starts */
+  int64_t         llLine;           /* its number, from the base */
+} TLogIndexRecord;
+
+typedef struct {
+  int             hIndex;           /* sidecar, -1 if none */
+  long            cchInterval;      /* bytes between records */
+  long long       llNext;           /* offset due for the next record */
+  time_t          tiNext;           /* time due for the next record */
+  int             bDue;             /* LogIndexTick() found the time due */
+  long long       llLines;          /* number of the next line */
+  long long       llLastOffset;     /* of the last record, or -1 */
+  unsigned long   ulRecords;        /* statistics: records written */
+} TLogIndex;
+
+#define LOGINDEX_MAGIC           "LOGIDX02"
+#define LOGINDEX_MAX_GAP         (64LL<<20) /* bytes counted at an open */
+#define LOGINDEX_PERIOD          60         /* seconds between records */
+
+char *LogIndexName(const char *szFile, ino_t iNode);
+int   LogIndexOpen(TLogIndex *pi, const char *szFile, int hFile,
+		   long cchInterval, long long llPosition);
+void  LogIndexClose(TLogIndex *pi);
+void  LogIndexTick(TLogIndex *pi);
+int   LogIndexLine(TLogIndex *pi, const char *pch, int cch,
+		   long long llOffset);
+int   LogIndexFind(const char *szFile, ino_t iNode, time_t ti,
+		   long long *pllOffset);
+
+#endif
@@ -0,0 +1,683 @@
+/* ======================================================================
+
+logparse.c
+
+Parsing the syslog header of a line once, and structured output of
+its fields for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The fields point into the line, which must stay as it is, until the
+output is written. Only the numbers are kept in the TLogParse, so it
+must not be copied between parsing and writing.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logparse.h"
+
+static const char *const aszField[LOGFRAME_FIELDS+1] = {
+  NULL, "time", "epoch", "host", "program", "pid", "msgid", "sd",
+  "facility", "severity", "message", "line"
+};
+
+static const char achMonths[]="JanFebMarAprMayJunJulAugSepOctNovDec";
+static const char achHex[]="0123456789abcdef";
+
+/* **********************************************************************
+
+LogParseInit(plp)
+
+Set up the parser with an empty cache.
+
+********************************************************************** */
+
+void LogParseInit(TLogParse *plp)
+{
+  memset(plp,0,sizeof(*plp));
+  plp->iHour=-1;
+}
+
+/* **********************************************************************
+
+Set(plp, idField, pch, cch)
+
+Take a field, a NULL pch makes it missing.
+
+********************************************************************** */
+
+static void Set(TLogParse *plp, int idField, const char *pch, int cch)
+{
+  plp->apch[idField]=pch;
+  plp->acch[idField]=pch ? cch : 0;
+}
+
+/* **********************************************************************
+
+SetNumber(plp, idField, ll)
+
+Take a field as the text of a number, appended to achNumbers.
+
+********************************************************************** */
+
+static void SetNumber(TLogParse *plp, int idField, long long ll)
+{
+  char *pch=plp->achNumbers+plp->cchNumbers;
+  int   cchRoom=sizeof(plp->achNumbers)-plp->cchNumbers;
+  int   cch=snprintf(pch,cchRoom,"%lld",ll);
+  if (cch<0 || cch>=cchRoom)
+    return;
+  Set(plp,idField,pch,cch);
+  plp->cchNumbers+=cch;
+}
+
+/* **********************************************************************
+
+n=Digits(pch, cch)
+
+Return code: The decimal number of exactly cch digits, -1 if there is
+anything else.
+
+********************************************************************** */
+
+static int Digits(const char *pch, int cch)
+{
+  int n=0;
+  while (cch-->0)
+    {
+      if (*pch<'0' || *pch>'9') return -1;
+      n=n*10+(*pch++-'0');
+    }
+  return n;
+}
+
+/* **********************************************************************
+
+pch=Token(pch, pchEnd, &cch)
+
+Return code: The end of the token at pch (the next blank, or pchEnd),
+cch is its length.
+
+********************************************************************** */
+
+static const char *Token(const char *pch, const char *pchEnd, int *pcch)
+{
+  const char *pchBlank=memchr(pch,' ',pchEnd-pch);
+  if (!pchBlank) pchBlank=pchEnd;
+  *pcch=pchBlank-pch;
+  return pchBlank;
+}
+
+/* **********************************************************************
+
+ti=LocalHour(plp, iYear, iMonth, iDay, iHour)
+
+Return code: The epoch of a local hour (month 1 to 12). Without a year
+(0), it is the latest one not more than a day ahead. The last hour is
+cached.
+
+********************************************************************** */
+
+static time_t LocalHour(TLogParse *plp, int iYear, int iMonth, int iDay,
+			int iHour)
+{
+  struct tm tm;
+  time_t    tiNow=0;
+  int       iYearNow=0;
+  if (iHour==plp->iHour && iDay==plp->iHourDay
+      && iMonth==plp->iHourMonth && iYear==plp->iHourYear)
+    return plp->tiHour;
+  memset(&tm,0,sizeof(tm));
+  if (iYear)
+    tm.tm_year=iYear-1900;
+  else
+    {
+      struct tm tmNow;
+      tiNow=time(NULL);
+      localtime_r(&tiNow,&tmNow);
+      tm.tm_year=iYearNow=tmNow.tm_year;
+    }
+  tm.tm_mon=iMonth-1;
+  tm.tm_mday=iDay;
+  tm.tm_hour=iHour;
+  tm.tm_isdst=-1;
+  plp->tiHour=mktime(&tm);
+  if (tiNow && plp->tiHour>tiNow+86400) /* syslog time of last year */
+    {
+      memset(&tm,0,sizeof(tm));
+      tm.tm_year=iYearNow-1;
+      tm.tm_mon=iMonth-1;
+      tm.tm_mday=iDay;
+      tm.tm_hour=iHour;
+      tm.tm_isdst=-1;
+      plp->tiHour=mktime(&tm);
+    }
+  plp->iHourYear=iYear;
+  plp->iHourMonth=iMonth;
+  plp->iHourDay=iDay;
+  plp->iHour=iHour;
+  return plp->tiHour;
+}
+
+/* **********************************************************************
+
+ti=UTCTime(iYear, iMonth, iDay, iHour, iMinute, iSecond)
+
+Return code: The epoch of a UTC time, by the days from the civil date.
+
+********************************************************************** */
+
+static time_t UTCTime(int iYear, int iMonth, int iDay, int iHour,
+		      int iMinute, int iSecond)
+{
+  long lEra,lYear,lDays;
+  iYear-=(iMonth<=2);
+  lEra=(iYear>=0 ? iYear : iYear-399)/400;
+  lYear=iYear-lEra*400;
+  lDays=lEra*146097+lYear*365+lYear/4-lYear/100
+    +(153*(iMonth+(iMonth>2 ? -3 : 9))+2)/5+iDay-1-719468;
+  return (time_t)lDays*86400+iHour*3600+iMinute*60+iSecond;
+}
+
+/* **********************************************************************
+
+cch=SyslogTime(plp, pch, pchEnd, &ti)
+
+Scan a timestamp "Mmm dd hh:mm:ss" (the day may start with a blank).
+
+Return code: Its length (15), or 0 if there is none.
+
+********************************************************************** */
+
+static int SyslogTime(TLogParse *plp, const char *pch, const char *pchEnd,
+		      time_t *pti)
+{
+  int iMonth,iDay,iHour,iMinute,iSecond;
+  if (pchEnd-pch<15 || pch[3]!=' ' || pch[6]!=' ' || pch[9]!=':'
+      || pch[12]!=':')
+    return 0;
+  for (iMonth=0; iMonth<12; iMonth++)
+    if (!memcmp(pch,achMonths+3*iMonth,3))
+      break;
+  iDay=(pch[4]==' ') ? Digits(pch+5,1) : Digits(pch+4,2);
+  iHour=Digits(pch+7,2);
+  iMinute=Digits(pch+10,2);
+  iSecond=Digits(pch+13,2);
+  if (iMonth==12 || iDay<1 || iHour<0 || iMinute<0 || iSecond<0)
+    return 0;
+  *pti=LocalHour(plp,0,iMonth+1,iDay,iHour)+iMinute*60+iSecond;
+  return 15;
+}
+
+/* **********************************************************************
+
+cch=IsoTime(plp, pch, pchEnd, bBlank, &ti)
+
+Scan a timestamp "YYYY-MM-DDThh:mm:ss" (with bBlank also with a blank
+instead of the "T"), maybe with a fraction and a zone ("Z" or
+"+hh:mm"). Without a zone the time is local. The caller checks, what
+follows it.
+
+Return code: Its length, or 0 if there is none.
+
+********************************************************************** */
+
+static int IsoTime(TLogParse *plp, const char *pch, const char *pchEnd,
+		   int bBlank, time_t *pti)
+{
+  const char *pchZone;
+  int         iYear,iMonth,iDay,iHour,iMinute,iSecond;
+  if (pchEnd-pch<19 || pch[4]!='-' || pch[7]!='-'
+      || (pch[10]!='T' && (!bBlank || pch[10]!=' '))
+      || pch[13]!=':' || pch[16]!=':')
+    return 0;
+  iYear=Digits(pch,4);
+  iMonth=Digits(pch+5,2);
+  iDay=Digits(pch+8,2);
+  iHour=Digits(pch+11,2);
+  iMinute=Digits(pch+14,2);
+  iSecond=Digits(pch+17,2);
+  if (iYear<1970 || iMonth<1 || iMonth>12 || iDay<1 || iHour<0
+      || iMinute<0 || iSecond<0)
+    return 0;
+  pchZone=pch+19;
+  if (pchZone<pchEnd && *pchZone=='.')
+    for (pchZone++; pchZone<pchEnd && *pchZone>='0' && *pchZone<='9'; )
+      pchZone++;
+  if (pchZone<pchEnd && *pchZone=='Z')
+    {
+      *pti=UTCTime(iYear,iMonth,iDay,iHour,iMinute,iSecond);
+      pchZone++;
+    }
+  else if (pchEnd-pchZone>=6 && (*pchZone=='+' || *pchZone=='-')
+	   && pchZone[3]==':' && Digits(pchZone+1,2)>=0
+	   && Digits(pchZone+4,2)>=0)
+    {
+      int sOffset=Digits(pchZone+1,2)*3600+Digits(pchZone+4,2)*60;
+      *pti=UTCTime(iYear,iMonth,iDay,iHour,iMinute,iSecond)
+	-(*pchZone=='+' ? sOffset : -sOffset);
+      pchZone+=6;
+    }
+  else
+    *pti=LocalHour(plp,iYear,iMonth,iDay,iHour)+iMinute*60+iSecond;
+  return pchZone-pch;
+}
+
+/* **********************************************************************
+
+bOk=Parse5424(plp, pch, pchEnd)
+
+Scan the header after "<PRI>1 ". A "-" is a missing field.
+
+Return code: true, if the header is complete.
+
+********************************************************************** */
+
+static int Parse5424(TLogParse *plp, const char *pch, const char *pchEnd)
+{
+  static const int aidToken[]={ LOGFRAME_FIELD_HOST, LOGFRAME_FIELD_PROGRAM,
+				LOGFRAME_FIELD_PID, LOGFRAME_FIELD_MSGID };
+  const char *pchSD;
+  time_t      ti=0;
+  int         cch,i;
+  if (*pch=='-')
+    cch=(pch+1<pchEnd && pch[1]==' ') ? 1 : 0;
+  else if ((cch=IsoTime(plp,pch,pchEnd,0,&ti))>0)
+    Set(plp,LOGFRAME_FIELD_TIME,pch,cch);
+  if (!cch || pch+cch>=pchEnd || pch[cch]!=' ') return 0;
+  pch+=cch+1;
+  for (i=0; i<(int)(sizeof(aidToken)/sizeof(aidToken[0])); i++)
+    {
+      const char *pchToken=pch;
+      pch=Token(pch,pchEnd,&cch);
+      if (!cch || pch==pchEnd) return 0;
+      if (cch!=1 || *pchToken!='-')
+	Set(plp,aidToken[i],pchToken,cch);
+      pch++;
+    }
+  if (pch>=pchEnd) return 0;
+  pchSD=pch;
+  if (*pch=='-')
+    pch++;
+  else
+    while (pch<pchEnd && *pch=='[')
+      {
+	int bQuoted=0;
+	for (pch++; pch<pchEnd; pch++)
+	  if (bQuoted && *pch=='\\')
+	    pch++;
+	  else if (*pch=='"')
+	    bQuoted=!bQuoted;
+	  else if (!bQuoted && *pch==']')
+	    break;
+	if (pch>=pchEnd) return 0;
+	pch++;
+      }
+  if (pch==pchSD || (pch<pchEnd && *pch!=' ')) return 0;
+  if (*pchSD!='-')
+    Set(plp,LOGFRAME_FIELD_SD,pchSD,pch-pchSD);
+  if (pch<pchEnd) pch++;
+  if (pchEnd-pch>=3 && !memcmp(pch,"\xef\xbb\xbf",3)) /* BOM */
+    pch+=3;
+  Set(plp,LOGFRAME_FIELD_MESSAGE,pch,pchEnd-pch);
+  if (plp->apch[LOGFRAME_FIELD_TIME])
+    SetNumber(plp,LOGFRAME_FIELD_EPOCH,(long long)ti);
+  return 1;
+}
+
+/* **********************************************************************
+
+bOk=Parse3164(plp, pch, pchEnd)
+
+Scan the header "TIME HOST TAG[PID]: ". A tag without its colon is
+part of the message.
+
+Return code: true, if there is a timestamp and a host.
+
+********************************************************************** */
+
+static int Parse3164(TLogParse *plp, const char *pch, const char *pchEnd)
+{
+  const char *pchTag,*pchPid=NULL;
+  time_t      ti;
+  int         cch;
+  if ((cch=SyslogTime(plp,pch,pchEnd,&ti))==0
+      && (cch=IsoTime(plp,pch,pchEnd,0,&ti))==0)
+    return 0;
+  if (pch+cch>=pchEnd || pch[cch]!=' ') return 0;
+  Set(plp,LOGFRAME_FIELD_TIME,pch,cch);
+  pch=Token(pch+cch+1,pchEnd,&cch);
+  if (!cch) return 0;
+  Set(plp,LOGFRAME_FIELD_HOST,pch-cch,cch);
+  if (pch<pchEnd) pch++;
+  for (pchTag=pch; pchTag<pchEnd; pchTag++)
+    if (*pchTag==':' || *pchTag=='[' || *pchTag==' ')
+      break;
+  if (pchTag<pchEnd && *pchTag=='[')
+    {
+      pchPid=pchTag+1;
+      pchTag=memchr(pchPid,']',pchEnd-pchPid);
+      if (pchTag) pchTag++;
+    }
+  if (pchTag && pchTag>pch && pchTag<pchEnd && *pchTag==':')
+    {
+      if (pchPid)
+	{
+	  Set(plp,LOGFRAME_FIELD_PROGRAM,pch,pchPid-1-pch);
+	  Set(plp,LOGFRAME_FIELD_PID,pchPid,pchTag-1-pchPid);
+	}
+      else
+	Set(plp,LOGFRAME_FIELD_PROGRAM,pch,pchTag-pch);
+      pch=pchTag+1;
+      if (pch<pchEnd && *pch==' ') pch++;
+    }
+  Set(plp,LOGFRAME_FIELD_MESSAGE,pch,pchEnd-pch);
+  SetNumber(plp,LOGFRAME_FIELD_EPOCH,(long long)ti);
+  return 1;
+}
+
+/* **********************************************************************
+
+LogParseLine(plp, pch, cch)
+
+Split a line (a final newline is dropped) into its fields.
+
+********************************************************************** */
+
+void LogParseLine(TLogParse *plp, const char *pch, int cch)
+{
+  const char *pchEnd,*pchHeader=pch;
+  int         iPri=-1;
+  if (cch && pch[cch-1]=='\n') cch--;
+  pchEnd=pch+cch;
+  memset(plp->apch,0,sizeof(plp->apch));
+  memset(plp->acch,0,sizeof(plp->acch));
+  plp->cchNumbers=0;
+  Set(plp,LOGFRAME_FIELD_LINE,pch,cch);
+  if (cch>2 && *pch=='<')
+    {
+      const char *pchClose=memchr(pch,'>',cch<6 ? cch : 6);
+      if (pchClose && pchClose>pch+1)
+	iPri=Digits(pch+1,pchClose-pch-1);
+      if (iPri>191) iPri=-1;
+      if (iPri>=0)
+	{
+	  SetNumber(plp,LOGFRAME_FIELD_FACILITY,iPri>>3);
+	  SetNumber(plp,LOGFRAME_FIELD_SEVERITY,iPri&7);
+	  pchHeader=pchClose+1;
+	}
+    }
+  if (iPri>=0 && pchEnd-pchHeader>2 && pchHeader[0]=='1'
+      && pchHeader[1]==' ')
+    plp->idSyntax=Parse5424(plp,pchHeader+2,pchEnd)
+      ? LOGPARSE_RFC5424 : LOGPARSE_NONE;
+  else
+    plp->idSyntax=Parse3164(plp,pchHeader,pchEnd)
+      ? LOGPARSE_RFC3164 : LOGPARSE_NONE;
+  if (plp->idSyntax==LOGPARSE_NONE)
+    {
+      memset(plp->apch,0,sizeof(plp->apch));
+      memset(plp->acch,0,sizeof(plp->acch));
+      Set(plp,LOGFRAME_FIELD_LINE,pch,cch);
+      Set(plp,LOGFRAME_FIELD_MESSAGE,pch,cch);
+    }
+}
+
+/* **********************************************************************
+
+ti=LogParseTimestamp(plp, pch, cch)
+
+Find the time at the start of a line, maybe after a "[": a syslog or
+an ISO timestamp, the latter also with a blank instead of the "T".
+Only the cache of the hour is touched, not the fields.
+
+Return code: The time, 0 if there is none.
+
+********************************************************************** */
+
+time_t LogParseTimestamp(TLogParse *plp, const char *pch, int cch)
+{
+  const char *pchEnd=pch+cch;
+  time_t      ti=0;
+  if (pch<pchEnd && *pch=='[') pch++;
+  if (pch<pchEnd && *pch>='0' && *pch<='9')
+    return IsoTime(plp,pch,pchEnd,1,&ti) && ti>0 ? ti : 0;
+  return SyslogTime(plp,pch,pchEnd,&ti) && ti>0 ? ti : 0;
+}
+
+/* **********************************************************************
+
+LogFormatInit(pfmt)
+
+Set up for plain lines, with the default fields for a later format.
+
+********************************************************************** */
+
+void LogFormatInit(TLogFormat *pfmt)
+{
+  memset(pfmt,0,sizeof(*pfmt));
+  pfmt->idFormat=LOGFORMAT_LINE;
+  LogFormatFields(pfmt,LOGFORMAT_DEFAULT_FIELDS);
+}
+
+/* **********************************************************************
+
+LogFormatKind(pfmt, szFormat)
+
+Take the output format: "line", "tsv", "json" or "binary".
+
+Return code: 0 on success, -1 for an unknown one.
+
+********************************************************************** */
+
+int LogFormatKind(TLogFormat *pfmt, const char *szFormat)
+{
+  static const char *const aszFormat[]={ "line", "tsv", "json", "binary" };
+  int i;
+  for (i=0; i<(int)(sizeof(aszFormat)/sizeof(aszFormat[0])); i++)
+    if (!strcmp(szFormat,aszFormat[i]))
+      {
+	pfmt->idFormat=i; /* in the order of LOGFORMAT_* */
+	return 0;
+      }
+  return -1;
+}
+
+/* **********************************************************************
+
+LogFormatFields(pfmt, szFields)
+
+Take the fields to write, a list of names separated by commas (see
+aszField), e.g. "time,host,message".
+
+Return code: 0 on success, -1 for an empty list, an unknown name or
+more than LOGFRAME_FIELDS names. pfmt stays as it was then.
+
+********************************************************************** */
+
+int LogFormatFields(TLogFormat *pfmt, const char *szFields)
+{
+  unsigned char aidField[LOGFRAME_FIELDS];
+  int           cFields=0;
+  while (*szFields)
+    {
+      int cch,idField;
+      while (*szFields==' ' || *szFields==',') szFields++;
+      for (cch=0; szFields[cch] && szFields[cch]!=',' && szFields[cch]!=' ';
+	   cch++)
+	;
+      if (!cch) break;
+      for (idField=1; idField<=LOGFRAME_FIELDS; idField++)
+	if ((int)strlen(aszField[idField])==cch
+	    && !memcmp(szFields,aszField[idField],cch))
+	  break;
+      if (idField>LOGFRAME_FIELDS || cFields==LOGFRAME_FIELDS)
+	return -1;
+      aidField[cFields++]=(unsigned char)idField;
+      szFields+=cch;
+    }
+  if (!cFields) return -1;
+  memcpy(pfmt->aidField,aidField,cFields);
+  pfmt->cFields=cFields;
+  return 0;
+}
+
+/* **********************************************************************
+
+LogFormatSame(pfmt1, pfmt2)
+
+Return code: true, if both write the same.
+
+********************************************************************** */
+
+int LogFormatSame(const TLogFormat *pfmt1, const TLogFormat *pfmt2)
+{
+  return pfmt1->idFormat==pfmt2->idFormat
+    && pfmt1->cFields==pfmt2->cFields
+    && !memcmp(pfmt1->aidField,pfmt2->aidField,pfmt1->cFields);
+}
+
+/* **********************************************************************
+
+cch=LogFormatSize(pfmt, plp)
+
+Return code: The bytes LogFormatWrite() needs at most for the line.
+
+********************************************************************** */
+
+int LogFormatSize(const TLogFormat *pfmt, const TLogParse *plp)
+{
+  int i,cch=4;
+  for (i=0; i<pfmt->cFields; i++)
+    {
+      int cchField=plp->acch[pfmt->aidField[i]];
+      switch (pfmt->idFormat)
+	{
+	case LOGFORMAT_TSV:
+	  cch+=2*cchField+1;
+	  break;
+	case LOGFORMAT_JSON:
+	  cch+=6*cchField+(int)strlen(aszField[pfmt->aidField[i]])+8;
+	  break;
+	default:
+	  cch+=LOGFRAME_FIELD_SIZE+cchField;
+	}
+    }
+  return cch;
+}
+
+/* **********************************************************************
+
+cch=Escape(pchOut, pch, cch, bJson)
+
+Copy a field with the escapes of TSV or JSON.
+
+Return code: The bytes written.
+
+********************************************************************** */
+
+static int Escape(char *pchOut, const char *pch, int cch, int bJson)
+{
+  char *pchStart=pchOut;
+  while (cch-->0)
+    {
+      unsigned char ch=(unsigned char)*pch++;
+      switch (ch)
+	{
+	case '\\': *pchOut++='\\'; *pchOut++='\\'; break;
+	case '\t': *pchOut++='\\'; *pchOut++='t'; break;
+	case '\n': *pchOut++='\\'; *pchOut++='n'; break;
+	case '\r': *pchOut++='\\'; *pchOut++='r'; break;
+	case '"':
+	  if (bJson) *pchOut++='\\';
+	  *pchOut++=ch;
+	  break;
+	default:
+	  if (bJson && ch<0x20)
+	    {
+	      memcpy(pchOut,"\\u00",4);
+	      pchOut[4]=achHex[ch>>4];
+	      pchOut[5]=achHex[ch&15];
+	      pchOut+=6;
+	    }
+	  else
+	    *pchOut++=ch;
+	}
+    }
+  return pchOut-pchStart;
+}
+
+/* **********************************************************************
+
+cch=LogFormatWrite(pfmt, plp, pch)
+
+Write the chosen fields of a parsed line to pch, which has room for
+LogFormatSize() bytes. Nothing is NUL terminated.
+
+Return code: The bytes written.
+
+********************************************************************** */
+
+int LogFormatWrite(const TLogFormat *pfmt, const TLogParse *plp, char *pch)
+{
+  char *pchStart=pch;
+  int   i;
+  if (pfmt->idFormat==LOGFORMAT_JSON) *pch++='{';
+  for (i=0; i<pfmt->cFields; i++)
+    {
+      int         idField=pfmt->aidField[i];
+      const char *pchField=plp->apch[idField];
+      int         cchField=plp->acch[idField];
+      switch (pfmt->idFormat)
+	{
+	case LOGFORMAT_TSV:
+	  if (i) *pch++='\t';
+	  if (pchField)
+	    pch+=Escape(pch,pchField,cchField,0);
+	  break;
+	case LOGFORMAT_JSON:
+	  pch+=sprintf(pch,"%s\"%s\":",i ? "," : "",aszField[idField]);
+	  if (!pchField)
+	    {
+	      memcpy(pch,"null",4);
+	      pch+=4;
+	    }
+	  else if (idField==LOGFRAME_FIELD_EPOCH
+		   || idField==LOGFRAME_FIELD_FACILITY
+		   || idField==LOGFRAME_FIELD_SEVERITY)
+	    {
+	      memcpy(pch,pchField,cchField);
+	      pch+=cchField;
+	    }
+	  else
+	    {
+	      *pch++='"';
+	      pch+=Escape(pch,pchField,cchField,1);
+	      *pch++='"';
+	    }
+	  break;
+	default:
+	  if (pchField)
+	    {
+	      TLogFrameField fld;
+	      fld.usField=(uint16_t)idField;
+	      fld.usReserved=0;
+	      fld.ulLength=(uint32_t)cchField;
+	      memcpy(pch,&fld,LOGFRAME_FIELD_SIZE); /* unaligned */
+	      memcpy(pch+LOGFRAME_FIELD_SIZE,pchField,cchField);
+	      pch+=LOGFRAME_FIELD_SIZE+cchField;
+	    }
+	}
+    }
+  if (pfmt->idFormat==LOGFORMAT_JSON) *pch++='}';
+  if (pfmt->idFormat!=LOGFORMAT_BINARY) *pch++='\n';
+  return pch-pchStart;
+}
@@ -0,0 +1,93 @@
+/* ======================================================================
+
+logparse.h
+
+Parsing the syslog header of a line once, and structured output of
+its fields for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+LogParseLine() splits a line into the fields of its header (see the
+LOGFRAME_FIELD_* numbers in logframe.h), for the known layouts:
+
+  RFC 5424  <PRI>1 TIMESTAMP HOST APP-NAME PROCID MSGID SD MSG
+  RFC 3164  [<PRI>]Mmm dd hh:mm:ss HOST TAG[PID]: MSG
+	    (or an ISO timestamp instead, as written by rsyslog)
+
+Both have their own scanner, without regular expressions or strptime.
+The epoch of a local timestamp is taken from a cache of the hour, so
+mktime() runs once an hour. Fields not found are missing (NULL), a
+line of none of the layouts has only its message (the whole line).
+LogParseTimestamp() takes just the time from the start of a line, by
+the same rules (see replay.h).
+
+A TLogFormat tells, how a destination wants the fields:
+
+  LOGFORMAT_LINE    the line itself, nothing is parsed
+  LOGFORMAT_TSV     the chosen fields separated by tabs, with \t, \n,
+		    \r and \\ escaped, missing ones empty
+  LOGFORMAT_JSON    an object of the chosen fields, with epoch,
+		    facility and severity as numbers, missing ones null
+		    (bytes beyond ASCII are copied, not checked)
+  LOGFORMAT_BINARY  the payload of a frame of LOGFRAME_VERSION_FIELDS,
+		    missing fields are left out
+
+The text formats end with a newline. Fields are chosen by a list of
+names like "time,host,program,pid,message" (LOGFORMAT_DEFAULT_FIELDS).
+
+   ====================================================================== */
+
+#ifndef LOGPARSE_H
+#define LOGPARSE_H
+
+#include <time.h>
+
+#include "logframe.h"
+
+#define LOGPARSE_NONE          0
+#define LOGPARSE_RFC3164       1
+#define LOGPARSE_RFC5424       2
+
+#define LOGFORMAT_LINE         0
+#define LOGFORMAT_TSV          1
+#define LOGFORMAT_JSON         2
+#define LOGFORMAT_BINARY       3
+
+#define LOGFORMAT_DEFAULT_FIELDS "time,host,program,pid,message"
+
+typedef struct {
+  int             idSyntax;         /* LOGPARSE_* */
+  const char     *apch[LOGFRAME_FIELDS+1]; /* by field, NULL if missing */
+  int             acch[LOGFRAME_FIELDS+1];
+  char            achNumbers[48];   /* text of epoch, facility, severity */
+  int             cchNumbers;       /* used of achNumbers */
+  int             iHourYear;        /* cache of the last local hour */
+  int             iHourMonth;
+  int             iHourDay;
+  int             iHour;
+  time_t          tiHour;
+} TLogParse;
+
+typedef struct {
+  int             idFormat;         /* LOGFORMAT_* */
+  int             cFields;
+  unsigned char   aidField[LOGFRAME_FIELDS]; /* in the order of output */
+} TLogFormat;
+
+void  LogParseInit(TLogParse *plp);
+void  LogParseLine(TLogParse *plp, const char *pch, int cch);
+time_t LogParseTimestamp(TLogParse *plp, const char *pch, int cch);
+void  LogFormatInit(TLogFormat *pfmt);
+int   LogFormatKind(TLogFormat *pfmt, const char *szFormat);
+int   LogFormatFields(TLogFormat *pfmt, const char *szFields);
+int   LogFormatSame(const TLogFormat *pfmt1, const TLogFormat *pfmt2);
+int   LogFormatSize(const TLogFormat *pfmt, const TLogParse *plp);
+int   LogFormatWrite(const TLogFormat *pfmt, const TLogParse *plp,
+		     char *pch);
+
+#endif
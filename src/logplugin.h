@@ -0,0 +1,76 @@
+/* ======================================================================
+
+logplugin.h
+
+The interface of destination plugins, loaded by tailfdx with
+type="plugin".
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A plugin is a shared object, which exports a TLogPlugin named
+"logplugin". tailfdx calls it from a thread of its own per destination:
+
+  Init()         once after loading, with the alias of the destination
+		 and its args like the argv of a command ("path" first).
+		 It may store a state in *ppvState. The arguments are
+		 valid during the call only.
+  ConsumeBatch() for every batch of lines. The lines are views into a
+		 buffer of tailfdx, valid until the call returns.
+  Flush()        whenever no more lines are waiting (may be NULL).
+  Shutdown()     before unloading, after the last batch.
+
+Init(), ConsumeBatch() and Flush() return 0 on success. A negative
+return code breaks the destination like a dying process: it is
+unloaded, and loaded again with option -r. Lines are given without
+their final newline and without a terminating NUL, together with
+their position, as in logframe.h. A minimal plugin:
+
+  #include <logplugin.h>
+
+  static int Consume(void *pv, const TLogPluginLine *aline, size_t c)
+  {
+    ... aline[0..c-1].pch, .cch, .ullOffset ...
+    return 0;
+  }
+
+  const TLogPlugin logplugin = {
+    LOGPLUGIN_VERSION, NULL, Consume, NULL, NULL
+  };
+
+Build it with "cc -shared -fPIC -o foo.so foo.c".
+
+   ====================================================================== */
+
+#ifndef LOGPLUGIN_H
+#define LOGPLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOGPLUGIN_VERSION   1
+#define LOGPLUGIN_SYMBOL    "logplugin"
+
+typedef struct {
+  const char     *pch;              /* the line, not NUL terminated */
+  uint32_t        cch;              /* its length */
+  uint64_t        ullOffset;        /* file position of the line */
+  uint64_t        ullInode;         /* inode of the monitored file */
+  uint64_t        ullTime;          /* receive time, us since the epoch */
+} TLogPluginLine;
+
+typedef struct {
+  int             iVersion;         /* LOGPLUGIN_VERSION */
+  int           (*Init)(void **ppvState, const char *szAlias,
+			int cArgs, char * const aszArgs[]);
+  int           (*ConsumeBatch)(void *pvState, const TLogPluginLine *aline,
+				size_t cLines);
+  int           (*Flush)(void *pvState);
+  void          (*Shutdown)(void *pvState);
+} TLogPlugin;
+
+#endif
@@ -0,0 +1,382 @@
+/* ======================================================================
+
+logset.c
+
+A set of log files, given by a glob pattern, for tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The set knows nothing about lines. The owner asks for the changed
+files, opens them with LogSetOpen(), reads from their position and
+stores the new position after the last complete line.
+
+   ====================================================================== */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "logset.h"
+
+#define DIR_EVENTS (IN_CREATE|IN_MOVED_TO|IN_MODIFY|IN_DELETE|IN_MOVED_FROM\
+		    |IN_ONLYDIR)
+
+/* **********************************************************************
+
+LogSetInit(ps, szGlob)
+
+Split the pattern and start watching its directory. The set is empty,
+LogSetScan() fills it.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+int LogSetInit(TLogSet *ps, const char *szGlob)
+{
+  const char *pchSlash=strrchr(szGlob,'/');
+  memset(ps,0,sizeof(*ps));
+  ps->hNotify=-1;
+  if (pchSlash)
+    {
+      ps->szDir=strndup(szGlob,pchSlash==szGlob ? 1 : pchSlash-szGlob);
+      ps->szPattern=strdup(pchSlash+1);
+    }
+  else
+    {
+      ps->szDir=strdup(".");
+      ps->szPattern=strdup(szGlob);
+    }
+  if (!ps->szDir || !ps->szPattern)
+    goto failed;
+  if (strpbrk(ps->szDir,"*?["))
+    {
+      errno=EINVAL; /* wildcards in the last component only */
+      goto failed;
+    }
+  ps->hNotify=inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+  if (ps->hNotify<0)
+    goto failed;
+  if (inotify_add_watch(ps->hNotify,ps->szDir,DIR_EVENTS)<0)
+    goto failed;
+  return 0;
+
+ failed:
+  {
+    int idError=errno;
+    LogSetFree(ps);
+    errno=idError;
+  }
+  return -1;
+}
+
+/* **********************************************************************
+
+LogSetFree(ps)
+
+Close all files and the watch, and forget everything. Repeatable.
+
+********************************************************************** */
+
+void LogSetFree(TLogSet *ps)
+{
+  TLogFile *plf,*plfNext;
+  for (plf=ps->plfFirst; plf; plf=plfNext)
+    {
+      plfNext=plf->pNext;
+      if (plf->hFile>=0) close(plf->hFile);
+      free(plf->szPath);
+      free(plf);
+    }
+  if (ps->hNotify>=0) close(ps->hNotify);
+  free(ps->szDir);
+  free(ps->szPattern);
+  memset(ps,0,sizeof(*ps));
+  ps->hNotify=-1;
+}
+
+/* **********************************************************************
+
+plf=FindFile(ps, szPath)
+
+Return code: The file of this name, which is not gone, or NULL.
+
+********************************************************************** */
+
+static TLogFile *FindFile(TLogSet *ps, const char *szPath)
+{
+  TLogFile *plf;
+  for (plf=ps->plfFirst; plf; plf=plf->pNext)
+    if (!plf->bGone && !strcmp(plf->szPath,szPath))
+      return plf;
+  return NULL;
+}
+
+/* **********************************************************************
+
+szPath=MatchName(ps, szName)
+
+Return code: The full name of a directory entry matching the pattern
+(malloc()ed), or NULL.
+
+********************************************************************** */
+
+static char *MatchName(TLogSet *ps, const char *szName)
+{
+  char *szPath;
+  if (fnmatch(ps->szPattern,szName,FNM_PERIOD))
+    return NULL;
+  szPath=malloc(strlen(ps->szDir)+strlen(szName)+2);
+  if (szPath)
+    {
+      strcpy(szPath,ps->szDir);
+      if (strcmp(ps->szDir,"/")) strcat(szPath,"/");
+      strcat(szPath,szName);
+    }
+  return szPath;
+}
+
+/* **********************************************************************
+
+plf=LogSetAdd(ps, szPath, iNode, lPosition)
+
+Add a file, e.g. from a checkpoint or when it has been found, which is
+to be read from lPosition. An inode of 0 is taken at the first open.
+A file already in the set is left as it is.
+
+Return code: The file, or NULL if out of memory.
+
+********************************************************************** */
+
+TLogFile *LogSetAdd(TLogSet *ps, const char *szPath, ino_t iNode,
+		    long lPosition)
+{
+  TLogFile *plf=FindFile(ps,szPath),**pplf;
+  if (plf) return plf;
+  plf=calloc(1,sizeof(TLogFile));
+  if (!plf) return NULL;
+  plf->szPath=strdup(szPath);
+  if (!plf->szPath)
+    {
+      free(plf);
+      return NULL;
+    }
+  plf->hFile=-1;
+  plf->iNode=iNode;
+  plf->lPosition=lPosition;
+  plf->lHeld=-1;
+  plf->tiActive=time(NULL);
+  for (pplf=&ps->plfFirst; *pplf; pplf=&(*pplf)->pNext) ; /* keep order */
+  *pplf=plf;
+  ps->cFiles++;
+  return plf;
+}
+
+/* **********************************************************************
+
+LogSetScan(ps)
+
+Read the directory and mark every matching file as changed, adding
+the new ones at position 0. Closed files, which are not there any
+more, are gone.
+
+Return code: 0 on success, -1 if the directory cannot be read.
+
+********************************************************************** */
+
+int LogSetScan(TLogSet *ps)
+{
+  DIR           *pdir=opendir(ps->szDir);
+  struct dirent *pde;
+  TLogFile      *plf;
+  if (!pdir) return -1;
+  for (plf=ps->plfFirst; plf; plf=plf->pNext)
+    plf->bChanged=plf->hFile>=0; /* open files are read anyway */
+  while ((pde=readdir(pdir))!=NULL)
+    {
+      char *szPath=MatchName(ps,pde->d_name);
+      if (!szPath) continue;
+      plf=LogSetAdd(ps,szPath,0,0);
+      free(szPath);
+      if (plf) plf->bChanged=1;
+    }
+  closedir(pdir);
+  for (plf=ps->plfFirst; plf; plf=plf->pNext)
+    if (!plf->bChanged)
+      plf->bGone=1;
+  return 0;
+}
+
+/* **********************************************************************
+
+HandleEvent(ps, pev)
+
+Apply one inotify event to the set.
+
+********************************************************************** */
+
+static void HandleEvent(TLogSet *ps, const struct inotify_event *pev)
+{
+  TLogFile *plf;
+  char     *szPath;
+  if (pev->mask & IN_Q_OVERFLOW)
+    {
+      LogSetScan(ps); /* events are lost, look for ourselves */
+      return;
+    }
+  if (!pev->len) return;
+  szPath=MatchName(ps,pev->name);
+  if (!szPath) return;
+  plf=FindFile(ps,szPath);
+  if (pev->mask & (IN_CREATE|IN_MOVED_TO))
+    {
+      if (plf) plf->bGone=1; /* replaced, the new file is another one */
+      plf=LogSetAdd(ps,szPath,0,0);
+    }
+  else if (!plf && (pev->mask & IN_MODIFY))
+    plf=LogSetAdd(ps,szPath,0,0); /* missed its creation */
+  else if (plf && (pev->mask & (IN_DELETE|IN_MOVED_FROM)))
+    plf->bGone=1; /* the open handle is read to its end */
+  if (plf)
+    {
+      plf->bChanged=1;
+      plf->tiActive=time(NULL);
+    }
+  free(szPath);
+}
+
+/* **********************************************************************
+
+LogSetWait(ps, ms)
+
+Wait up to ms milliseconds for events in the directory and mark the
+files concerned. Signals end the wait early, too. With ms=0 only the
+pending events are taken.
+
+Return code: 1, if there were events, 0 otherwise.
+
+********************************************************************** */
+
+int LogSetWait(TLogSet *ps, long ms)
+{
+  struct pollfd pfd;
+  char          achEvents[16384]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  ssize_t       cb;
+  int           bEvents=0;
+  pfd.fd=ps->hNotify;
+  pfd.events=POLLIN;
+  if (poll(&pfd,1,(int)ms)<=0) return 0;
+  while ((cb=read(ps->hNotify,achEvents,sizeof(achEvents)))>0)
+    {
+      char *pch=achEvents;
+      while (pch<achEvents+cb)
+	{
+	  const struct inotify_event *pev=(const struct inotify_event *)pch;
+	  HandleEvent(ps,pev);
+	  pch+=sizeof(struct inotify_event)+pev->len;
+	}
+      bEvents=1;
+    }
+  return bEvents;
+}
+
+/* **********************************************************************
+
+LogSetOpen(ps, plf)
+
+Make sure, the file is open and its handle is at the position. A file
+replaced by another one while idle, or truncated below the position,
+is read from the start.
+
+Return code: 0 on success, 1 if the file starts again at 0, -1 on
+failure (errno).
+
+********************************************************************** */
+
+int LogSetOpen(TLogSet *ps, TLogFile *plf)
+{
+  struct stat st;
+  int         rc=0;
+  if (plf->hFile<0)
+    {
+      int h=open(plf->szPath,O_RDONLY|O_CLOEXEC);
+      if (h<0) return -1;
+      plf->hFile=h;
+      ps->cOpen++;
+    }
+  if (fstat(plf->hFile,&st)<0)
+    return -1;
+  if (plf->iNode && plf->iNode!=st.st_ino)
+    {
+      plf->lPosition=0;
+      rc=1;
+    }
+  else if (st.st_size<plf->lPosition)
+    {
+      plf->lPosition=0;
+      rc=1;
+    }
+  plf->iNode=st.st_ino;
+  if (lseek(plf->hFile,plf->lPosition,SEEK_SET)!=plf->lPosition)
+    return -1;
+  return rc;
+}
+
+/* **********************************************************************
+
+LogSetClose(ps, plf)
+
+Close the handle of a file, which stays in the set.
+
+********************************************************************** */
+
+void LogSetClose(TLogSet *ps, TLogFile *plf)
+{
+  if (plf->hFile<0) return;
+  close(plf->hFile);
+  plf->hFile=-1;
+  ps->cOpen--;
+}
+
+/* **********************************************************************
+
+LogSetExpire(ps, msIdle)
+
+Close the handles idle for msIdle milliseconds, and drop the gone
+files, which are closed now.
+
+********************************************************************** */
+
+void LogSetExpire(TLogSet *ps, long msIdle)
+{
+  TLogFile **pplf=&ps->plfFirst;
+  time_t     tiIdle=time(NULL)-(msIdle+999)/1000;
+  while (*pplf)
+    {
+      TLogFile *plf=*pplf;
+      if (plf->hFile>=0 && plf->tiActive<=tiIdle && !plf->bChanged)
+	LogSetClose(ps,plf);
+      if (plf->bGone && plf->hFile<0)
+	{
+	  *pplf=plf->pNext;
+	  free(plf->szPath);
+	  free(plf);
+	  ps->cFiles--;
+	  continue;
+	}
+      pplf=&plf->pNext;
+    }
+}
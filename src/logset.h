@@ -0,0 +1,67 @@
+/* ======================================================================
+
+logset.h
+
+A set of log files, given by a glob pattern, for tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The pattern may have wildcards in its last component only, like
+"*.log" in "/var/log/mail". A single inotify watch on the directory
+finds new files, changes, deletions and renames by name, so there is
+no watch per file. Every file carries its own read position.
+
+A file is kept open only while it is active. After some idle time its
+descriptor is closed, and the next change opens it again at its
+position. So thousands of files can be followed with a few open
+descriptors. A deleted or renamed file is "gone": its descriptor is
+read to the end, then closed and the file is forgotten.
+
+   ====================================================================== */
+
+#ifndef LOGSET_H
+#define LOGSET_H
+
+#include <sys/types.h>
+#include <time.h>
+
+typedef struct TLogFile {
+  char             *szPath;         /* full name */
+  struct TLogFile  *pNext;          /* next file in set */
+  int               hFile;          /* open handle or -1, when idle */
+  ino_t             iNode;          /* 0 until the first open */
+  long              lPosition;      /* next line to be read */
+  time_t            tiActive;       /* last data or event */
+  int               bChanged;       /* there may be something to read */
+  int               bGone;          /* deleted or renamed */
+  long              lHeld;          /* of the owner: checkpoint held back
+				       to, -1 if not */
+} TLogFile;
+
+typedef struct {
+  int               hNotify;        /* inotify handle, -1 if unused */
+  char             *szDir;          /* directory part of the pattern */
+  char             *szPattern;      /* file name part of the pattern */
+  TLogFile         *plfFirst;
+  int               cFiles;         /* statistics */
+  int               cOpen;
+} TLogSet;
+
+#define LOGSET_DEFAULT_IDLE      60000      /* ms until an fd is closed */
+
+int       LogSetInit(TLogSet *ps, const char *szGlob);
+void      LogSetFree(TLogSet *ps);
+TLogFile *LogSetAdd(TLogSet *ps, const char *szPath, ino_t iNode,
+		    long lPosition);
+int       LogSetScan(TLogSet *ps);
+int       LogSetWait(TLogSet *ps, long ms);
+int       LogSetOpen(TLogSet *ps, TLogFile *plf);
+void      LogSetClose(TLogSet *ps, TLogFile *plf);
+void      LogSetExpire(TLogSet *ps, long msIdle);
+
+#endif
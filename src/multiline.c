@@ -0,0 +1,183 @@
+/* ======================================================================
+
+multiline.c
+
+Assembly of multiline records (stack traces and the like) for tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Records are assembled once, in a single buffer, which is grown on
+demand and kept over the whole run. So there is no allocation per
+record. The owner asks MultilineStarts() for every complete line,
+hands the finished record to the destinations, clears it and appends
+the new line. The timeout is the job of the main loop.
+
+   ====================================================================== */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <regex.h>
+
+#include "multiline.h"
+
+/* **********************************************************************
+
+MultilineInit(pm, szMode, szStart, msTimeout)
+
+Set up the rule. szMode may be "indent", "start" or NULL, szStart is
+the regular expression (POSIX extended) for "start" and implies it.
+Without any rule the assembly stays disabled.
+
+Return code: 0 on success, -1 on an unknown mode or a bad expression.
+
+********************************************************************** */
+
+int MultilineInit(TMultiline *pm, const char *szMode, const char *szStart,
+		  long msTimeout)
+{
+  memset(pm,0,sizeof(*pm));
+  pm->msTimeout=(msTimeout>0) ? msTimeout : MULTILINE_DEFAULT_DELAY;
+  if (szMode && !strcmp(szMode,"indent") && !szStart)
+    pm->idMode=MULTILINE_INDENT;
+  else if (szStart && (!szMode || !strcmp(szMode,"start")))
+    {
+      if (regcomp(&pm->reStart,szStart,REG_EXTENDED|REG_NOSUB|REG_NEWLINE))
+	return -1;
+      pm->idMode=MULTILINE_START;
+    }
+  else if (szMode || szStart)
+    return -1;
+  return 0;
+}
+
+/* **********************************************************************
+
+MultilineFree(pm)
+
+Release the buffer and the expression. The assembly is disabled
+afterwards.
+
+********************************************************************** */
+
+void MultilineFree(TMultiline *pm)
+{
+  if (pm->idMode==MULTILINE_START)
+    regfree(&pm->reStart);
+  free(pm->pchBuffer);
+  memset(pm,0,sizeof(*pm));
+}
+
+/* **********************************************************************
+
+MultilineEnabled(pm)
+
+Return code: true, if lines are assembled to records.
+
+********************************************************************** */
+
+int MultilineEnabled(const TMultiline *pm)
+{
+  return pm->idMode!=MULTILINE_NONE;
+}
+
+/* **********************************************************************
+
+MultilineStarts(pm, szLine, cch)
+
+Check the NUL terminated line against the rule. Every line starts a
+record, if there is no record pending, and if the pending record
+cannot take the line any more.
+
+Return code: true, if the pending record is complete before szLine.
+
+********************************************************************** */
+
+int MultilineStarts(const TMultiline *pm, const char *szLine, int cch)
+{
+  if (!pm->cLines) return 1;
+  if (pm->cchBuffer+cch>MULTILINE_MAX_BYTES) return 1;
+  switch (pm->idMode)
+    {
+    case MULTILINE_INDENT:
+      return !(cch && (szLine[0]==' ' || szLine[0]=='\t'));
+    case MULTILINE_START:
+      return !regexec(&pm->reStart,szLine,0,NULL,0);
+    default:
+      return 1;
+    }
+}
+
+/* **********************************************************************
+
+MultilineAppend(pm, pchLine, cch, lPosition)
+
+Add a complete line to the record. lPosition is the file position of
+the line, the first one is kept for the checkpoint.
+
+Return code: 0 on success, -1 if there is no memory.
+
+********************************************************************** */
+
+int MultilineAppend(TMultiline *pm, const char *pchLine, int cch,
+		    long lPosition)
+{
+  if (pm->cchBuffer+cch+1>pm->cchAlloc)
+    {
+      int   cchAlloc=pm->cchAlloc ? pm->cchAlloc : 4096;
+      char *pch;
+      while (pm->cchBuffer+cch+1>cchAlloc) cchAlloc*=2;
+      pch=realloc(pm->pchBuffer,cchAlloc);
+      if (!pch) return -1;
+      pm->pchBuffer=pch;
+      pm->cchAlloc=cchAlloc;
+    }
+  if (!pm->cLines)
+    pm->lPosition=lPosition;
+  memcpy(pm->pchBuffer+pm->cchBuffer,pchLine,cch);
+  pm->cchBuffer+=cch;
+  pm->pchBuffer[pm->cchBuffer]='\0';
+  pm->cLines++;
+  clock_gettime(CLOCK_MONOTONIC,&pm->tsLast);
+  return 0;
+}
+
+/* **********************************************************************
+
+MultilineClear(pm)
+
+Forget the record after delivery. The buffer is kept.
+
+********************************************************************** */
+
+void MultilineClear(TMultiline *pm)
+{
+  pm->cchBuffer=0;
+  pm->cLines=0;
+  if (pm->pchBuffer) pm->pchBuffer[0]='\0';
+}
+
+/* **********************************************************************
+
+MultilineMsLeft(pm)
+
+Return code: -1, if there is no pending record, otherwise the
+milliseconds (>=0) until the record is complete by timeout.
+
+********************************************************************** */
+
+long MultilineMsLeft(const TMultiline *pm)
+{
+  struct timespec tsNow;
+  long ms;
+  if (!pm->cLines) return -1;
+  clock_gettime(CLOCK_MONOTONIC,&tsNow);
+  ms=pm->msTimeout-((tsNow.tv_sec-pm->tsLast.tv_sec)*1000L
+		    +(tsNow.tv_nsec-pm->tsLast.tv_nsec)/1000000L);
+  return (ms>0) ? ms : 0;
+}
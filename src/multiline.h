@@ -0,0 +1,57 @@
+/* ======================================================================
+
+multiline.h
+
+Assembly of multiline records (stack traces and the like) for tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A record is a first line and all its continuation lines. The rule
+decides, which line starts a new record: Either any line not starting
+with white space ("indent"), or any line matching a regular expression
+("start"). A record is complete, when the next record starts, when it
+would grow beyond MULTILINE_MAX_BYTES, or when no continuation has
+arrived for the timeout.
+
+   ====================================================================== */
+
+#ifndef MULTILINE_H
+#define MULTILINE_H
+
+#include <regex.h>
+#include <time.h>
+
+typedef enum { MULTILINE_NONE, MULTILINE_INDENT, MULTILINE_START }
+  TMultilineMode;
+
+typedef struct {
+  TMultilineMode  idMode;
+  regex_t         reStart;          /* start of record, MULTILINE_START */
+  long            msTimeout;        /* wait for continuation lines */
+  char           *pchBuffer;        /* the record, NUL terminated */
+  int             cchAlloc;         /* size of the buffer, kept */
+  int             cchBuffer;        /* bytes in record */
+  int             cLines;           /* lines in record */
+  long            lPosition;        /* file position of the first line */
+  struct timespec tsLast;           /* arrival of the latest line */
+} TMultiline;
+
+#define MULTILINE_MAX_BYTES      (1L<<20)   /* records are cut here */
+#define MULTILINE_DEFAULT_DELAY  1000       /* default timeout in ms */
+
+int   MultilineInit(TMultiline *pm, const char *szMode, const char *szStart,
+		    long msTimeout);
+void  MultilineFree(TMultiline *pm);
+int   MultilineEnabled(const TMultiline *pm);
+int   MultilineStarts(const TMultiline *pm, const char *szLine, int cch);
+int   MultilineAppend(TMultiline *pm, const char *pchLine, int cch,
+		      long lPosition);
+void  MultilineClear(TMultiline *pm);
+long  MultilineMsLeft(const TMultiline *pm);
+
+#endif
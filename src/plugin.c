@@ -0,0 +1,312 @@
+/* ======================================================================
+
+plugin.c
+
+Loading and feeding destination plugins (see logplugin.h) in tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The thread of a plugin blocks all signals, so the flags of the signal
+handlers are still raised in the main thread only. When the plugin
+fails, the thread drops the pending frames and ends, and the next
+PluginWrite() fails with EPIPE, like a write to a dead pipe.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <dlfcn.h>
+
+#include "plugin.h"
+#include "logframe.h"
+
+/* **********************************************************************
+
+SplitFrames(pp, cch)
+
+Cut the first cch bytes of pchWork into views of lines.
+
+Return code: The number of lines, or -1 for a broken frame or if out
+of memory.
+
+********************************************************************** */
+
+static int SplitFrames(TPlugin *pp, int cch)
+{
+  int iFrame=0,cLines=0;
+  while (iFrame<cch)
+    {
+      TLogFrameHeader hdr;
+      TLogPluginLine *pline;
+      if (cch-iFrame<LOGFRAME_HEADER_SIZE)
+	return -1;
+      memcpy(&hdr,pp->pchWork+iFrame,LOGFRAME_HEADER_SIZE); /* unaligned */
+      if (hdr.usMagic!=LOGFRAME_MAGIC
+	  || hdr.ulLength>(uint32_t)(cch-iFrame-LOGFRAME_HEADER_SIZE))
+	return -1;
+      if (cLines==pp->cLinesAlloc)
+	{
+	  int cAlloc=pp->cLinesAlloc ? 2*pp->cLinesAlloc : 256;
+	  TLogPluginLine *alineNew=realloc(pp->aline,
+					   cAlloc*sizeof(TLogPluginLine));
+	  if (!alineNew) return -1;
+	  pp->aline=alineNew;
+	  pp->cLinesAlloc=cAlloc;
+	}
+      pline=pp->aline+cLines++;
+      pline->pch=pp->pchWork+iFrame+LOGFRAME_HEADER_SIZE;
+      pline->cch=hdr.ulLength;
+      pline->ullOffset=hdr.ullOffset;
+      pline->ullInode=hdr.ullInode;
+      pline->ullTime=hdr.ullTime;
+      iFrame+=LOGFRAME_HEADER_SIZE+hdr.ulLength;
+    }
+  return cLines;
+}
+
+/* **********************************************************************
+
+Consume(pp)
+
+The thread of a plugin: take the pending frames, hand them to the
+plugin, and flush it, when nothing else is pending. It ends on
+PluginClose() or when the plugin fails.
+
+********************************************************************** */
+
+static void *Consume(void *pv)
+{
+  TPlugin *pp=pv;
+  pthread_mutex_lock(&pp->mutex);
+  while (!pp->bFailed)
+    {
+      char *pch;
+      int   cch,cAlloc,cLines,rc=0;
+      while (!pp->cchPending && !pp->bStop)
+	pthread_cond_wait(&pp->cond,&pp->mutex);
+      if (!pp->cchPending)
+	break; /* stopped, and everything is consumed */
+      pch=pp->pchWork; /* swap the buffers */
+      cAlloc=pp->cchWorkAlloc;
+      pp->pchWork=pp->pchPending;
+      pp->cchWorkAlloc=pp->cchPendingAlloc;
+      pp->pchPending=pch;
+      pp->cchPendingAlloc=cAlloc;
+      cch=pp->cchPending;
+      pp->cchPending=0;
+      pthread_cond_broadcast(&pp->cond); /* room for the writer */
+      pthread_mutex_unlock(&pp->mutex);
+
+      cLines=SplitFrames(pp,cch);
+      if (cLines<0)
+	rc=-1;
+      else if (cLines>0)
+	rc=pp->pplugin->ConsumeBatch(pp->pvState,pp->aline,cLines);
+
+      pthread_mutex_lock(&pp->mutex);
+      if (rc>=0)
+	{
+	  pp->ulBatches++;
+	  pp->ulLines+=cLines;
+	  if (!pp->cchPending && pp->pplugin->Flush)
+	    {
+	      pthread_mutex_unlock(&pp->mutex);
+	      rc=pp->pplugin->Flush(pp->pvState);
+	      pthread_mutex_lock(&pp->mutex);
+	    }
+	}
+      if (rc<0)
+	{
+	  pp->bFailed=1;
+	  pp->cchPending=0;
+	  pthread_cond_broadcast(&pp->cond); /* wake a waiting writer */
+	}
+    }
+  pthread_mutex_unlock(&pp->mutex);
+  return NULL;
+}
+
+/* **********************************************************************
+
+PluginOpen(pp, szPath, szAlias, cArgs, aszArgs)
+
+Load the plugin, initialize it with the alias and the arguments of the
+destination and start its thread. pp must be zeroed or closed.
+
+Return code: 0 on success, -1 on failure, with a message in
+pp->achError.
+
+********************************************************************** */
+
+int PluginOpen(TPlugin *pp, const char *szPath, const char *szAlias,
+	       int cArgs, char * const aszArgs[])
+{
+  sigset_t sigsAll,sigsOld;
+  int      rc;
+  memset(pp,0,sizeof(*pp));
+  pp->hLib=dlopen(szPath,RTLD_NOW|RTLD_LOCAL);
+  if (!pp->hLib)
+    {
+      snprintf(pp->achError,sizeof(pp->achError),"%s",dlerror());
+      return -1;
+    }
+  pp->pplugin=dlsym(pp->hLib,LOGPLUGIN_SYMBOL);
+  if (!pp->pplugin || pp->pplugin->iVersion!=LOGPLUGIN_VERSION
+      || !pp->pplugin->ConsumeBatch)
+    {
+      snprintf(pp->achError,sizeof(pp->achError),
+	       "%s has no \"%s\" of version %d",szPath,LOGPLUGIN_SYMBOL,
+	       LOGPLUGIN_VERSION);
+      goto failed;
+    }
+  if (pp->pplugin->Init
+      && pp->pplugin->Init(&pp->pvState,szAlias,cArgs,aszArgs)<0)
+    {
+      snprintf(pp->achError,sizeof(pp->achError),"%s failed to start",
+	       szPath);
+      goto failed;
+    }
+  pthread_mutex_init(&pp->mutex,NULL);
+  pthread_cond_init(&pp->cond,NULL);
+  sigfillset(&sigsAll);
+  pthread_sigmask(SIG_SETMASK,&sigsAll,&sigsOld); /* inherited */
+  rc=pthread_create(&pp->thread,NULL,Consume,pp);
+  pthread_sigmask(SIG_SETMASK,&sigsOld,NULL);
+  if (rc)
+    {
+      snprintf(pp->achError,sizeof(pp->achError),"no thread: %s",
+	       strerror(rc));
+      pthread_cond_destroy(&pp->cond);
+      pthread_mutex_destroy(&pp->mutex);
+      if (pp->pplugin->Shutdown)
+	pp->pplugin->Shutdown(pp->pvState);
+      goto failed;
+    }
+  return 0;
+
+ failed:
+  dlclose(pp->hLib);
+  pp->hLib=NULL;
+  return -1;
+}
+
+/* **********************************************************************
+
+PluginOpened(pp)
+
+Return code: true, if the plugin is loaded.
+
+********************************************************************** */
+
+int PluginOpened(const TPlugin *pp)
+{
+  return pp->hLib!=NULL;
+}
+
+/* **********************************************************************
+
+cchWritten=PluginWrite(pp, pch, cch)
+
+Append whole frames for the thread. If too much is pending already,
+wait until the thread has taken it.
+
+Return code: cch, or -1 if the plugin is not loaded or has failed
+(errno=EPIPE).
+
+********************************************************************** */
+
+int PluginWrite(TPlugin *pp, const char *pch, int cch)
+{
+  if (!pp->hLib)
+    {
+      errno=EPIPE;
+      return -1;
+    }
+  pthread_mutex_lock(&pp->mutex);
+  while (!pp->bFailed && pp->cchPending
+	 && pp->cchPending+cch>PLUGIN_MAX_PENDING)
+    pthread_cond_wait(&pp->cond,&pp->mutex);
+  if (!pp->bFailed && pp->cchPending+cch>pp->cchPendingAlloc)
+    {
+      int   cchAlloc=pp->cchPendingAlloc ? pp->cchPendingAlloc : 65536;
+      char *pchNew;
+      while (pp->cchPending+cch>cchAlloc) cchAlloc*=2;
+      pchNew=realloc(pp->pchPending,cchAlloc);
+      if (!pchNew)
+	{
+	  pthread_mutex_unlock(&pp->mutex);
+	  errno=ENOMEM;
+	  return -1;
+	}
+      pp->pchPending=pchNew;
+      pp->cchPendingAlloc=cchAlloc;
+    }
+  if (pp->bFailed)
+    {
+      pthread_mutex_unlock(&pp->mutex);
+      errno=EPIPE;
+      return -1;
+    }
+  memcpy(pp->pchPending+pp->cchPending,pch,cch);
+  pp->cchPending+=cch;
+  pthread_cond_broadcast(&pp->cond);
+  pthread_mutex_unlock(&pp->mutex);
+  return cch;
+}
+
+/* **********************************************************************
+
+PluginStatistics(pp, &ulBatches, &ulLines, &cchPending)
+
+Read the counters of the thread.
+
+********************************************************************** */
+
+void PluginStatistics(TPlugin *pp, unsigned long *pulBatches,
+		      unsigned long *pulLines, int *pcchPending)
+{
+  *pulBatches=*pulLines=0;
+  *pcchPending=0;
+  if (!pp->hLib) return;
+  pthread_mutex_lock(&pp->mutex);
+  *pulBatches=pp->ulBatches;
+  *pulLines=pp->ulLines;
+  *pcchPending=pp->cchPending;
+  pthread_mutex_unlock(&pp->mutex);
+}
+
+/* **********************************************************************
+
+PluginClose(pp)
+
+Let the thread consume the pending frames (unless the plugin has
+failed), shut the plugin down and unload it. Repeatable.
+
+********************************************************************** */
+
+void PluginClose(TPlugin *pp)
+{
+  if (!pp->hLib) return;
+  pthread_mutex_lock(&pp->mutex);
+  pp->bStop=1;
+  pthread_cond_broadcast(&pp->cond);
+  pthread_mutex_unlock(&pp->mutex);
+  pthread_join(pp->thread,NULL);
+  if (pp->pplugin->Shutdown)
+    pp->pplugin->Shutdown(pp->pvState);
+  pthread_cond_destroy(&pp->cond);
+  pthread_mutex_destroy(&pp->mutex);
+  dlclose(pp->hLib);
+  free(pp->pchPending);
+  free(pp->pchWork);
+  free(pp->aline);
+  memset(pp,0,sizeof(*pp));
+}
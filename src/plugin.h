@@ -0,0 +1,61 @@
+/* ======================================================================
+
+plugin.h
+
+Loading and feeding destination plugins (see logplugin.h) in tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The owner writes binary frames (see logframe.h) with PluginWrite(),
+as it would write them to a pipe. They are appended to a pending
+buffer, and the thread of the plugin swaps it with its own one, cuts
+it into lines without copying and hands them to the plugin in one
+batch. So the owner only waits, when more than PLUGIN_MAX_PENDING
+bytes are pending, like a writer on a full pipe.
+
+   ====================================================================== */
+
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <pthread.h>
+
+#include "logplugin.h"
+
+typedef struct {
+  void             *hLib;           /* dlopen() handle, NULL if closed */
+  const TLogPlugin *pplugin;
+  void             *pvState;        /* of the plugin */
+  pthread_t         thread;
+  pthread_mutex_t   mutex;          /* for everything below */
+  pthread_cond_t    cond;           /* frames pending, or taken */
+  char             *pchPending;     /* frames for the thread */
+  int               cchPending;
+  int               cchPendingAlloc;
+  char             *pchWork;        /* frames in the plugin */
+  int               cchWorkAlloc;
+  TLogPluginLine   *aline;          /* views into pchWork */
+  int               cLinesAlloc;
+  int               bStop;          /* close after the pending frames */
+  int               bFailed;        /* the plugin returned an error */
+  unsigned long     ulBatches;      /* statistics */
+  unsigned long     ulLines;
+  char              achError[256];  /* why PluginOpen() failed */
+} TPlugin;
+
+#define PLUGIN_MAX_PENDING       (4<<20)    /* bytes before waiting */
+
+int  PluginOpen(TPlugin *pp, const char *szPath, const char *szAlias,
+		int cArgs, char * const aszArgs[]);
+int  PluginOpened(const TPlugin *pp);
+int  PluginWrite(TPlugin *pp, const char *pch, int cch);
+void PluginStatistics(TPlugin *pp, unsigned long *pulBatches,
+		      unsigned long *pulLines, int *pcchPending);
+void PluginClose(TPlugin *pp);
+
+#endif
@@ -0,0 +1,447 @@
+/* ======================================================================
+
+ratelimit.c
+
+Token bucket rate limits for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The memory queue is one buffer of records, which is compacted when
+it has to grow, so there is no allocation per line. The spool is an
+anonymous temporary file with the same records; it is emptied, as
+soon as it has been read back completely.
+
+   ====================================================================== */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "ratelimit.h"
+
+typedef struct {
+  long lPosition;
+  int  cch;
+} TRecord;
+
+#define RECORD_SIZE(cch) ((int)sizeof(TRecord)+(((cch)+7)&~7))
+
+/* **********************************************************************
+
+RateLimitInit(prl)
+
+Set up a disabled limit with the default queue.
+
+********************************************************************** */
+
+void RateLimitInit(TRateLimit *prl)
+{
+  memset(prl,0,sizeof(*prl));
+  prl->cMaxQueued=RATELIMIT_DEFAULT_QUEUE;
+  prl->hSpool=-1;
+}
+
+/* **********************************************************************
+
+RateLimitFree(prl)
+
+Drop the queue and the spool. The limit is disabled.
+
+********************************************************************** */
+
+void RateLimitFree(TRateLimit *prl)
+{
+  free(prl->pchQueue);
+  free(prl->pchLine);
+  if (prl->hSpool>=0) close(prl->hSpool);
+  RateLimitInit(prl);
+}
+
+/* **********************************************************************
+
+RateLimitParse(prl, szSpec)
+
+Take a limit "lines[/s][,burst]". Without a burst, the bucket holds
+one second of lines.
+
+Return code: 0 on success, -1 for a bad specification.
+
+********************************************************************** */
+
+int RateLimitParse(TRateLimit *prl, const char *szSpec)
+{
+  char  *pch;
+  double dRate=strtod(szSpec,&pch),dBurst;
+  if (pch==szSpec || dRate<=0) return -1;
+  if (!strncmp(pch,"/s",2)) pch+=2;
+  dBurst=dRate;
+  if (*pch==',')
+    {
+      const char *pchBurst=pch+1;
+      dBurst=strtod(pchBurst,&pch);
+      if (pch==pchBurst) return -1;
+    }
+  if (*pch) return -1;
+  if (dBurst<1) dBurst=1;
+  prl->dRate=dRate;
+  prl->dBurst=prl->dTokens=dBurst;
+  clock_gettime(CLOCK_MONOTONIC,&prl->tsLast);
+  return 0;
+}
+
+/* **********************************************************************
+
+RateLimitAdopt(prl, prlNew)
+
+Take the settings of another limit, e.g. after a reload, keeping the
+queued lines.
+
+********************************************************************** */
+
+void RateLimitAdopt(TRateLimit *prl, const TRateLimit *prlNew)
+{
+  prl->dRate=prlNew->dRate;
+  prl->dBurst=prlNew->dBurst;
+  prl->cMaxQueued=prlNew->cMaxQueued;
+  prl->bSpool=prlNew->bSpool;
+  if (prl->dTokens>prl->dBurst) prl->dTokens=prl->dBurst;
+}
+
+/* **********************************************************************
+
+RateLimitEnabled(prl)
+
+Return code: true, if there is a limit or anything still queued.
+
+********************************************************************** */
+
+int RateLimitEnabled(const TRateLimit *prl)
+{
+  return prl->dRate>0 || prl->cQueued || prl->cSpooled;
+}
+
+/* **********************************************************************
+
+Refill(prl)
+
+Add the tokens earned since the last refill.
+
+********************************************************************** */
+
+static void Refill(TRateLimit *prl)
+{
+  struct timespec ts;
+  double dSeconds;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  dSeconds=(ts.tv_sec-prl->tsLast.tv_sec)
+    +(ts.tv_nsec-prl->tsLast.tv_nsec)/1e9;
+  prl->tsLast=ts;
+  if (prl->dRate<=0)
+    {
+      prl->dTokens=1; /* limit removed, drain the queue */
+      return;
+    }
+  prl->dTokens+=dSeconds*prl->dRate;
+  if (prl->dTokens>prl->dBurst) prl->dTokens=prl->dBurst;
+}
+
+/* **********************************************************************
+
+RateLimitTake(prl)
+
+Take a token for a new line, if nothing is waiting before it.
+
+Return code: true, if the line may go now; false, if it must be
+queued.
+
+********************************************************************** */
+
+int RateLimitTake(TRateLimit *prl)
+{
+  if (prl->cQueued || prl->cSpooled) return 0;
+  Refill(prl);
+  if (prl->dTokens<1) return 0;
+  prl->dTokens-=1;
+  return 1;
+}
+
+/* **********************************************************************
+
+Spool(prl, prec, pch)
+
+Append a record to the spool file, which is created on demand.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+static int Spool(TRateLimit *prl, const TRecord *prec, const char *pch)
+{
+  if (prl->hSpool<0)
+    {
+      char szName[]="/tmp/tailfdx-spool-XXXXXX";
+#ifdef O_TMPFILE
+      prl->hSpool=open(P_tmpdir,O_TMPFILE|O_RDWR|O_CLOEXEC,0600);
+#endif
+      if (prl->hSpool<0)
+	{
+	  prl->hSpool=mkstemp(szName);
+	  if (prl->hSpool<0) return -1;
+	  unlink(szName);
+	  fcntl(prl->hSpool,F_SETFD,FD_CLOEXEC);
+	}
+    }
+  if (pwrite(prl->hSpool,prec,sizeof(*prec),prl->lSpoolWrite)!=sizeof(*prec)
+      || pwrite(prl->hSpool,pch,prec->cch,prl->lSpoolWrite+sizeof(*prec))
+      !=prec->cch)
+    return -1;
+  prl->lSpoolWrite+=sizeof(*prec)+prec->cch;
+  prl->cSpooled++;
+  return 0;
+}
+
+/* **********************************************************************
+
+Enqueue(prl, prec, pch)
+
+Append a record to the memory queue, which grows on demand.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+static int Enqueue(TRateLimit *prl, const TRecord *prec, const char *pch)
+{
+  if (prl->cchUsed+RECORD_SIZE(prec->cch)>prl->cchAlloc)
+    {
+      if (prl->iHead)
+	{
+	  memmove(prl->pchQueue,prl->pchQueue+prl->iHead,
+		  prl->cchUsed-prl->iHead);
+	  prl->cchUsed-=prl->iHead;
+	  prl->iHead=0;
+	}
+      if (prl->cchUsed+RECORD_SIZE(prec->cch)>prl->cchAlloc)
+	{
+	  int   cchAlloc=prl->cchAlloc ? prl->cchAlloc : 65536;
+	  char *pchNew;
+	  while (prl->cchUsed+RECORD_SIZE(prec->cch)>cchAlloc) cchAlloc*=2;
+	  pchNew=realloc(prl->pchQueue,cchAlloc);
+	  if (!pchNew) return -1;
+	  prl->pchQueue=pchNew;
+	  prl->cchAlloc=cchAlloc;
+	}
+    }
+  memcpy(prl->pchQueue+prl->cchUsed,prec,sizeof(*prec));
+  memcpy(prl->pchQueue+prl->cchUsed+sizeof(*prec),pch,prec->cch);
+  prl->cchUsed+=RECORD_SIZE(prec->cch);
+  prl->cQueued++;
+  return 0;
+}
+
+/* **********************************************************************
+
+RateLimitQueue(prl, pch, cch, lPosition)
+
+Queue a line, which has not got a token. It goes to the spool or is
+dropped, when the memory queue is full (or the spool is in use).
+
+Return code: 0 if queued, 1 if dropped, -1 on failure (errno).
+
+********************************************************************** */
+
+int RateLimitQueue(TRateLimit *prl, const char *pch, int cch, long lPosition)
+{
+  TRecord rec;
+  rec.lPosition=lPosition;
+  rec.cch=cch;
+  if (prl->cSpooled || prl->cQueued>=prl->cMaxQueued)
+    {
+      if (!prl->bSpool)
+	{
+	  prl->ulDropped++;
+	  return 1;
+	}
+      if (Spool(prl,&rec,pch)<0) return -1;
+      prl->ulThrottled++;
+      return 0;
+    }
+  if (Enqueue(prl,&rec,pch)<0) return -1;
+  prl->ulThrottled++;
+  return 0;
+}
+
+/* **********************************************************************
+
+pch=RateLimitNext(prl, &cch, &lPosition)
+
+Take the oldest queued line, if there is a token for it.
+
+Return code: The line, valid until the next call, or NULL.
+
+********************************************************************** */
+
+const char *RateLimitNext(TRateLimit *prl, int *pcch, long *plPosition)
+{
+  TRecord rec;
+  if (!prl->cQueued && !prl->cSpooled) return NULL;
+  Refill(prl);
+  if (prl->dTokens<1) return NULL;
+  if (prl->cQueued)
+    {
+      const char *pch=prl->pchQueue+prl->iHead;
+      memcpy(&rec,pch,sizeof(rec));
+      prl->iHead+=RECORD_SIZE(rec.cch);
+      if (!--prl->cQueued) prl->iHead=prl->cchUsed=0;
+      prl->dTokens-=1;
+      *pcch=rec.cch;
+      *plPosition=rec.lPosition;
+      return pch+sizeof(rec); /* not overwritten before the next call */
+    }
+  if (pread(prl->hSpool,&rec,sizeof(rec),prl->lSpoolRead)!=sizeof(rec))
+    return NULL;
+  if (rec.cch>prl->cchLineAlloc)
+    {
+      char *pchNew=realloc(prl->pchLine,rec.cch);
+      if (!pchNew) return NULL;
+      prl->pchLine=pchNew;
+      prl->cchLineAlloc=rec.cch;
+    }
+  if (pread(prl->hSpool,prl->pchLine,rec.cch,prl->lSpoolRead+sizeof(rec))
+      !=rec.cch)
+    return NULL;
+  prl->lSpoolRead+=sizeof(rec)+rec.cch;
+  if (!--prl->cSpooled && ftruncate(prl->hSpool,0)==0)
+    prl->lSpoolRead=prl->lSpoolWrite=0; /* else the spool just grows on */
+  prl->dTokens-=1;
+  *pcch=rec.cch;
+  *plPosition=rec.lPosition;
+  return prl->pchLine;
+}
+
+/* **********************************************************************
+
+RateLimitMsLeft(prl)
+
+Return code: The milliseconds until the next queued line may go, 0 if
+it may go now, or -1 if nothing is queued.
+
+********************************************************************** */
+
+long RateLimitMsLeft(TRateLimit *prl)
+{
+  if (!prl->cQueued && !prl->cSpooled) return -1;
+  Refill(prl);
+  if (prl->dTokens>=1) return 0;
+  return (long)((1-prl->dTokens)*1000/prl->dRate)+1;
+}
+
+/* **********************************************************************
+
+RateLimitOldest(prl)
+
+Return code: The file position of the oldest queued line, or -1.
+
+********************************************************************** */
+
+long RateLimitOldest(const TRateLimit *prl)
+{
+  TRecord rec;
+  if (prl->cQueued)
+    {
+      memcpy(&rec,prl->pchQueue+prl->iHead,sizeof(rec));
+      return rec.lPosition;
+    }
+  if (prl->cSpooled
+      && pread(prl->hSpool,&rec,sizeof(rec),prl->lSpoolRead)==sizeof(rec))
+    return rec.lPosition;
+  return -1;
+}
+
+/* **********************************************************************
+
+RateLimitSave(prl, fh)
+
+Write all queued lines, oldest first, as records (position, length,
+bytes) to fh, without taking them. See RateLimitLoad().
+
+Return code: The number of lines written, or -1 on failure (errno).
+
+********************************************************************** */
+
+long RateLimitSave(const TRateLimit *prl, FILE *fh)
+{
+  TRecord rec;
+  char    ach[65536];
+  int     i;
+  off_t   l;
+  for (i=prl->iHead; i<prl->cchUsed; i+=RECORD_SIZE(rec.cch))
+    {
+      memcpy(&rec,prl->pchQueue+i,sizeof(rec));
+      if (fwrite(prl->pchQueue+i,sizeof(rec)+rec.cch,1,fh)!=1)
+	return -1;
+    }
+  for (l=prl->lSpoolRead; l<prl->lSpoolWrite; )
+    {
+      size_t  cchWanted=prl->lSpoolWrite-l<(off_t)sizeof(ach)
+	? (size_t)(prl->lSpoolWrite-l) : sizeof(ach);
+      ssize_t cch=pread(prl->hSpool,ach,cchWanted,l);
+      if (cch<=0)
+	{
+	  if (!cch) errno=EIO;
+	  return -1;
+	}
+      if (fwrite(ach,cch,1,fh)!=1) return -1;
+      l+=cch;
+    }
+  return prl->cQueued+(long)prl->cSpooled;
+}
+
+/* **********************************************************************
+
+RateLimitLoad(prl, fh, cLines)
+
+Queue cLines records written by RateLimitSave(), behind the lines
+already queued. They are neither counted nor dropped: Beyond the
+memory queue they are spooled, whatever the policy.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+int RateLimitLoad(TRateLimit *prl, FILE *fh, long cLines)
+{
+  TRecord rec;
+  while (cLines-->0)
+    {
+      if (fread(&rec,sizeof(rec),1,fh)!=1 || rec.cch<0)
+	{
+	  errno=EPROTO;
+	  return -1;
+	}
+      if (rec.cch>prl->cchLineAlloc)
+	{
+	  char *pchNew=realloc(prl->pchLine,rec.cch);
+	  if (!pchNew) return -1;
+	  prl->pchLine=pchNew;
+	  prl->cchLineAlloc=rec.cch;
+	}
+      if (rec.cch && fread(prl->pchLine,rec.cch,1,fh)!=1)
+	{
+	  errno=EPROTO;
+	  return -1;
+	}
+      if ((prl->cSpooled || prl->cQueued>=prl->cMaxQueued
+	   ? Spool(prl,&rec,prl->pchLine) : Enqueue(prl,&rec,prl->pchLine))<0)
+	return -1;
+    }
+  return 0;
+}
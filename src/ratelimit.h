@@ -0,0 +1,70 @@
+/* ======================================================================
+
+ratelimit.h
+
+Token bucket rate limits for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The bucket holds up to dBurst tokens and gains dRate tokens per
+second. A line takes one token. A line finding no token (or older
+lines still waiting) is queued in memory, up to cMaxQueued lines.
+Beyond that, the policy decides: the line is dropped, or it goes to a
+spool file, which is read back in order when the queue has drained.
+Every queued line carries its file position, so the owner can keep
+its checkpoint before the oldest one. For an upgrade, the queued lines
+are saved to a file and loaded by the new binary.
+
+   ====================================================================== */
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef struct {
+  double          dRate;            /* tokens per second, 0 = no limit */
+  double          dBurst;           /* bucket size */
+  int             cMaxQueued;       /* lines kept in memory */
+  int             bSpool;           /* spool beyond cMaxQueued, or drop */
+  double          dTokens;
+  struct timespec tsLast;           /* last refill */
+  char           *pchQueue;         /* records: position, length, bytes */
+  int             cchAlloc;
+  int             iHead;            /* oldest record */
+  int             cchUsed;          /* end of the records */
+  int             cQueued;          /* lines in memory */
+  int             hSpool;           /* spool file, -1 if none */
+  off_t           lSpoolRead;
+  off_t           lSpoolWrite;
+  unsigned long   cSpooled;         /* lines in the spool */
+  char           *pchLine;          /* line read back from the spool */
+  int             cchLineAlloc;
+  unsigned long   ulThrottled;      /* statistics: lines delayed */
+  unsigned long   ulDropped;        /* statistics: lines dropped */
+} TRateLimit;
+
+#define RATELIMIT_DEFAULT_QUEUE  10000      /* lines */
+
+void        RateLimitInit(TRateLimit *prl);
+void        RateLimitFree(TRateLimit *prl);
+int         RateLimitParse(TRateLimit *prl, const char *szSpec);
+void        RateLimitAdopt(TRateLimit *prl, const TRateLimit *prlNew);
+int         RateLimitEnabled(const TRateLimit *prl);
+int         RateLimitTake(TRateLimit *prl);
+int         RateLimitQueue(TRateLimit *prl, const char *pch, int cch,
+			   long lPosition);
+const char *RateLimitNext(TRateLimit *prl, int *pcch, long *plPosition);
+long        RateLimitMsLeft(TRateLimit *prl);
+long        RateLimitOldest(const TRateLimit *prl);
+long        RateLimitSave(const TRateLimit *prl, FILE *fh);
+int         RateLimitLoad(TRateLimit *prl, FILE *fh, long cLines);
+
+#endif
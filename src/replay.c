@@ -0,0 +1,629 @@
+/* ======================================================================
+
+replay.c
+
+Replaying a bounded range of a log for tailfd and tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A lower offset bound is not searched for: the file is opened one byte
+before it, so the piece of a line up to the bound is a line starting
+before it and is skipped like any other. A lower time bound is
+searched for in every file, from the record before it in the index of
+the file (see logindex.h), if there is one.
+
+   ====================================================================== */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  /* strptime() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "replay.h"
+#include "logindex.h"
+#include "logparse.h"
+
+/* **********************************************************************
+
+ReplayInit(pr)
+
+Set up an unbounded replay without files.
+
+********************************************************************** */
+
+void ReplayInit(TReplay *pr)
+{
+  memset(pr,0,sizeof(*pr));
+  pr->llFrom=pr->llTo=-1;
+}
+
+/* **********************************************************************
+
+ReplayFree(pr)
+
+Forget the files and the bounds.
+
+********************************************************************** */
+
+void ReplayFree(TReplay *pr)
+{
+  int i;
+  for (i=0; i<pr->cFiles; i++)
+    free(pr->aszFiles[i]);
+  free(pr->aszFiles);
+  ReplayInit(pr);
+}
+
+/* **********************************************************************
+
+ReplayEnabled(pr)
+
+Return code: true, if there are files to replay.
+
+********************************************************************** */
+
+int ReplayEnabled(const TReplay *pr)
+{
+  return pr->cFiles>0;
+}
+
+/* **********************************************************************
+
+ReplayParseTime(sz, &ti)
+
+Take a local time "YYYY-MM-DD[(T| )HH:MM[:SS]]" or "@seconds".
+
+Return code: 0 on success, -1 for a bad time.
+
+********************************************************************** */
+
+int ReplayParseTime(const char *sz, time_t *pti)
+{
+  static const char *aszFormat[] = {
+    "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M",
+    "%Y-%m-%d %H:%M", "%Y-%m-%d", NULL
+  };
+  const char **psz;
+  if (*sz=='@')
+    {
+      char *pch;
+      long  l=strtol(sz+1,&pch,10);
+      if (pch==sz+1 || *pch || l<=0) return -1;
+      *pti=(time_t)l;
+      return 0;
+    }
+  for (psz=aszFormat; *psz; psz++)
+    {
+      struct tm tm;
+      const char *pch;
+      memset(&tm,0,sizeof(tm));
+      pch=strptime(sz,*psz,&tm);
+      if (pch && !*pch)
+	{
+	  tm.tm_isdst=-1;
+	  *pti=mktime(&tm);
+	  return *pti>0 ? 0 : -1;
+	}
+    }
+  return -1;
+}
+
+/* **********************************************************************
+
+ParseBound(sz, &ll, &ti)
+
+Take a bound: digits are an offset, anything else is a time.
+
+Return code: 0 on success, -1 for a bad bound.
+
+********************************************************************** */
+
+static int ParseBound(const char *sz, long long *pll, time_t *pti)
+{
+  const char *pch=sz;
+  if (!sz) return 0;
+  while (isdigit((unsigned char)*pch)) pch++;
+  if (pch>sz && !*pch)
+    {
+      *pll=atoll(sz);
+      return 0;
+    }
+  return ReplayParseTime(sz,pti);
+}
+
+/* **********************************************************************
+
+ReplayBounds(pr, szFrom, szTo)
+
+Set the bounds of the range, both may be NULL. The range includes
+the lines starting at or after szFrom and before szTo.
+
+Return code: 0 on success, -1 for a bad bound (errno=EINVAL).
+
+********************************************************************** */
+
+int ReplayBounds(TReplay *pr, const char *szFrom, const char *szTo)
+{
+  if (ParseBound(szFrom,&pr->llFrom,&pr->tiFrom)<0
+      || ParseBound(szTo,&pr->llTo,&pr->tiTo)<0)
+    {
+      errno=EINVAL;
+      return -1;
+    }
+  return 0;
+}
+
+/* **********************************************************************
+
+ReplayFiles(pr, szFile, bRotated)
+
+Set the files to replay: FILE, and with bRotated its predecessors
+FILE.1, FILE.2 ... as far as they exist, oldest first.
+
+Return code: 0 on success, -1 if out of memory.
+
+********************************************************************** */
+
+int ReplayFiles(TReplay *pr, const char *szFile, int bRotated)
+{
+  struct stat st;
+  int         cRotated=0,i;
+  char       *szName=malloc(strlen(szFile)+16);
+  if (!szName) return -1;
+  while (bRotated)
+    {
+      sprintf(szName,"%s.%d",szFile,cRotated+1);
+      if (stat(szName,&st)<0) break;
+      cRotated++;
+    }
+  pr->aszFiles=calloc(cRotated+1,sizeof(char *));
+  if (!pr->aszFiles)
+    {
+      free(szName);
+      return -1;
+    }
+  for (i=cRotated; i>0; i--)
+    {
+      sprintf(szName,"%s.%d",szFile,i);
+      if (!(pr->aszFiles[pr->cFiles++]=strdup(szName)))
+	break;
+    }
+  free(szName);
+  if (i || !(pr->aszFiles[pr->cFiles++]=strdup(szFile)))
+    return -1;
+  pr->iFile=0;
+  pr->llNext=0;
+  return 0;
+}
+
+/* **********************************************************************
+
+FindStamp(h, ll, llLimit, bResync, tiMin, &ti)
+
+Find the first line stamped at or after tiMin (with any timestamp for
+0), which starts at or after ll and before llLimit. With bResync, ll
+may be inside a line, which is skipped, otherwise it is a line start.
+
+Return code: The offset of the line, or -1 if there is none (or on a
+read error).
+
+********************************************************************** */
+
+static long long FindStamp(int h, long long ll, long long llLimit,
+			   int bResync, time_t tiMin, time_t *pti)
+{
+  char ach[65536];
+  while (ll<llLimit)
+    {
+      ssize_t cch=pread(h,ach,sizeof(ach),ll);
+      char   *pch=ach,*pchEnd;
+      if (cch<=0) return -1;
+      pchEnd=ach+cch;
+      if (bResync)
+	{
+	  char *pchNL=memchr(ach,'\n',cch);
+	  if (!pchNL)
+	    {
+	      ll+=cch;
+	      continue;
+	    }
+	  pch=pchNL+1;
+	  bResync=0;
+	}
+      while (pch<pchEnd && ll+(pch-ach)<llLimit)
+	{
+	  char *pchNL=memchr(pch,'\n',pchEnd-pch);
+	  if (!pchNL && pch>ach && cch==sizeof(ach))
+	    break; /* read again from the line start */
+	  *pti=ReplayTimestamp(pch,(pchNL ? pchNL : pchEnd)-pch);
+	  if (*pti && *pti>=tiMin) return ll+(pch-ach);
+	  if (!pchNL)
+	    {
+	      bResync=1; /* a long line, or the last one */
+	      pch=pchEnd;
+	      break;
+	    }
+	  pch=pchNL+1;
+	}
+      if (ll+(pch-ach)>=llLimit || (cch<(ssize_t)sizeof(ach) && pch==pchEnd))
+	return -1;
+      ll+=pch-ach;
+    }
+  return -1;
+}
+
+/* **********************************************************************
+
+ll=ReplaySeekTime(h, llLow, ti)
+
+Binary search the file open as h for the first line stamped at or
+after ti, by reading single blocks and resyncing to the next line.
+llLow is a line start, before which all lines are older (0, or a
+record of an index). The lines must be in order, lines without a
+timestamp belong to the last stamped line.
+
+Return code: The offset of the line, the size of the file, if there
+is none, or -1 on failure (errno).
+
+********************************************************************** */
+
+long long ReplaySeekTime(int h, long long llLow, time_t ti)
+{
+  struct stat st;
+  long long   llHigh,ll;
+  time_t      tiLine;
+  if (fstat(h,&st)<0) return -1;
+  llHigh=st.st_size;
+  if (llLow>llHigh) llLow=0;
+  while (llHigh-llLow>65536)
+    {
+      long long llMiddle=llLow+(llHigh-llLow)/2;
+      ll=FindStamp(h,llMiddle,llHigh,1,0,&tiLine);
+      if (ll>=0 && tiLine<ti)
+	llLow=ll;
+      else
+	llHigh=llMiddle;
+    }
+  ll=FindStamp(h,llLow,st.st_size,0,ti,&tiLine);
+  return ll>=0 ? ll : st.st_size;
+}
+
+/* **********************************************************************
+
+ll=ReplaySeekLines(h, cLines)
+
+Find the start of the last cLines complete lines of the file open as
+h, like "tail -n", by reading big blocks backwards from the end and
+counting the newlines with memrchr(). An unterminated last line is
+always included, so for 0 lines the start of the last line is found.
+
+Return code: The offset, 0 if the file has fewer lines, or -1 on
+failure (errno).
+
+********************************************************************** */
+
+long long ReplaySeekLines(int h, long cLines)
+{
+  struct stat st;
+  long long   ll;
+  long        cLeft=cLines+1; /* the newline before the first line */
+  char       *pchBuffer=malloc(REPLAY_SCAN_BLOCK);
+  if (!pchBuffer || fstat(h,&st)<0)
+    {
+      free(pchBuffer);
+      return -1;
+    }
+  for (ll=st.st_size; ll>0; )
+    {
+      size_t cch=ll<REPLAY_SCAN_BLOCK ? (size_t)ll : REPLAY_SCAN_BLOCK;
+      char  *pchEnd=pchBuffer+cch,*pchNL;
+      ll-=cch;
+      if (pread(h,pchBuffer,cch,ll)!=(ssize_t)cch)
+	{
+	  int idError=errno ? errno : EIO;
+	  free(pchBuffer);
+	  errno=idError;
+	  return -1;
+	}
+      while ((pchNL=memrchr(pchBuffer,'\n',pchEnd-pchBuffer))!=NULL)
+	{
+	  if (!--cLeft)
+	    {
+	      ll+=pchNL-pchBuffer+1;
+	      free(pchBuffer);
+	      return ll;
+	    }
+	  pchEnd=pchNL;
+	}
+    }
+  free(pchBuffer);
+  return 0;
+}
+
+/* **********************************************************************
+
+ll=FindTime(pr, h, iNode, ti)
+
+Find the first line at or after ti in a file of the replay, starting
+at the last record before ti in its index, if it has one.
+
+Return code: The offset of the line, or 0 on failure.
+
+********************************************************************** */
+
+static long long FindTime(TReplay *pr, int h, ino_t iNode, time_t ti)
+{
+  long long llLow=0,ll;
+  if (LogIndexFind(pr->aszFiles[pr->cFiles-1],iNode,ti,&llLow)<0)
+    llLow=0;
+  ll=ReplaySeekTime(h,llLow,ti);
+  return ll>0 ? ll : 0;
+}
+
+/* **********************************************************************
+
+h=ReplayOpen(pr)
+
+Open the next file at the first position to be read (see above). Files
+ending before an offset bound are skipped.
+
+Return code: The handle, or -1 with errno=0 after the last file and
+errno set, if a file cannot be opened.
+
+********************************************************************** */
+
+int ReplayOpen(TReplay *pr)
+{
+  while (pr->iFile<pr->cFiles && !pr->bDone)
+    {
+      const char *szName=pr->aszFiles[pr->iFile++];
+      struct stat st;
+      int         h=open(szName,O_RDONLY|O_CLOEXEC);
+      if (h<0 || fstat(h,&st)<0)
+	{
+	  if (h>=0) close(h);
+	  if (!errno) errno=EIO;
+	  return -1;
+	}
+      pr->llBase=pr->llNext;
+      pr->llNext=pr->llBase+st.st_size;
+      pr->lStart=0;
+      if (pr->llFrom>=0 && pr->llFrom>=pr->llNext && pr->iFile<pr->cFiles)
+	{
+	  close(h); /* entirely before the range */
+	  continue;
+	}
+      if (pr->llFrom>pr->llBase)
+	{
+	  pr->lStart=(long)(pr->llFrom-pr->llBase-1);
+	  if (pr->lStart>st.st_size) pr->lStart=st.st_size;
+	}
+      if (pr->tiFrom)
+	{
+	  long long ll=FindTime(pr,h,st.st_ino,pr->tiFrom);
+	  if (ll>pr->lStart)
+	    pr->lStart=(long)ll; /* the first line at the time */
+	}
+      if (pr->lStart && lseek(h,pr->lStart,SEEK_SET)!=pr->lStart)
+	{
+	  close(h);
+	  return -1;
+	}
+      return h;
+    }
+  errno=0;
+  return -1;
+}
+
+/* **********************************************************************
+
+ReplayTimestamp(pch, cch)
+
+Return code: The time at the start of a line (see replay.h), 0 if
+there is none. Syslog times lack the year, they are taken as the
+latest time not more than a day ahead. The parser of logparse.h keeps
+the local hour, so mktime() runs once an hour, not once a line.
+
+********************************************************************** */
+
+time_t ReplayTimestamp(const char *pch, int cch)
+{
+  static TLogParse lpTimes;         /* for its cache of the hour */
+  static int       bTimes;
+  if (!bTimes)
+    {
+      LogParseInit(&lpTimes);
+      bTimes=1;
+    }
+  return LogParseTimestamp(&lpTimes,pch,cch);
+}
+
+/* **********************************************************************
+
+ReplayCheck(pr, pch, cch, llOffset)
+
+Place a line starting at llOffset (in the stream of all files) in the
+range.
+
+Return code: REPLAY_SKIP, REPLAY_PASS or REPLAY_DONE.
+
+********************************************************************** */
+
+int ReplayCheck(TReplay *pr, const char *pch, int cch, long long llOffset)
+{
+  if (pr->bDone) return REPLAY_DONE;
+  if ((pr->tiFrom && !pr->bStarted) || pr->tiTo)
+    {
+      time_t ti=ReplayTimestamp(pch,cch);
+      if (ti) pr->tiLine=ti;
+    }
+  if ((pr->llTo>=0 && llOffset>=pr->llTo)
+      || (pr->tiTo && pr->tiLine && pr->tiLine>=pr->tiTo))
+    {
+      pr->bDone=1;
+      return REPLAY_DONE;
+    }
+  if (!pr->bStarted)
+    {
+      if ((pr->llFrom>=0 && llOffset<pr->llFrom)
+	  || (pr->tiFrom && (!pr->tiLine || pr->tiLine<pr->tiFrom)))
+	{
+	  pr->ulSkipped++;
+	  return REPLAY_SKIP;
+	}
+      pr->bStarted=1;
+    }
+  pr->ulPassed++;
+  return REPLAY_PASS;
+}
+
+/* **********************************************************************
+
+ReplayReset(pr)
+
+Forget the lines seen so far, before the lines of another chunk.
+
+********************************************************************** */
+
+void ReplayReset(TReplay *pr)
+{
+  pr->tiLine=0;
+  pr->bStarted=pr->bDone=0;
+}
+
+/* **********************************************************************
+
+AlignLine(h, l, lLimit)
+
+Return code: The first line start at or after l, lLimit if there is
+none before it, or -1 on a read error.
+
+********************************************************************** */
+
+static long AlignLine(int h, long l, long lLimit)
+{
+  char ach[65536];
+  if (l<=0) return 0;
+  l--; /* a newline just before l is fine */
+  while (l<lLimit)
+    {
+      ssize_t cch=pread(h,ach,sizeof(ach),l);
+      char   *pchNL;
+      if (cch<0) return -1;
+      if (!cch) break;
+      pchNL=memchr(ach,'\n',cch);
+      if (pchNL)
+	{
+	  l+=pchNL-ach+1;
+	  return l<lLimit ? l : lLimit;
+	}
+      l+=cch;
+    }
+  return lLimit;
+}
+
+/* **********************************************************************
+
+c=ReplayChunks(pr, cchChunk, &lLastSize, &apc)
+
+Cut the range into chunks of about cchChunk bytes. Offset bounds are
+aligned to lines, so they need not be searched for again. The last
+file, which may grow, is taken up to *plLastSize, if that is not -1,
+which keeps the chunks of an interrupted backfill. *plLastSize gets
+the size used.
+
+Return code: The number of chunks in apc (malloc()ed), or -1 on
+failure (errno).
+
+********************************************************************** */
+
+int ReplayChunks(TReplay *pr, long cchChunk, long *plLastSize,
+		 TReplayChunk **papc)
+{
+  TReplayChunk *apc=NULL;
+  long long     llBase=0;
+  int           c=0,cAlloc=0,i;
+  if (cchChunk<1) cchChunk=REPLAY_CHUNK_SIZE;
+  for (i=0; i<pr->cFiles; i++)
+    {
+      struct stat st;
+      long        lSize,lBegin=0,lFinish,l;
+      int         h=open(pr->aszFiles[i],O_RDONLY|O_CLOEXEC);
+      if (h<0 || fstat(h,&st)<0)
+	goto failed;
+      lSize=st.st_size;
+      if (i==pr->cFiles-1)
+	{
+	  if (*plLastSize>=0 && *plLastSize<lSize) lSize=*plLastSize;
+	  *plLastSize=lSize;
+	}
+      lFinish=lSize;
+      if (pr->llTo>=0 && pr->llTo<llBase+lSize)
+	lFinish=pr->llTo>llBase ? AlignLine(h,pr->llTo-llBase,lSize) : 0;
+      if (pr->llFrom>llBase)
+	lBegin=pr->llFrom<llBase+lSize
+	  ? AlignLine(h,pr->llFrom-llBase,lSize) : lSize;
+      if (pr->tiFrom)
+	{
+	  long long ll=FindTime(pr,h,st.st_ino,pr->tiFrom);
+	  if (ll>lBegin)
+	    lBegin=ll<lSize ? (long)ll : lSize;
+	}
+      for (l=lBegin; l>=0 && lFinish>=0 && l<lFinish; )
+	{
+	  long lNext=lFinish;
+	  if (lFinish-l>cchChunk)
+	    lNext=AlignLine(h,l+cchChunk,lFinish);
+	  if (lNext<0)
+	    {
+	      close(h);
+	      goto failed;
+	    }
+	  if (c==cAlloc)
+	    {
+	      TReplayChunk *apcNew;
+	      cAlloc=cAlloc ? 2*cAlloc : 64;
+	      apcNew=realloc(apc,cAlloc*sizeof(TReplayChunk));
+	      if (!apcNew)
+		{
+		  close(h);
+		  goto failed;
+		}
+	      apc=apcNew;
+	    }
+	  apc[c].iFile=i;
+	  apc[c].lStart=l;
+	  apc[c].lEnd=lNext;
+	  apc[c].llBase=llBase;
+	  c++;
+	  l=lNext;
+	}
+      close(h);
+      if (lBegin<0 || lFinish<0)
+	goto failed;
+      llBase+=st.st_size;
+    }
+  *papc=apc;
+  return c;
+
+ failed:
+  {
+    int idError=errno ? errno : EIO;
+    free(apc);
+    errno=idError;
+  }
+  return -1;
+}
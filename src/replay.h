@@ -0,0 +1,92 @@
+/* ======================================================================
+
+replay.h
+
+Replaying a bounded range of a log for tailfd and tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A replay reads a log once, from a lower to an upper bound, instead of
+following it. Both bounds are optional and are either byte offsets or
+times. With rotated predecessors the files FILE.N ... FILE.1 come
+before FILE, and offsets count through all of them as one stream.
+
+The owner opens the files one by one with ReplayOpen(), splits them
+into lines and asks ReplayCheck() for every line. Times are taken
+from the start of the lines, where a syslog ("Oct 19 12:00:00") or an
+ISO ("2026-10-19T12:00:00" or with a blank) timestamp is found. An ISO
+one may have a fraction and a zone ("Z" or "+02:00"), without a zone
+it is local time. Lines without one belong to the last stamped line.
+Once the lower bound is passed, only an upper time bound needs them.
+
+A lower time bound is not read up to: ReplaySeekTime() finds the first
+line at the time by a binary search on the timestamps, which also
+lets a daemon without a checkpoint start at a time. ReplaySeekLines()
+finds the last lines of a file instead, reading backwards.
+
+For a parallel backfill, ReplayChunks() cuts the range into chunks at
+line boundaries, which never span two files. Each chunk is checked on
+its own after ReplayReset(), so lines keep their order only within a
+chunk.
+
+   ====================================================================== */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <time.h>
+
+typedef struct {
+  char          **aszFiles;         /* oldest first, FILE last */
+  int             cFiles;
+  int             iFile;            /* next file to open */
+  long long       llFrom;           /* offset bounds, -1 if none */
+  long long       llTo;
+  time_t          tiFrom;           /* time bounds, 0 if none */
+  time_t          tiTo;
+  long long       llBase;           /* offset of the open file */
+  long long       llNext;           /* offset of the file after it */
+  long            lStart;           /* first position read in it */
+  time_t          tiLine;           /* time of the last stamped line */
+  int             bStarted;         /* lower bound passed */
+  int             bDone;            /* upper bound reached */
+  unsigned long   ulSkipped;        /* statistics */
+  unsigned long   ulPassed;
+} TReplay;
+
+typedef struct {
+  int             iFile;            /* in aszFiles */
+  long            lStart;           /* first line in the file */
+  long            lEnd;             /* after the last line */
+  long long       llBase;           /* offset of the file */
+} TReplayChunk;
+
+#define REPLAY_SKIP 0                       /* before the range */
+#define REPLAY_PASS 1                       /* in the range */
+#define REPLAY_DONE 2                       /* the range is over */
+
+#define REPLAY_CHUNK_SIZE        (64L<<20)  /* bytes per chunk */
+#define REPLAY_SCAN_BLOCK        (1L<<20)   /* read backwards */
+
+void      ReplayInit(TReplay *pr);
+void      ReplayFree(TReplay *pr);
+int       ReplayEnabled(const TReplay *pr);
+int       ReplayBounds(TReplay *pr, const char *szFrom, const char *szTo);
+int       ReplayFiles(TReplay *pr, const char *szFile, int bRotated);
+int       ReplayOpen(TReplay *pr);
+time_t    ReplayTimestamp(const char *pch, int cch);
+int       ReplayParseTime(const char *sz, time_t *pti);
+long long ReplaySeekTime(int h, long long llLow, time_t ti);
+long long ReplaySeekLines(int h, long cLines);
+int       ReplayCheck(TReplay *pr, const char *pch, int cch,
+		       long long llOffset);
+void      ReplayReset(TReplay *pr);
+int       ReplayChunks(TReplay *pr, long cchChunk, long *plLastSize,
+		       TReplayChunk **papc);
+
+#endif
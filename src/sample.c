@@ -0,0 +1,138 @@
+/* ======================================================================
+
+sample.c
+
+Deterministic sampling of lines for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The hash is FNV-1a over the bytes, with a final mix, so that the low
+bits are good enough for a modulus. It must never change, or the
+samples of old and new versions would not match.
+
+   ====================================================================== */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sample.h"
+#include "hash.h"
+
+/* **********************************************************************
+
+SampleInit(ps)
+
+Set up without sampling: every line is kept.
+
+********************************************************************** */
+
+void SampleInit(TSample *ps)
+{
+  memset(ps,0,sizeof(*ps));
+}
+
+/* **********************************************************************
+
+SampleParse(ps, szRate)
+
+Take a rate "1/N" (or just "N").
+
+Return code: 0 on success, -1 for a bad rate.
+
+********************************************************************** */
+
+int SampleParse(TSample *ps, const char *szRate)
+{
+  char *pch;
+  if (!strncmp(szRate,"1/",2)) szRate+=2;
+  ps->ulModulus=strtoul(szRate,&pch,10);
+  if (pch==szRate || *pch || !ps->ulModulus)
+    return -1;
+  return 0;
+}
+
+/* **********************************************************************
+
+SampleKey(ps, szKey)
+
+Hash the key matched by an extended regular expression instead of
+the whole line.
+
+Return code: 0 on success, -1 for a bad expression.
+
+********************************************************************** */
+
+int SampleKey(TSample *ps, const char *szKey)
+{
+  if (ps->bKey) regfree(&ps->reKey);
+  ps->bKey=0;
+  if (regcomp(&ps->reKey,szKey,REG_EXTENDED|REG_NEWLINE))
+    return -1;
+  ps->bKey=1;
+  return 0;
+}
+
+/* **********************************************************************
+
+SampleFree(ps)
+
+Release the expression. Every line is kept afterwards.
+
+********************************************************************** */
+
+void SampleFree(TSample *ps)
+{
+  if (ps->bKey) regfree(&ps->reKey);
+  memset(ps,0,sizeof(*ps));
+}
+
+/* **********************************************************************
+
+SampleEnabled(ps)
+
+Return code: true, if lines are sampled.
+
+********************************************************************** */
+
+int SampleEnabled(const TSample *ps)
+{
+  return ps->ulModulus>1;
+}
+
+/* **********************************************************************
+
+SampleKeep(ps, szLine, cch)
+
+Decide about a line (NUL terminated). The final newline is not part of
+the hash.
+
+Return code: true, if the line is kept.
+
+********************************************************************** */
+
+int SampleKeep(TSample *ps, const char *szLine, int cch)
+{
+  const char *pch=szLine;
+  regmatch_t  amatch[2];
+  int         bKeep;
+  if (!SampleEnabled(ps)) return 1;
+  if (cch && szLine[cch-1]=='\n') cch--;
+  if (ps->bKey && !regexec(&ps->reKey,szLine,2,amatch,0))
+    {
+      int i=(amatch[1].rm_so>=0) ? 1 : 0;
+      pch=szLine+amatch[i].rm_so;
+      cch=amatch[i].rm_eo-amatch[i].rm_so;
+    }
+  bKeep=(HashBytes(pch,cch)%ps->ulModulus)==0;
+  if (bKeep)
+    ps->ulKept++;
+  else
+    ps->ulRejected++;
+  return bKeep;
+}
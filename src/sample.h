@@ -0,0 +1,44 @@
+/* ======================================================================
+
+sample.h
+
+Deterministic sampling of lines for the destinations of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A sampled destination gets 1 of N lines. The choice is made by a hash
+of the line, or of a key taken from the line by a regular expression
+(its first subexpression, or the whole match). The hash has no seed,
+so the same line (or key) is always chosen or always rejected: across
+restarts, replays and daemons. With a key, all lines of e.g. a user
+or a session stay together. A line without the key is hashed as a
+whole.
+
+   ====================================================================== */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <regex.h>
+
+typedef struct {
+  unsigned long   ulModulus;        /* N, 0 = every line */
+  int             bKey;             /* hash the key, not the line */
+  regex_t         reKey;
+  unsigned long   ulKept;           /* statistics */
+  unsigned long   ulRejected;
+} TSample;
+
+void  SampleInit(TSample *ps);
+int   SampleParse(TSample *ps, const char *szRate);
+int   SampleKey(TSample *ps, const char *szKey);
+void  SampleFree(TSample *ps);
+int   SampleEnabled(const TSample *ps);
+int   SampleKeep(TSample *ps, const char *szLine, int cch);
+
+#endif
@@ -0,0 +1,344 @@
+/* ======================================================================
+
+shmring.c
+
+Shared memory ring between tailfdx and a local consumer
+(transport="shm"), with the consumer side for liblogframe.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Every chunk in the data area starts with a TChunk header and is padded
+to 8 bytes. A chunk never wraps around the end of the data area: if it
+does not fit into the rest, a SHMRING_WRAP chunk fills the rest, and
+the chunk starts at the beginning.
+
+Head and tail only grow. The producer owns the head and the consumer
+owns the tail, both publish them with release semantics. The waiting
+flags follow the usual pattern: set the flag, check again, then sleep
+on the sequence number, which the other side increments before waking.
+
+   ====================================================================== */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  /* memfd_create() */
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shmring.h"
+
+typedef struct {
+  uint32_t        cch;              /* payload bytes */
+  uint32_t        ulFlags;
+} TChunk;
+
+#define SHMRING_MORE   1          /* the next chunk continues this one */
+#define SHMRING_WRAP   2          /* filler up to the end of the data */
+
+#define ALIGN8(n)      (((n)+7) & ~(uint64_t)7)
+
+/* **********************************************************************
+
+FutexWait(pul, ulValue, msTimeout) / FutexWake(pul)
+
+Sleep while *pul has the value (at most msTimeout ms, forever if <0),
+or wake the sleepers. The ring is shared between processes, so the
+futexes are not private.
+
+********************************************************************** */
+
+static void FutexWait(uint32_t *pul, uint32_t ulValue, long msTimeout)
+{
+  struct timespec ts,*pts=NULL;
+  if (msTimeout>=0)
+    {
+      ts.tv_sec=msTimeout/1000;
+      ts.tv_nsec=(msTimeout%1000)*1000000L;
+      pts=&ts;
+    }
+  syscall(SYS_futex,pul,FUTEX_WAIT,ulValue,pts,NULL,0);
+}
+
+static void FutexWake(uint32_t *pul)
+{
+  __atomic_add_fetch(pul,1,__ATOMIC_SEQ_CST);
+  syscall(SYS_futex,pul,FUTEX_WAKE,1,NULL,NULL,0);
+}
+
+/* **********************************************************************
+
+Map(hRing, cbData)
+
+Map control block and data area of a ring.
+
+Return code: The new ring handle, NULL on failure.
+
+********************************************************************** */
+
+static TShmRing *Map(int hRing, uint64_t cbData)
+{
+  TShmRing *pr=calloc(1,sizeof(TShmRing));
+  void     *pv;
+  if (!pr) return NULL;
+  pr->cbMap=SHMRING_CONTROL_SIZE+cbData;
+  pv=mmap(NULL,pr->cbMap,PROT_READ|PROT_WRITE,MAP_SHARED,hRing,0);
+  if (pv==MAP_FAILED)
+    {
+      free(pr);
+      return NULL;
+    }
+  pr->hRing=hRing;
+  pr->pctl=(TShmRingControl*)pv;
+  pr->pchData=(char*)pv+SHMRING_CONTROL_SIZE;
+  return pr;
+}
+
+/* **********************************************************************
+
+pr=ShmRingCreate(szName, cbSize)
+
+Producer: Create a ring with (about) cbSize bytes of data in a new
+memfd. The memfd is close-on-exec, the caller passes it on as the
+stdin of the consumer.
+
+Return code: The ring, NULL on failure (errno tells why).
+
+********************************************************************** */
+
+TShmRing *ShmRingCreate(const char *szName, long cbSize)
+{
+  TShmRing *pr;
+  int       hRing;
+  uint64_t  cbData;
+  if (cbSize<=0) cbSize=SHMRING_DEFAULT_SIZE;
+  cbData=ALIGN8((uint64_t)cbSize);
+  hRing=memfd_create(szName,MFD_CLOEXEC);
+  if (hRing<0) return NULL;
+  if (ftruncate(hRing,SHMRING_CONTROL_SIZE+cbData)<0
+      || !(pr=Map(hRing,cbData)))
+    {
+      int idError=errno;
+      close(hRing);
+      errno=idError;
+      return NULL;
+    }
+  pr->pctl->ullSize=cbData;
+  pr->pctl->ulVersion=SHMRING_VERSION;
+  __atomic_store_n(&pr->pctl->ulMagic,SHMRING_MAGIC,__ATOMIC_RELEASE);
+  return pr;
+}
+
+/* **********************************************************************
+
+cch=ShmRingWrite(pr, pch, cch, msTimeout)
+
+Producer: Append a chunk. If the ring is full, wait up to msTimeout ms
+for the consumer (forever if <0). Big chunks are written in pieces.
+
+Return code: The number of bytes written, which is less than cch after
+a timeout (like write() on a pipe).
+
+********************************************************************** */
+
+int ShmRingWrite(TShmRing *pr, const char *pch, int cch, long msTimeout)
+{
+  TShmRingControl *pctl=pr->pctl;
+  uint64_t ullSize=pctl->ullSize;
+  int      cchDone=0;
+  while (cchDone<cch)
+    {
+      uint64_t ullHead=pctl->ullHead;
+      uint64_t ullPos=ullHead%ullSize;
+      uint64_t cbRest=ullSize-ullPos;
+      int      cchPiece=cch-cchDone;
+      uint64_t cbNeed;
+      TChunk  *pchunk;
+      if ((uint64_t)cchPiece>ullSize/2-sizeof(TChunk))
+	cchPiece=(int)(ullSize/2-sizeof(TChunk));
+      cbNeed=ALIGN8(sizeof(TChunk)+cchPiece);
+      if (cbNeed>cbRest) cbNeed+=cbRest; /* wrap filler */
+      if (cbNeed>ullSize-(ullHead
+			  -__atomic_load_n(&pctl->ullTail,__ATOMIC_ACQUIRE)))
+	{
+	  uint32_t ulSeq=__atomic_load_n(&pctl->ulSpaceSeq,__ATOMIC_SEQ_CST);
+	  __atomic_store_n(&pctl->ulProducerWaiting,1,__ATOMIC_SEQ_CST);
+	  if (cbNeed>ullSize-(ullHead
+			      -__atomic_load_n(&pctl->ullTail,__ATOMIC_SEQ_CST)))
+	    {
+	      if (!msTimeout) break;
+	      FutexWait(&pctl->ulSpaceSeq,ulSeq,msTimeout);
+	      if (msTimeout>0 && cbNeed>ullSize-(ullHead
+			 -__atomic_load_n(&pctl->ullTail,__ATOMIC_SEQ_CST)))
+		break; /* timeout or signal */
+	    }
+	  continue;
+	}
+      if (ALIGN8(sizeof(TChunk)+cchPiece)>cbRest)
+	{
+	  pchunk=(TChunk*)(pr->pchData+ullPos);
+	  pchunk->cch=0;
+	  pchunk->ulFlags=SHMRING_WRAP;
+	  ullHead+=cbRest;
+	  ullPos=0;
+	}
+      pchunk=(TChunk*)(pr->pchData+ullPos);
+      pchunk->cch=cchPiece;
+      pchunk->ulFlags=(cchDone+cchPiece<cch) ? SHMRING_MORE : 0;
+      memcpy(pchunk+1,pch+cchDone,cchPiece);
+      ullHead+=ALIGN8(sizeof(TChunk)+cchPiece);
+      __atomic_store_n(&pctl->ullHead,ullHead,__ATOMIC_SEQ_CST);
+      cchDone+=cchPiece;
+      if (__atomic_exchange_n(&pctl->ulConsumerWaiting,0,__ATOMIC_SEQ_CST))
+	FutexWake(&pctl->ulDataSeq);
+    }
+  return cchDone;
+}
+
+/* **********************************************************************
+
+ShmRingClose(pr)
+
+Producer: Tell the consumer, that nothing will follow, and release the
+ring. The consumer still reads the rest.
+
+********************************************************************** */
+
+void ShmRingClose(TShmRing *pr)
+{
+  if (!pr) return;
+  __atomic_store_n(&pr->pctl->ulClosed,1,__ATOMIC_SEQ_CST);
+  FutexWake(&pr->pctl->ulDataSeq);
+  ShmRingDetach(pr);
+}
+
+/* **********************************************************************
+
+pr=ShmRingAttach(hRing)
+
+Consumer: Map the ring passed as hRing (normally 0, the stdin).
+The producer maps its rings this way again after an upgrade of
+tailfdx, ShmRingClose() works on them as usual.
+
+Return code: The ring, NULL if hRing is no ring (errno is EPROTO then)
+or cannot be mapped.
+
+********************************************************************** */
+
+TShmRing *ShmRingAttach(int hRing)
+{
+  struct stat st;
+  TShmRing   *pr;
+  if (fstat(hRing,&st)<0) return NULL;
+  if (!S_ISREG(st.st_mode) || st.st_size<=SHMRING_CONTROL_SIZE)
+    {
+      errno=EPROTO;
+      return NULL;
+    }
+  pr=Map(hRing,(uint64_t)st.st_size-SHMRING_CONTROL_SIZE);
+  if (!pr) return NULL;
+  if (__atomic_load_n(&pr->pctl->ulMagic,__ATOMIC_ACQUIRE)!=SHMRING_MAGIC
+      || pr->pctl->ullSize!=(uint64_t)st.st_size-SHMRING_CONTROL_SIZE)
+    {
+      ShmRingDetach(pr);
+      errno=EPROTO;
+      return NULL;
+    }
+  pr->ullNext=pr->pctl->ullTail;
+  return pr;
+}
+
+/* **********************************************************************
+
+cch=ShmRingNext(pr, &pch, &bMore, msTimeout)
+
+Consumer: Get the next chunk in place, waiting up to msTimeout ms for
+it (forever if <0). The chunk stays valid until ShmRingRelease().
+
+Return code: The number of bytes at pch (>0), 0 after a timeout, -1
+if the producer has closed the ring and everything has been read.
+
+********************************************************************** */
+
+int ShmRingNext(TShmRing *pr, const char **ppch, int *pbMore,
+		long msTimeout)
+{
+  TShmRingControl *pctl=pr->pctl;
+  uint64_t ullTail=pctl->ullTail;
+  for (;;)
+    {
+      TChunk *pchunk;
+      if (ullTail==__atomic_load_n(&pctl->ullHead,__ATOMIC_ACQUIRE))
+	{
+	  uint32_t ulSeq=__atomic_load_n(&pctl->ulDataSeq,__ATOMIC_SEQ_CST);
+	  if (__atomic_load_n(&pctl->ulClosed,__ATOMIC_SEQ_CST))
+	    return -1;
+	  __atomic_store_n(&pctl->ulConsumerWaiting,1,__ATOMIC_SEQ_CST);
+	  if (ullTail!=__atomic_load_n(&pctl->ullHead,__ATOMIC_SEQ_CST))
+	    continue;
+	  if (!msTimeout) return 0;
+	  FutexWait(&pctl->ulDataSeq,ulSeq,msTimeout);
+	  if (msTimeout>0
+	      && ullTail==__atomic_load_n(&pctl->ullHead,__ATOMIC_SEQ_CST)
+	      && !__atomic_load_n(&pctl->ulClosed,__ATOMIC_SEQ_CST))
+	    return 0;
+	  continue;
+	}
+      pchunk=(TChunk*)(pr->pchData+ullTail%pctl->ullSize);
+      if (pchunk->ulFlags & SHMRING_WRAP)
+	{
+	  /* skip the filler, nobody else needs it */
+	  ullTail+=pctl->ullSize-ullTail%pctl->ullSize;
+	  __atomic_store_n(&pctl->ullTail,ullTail,__ATOMIC_RELEASE);
+	  continue;
+	}
+      *ppch=(const char*)(pchunk+1);
+      if (pbMore) *pbMore=(pchunk->ulFlags & SHMRING_MORE)!=0;
+      pr->ullNext=ullTail+ALIGN8(sizeof(TChunk)+pchunk->cch);
+      return (int)pchunk->cch;
+    }
+}
+
+/* **********************************************************************
+
+ShmRingRelease(pr)
+
+Consumer: Give the chunk from ShmRingNext() back to the producer.
+
+********************************************************************** */
+
+void ShmRingRelease(TShmRing *pr)
+{
+  TShmRingControl *pctl=pr->pctl;
+  __atomic_store_n(&pctl->ullTail,pr->ullNext,__ATOMIC_SEQ_CST);
+  if (__atomic_exchange_n(&pctl->ulProducerWaiting,0,__ATOMIC_SEQ_CST))
+    FutexWake(&pctl->ulSpaceSeq);
+}
+
+/* **********************************************************************
+
+ShmRingDetach(pr)
+
+Unmap the ring and close its descriptor.
+
+********************************************************************** */
+
+void ShmRingDetach(TShmRing *pr)
+{
+  if (!pr) return;
+  munmap(pr->pctl,pr->cbMap);
+  close(pr->hRing);
+  free(pr);
+}
@@ -0,0 +1,80 @@
+/* ======================================================================
+
+shmring.h
+
+Shared memory ring between tailfdx and a local consumer
+(transport="shm"), with the consumer side for liblogframe.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The ring lives in a memfd, which the consumer gets as its stdin. The
+first page holds the control block, the data area follows. tailfdx
+appends chunks of complete lines (or frames, see logframe.h), each
+with a small header, and the consumer reads them in place:
+
+  TShmRing   *pr=ShmRingAttach(0);
+  const char *pch;
+  int         cch,bMore;
+  while ((cch=ShmRingNext(pr,&pch,&bMore,-1))>=0)
+    {
+      ... process cch bytes at pch ...
+      ShmRingRelease(pr);
+    }
+
+A chunk larger than half of the ring is split into pieces; bMore is
+set for every piece but the last one. The sides wake each other with
+futexes in the control block, only if the other side is waiting, so
+a busy ring costs no system calls at all.
+
+   ====================================================================== */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHMRING_MAGIC         0x52534c54 /* "TLSR" */
+#define SHMRING_VERSION       1
+#define SHMRING_CONTROL_SIZE  4096
+#define SHMRING_DEFAULT_SIZE  (4L<<20)
+
+typedef struct {
+  uint32_t        ulMagic;          /* SHMRING_MAGIC */
+  uint32_t        ulVersion;        /* SHMRING_VERSION */
+  uint64_t        ullSize;          /* bytes in the data area */
+  uint32_t        ulClosed;         /* the producer has gone */
+  char            achPad1[44];
+  uint64_t        ullHead;          /* bytes ever written (producer) */
+  uint32_t        ulDataSeq;        /* futex: data arrived */
+  uint32_t        ulConsumerWaiting;
+  char            achPad2[48];
+  uint64_t        ullTail;          /* bytes ever released (consumer) */
+  uint32_t        ulSpaceSeq;       /* futex: space freed */
+  uint32_t        ulProducerWaiting;
+} TShmRingControl;
+
+typedef struct {
+  int              hRing;           /* the memfd */
+  TShmRingControl *pctl;
+  char            *pchData;
+  size_t           cbMap;
+  uint64_t         ullNext;         /* consumer: tail after release */
+} TShmRing;
+
+TShmRing *ShmRingCreate(const char *szName, long cbSize);
+int       ShmRingWrite(TShmRing *pr, const char *pch, int cch,
+		       long msTimeout);
+void      ShmRingClose(TShmRing *pr);
+TShmRing *ShmRingAttach(int hRing);
+int       ShmRingNext(TShmRing *pr, const char **ppch, int *pbMore,
+		      long msTimeout);
+void      ShmRingRelease(TShmRing *pr);
+void      ShmRingDetach(TShmRing *pr);
+
+#endif
@@ -0,0 +1,531 @@
+/* ======================================================================
+
+sketch.c
+
+Heavy hitter and cardinality sketches for the counters of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The hash is the one of hash.h (FNV-1a with a final mix). The rows
+of the Count-Min sketch take their columns from both halves of it
+(h1+i*h2), the HyperLogLog takes the register from the top bits and
+the rank from the rest. Counters saturate instead of wrapping.
+
+A snapshot is
+
+  sketch NAME topk FIELDS DEPTH WIDTH CELLS COUNT KEY:EST,...
+  sketch NAME distinct FIELDS BITS REGISTERS
+
+with the cells (8 digits each), registers (2 digits each) and keys in
+hex, so a field may contain anything. The owner puts it into a line
+of its own.
+
+   ====================================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sketch.h"
+#include "hash.h"
+
+static const char achHex[]="0123456789abcdef";
+
+/* **********************************************************************
+
+SketchInit(ps, idKind, szSpec)
+
+Set up a sketch "name:regex" without memory, see SketchAllocate().
+The name must not contain blanks.
+
+Return code: 0 on success, -1 for a bad specification (or no memory).
+
+********************************************************************** */
+
+int SketchInit(TSketch *ps, int idKind, const char *szSpec)
+{
+  const char *pchColon=strchr(szSpec,':');
+  memset(ps,0,sizeof(*ps));
+  if (!pchColon || pchColon==szSpec
+      || memchr(szSpec,' ',pchColon-szSpec)
+      || memchr(szSpec,'\t',pchColon-szSpec))
+    return -1;
+  if (regcomp(&ps->re,pchColon+1,REG_EXTENDED|REG_NEWLINE))
+    return -1;
+  ps->szName=strndup(szSpec,pchColon-szSpec);
+  ps->szRegex=strdup(pchColon+1);
+  if (!ps->szName || !ps->szRegex)
+    {
+      free(ps->szName);
+      free(ps->szRegex);
+      regfree(&ps->re);
+      ps->szName=NULL;
+      return -1;
+    }
+  ps->idKind=idKind;
+  return 0;
+}
+
+/* **********************************************************************
+
+SketchAllocate(ps, cWidth, cDepth, cTop, cBits)
+
+Get the memory of the sketch, which does not grow afterwards. Sizes
+of 0 (or below) take the defaults. A top sketch needs the first
+three, a distinct sketch the last one.
+
+Return code: 0 on success, -1 for bad sizes or no memory.
+
+********************************************************************** */
+
+int SketchAllocate(TSketch *ps, int cWidth, int cDepth, int cTop,
+		   int cBits)
+{
+  if (ps->idKind==SKETCH_TOPK)
+    {
+      ps->cWidth=cWidth>0 ? cWidth : SKETCH_DEFAULT_WIDTH;
+      ps->cDepth=cDepth>0 ? cDepth : SKETCH_DEFAULT_DEPTH;
+      ps->cTop=cTop>0 ? cTop : SKETCH_DEFAULT_TOP;
+      if (ps->cDepth>16 || (long)ps->cWidth*ps->cDepth>(1L<<24))
+	return -1;
+      ps->aulCells=calloc((size_t)ps->cWidth*ps->cDepth,sizeof(uint32_t));
+      ps->atop=calloc(ps->cTop,sizeof(TSketchTop));
+      return ps->aulCells && ps->atop ? 0 : -1;
+    }
+  ps->cBits=cBits>0 ? cBits : SKETCH_DEFAULT_BITS;
+  if (ps->cBits<4 || ps->cBits>18)
+    return -1;
+  ps->abRegisters=calloc((size_t)1<<ps->cBits,1);
+  return ps->abRegisters ? 0 : -1;
+}
+
+/* **********************************************************************
+
+SketchFree(ps)
+
+Release the expression and the memory.
+
+********************************************************************** */
+
+void SketchFree(TSketch *ps)
+{
+  if (ps->szName)
+    {
+      free(ps->szName);
+      free(ps->szRegex);
+      regfree(&ps->re);
+    }
+  free(ps->aulCells);
+  free(ps->atop);
+  free(ps->abRegisters);
+  memset(ps,0,sizeof(*ps));
+}
+
+/* **********************************************************************
+
+SketchSame(ps1, ps2)
+
+Compare name, expression, kind and sizes.
+
+Return code: true, if both estimate the same.
+
+********************************************************************** */
+
+int SketchSame(const TSketch *ps1, const TSketch *ps2)
+{
+  return !strcmp(ps1->szName,ps2->szName)
+    && !strcmp(ps1->szRegex,ps2->szRegex) && ps1->idKind==ps2->idKind
+    && ps1->cWidth==ps2->cWidth && ps1->cDepth==ps2->cDepth
+    && ps1->cTop==ps2->cTop && ps1->cBits==ps2->cBits;
+}
+
+/* **********************************************************************
+
+ulCount=Estimate(ps, ullHash)
+
+Return code: The Count-Min estimate of a field, the least of its
+counters.
+
+********************************************************************** */
+
+static uint32_t Estimate(const TSketch *ps, uint64_t ullHash)
+{
+  uint32_t ulH1=(uint32_t)ullHash,ulH2=(uint32_t)(ullHash>>32)|1;
+  uint32_t ulMin=UINT32_MAX;
+  int      i;
+  for (i=0; i<ps->cDepth; i++)
+    {
+      uint32_t ul=ps->aulCells[(size_t)i*ps->cWidth
+			       +(ulH1+i*ulH2)%(uint32_t)ps->cWidth];
+      if (ul<ulMin) ulMin=ul;
+    }
+  return ulMin;
+}
+
+/* **********************************************************************
+
+Offer(ps, pch, cch, ulCount)
+
+Update a candidate of the top, or let the field replace the weakest
+one, if it has a higher estimate.
+
+********************************************************************** */
+
+static void Offer(TSketch *ps, const char *pch, int cch, uint32_t ulCount)
+{
+  TSketchTop *ptop,*ptopMin=NULL;
+  int         i;
+  for (i=0; i<ps->cTopUsed; i++)
+    {
+      ptop=ps->atop+i;
+      if (ptop->cchKey==cch && !memcmp(ptop->achKey,pch,cch))
+	{
+	  ptop->ulCount=ulCount;
+	  return;
+	}
+      if (!ptopMin || ptop->ulCount<ptopMin->ulCount)
+	ptopMin=ptop;
+    }
+  if (ps->cTopUsed<ps->cTop)
+    ptop=ps->atop+ps->cTopUsed++;
+  else if (ulCount>ptopMin->ulCount)
+    ptop=ptopMin;
+  else
+    return;
+  ptop->ulCount=ulCount;
+  ptop->cchKey=cch;
+  memcpy(ptop->achKey,pch,cch);
+}
+
+/* **********************************************************************
+
+Add(ps, pch, cch)
+
+Count a field.
+
+********************************************************************** */
+
+static void Add(TSketch *ps, const char *pch, int cch)
+{
+  uint64_t ullHash;
+  if (cch>SKETCH_MAX_KEY) cch=SKETCH_MAX_KEY;
+  ullHash=HashBytes(pch,cch);
+  ps->ulFields++;
+  if (ps->idKind==SKETCH_TOPK)
+    {
+      uint32_t ulH1=(uint32_t)ullHash,ulH2=(uint32_t)(ullHash>>32)|1;
+      int      i;
+      for (i=0; i<ps->cDepth; i++)
+	{
+	  uint32_t *pul=ps->aulCells+(size_t)i*ps->cWidth
+	    +(ulH1+i*ulH2)%(uint32_t)ps->cWidth;
+	  if (*pul<UINT32_MAX) (*pul)++;
+	}
+      Offer(ps,pch,cch,Estimate(ps,ullHash));
+    }
+  else
+    {
+      uint32_t iRegister=(uint32_t)(ullHash>>(64-ps->cBits));
+      uint64_t ullRest=ullHash<<ps->cBits;
+      uint8_t  bRank=ullRest ? __builtin_clzll(ullRest)+1 : 64-ps->cBits+1;
+      if (bRank>ps->abRegisters[iRegister])
+	ps->abRegisters[iRegister]=bRank;
+    }
+}
+
+/* **********************************************************************
+
+SketchFeed(ps, szLine)
+
+Take the field of a line (NUL terminated), if it has one.
+
+********************************************************************** */
+
+void SketchFeed(TSketch *ps, const char *szLine)
+{
+  regmatch_t amatch[2];
+  int        i;
+  if (regexec(&ps->re,szLine,2,amatch,0))
+    return;
+  i=(amatch[1].rm_so>=0) ? 1 : 0;
+  Add(ps,szLine+amatch[i].rm_so,amatch[i].rm_eo-amatch[i].rm_so);
+}
+
+/* **********************************************************************
+
+SketchReset(ps)
+
+Forget everything, for the next interval.
+
+********************************************************************** */
+
+void SketchReset(TSketch *ps)
+{
+  if (ps->aulCells)
+    memset(ps->aulCells,0,(size_t)ps->cWidth*ps->cDepth*sizeof(uint32_t));
+  if (ps->abRegisters)
+    memset(ps->abRegisters,0,(size_t)1<<ps->cBits);
+  ps->cTopUsed=0;
+  ps->ulFields=0;
+}
+
+/* **********************************************************************
+
+dCount=Distinct(ps)
+
+Return code: The HyperLogLog estimate, with the linear counting of the
+original paper for small numbers.
+
+********************************************************************** */
+
+static double Distinct(const TSketch *ps)
+{
+  int    m=1<<ps->cBits,i,cZeros=0;
+  double dSum=0,dEstimate;
+  for (i=0; i<m; i++)
+    {
+      dSum+=ldexp(1.0,-ps->abRegisters[i]);
+      if (!ps->abRegisters[i]) cZeros++;
+    }
+  dEstimate=0.7213/(1+1.079/m)*m*m/dSum;
+  if (dEstimate<=2.5*m && cZeros)
+    dEstimate=m*log((double)m/cZeros);
+  return dEstimate;
+}
+
+/* **********************************************************************
+
+CompareTop(pv1, pv2)
+
+qsort() helper, the highest estimate first.
+
+********************************************************************** */
+
+static int CompareTop(const void *pv1, const void *pv2)
+{
+  const TSketchTop *ptop1=pv1,*ptop2=pv2;
+  if (ptop1->ulCount!=ptop2->ulCount)
+    return ptop1->ulCount<ptop2->ulCount ? 1 : -1;
+  return 0;
+}
+
+/* **********************************************************************
+
+SketchFormat(ps, pch, cchMax)
+
+Write the result " name=field:count,..." (highest first) or
+" name=count" to pch. Blanks and commas in a field are shown as '_'.
+
+Return code: The length of the result (it is cut at cchMax-1).
+
+********************************************************************** */
+
+int SketchFormat(TSketch *ps, char *pch, int cchMax)
+{
+  int cch,i;
+  if (ps->idKind==SKETCH_DISTINCT)
+    {
+      cch=snprintf(pch,cchMax," %s=%.0f",ps->szName,Distinct(ps));
+      return cch<cchMax ? cch : cchMax-1;
+    }
+  qsort(ps->atop,ps->cTopUsed,sizeof(TSketchTop),CompareTop);
+  cch=snprintf(pch,cchMax," %s=",ps->szName);
+  for (i=0; i<ps->cTopUsed && cch<cchMax; i++)
+    {
+      const TSketchTop *ptop=ps->atop+i;
+      int               j;
+      if (i && cch<cchMax-1)
+	pch[cch++]=',';
+      for (j=0; j<ptop->cchKey && cch<cchMax-1; j++)
+	pch[cch++]=strchr(" \t,",ptop->achKey[j]) ? '_' : ptop->achKey[j];
+      if (cch<cchMax)
+	cch+=snprintf(pch+cch,cchMax-cch,":%lu",(unsigned long)ptop->ulCount);
+    }
+  if (cch>=cchMax) cch=cchMax-1;
+  pch[cch]='\0';
+  return cch;
+}
+
+/* **********************************************************************
+
+SketchFormatSize(ps)
+
+Return code: The buffer size needed for SketchFormat().
+
+********************************************************************** */
+
+int SketchFormatSize(const TSketch *ps)
+{
+  int cch=strlen(ps->szName)+32;
+  if (ps->idKind==SKETCH_TOPK)
+    return cch+ps->cTop*(SKETCH_MAX_KEY+22);
+  return cch;
+}
+
+/* **********************************************************************
+
+SketchSnapshotSize(ps)
+
+Return code: The buffer size needed for a snapshot.
+
+********************************************************************** */
+
+int SketchSnapshotSize(const TSketch *ps)
+{
+  int cch=strlen(ps->szName)+96;
+  if (ps->idKind==SKETCH_TOPK)
+    return cch+ps->cWidth*ps->cDepth*8+ps->cTop*(2*SKETCH_MAX_KEY+12);
+  return cch+(1<<ps->cBits)*2;
+}
+
+/* **********************************************************************
+
+SketchSnapshot(ps, pch, cchMax)
+
+Write the snapshot (see above) to pch, without a newline.
+
+Return code: Its length, or -1 if cchMax is below SketchSnapshotSize().
+
+********************************************************************** */
+
+int SketchSnapshot(const TSketch *ps, char *pch, int cchMax)
+{
+  char *pchNext=pch;
+  int   i,j;
+  if (cchMax<SketchSnapshotSize(ps))
+    return -1;
+  if (ps->idKind==SKETCH_DISTINCT)
+    {
+      pchNext+=sprintf(pchNext,"sketch %s distinct %lu %d ",ps->szName,
+		       ps->ulFields,ps->cBits);
+      for (i=0; i<1<<ps->cBits; i++)
+	{
+	  *pchNext++=achHex[ps->abRegisters[i]>>4];
+	  *pchNext++=achHex[ps->abRegisters[i]&15];
+	}
+      *pchNext='\0';
+      return pchNext-pch;
+    }
+  pchNext+=sprintf(pchNext,"sketch %s topk %lu %d %d ",ps->szName,
+		   ps->ulFields,ps->cDepth,ps->cWidth);
+  for (i=0; i<ps->cWidth*ps->cDepth; i++)
+    pchNext+=sprintf(pchNext,"%08lx",(unsigned long)ps->aulCells[i]);
+  pchNext+=sprintf(pchNext," %d ",ps->cTopUsed);
+  for (i=0; i<ps->cTopUsed; i++)
+    {
+      const TSketchTop *ptop=ps->atop+i;
+      if (i) *pchNext++=',';
+      for (j=0; j<ptop->cchKey; j++)
+	{
+	  *pchNext++=achHex[(unsigned char)ptop->achKey[j]>>4];
+	  *pchNext++=achHex[(unsigned char)ptop->achKey[j]&15];
+	}
+      pchNext+=sprintf(pchNext,":%lu",(unsigned long)ptop->ulCount);
+    }
+  *pchNext='\0';
+  return pchNext-pch;
+}
+
+/* **********************************************************************
+
+n=HexDigit(ch)
+
+Return code: The value of a hex digit, or -1.
+
+********************************************************************** */
+
+static int HexDigit(char ch)
+{
+  const char *pch=ch ? strchr(achHex,ch) : NULL;
+  return pch ? (int)(pch-achHex) : -1;
+}
+
+/* **********************************************************************
+
+SketchMerge(ps, szLine)
+
+Add the snapshot of a sketch with the same name, kind and size, found
+anywhere in the line (e.g. after a counter's timestamp and alias).
+The candidates of both tops are estimated again by the merged counts.
+
+Return code: 0 if merged, 1 if the line has no snapshot of it, -1 for
+a bad or different one (nothing is merged then).
+
+********************************************************************** */
+
+int SketchMerge(TSketch *ps, const char *szLine)
+{
+  const char   *pch=szLine;
+  int           cchName=strlen(ps->szName),cch=0,cDepth,cWidth,cBits,i;
+  unsigned long ulFields;
+  while ((pch=strstr(pch,"sketch ")))
+    {
+      pch+=7;
+      if (!strncmp(pch,ps->szName,cchName) && pch[cchName]==' ')
+	break;
+    }
+  if (!pch) return 1;
+  pch+=cchName+1;
+  if (ps->idKind==SKETCH_DISTINCT)
+    {
+      int m=1<<ps->cBits;
+      if (sscanf(pch,"distinct %lu %d %n",&ulFields,&cBits,&cch)!=2 || !cch
+	  || cBits!=ps->cBits || (int)strlen(pch+cch)<2*m)
+	return -1;
+      pch+=cch;
+      for (i=0; i<2*m; i++)
+	if (HexDigit(pch[i])<0) return -1;
+      for (i=0; i<m; i++,pch+=2)
+	{
+	  uint8_t b=HexDigit(pch[0])<<4|HexDigit(pch[1]);
+	  if (b>ps->abRegisters[i]) ps->abRegisters[i]=b;
+	}
+      ps->ulFields+=ulFields;
+      return 0;
+    }
+  if (sscanf(pch,"topk %lu %d %d %n",&ulFields,&cDepth,&cWidth,&cch)!=3
+      || !cch || cDepth!=ps->cDepth || cWidth!=ps->cWidth
+      || (long)strlen(pch+cch)<8L*cDepth*cWidth)
+    return -1;
+  pch+=cch;
+  for (i=0; i<8*cDepth*cWidth; i++)
+    if (HexDigit(pch[i])<0) return -1;
+  for (i=0; i<cDepth*cWidth; i++,pch+=8)
+    {
+      uint32_t ul=0;
+      int      j;
+      for (j=0; j<8; j++)
+	ul=ul<<4|HexDigit(pch[j]);
+      ps->aulCells[i]=ps->aulCells[i]>UINT32_MAX-ul
+	? UINT32_MAX : ps->aulCells[i]+ul;
+    }
+  ps->ulFields+=ulFields;
+  for (i=0; i<ps->cTopUsed; i++)
+    ps->atop[i].ulCount=Estimate(ps,HashBytes(ps->atop[i].achKey,
+					      ps->atop[i].cchKey));
+  if (sscanf(pch," %d %n",&i,&cch)!=1 || !cch)
+    return 0; /* no candidates */
+  pch+=cch;
+  while (HexDigit(*pch)>=0)
+    {
+      char achKey[SKETCH_MAX_KEY];
+      int  cchKey=0;
+      while (HexDigit(pch[0])>=0 && HexDigit(pch[1])>=0)
+	{
+	  if (cchKey<SKETCH_MAX_KEY)
+	    achKey[cchKey++]=HexDigit(pch[0])<<4|HexDigit(pch[1]);
+	  pch+=2;
+	}
+      Offer(ps,achKey,cchKey,Estimate(ps,HashBytes(achKey,cchKey)));
+      pch=strchr(pch,',');
+      if (!pch) break;
+      pch++;
+    }
+  return 0;
+}
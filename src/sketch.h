@@ -0,0 +1,82 @@
+/* ======================================================================
+
+sketch.h
+
+Heavy hitter and cardinality sketches for the counters of tailfdx.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+A sketch takes a field of every line, extracted by an extended
+regular expression (its first subexpression, or the whole match), and
+estimates in fixed memory, whatever the number of different fields:
+
+  SKETCH_TOPK      the most frequent fields with their counts, by a
+		   Count-Min sketch (cDepth rows of cWidth counters)
+		   and the cTop candidates with the highest estimates
+  SKETCH_DISTINCT  the number of different fields, by a HyperLogLog
+		   of 2^cBits registers (about 1.04/sqrt(2^cBits)
+		   standard error, 1.6% for 12 bits)
+
+Sketches of the same kind and size can be merged, e.g. those of the
+same field on several hosts: A snapshot is one line of text, which
+SketchMerge() adds into another sketch. The counts of a Count-Min
+sketch are summed, the registers of a HyperLogLog take the maximum.
+
+   ====================================================================== */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+#include <regex.h>
+
+#define SKETCH_TOPK            1
+#define SKETCH_DISTINCT        2
+
+#define SKETCH_DEFAULT_WIDTH   2048
+#define SKETCH_DEFAULT_DEPTH   4
+#define SKETCH_DEFAULT_TOP     10
+#define SKETCH_DEFAULT_BITS    12
+#define SKETCH_MAX_KEY         64   /* bytes of a field, the rest is cut */
+
+typedef struct {
+  uint32_t        ulCount;          /* estimate */
+  int             cchKey;
+  char            achKey[SKETCH_MAX_KEY];
+} TSketchTop;
+
+typedef struct {
+  char           *szName;
+  int             idKind;           /* SKETCH_TOPK or SKETCH_DISTINCT */
+  char           *szRegex;          /* the text of re */
+  regex_t         re;               /* extracts the field */
+  int             cWidth;           /* SKETCH_TOPK */
+  int             cDepth;
+  uint32_t       *aulCells;         /* cDepth rows of cWidth counters */
+  int             cTop;
+  int             cTopUsed;
+  TSketchTop     *atop;             /* the candidates */
+  int             cBits;            /* SKETCH_DISTINCT */
+  uint8_t        *abRegisters;      /* 2^cBits of them */
+  unsigned long   ulFields;         /* fields taken */
+} TSketch;
+
+int   SketchInit(TSketch *ps, int idKind, const char *szSpec);
+int   SketchAllocate(TSketch *ps, int cWidth, int cDepth, int cTop,
+		     int cBits);
+void  SketchFree(TSketch *ps);
+int   SketchSame(const TSketch *ps1, const TSketch *ps2);
+void  SketchFeed(TSketch *ps, const char *szLine);
+void  SketchReset(TSketch *ps);
+int   SketchFormat(TSketch *ps, char *pch, int cchMax);
+int   SketchFormatSize(const TSketch *ps);
+int   SketchSnapshotSize(const TSketch *ps);
+int   SketchSnapshot(const TSketch *ps, char *pch, int cchMax);
+int   SketchMerge(TSketch *ps, const char *szLine);
+
+#endif
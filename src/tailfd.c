@@ -60,9 +60,17 @@ Panic() makes any sense instead.
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <poll.h>
 #include <signal.h>
 #include <syslog.h>
 
+#include "childspawn.h"
+#include "linebatch.h"
+#include "follow.h"
+#include "linearena.h"
+#include "replay.h"
+#include "logindex.h"
+
 /* ====================================================================== */
 
 #define REVISION "Revision: 1.5 $"
@@ -78,6 +86,21 @@ Panic() makes any sense instead.
 "\n"\
 "\n\t-p <file> : use <file> as PID file"\
 "\n\t-s <file> : use <file> as NVRAM"\
+"\n\t-S : always start the slave through /bin/sh"\
+"\n\t-b <bytes> : batch up to <bytes> before writing"\
+"\n\t-l <lines> : batch up to <lines> before writing"\
+"\n\t-w <ms> : write batched lines after <ms> at the latest"\
+"\n\t-m <bytes> : cut lines longer than <bytes> (default 1 MB)"\
+"\n\t-I <kbytes> : index FILE every <kbytes> in FILE.<inode>.idx"\
+"\n\t-A <time> : start at <time>, if there is no checkpoint"\
+"\n\t-n <lines> : start <lines> before the end, if there is no checkpoint"\
+"\n"\
+"\n\t-F <from> : replay from the offset or time <from>, then exit"\
+"\n\t-T <to> : replay up to the offset or time <to>, then exit"\
+"\n\t-R : replay the rotated FILE.N ... FILE.1 before FILE, then exit"\
+"\n\t-j <jobs> : replay in chunks by <jobs> slaves at a time"\
+"\n\t-k <bytes> : replay chunks of <bytes> (default 64 MB)"\
+"\n\nSIGUSR1 logs statistics."\
 "\n\n"
 
 #define DEBUG_CONFIG     0x0001
@@ -109,6 +132,20 @@ typedef enum { false, true } TBool;
 static unsigned long      ulDebugMask;
 static TBool              bVerbose=true;
 static TBool              bDaemonMode=true;
+static int                nShellMode=SPAWN_SHELL_AUTO;
+static int                cchBatchMaxBytes;
+static int                cBatchMaxLines;
+static long               msBatchMaxDelay;
+static int                cchMaxLine;
+static char *             szReplayFrom;        /* replay bounds */
+static char *             szReplayTo;
+static TBool              bReplayRotated;
+static int                cBackfillJobs;       /* parallel replay */
+static long               cchBackfillChunk;
+static long               cchIndexInterval;    /* sparse index, 0 = none */
+static char *             szStartAt;           /* start time, if new */
+static time_t             tiStartAt;
+static long               cStartLines=-1;      /* lines before the end */
 
 /* from configuration file */
 static char *             szStatusFile;
@@ -120,17 +157,36 @@ static char *             szChildCommand;      /* name for the slave/child */
 static volatile TBool     bAbortRequest = false;
 static volatile TBool     bHUPRequest   = false;
 static volatile TBool     bPipeDied     = false;
+static volatile TBool     bStatsRequest = false;
 
 /* some states */
 static TBool              bKeepPidFile  = false;
 static TBool              bWriteStatus  = false;
+static TBool              bNoCheckpoint = false; /* for -A and -n */
 static int                hMonitoredFile;  /* the watched file's handle */
 static TFilepos           lReadPosition;   /* current reading position */
-static FILE              *fhChild;         /* pipe FHandle of the child */
-static int                hChild;          /* file descriptor thereof */
+static pid_t              idChild=ID_NOPROCESS; /* pid of the child */
+static int                hChild=ID_NOFILE;     /* pipe to the child */
 
-#define                   LOG_BUFFER_SIZE 8192
+#define                   LOG_BUFFER_SIZE FOLLOW_CATCHUP_READ
 static char               achLogBuffer[LOG_BUFFER_SIZE];
+static TLineBatch         batchChild;      /* lines not yet written */
+static long               lBatchRaw;       /* input bytes of the batch */
+static TLineArena         arenaLines;      /* lines spanning two reads */
+static int                hWatch=ID_NOFILE; /* change notification */
+static TReplay            replay;          /* range and files of -F/-T/-R */
+static long long          llReplayOffset;  /* of the next line replayed */
+static char *             szBackfillFile;  /* chunks done in a backfill */
+static TLogIndex          indexFile={ .hIndex=-1 }; /* of the followed file */
+static long long          llIndexOffset;   /* of the next line indexed */
+
+/* statistics */
+static TFollowMode        idFollowMode=FOLLOW_LIVE;
+static time_t             tiModeSince;
+static unsigned long      ulModeSwitches;
+static unsigned long      ulWrites;
+static long long          llBytesRead;
+static long long          llLastGap;
 
 /* **********************************************************************
 
@@ -276,6 +332,9 @@ static void CatchAbortRequest(int idSignal, siginfo_t * psi, void * pDummy2)
     case SIGHUP:
       bHUPRequest=true;
       break;
+    case SIGUSR1:
+      bStatsRequest=true;
+      break;
     default:
       Panic(PANIC_INTERNAL,"illegal signal %d caught",idSignal);
     }
@@ -286,7 +345,7 @@ static void CatchAbortRequest(int idSignal, siginfo_t * psi, void * pDummy2)
 
 SetSignalHandler(bSet)
 
-Install or deinstall the signal handler for HUP, INT, TERM.
+Install or deinstall the signal handler for HUP, INT, TERM, USR1.
 
 ********************************************************************** */
 
@@ -305,6 +364,7 @@ static void SetSignalHandler(TBool bSetit)
       sigaction(SIGINT,  &sigCatcher, NULL);
       sigaction(SIGTERM, &sigCatcher, NULL);
       sigaction(SIGPIPE, &sigCatcher, NULL);
+      sigaction(SIGUSR1, &sigCatcher, NULL);
     }
 }
 
@@ -377,6 +437,7 @@ static int ReadStatusFile(void)
       if (bVerbose)
 	lprintf("file %s not found, using defaults.",szStatusFile);
       lReadPosition=0;
+      bNoCheckpoint=true;
       return -1;
     }
   while (!feof(fh))
@@ -411,12 +472,15 @@ Return code: Always 0.
 
 static int ShutdownDestination()
 {
-  if (fhChild) /* standard descriptors are ok */
+  if (hChild>=0) /* standard descriptors are ok */
     {
       dprintf(DEBUG_PIPES,"closing child fd\n");
-      pclose(fhChild);
+      close(hChild);
+      if (idChild>0)
+	waitpid(idChild,NULL,0); /* may be reaped by SIGCHLD already */
     }
-  fhChild=NULL;
+  hChild=ID_NOFILE;
+  idChild=ID_NOPROCESS;
   dprintf(DEBUG_PIPES,"shutdown complete\n");
   return 0;
 }
@@ -465,10 +529,15 @@ static int RestartDestination(void)
 
   /* not output file juggling, no nothing. */
   bPipeDied=false;
-  fhChild=popen(szChildCommand,"w");
-  if (!fhChild)
-    Panic(PANIC_RUN,"cannot popen destination pipe (%m)");
-  hChild=fileno(fhChild); /* cache the fd */
+  {
+    int hRead;
+    if (SpawnPipe(&hRead,&hChild)<0)
+      Panic(PANIC_RUN,"cannot create destination pipe (%m)");
+    idChild=SpawnCommand(szChildCommand,nShellMode,hRead,ID_NOFILE);
+    close(hRead); /* read direction not needed */
+  }
+  if (idChild<0)
+    Panic(PANIC_RUN,"cannot start destination \"%s\" (%m)",szChildCommand);
   return 0;
 }
 
@@ -494,7 +563,7 @@ Return code: 0 on success, -1 otherwise
 static int WriteToDestination(const char *pchBuffer, int cch)
 {
   int   cchWritten;
-  if (!fhChild) return 0;      /* inactive Pipe handle */
+  if (hChild<0) return 0;      /* inactive Pipe handle */
   if (bPipeDied) return -1;
   dprintf(DEBUG_PIPES,"outputting content: %d byte(s)\n",cch);
   do {
@@ -502,6 +571,8 @@ static int WriteToDestination(const char *pchBuffer, int cch)
     cchWritten = write(hChild,pchBuffer, cch); /* unbuffered */
     // perror("debug:");
     if (errno==EPIPE) bPipeDied=1; /* won't happen, even the shell will catch it */
+    if (cchWritten<0 && errno==EINTR && !bPipeDied)
+      cchWritten=0; /* interrupted by a signal, try again */
     dprintf(DEBUG_PIPES,"%d from %d byte(s) written (errno=%d)\n",
 	    cchWritten,cch,errno);
     if (cchWritten>0)
@@ -534,14 +605,16 @@ static int ReadFromFile(int fdFile, char *pchTo, int cchMax)
 
 /* **********************************************************************
 
-WriteRestartable(pchBuffer,cch)
+WriteRestartable(pchBuffer,cch,cchRaw)
 
 Write to destination and restart it if neccessary.
-Panics on error.
+Panics on error. The reading position advances by cchRaw, the number
+of bytes in the file, which differs for cut lines.
 
 ********************************************************************** */
 
-static void WriteRestartable(const char *achLogBuffer, int cchBuffer)
+static void WriteRestartable(const char *achLogBuffer, int cchBuffer,
+			     long cchRaw)
 {
   /*
    * do exact 2 attempts to flush the buffer
@@ -549,6 +622,8 @@ static void WriteRestartable(const char *achLogBuffer, int cchBuffer)
   if (WriteToDestination(achLogBuffer,cchBuffer))
     {
       int bFailed=1;
+      if (szBackfillFile) /* a restart would repeat a part of the chunk */
+	Panic(PANIC_RUN,"slave failed, the chunk is left for a resume");
       if (!RestartDestination())
 	{
 	  if (!WriteToDestination(achLogBuffer,cchBuffer))
@@ -561,28 +636,215 @@ static void WriteRestartable(const char *achLogBuffer, int cchBuffer)
       if (bFailed)
 	Panic(PANIC_RUN,"destination failed twice, aborting...");
     }
+  lReadPosition+=cchRaw; /* delivered */
+  ulWrites++;
+}
+
+/* **********************************************************************
+
+FlushBatch()
+
+Write the pending batch, if there is one.
+
+********************************************************************** */
+
+static void FlushBatch(void)
+{
+  if (!batchChild.cchBuffer) return;
+  dprintf(DEBUG_BUFFER,"flushing %d line(s)\n",batchChild.cLines);
+  WriteRestartable(batchChild.pchBuffer,batchChild.cchBuffer,lBatchRaw);
+  LineBatchClear(&batchChild);
+  lBatchRaw=0;
+}
+
+/* **********************************************************************
+
+QueueLines(pchBuffer,cch,cchRaw)
+
+Hand complete lines to the destination. Without batch bounds they are
+written at once, otherwise they are collected line by line until a
+bound is hit. This is the sink of LineArenaFeed(): cchRaw only differs
+from cch for a single cut line.
+
+********************************************************************** */
+
+static void QueueLines(const char *pchBuffer, int cch, long cchRaw)
+{
+  TBool bCut=(cchRaw!=cch);
+  if (!LineBatchEnabled(&batchChild))
+    {
+      WriteRestartable(pchBuffer,cch,cchRaw);
+      return;
+    }
+  while (cch>0)
+    {
+      const char *pchNL=memchr(pchBuffer,'\n',cch);
+      int cchLine=pchNL ? pchNL-pchBuffer+1 : cch;
+      long cchLineRaw=bCut ? cchRaw : cchLine;
+      if (!LineBatchFits(&batchChild,cchLine))
+	FlushBatch();
+      if (!LineBatchFits(&batchChild,cchLine))
+	WriteRestartable(pchBuffer,cchLine,cchLineRaw); /* longer than any batch */
+      else
+	{
+	  lBatchRaw+=cchLineRaw;
+	  if (LineBatchAppend(&batchChild,pchBuffer,cchLine))
+	    FlushBatch();
+	}
+      pchBuffer+=cchLine;
+      cch-=cchLine;
+    }
+}
+
+/* **********************************************************************
+
+IndexLines(pchBuffer,cch,cchRaw)
+
+The sink of LineArenaFeed() while following with an index: pass the
+lines to LogIndexLine() with their offsets, then to QueueLines(). If
+the index cannot be written, it is given up, following goes on.
+
+********************************************************************** */
+
+static void IndexLines(const char *pchBuffer, int cch, long cchRaw)
+{
+  const char *pch=pchBuffer;
+  int         cchLeft=cch;
+  while (cchLeft>0 && indexFile.hIndex>=0)
+    {
+      const char *pchNL=memchr(pch,'\n',cchLeft);
+      int cchLine=pchNL ? pchNL-pch+1 : cchLeft;
+      if (LogIndexLine(&indexFile,pch,cchLine,llIndexOffset)<0)
+	lprintf("cannot write index of \"%s\", giving it up (%m)",
+		szMonitoredFile);
+      llIndexOffset+=(cchRaw!=cch) ? cchRaw : cchLine;
+      pch+=cchLine;
+      cchLeft-=cchLine;
+    }
+  QueueLines(pchBuffer,cch,cchRaw);
+}
+
+/* **********************************************************************
+
+OpenIndex()
+
+Open the index of the followed file at the read position, if there
+is to be one.
+
+********************************************************************** */
+
+static void OpenIndex(void)
+{
+  if (cchIndexInterval<=0) return;
+  llIndexOffset=lReadPosition;
+  if (LogIndexOpen(&indexFile,szMonitoredFile,hMonitoredFile,
+		   cchIndexInterval*1024,llIndexOffset)<0)
+    lprintf("cannot open index of \"%s\", going on without (%m)",
+	    szMonitoredFile);
+}
+
+/* **********************************************************************
+
+SwitchMode(idMode)
+
+Change between live and catch-up mode.
+
+********************************************************************** */
+
+static void SwitchMode(TFollowMode idMode)
+{
+  if (idMode==idFollowMode) return;
+  if (bVerbose)
+    lprintf("switching to %s mode, " PRINTF_LD64 " byte(s) behind",
+	    FollowModeName(idMode),(TFilepos)llLastGap);
+  idFollowMode=idMode;
+  tiModeSince=time(NULL);
+  ulModeSwitches++;
 }
 
 /* **********************************************************************
 
-i=SearchNewLine(achBuffer,cch)
+DumpStatistics()
 
-returns first index of a NL in a buffer.
-returns -1 if there is no NL
+Log the counters, on request by SIGUSR1.
 
 ********************************************************************** */
 
-static int SearchNewLine(const char *pchBuffer, int cch)
+static void DumpStatistics(void)
 {
-  int i,iLast;
-  iLast=-1;
-  for (i=0; i<cch; i++)
-    if (pchBuffer[i]=='\n')
-      iLast=i;
-  return iLast;
+  bStatsRequest=false;
+  lprintf("statistics: mode=%s for %lds, switches=%lu, writes=%lu, "
+	  "bytes=%lld, position=" PRINTF_LD64 ", gap=%lld, pending=%d, "
+	  "truncated=%lu",
+	  FollowModeName(idFollowMode),(long)(time(NULL)-tiModeSince),
+	  ulModeSwitches,ulWrites,llBytesRead,lReadPosition,llLastGap,
+	  batchChild.cLines,arenaLines.ulTruncated);
+  if (indexFile.hIndex>=0)
+    lprintf("statistics: index records=%lu, lines=%lld",
+	    indexFile.ulRecords,indexFile.llLines);
 }
 
+/* **********************************************************************
+
+WaitForInput(ms)
 
+Sleep for ms milliseconds, while there is nothing to read, or until
+the monitored file changes. A batch getting due in the meantime is
+flushed in time.
+
+********************************************************************** */
+
+static void WaitForInput(long msTotal)
+{
+  while (msTotal>0 && !bAbortRequest && !bHUPRequest)
+    {
+      TBool bChanged=false;
+      long ms=LineBatchMsLeft(&batchChild);
+      if (ms<0 || ms>msTotal) ms=msTotal;
+      if (ms>0)
+	bChanged=FollowWait(hWatch,ms); /* interrupted by signals */
+      msTotal-=ms;
+      if (!LineBatchMsLeft(&batchChild))
+	FlushBatch();
+      if (bStatsRequest) DumpStatistics();
+      if (bChanged) break;
+    }
+}
+
+/* **********************************************************************
+
+StartWithoutCheckpoint()
+
+Set the read position of the file without a checkpoint by -A to the first
+line at the time (see ReplaySeekTime()), or by -n to the last lines
+(see ReplaySeekLines()). On failure it stays at the start.
+
+********************************************************************** */
+
+static void StartWithoutCheckpoint(void)
+{
+  long long   ll;
+  struct stat statFD;
+  if (tiStartAt)
+    {
+      long long llLow=0;
+      if (fstat(hMonitoredFile,&statFD)<0
+	  || LogIndexFind(szMonitoredFile,statFD.st_ino,tiStartAt,&llLow)<0)
+	llLow=0;
+      ll=ReplaySeekTime(hMonitoredFile,llLow,tiStartAt);
+    }
+  else
+    ll=ReplaySeekLines(hMonitoredFile,cStartLines);
+  if (ll<0)
+    {
+      lprintf("cannot search \"%s\" for the start, starting at 0 (%m)",
+	      szMonitoredFile);
+      return;
+    }
+  lReadPosition=(TFilepos)ll;
+  if (bVerbose)
+    lprintf("no checkpoint, starting at " PRINTF_LD64 "",lReadPosition);
+}
 
 /* **********************************************************************
 
@@ -590,6 +852,13 @@ MonitorFile()
 
 Seek to the last position of the open file and watch it changing :-)
 
+The read size and the checkpoint interval follow the mode (see
+follow.h). In catch-up mode the status file is written every
+FOLLOW_CATCHUP_STATUS seconds instead of every 3 seconds.
+
+Complete lines go out straight from the read buffer, only a line
+spanning two reads is collected in the arena (see linearena.h).
+
 ********************************************************************** */
 
 static void MonitorFile(void)
@@ -599,7 +868,6 @@ static void MonitorFile(void)
   ino_t       iNode;          /* inode of open file */
   struct stat statFD;
   time_t      tiLastUpdate;
-  int         iEOB; /* end of buffer AFTER last character */
 
   /*
     since lseek allows for seeking beyond EOF, we have do to the bounds
@@ -615,56 +883,72 @@ static void MonitorFile(void)
       if (bVerbose)
 	lprintf("file size<lastpos, restarting at beginning");
       lReadPosition=lseek(hMonitoredFile, 0, SEEK_SET);
+      bNoCheckpoint=true;
     }
-  else if (lseek(hMonitoredFile, lReadPosition, SEEK_SET)!=lReadPosition)
+  if (bNoCheckpoint && (tiStartAt || cStartLines>=0))
+    StartWithoutCheckpoint();
+  bNoCheckpoint=false;
+  if (lseek(hMonitoredFile, lReadPosition, SEEK_SET)!=lReadPosition)
     Panic(PANIC_RUN,"cannot seek to " PRINTF_LD64 ,lReadPosition);
   bWriteStatus=true;
   tiLastUpdate=time(NULL);
   cLoops=0;
-  iEOB=0;
+  lFileIndex=lReadPosition; /* end of the data read */
+  LineArenaClear(&arenaLines);
+  OpenIndex();
+  hWatch=FollowWatch(szMonitoredFile);
+  tiModeSince=time(NULL);
+  llLastGap=statFD.st_size-lReadPosition;
+  SwitchMode(FollowMode(idFollowMode,llLastGap));
 
   while (!bAbortRequest && !bHUPRequest)
     {
-      int cchRead;
+      int cchRead,cchWanted;
+      if (bStatsRequest) DumpStatistics();
       /* update Status file every 3 seconds, if anything happened */
-      if (lPosWritten!=lReadPosition && tiLastUpdate+3 < time(NULL))
+      if (lPosWritten!=lReadPosition
+	  && tiLastUpdate+(idFollowMode==FOLLOW_CATCHUP
+			   ? FOLLOW_CATCHUP_STATUS : 3) < time(NULL))
 	{
 	  WriteStatusFile();
+	  lPosWritten=lReadPosition;
 	  tiLastUpdate=time(NULL);
 	}
       /*
        * fill the buffer to the maximum
        */
-      cchRead=ReadFromFile(hMonitoredFile,achLogBuffer+iEOB,LOG_BUFFER_SIZE-iEOB); /* non blocking */
+      cchWanted=(idFollowMode==FOLLOW_CATCHUP)
+	? LOG_BUFFER_SIZE : FOLLOW_LIVE_READ;
+      cchRead=ReadFromFile(hMonitoredFile,achLogBuffer,cchWanted); /* non blocking */
       /* dprintf(DEBUG_BUFFER,"i=%d, ch=<%c>\n",i,achLine[i]); */
       cLoops++;
       if (cchRead>0) /* if there is something new */
 	{
-	  iEOB+=cchRead;
-	  int iNL;
-	  while (
-		 !bAbortRequest
-		 &&
-		 ((iNL=SearchNewLine(achLogBuffer,iEOB))>=0 || iEOB==LOG_BUFFER_SIZE)
-		 )
+	  lFileIndex+=cchRead;
+	  llBytesRead+=cchRead;
+	  /* a full block may mean, that we are far behind */
+	  if (cchRead==cchWanted || idFollowMode==FOLLOW_CATCHUP)
 	    {
-	      int i;
-	      if (iNL<0) iNL=iEOB-1; /* if no NL and full buffer, flush whole buffer */
-	      WriteRestartable(achLogBuffer,iNL+1);
-	      /* delete the line(s) */
-	      for (i=0; i<iEOB-iNL-1; i++)
-		achLogBuffer[i]=achLogBuffer[i+iNL+1]; /* or just memmove()? */
-	      iEOB-=iNL+1;
+	      if (fstat(hMonitoredFile,&statFD)==0)
+		{
+		  llLastGap=statFD.st_size-lFileIndex;
+		  SwitchMode(FollowMode(idFollowMode,llLastGap));
+		}
 	    }
+	  LogIndexTick(&indexFile);
+	  if (LineArenaFeed(&arenaLines,achLogBuffer,cchRead,
+			    indexFile.hIndex>=0 ? IndexLines : QueueLines)<0)
+	    Panic(PANIC_RUN,"out of memory for line buffer");
+	  if (!LineBatchMsLeft(&batchChild))
+	    FlushBatch();
 	}
       else /* nothing in read buffer */
 	{
 	  int   cRetries;
+	  llLastGap=0;
+	  SwitchMode(FOLLOW_LIVE);
 	  /* wait ONE second, but check abort/HUP */
-	  for (cRetries=0;
-	       cRetries>=0 && !bAbortRequest && !bHUPRequest;
-	       cRetries--)
-	      sleep(1);
+	  WaitForInput(1000);
 	  if (bHUPRequest || bAbortRequest) break; /* break whole master loop */
 	  /* BEGIN: hup-rollover-block */
 	  {
@@ -692,12 +976,28 @@ static void MonitorFile(void)
 	      }
 	    if (bReopen)
 	      {
+		if (LineArenaOpen(&arenaLines)) /* the last line, unterminated */
+		  {
+		    int         cchLine;
+		    long        cchRaw;
+		    const char *pchLine;
+		    pchLine=LineArenaClose(&arenaLines,&cchLine,&cchRaw);
+		    if (!pchLine)
+		      Panic(PANIC_RUN,"out of memory for line buffer");
+		    QueueLines(pchLine,cchLine,cchRaw);
+		    LineArenaClear(&arenaLines);
+		  }
+		FlushBatch(); /* nothing may refer to the old file */
 		close(hMonitoredFile);
-		hMonitoredFile=open(szMonitoredFile,O_RDONLY);
+		hMonitoredFile=open(szMonitoredFile,O_RDONLY|O_CLOEXEC);
 		if (hMonitoredFile<0)
 		  Panic(PANIC_RUN,"cannot open continuation log \"%s\"",
 			szMonitoredFile);
-		lReadPosition=0; /* update line status */
+		FollowUnwatch(hWatch);
+		hWatch=FollowWatch(szMonitoredFile);
+		lFileIndex=lReadPosition=0; /* update line status */
+		LogIndexClose(&indexFile);
+		OpenIndex();
 	      }
 	  }  /* END: hup-rollover-block */
 	} /* if "nothing in buffer" */
@@ -709,8 +1009,357 @@ static void MonitorFile(void)
   if (!bAbortRequest && !bHUPRequest)
     Panic(PANIC_INTERNAL,"internal error: line buffer overflowed");
 
+  FlushBatch();
   WriteStatusFile();
   bWriteStatus=false;
+  LogIndexClose(&indexFile);
+  FollowUnwatch(hWatch);
+  hWatch=ID_NOFILE;
+}
+
+/* **********************************************************************
+
+ReplayLines(pchBuffer,cch,cchRaw)
+
+The sink of LineArenaFeed() in a replay: the lines in the range go on
+to QueueLines(), the others are dropped.
+
+********************************************************************** */
+
+static void ReplayLines(const char *pchBuffer, int cch, long cchRaw)
+{
+  TBool       bCut=(cchRaw!=cch);
+  const char *pchRun=pchBuffer;
+  int         cchRun=0;
+  long        cchRunRaw=0;
+  while (cch>0)
+    {
+      const char *pchNL=memchr(pchBuffer,'\n',cch);
+      int cchLine=pchNL ? pchNL-pchBuffer+1 : cch;
+      long cchLineRaw=bCut ? cchRaw : cchLine;
+      if (ReplayCheck(&replay,pchBuffer,cchLine,llReplayOffset)==REPLAY_PASS)
+	{
+	  if (!cchRun) pchRun=pchBuffer;
+	  cchRun+=cchLine;
+	  cchRunRaw+=cchLineRaw;
+	}
+      else if (cchRun)
+	{
+	  QueueLines(pchRun,cchRun,cchRunRaw);
+	  cchRun=0;
+	  cchRunRaw=0;
+	}
+      llReplayOffset+=cchLineRaw;
+      pchBuffer+=cchLine;
+      cch-=cchLine;
+    }
+  if (cchRun)
+    QueueLines(pchRun,cchRun,cchRunRaw);
+}
+
+/* **********************************************************************
+
+ReplayRange()
+
+Read the files of the replay with big blocks, from the start of the
+range to its end or the end of the last file, and deliver the lines
+in the range. There is no status file in a replay, so the checkpoint
+of the daemon stays as it is.
+
+********************************************************************** */
+
+static void ReplayRange(void)
+{
+  int h;
+  while (!bAbortRequest && (h=ReplayOpen(&replay))>=0)
+    {
+      int cchRead=0;
+      llReplayOffset=replay.llBase+replay.lStart;
+      LineArenaClear(&arenaLines);
+      while (!bAbortRequest && !replay.bDone
+	     && (cchRead=ReadFromFile(h,achLogBuffer,LOG_BUFFER_SIZE))>0)
+	{
+	  llBytesRead+=cchRead;
+	  if (LineArenaFeed(&arenaLines,achLogBuffer,cchRead,ReplayLines)<0)
+	    Panic(PANIC_RUN,"out of memory for line buffer");
+	  if (bStatsRequest) DumpStatistics();
+	}
+      if (cchRead<0)
+	Panic(PANIC_RUN,"cannot read replayed file (%m)");
+      if (LineArenaOpen(&arenaLines) && !replay.bDone) /* unterminated */
+	{
+	  int         cchLine;
+	  long        cchRaw;
+	  const char *pchLine=LineArenaClose(&arenaLines,&cchLine,&cchRaw);
+	  if (!pchLine)
+	    Panic(PANIC_RUN,"out of memory for line buffer");
+	  ReplayLines(pchLine,cchLine,cchRaw);
+	}
+      LineArenaClear(&arenaLines);
+      close(h);
+    }
+  if (errno && !bAbortRequest)
+    Panic(PANIC_RUN,"cannot open replayed file (%m)");
+  FlushBatch();
+  if (bVerbose)
+    lprintf("replay %s: %lu line(s) replayed, %lu skipped",
+	    bAbortRequest ? "aborted" : "done",replay.ulPassed,
+	    replay.ulSkipped);
+}
+
+/* **********************************************************************
+
+ReadBackfillFile(szParams, &lLastSize, pchDone, cChunks)
+
+Read the progress of a backfill: a line with its parameters, the size
+of the last file, and a line "done:<chunk>" for every chunk, that
+has been consumed by its slave. pchDone may be NULL.
+
+Return code: true, if the file belongs to the same backfill.
+
+********************************************************************** */
+
+static TBool ReadBackfillFile(const char *szParams, long *plLastSize,
+			      char *pchDone, int cChunks)
+{
+  FILE *fh=fopen(szBackfillFile,"r");
+  char  achLine[256];
+  TBool bMatch=false;
+  if (!fh) return false;
+  while (fgets(achLine,sizeof(achLine),fh))
+    {
+      ChopLine(achLine);
+      if (!strncmp(achLine,"backfill:",9))
+	bMatch=!strcmp(achLine,szParams);
+      else if (!bMatch)
+	break;
+      else if (!strncmp(achLine,"size:",5))
+	*plLastSize=atol(achLine+5);
+      else if (!strncmp(achLine,"done:",5) && pchDone)
+	{
+	  int i=atoi(achLine+5);
+	  if (i>=0 && i<cChunks) pchDone[i]=1;
+	}
+    }
+  fclose(fh);
+  return bMatch;
+}
+
+/* **********************************************************************
+
+MarkChunkDone(iChunk)
+
+Append the checkpoint of a chunk to the backfill file. The workers
+share the file, and a short append is atomic.
+
+********************************************************************** */
+
+static void MarkChunkDone(int iChunk)
+{
+  char ach[32];
+  int  cch=snprintf(ach,sizeof(ach),"done:%d\n",iChunk);
+  int  h=open(szBackfillFile,O_WRONLY|O_APPEND|O_CLOEXEC);
+  if (h<0 || write(h,ach,cch)!=cch)
+    Panic(PANIC_RUN,"cannot write backfill file \"%s\" (%m)",szBackfillFile);
+  close(h);
+}
+
+/* **********************************************************************
+
+BackfillChunk(pc)
+
+Replay a chunk to a slave of its own, which is waited for.
+
+Return code: true, if the slave has consumed the chunk and exited
+with 0.
+
+********************************************************************** */
+
+static TBool BackfillChunk(const TReplayChunk *pc)
+{
+  int   h=open(replay.aszFiles[pc->iFile],O_RDONLY|O_CLOEXEC);
+  long  lLeft=pc->lEnd-pc->lStart;
+  int   cchRead=0,nStatus=0;
+  pid_t idProcess;
+  if (h<0 || lseek(h,pc->lStart,SEEK_SET)!=pc->lStart)
+    Panic(PANIC_RUN,"cannot read \"%s\" (%m)",replay.aszFiles[pc->iFile]);
+  ReplayReset(&replay);
+  llReplayOffset=pc->llBase+pc->lStart;
+  LineArenaClear(&arenaLines);
+  RestartDestination();
+  while (lLeft>0 && !bAbortRequest && !replay.bDone
+	 && (cchRead=ReadFromFile(h,achLogBuffer,lLeft<LOG_BUFFER_SIZE
+				  ? (int)lLeft : LOG_BUFFER_SIZE))>0)
+    {
+      lLeft-=cchRead;
+      llBytesRead+=cchRead;
+      if (LineArenaFeed(&arenaLines,achLogBuffer,cchRead,ReplayLines)<0)
+	Panic(PANIC_RUN,"out of memory for line buffer");
+      if (bStatsRequest) DumpStatistics();
+    }
+  if (cchRead<0)
+    Panic(PANIC_RUN,"cannot read \"%s\" (%m)",replay.aszFiles[pc->iFile]);
+  if (LineArenaOpen(&arenaLines) && !replay.bDone && !bAbortRequest)
+    {
+      int         cchLine;
+      long        cchRaw;
+      const char *pchLine=LineArenaClose(&arenaLines,&cchLine,&cchRaw);
+      if (!pchLine)
+	Panic(PANIC_RUN,"out of memory for line buffer");
+      ReplayLines(pchLine,cchLine,cchRaw); /* unterminated, at the end */
+    }
+  LineArenaClear(&arenaLines);
+  close(h);
+  if (!bAbortRequest)
+    FlushBatch();
+  LineBatchClear(&batchChild);
+  lBatchRaw=0;
+  idProcess=idChild;
+  idChild=ID_NOPROCESS; /* reaped here, not by the shutdown */
+  ShutdownDestination();
+  if (waitpid(idProcess,&nStatus,0)<0)
+    return false;
+  return !bAbortRequest && WIFEXITED(nStatus) && !WEXITSTATUS(nStatus);
+}
+
+/* **********************************************************************
+
+BackfillWorker(iWorker, apc, cChunks, pchDone)
+
+Replay the chunks iWorker, iWorker+cBackfillJobs ..., which are not
+done yet.
+
+Return code: The exit code of the worker.
+
+********************************************************************** */
+
+static int BackfillWorker(int iWorker, const TReplayChunk *apc, int cChunks,
+			  const char *pchDone)
+{
+  int i,rc=0;
+  for (i=iWorker; i<cChunks && !bAbortRequest; i+=cBackfillJobs)
+    {
+      if (pchDone[i]) continue;
+      if (BackfillChunk(&apc[i]))
+	MarkChunkDone(i);
+      else if (!bAbortRequest)
+	{
+	  lprintf("warning: slave failed on chunk %d",i);
+	  rc=PANIC_RUN;
+	}
+    }
+  return bAbortRequest ? PANIC_RUN : rc;
+}
+
+/* **********************************************************************
+
+Backfill()
+
+Cut the replay into chunks (see replay.h) and let cBackfillJobs
+worker processes replay them at the same time, each chunk to a slave
+of its own. Lines keep their order only within a chunk. The chunks
+done are recorded in szBackfillFile, so an interrupted backfill with
+the same parameters goes on with the others. The file is removed,
+when all chunks are done.
+
+Return code: The exit code, 0 if all chunks are done.
+
+********************************************************************** */
+
+static int Backfill(void)
+{
+  TReplayChunk *apc;
+  struct stat   st;
+  char          achParams[160],*pchDone;
+  long          lLastSize=-1;
+  pid_t        *aidWorker;
+  int           cChunks,cDone=0,cRunning,i,rc=0;
+  TBool         bResume;
+
+  if (stat(replay.aszFiles[replay.cFiles-1],&st)<0)
+    Panic(PANIC_RUN,"cannot stat \"%s\" (%m)",szMonitoredFile);
+  snprintf(achParams,sizeof(achParams),
+	   "backfill:%d:%lu:%ld:%lld:%lld:%ld:%ld",replay.cFiles,
+	   (unsigned long)st.st_ino,cchBackfillChunk,replay.llFrom,
+	   replay.llTo,(long)replay.tiFrom,(long)replay.tiTo);
+  bResume=ReadBackfillFile(achParams,&lLastSize,NULL,0);
+  if (!bResume) lLastSize=-1;
+  cChunks=ReplayChunks(&replay,cchBackfillChunk,&lLastSize,&apc);
+  if (cChunks<0)
+    Panic(PANIC_RUN,"cannot cut the replay into chunks (%m)");
+  pchDone=calloc(cChunks+1,1);
+  aidWorker=calloc(cBackfillJobs,sizeof(pid_t));
+  if (!pchDone || !aidWorker)
+    Panic(PANIC_CONFIG,"no memory");
+  if (bResume)
+    ReadBackfillFile(achParams,&lLastSize,pchDone,cChunks);
+  else
+    {
+      FILE *fh=fopen(szBackfillFile,"w");
+      if (!fh || fprintf(fh,"%s\nsize:%ld\n",achParams,lLastSize)<0
+	  || fclose(fh))
+	Panic(PANIC_RUN,"cannot write backfill file \"%s\" (%m)",
+	      szBackfillFile);
+    }
+  for (i=0; i<cChunks; i++)
+    cDone+=pchDone[i];
+  if (bVerbose)
+    lprintf("backfill of %d chunk(s), %d done before, by %d job(s)",
+	    cChunks,cDone,cBackfillJobs);
+
+  for (i=0; i<cBackfillJobs; i++)
+    {
+      aidWorker[i]=fork();
+      if (aidWorker[i]<0)
+	Panic(PANIC_RUN,"cannot fork a backfill job (%m)");
+      if (!aidWorker[i])
+	{
+	  rc=BackfillWorker(i,apc,cChunks,pchDone);
+	  CloseAllFilesAndPipes();
+	  closelog();
+	  exit(rc);
+	}
+    }
+  for (cRunning=cBackfillJobs; cRunning>0; )
+    {
+      int   nStatus;
+      pid_t id=waitpid(-1,&nStatus,0);
+      if (id<0)
+	{
+	  if (errno!=EINTR) break;
+	  if (bAbortRequest) /* stop the jobs at their next line */
+	    for (i=0; i<cBackfillJobs; i++)
+	      if (aidWorker[i]>0) kill(aidWorker[i],SIGTERM);
+	  continue;
+	}
+      for (i=0; i<cBackfillJobs; i++)
+	if (aidWorker[i]==id)
+	  {
+	    aidWorker[i]=0;
+	    cRunning--;
+	    if (!WIFEXITED(nStatus) || WEXITSTATUS(nStatus))
+	      rc=PANIC_RUN;
+	  }
+    }
+
+  memset(pchDone,0,cChunks);
+  ReadBackfillFile(achParams,&lLastSize,pchDone,cChunks);
+  for (cDone=i=0; i<cChunks; i++)
+    cDone+=pchDone[i];
+  if (cDone==cChunks)
+    {
+      unlink(szBackfillFile);
+      rc=0;
+    }
+  else
+    rc=PANIC_RUN;
+  if (bVerbose)
+    lprintf("backfill %s: %d of %d chunk(s) done",
+	    rc ? "incomplete, run again to resume" : "done",cDone,cChunks);
+  free(apc);
+  free(pchDone);
+  free(aidWorker);
+  return rc;
 }
 
 /* **********************************************************************
@@ -811,7 +1460,7 @@ void OpenMonitoredFile(void)
   hMonitoredFile=-1;
   if (hTemp<0)
     Panic(PANIC_RUN,"cannot open \"%s\" [%m]",szMonitoredFile);
-  hMonitoredFile=fcntl(hTemp,F_DUPFD,3);
+  hMonitoredFile=fcntl(hTemp,F_DUPFD_CLOEXEC,3);
   close(hTemp);
   if (hMonitoredFile<0)
     Panic(PANIC_RUN,"cannot fdup \"%s\" [%m]",szMonitoredFile);
@@ -855,7 +1504,7 @@ DDD param:        -d 1 -f testlog cat
 
   strcpy(achConfigName,DEF_CONFIG_FILE_NAME);
   
-  while (EOF!=(chOpt=getopt(cArg,ppchArg,"Vqfhp:s:d:")))
+  while (EOF!=(chOpt=getopt(cArg,ppchArg,"VqfhSp:s:d:b:l:w:m:F:T:Rj:k:I:A:n:")))
     {
       switch (chOpt)
 	{
@@ -871,9 +1520,25 @@ DDD param:        -d 1 -f testlog cat
 	case 'f': bDaemonMode = false; break;
 	case 'p': szPidFile = strdup(optarg); break;
 	case 's': szStatusFile = strdup(optarg); break;
+	case 'S': nShellMode = SPAWN_SHELL_ALWAYS; break;
+	case 'b': cchBatchMaxBytes = atoi(optarg); break;
+	case 'l': cBatchMaxLines = atoi(optarg); break;
+	case 'w': msBatchMaxDelay = atol(optarg); break;
+	case 'm': cchMaxLine = atoi(optarg); break;
+	case 'F': szReplayFrom = optarg; break;
+	case 'T': szReplayTo = optarg; break;
+	case 'R': bReplayRotated = true; break;
+	case 'j': cBackfillJobs = atoi(optarg); break;
+	case 'k': cchBackfillChunk = atol(optarg); break;
+	case 'I': cchIndexInterval = atol(optarg); break;
+	case 'A': szStartAt = optarg; break;
+	case 'n': cStartLines = atol(optarg); break;
 	}
     }
   
+  if (szReplayFrom || szReplayTo || bReplayRotated || cBackfillJobs>0)
+    bDaemonMode = false; /* a replay is a run to completion */
+
   /* prepare logger */
   openlog(PROG_NAME,
 	  bDaemonMode ? LOG_PID : LOG_PERROR,
@@ -890,6 +1555,48 @@ DDD param:        -d 1 -f testlog cat
   szChildCommand=ppchArg[optind+1];
   if (!szPidFile)    szPidFile   =SetDefaultFileName(szMonitoredFile,".pid");
   if (!szStatusFile) szStatusFile=SetDefaultFileName(szMonitoredFile,".status");
+  LineArenaInit(&arenaLines,cchMaxLine);
+  ReplayInit(&replay);
+  if (szStartAt && ReplayParseTime(szStartAt,&tiStartAt)<0)
+    Panic(PANIC_USAGE,"bad start time %s",szStartAt);
+  if (szStartAt && cStartLines>=0)
+    Panic(PANIC_USAGE,"-A and -n exclude each other");
+  if (szReplayFrom || szReplayTo || bReplayRotated || cBackfillJobs>0)
+    {
+      if (ReplayBounds(&replay,szReplayFrom,szReplayTo)<0)
+	Panic(PANIC_USAGE,"bad replay range %s..%s",
+	      szReplayFrom ? szReplayFrom : "",szReplayTo ? szReplayTo : "");
+      if (ReplayFiles(&replay,szMonitoredFile,bReplayRotated)<0)
+	Panic(PANIC_CONFIG,"no memory");
+      if (!cchBatchMaxBytes && !cBatchMaxLines)
+	cchBatchMaxBytes=FOLLOW_CATCHUP_BATCH; /* full speed */
+    }
+  if (LineBatchInit(&batchChild,cchBatchMaxBytes,cBatchMaxLines,msBatchMaxDelay)<0)
+    Panic(PANIC_CONFIG,"no memory");
+
+  if (ReplayEnabled(&replay))
+    {
+      int rc=0;
+      hMonitoredFile=ID_NOFILE;
+      SetSignalHandler(true);
+      if (cBackfillJobs>0)
+	{
+	  signal(SIGCHLD,SIG_DFL); /* jobs and slaves are waited for */
+	  szBackfillFile=SetDefaultFileName(szMonitoredFile,".backfill");
+	  rc=Backfill();
+	}
+      else
+	{
+	  RestartDestination();
+	  ReplayRange();
+	}
+      SetSignalHandler(false);
+      if (bAbortRequest)
+	Panic(PANIC_RUN,"replay aborted");
+      CloseAllFilesAndPipes(); /* waits for the slave */
+      closelog();
+      return rc;
+    }
 
   OpenMonitoredFile();
 
@@ -31,6 +31,7 @@ Panic() makes any sense instead.
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include <ctype.h>
 #include <time.h>
@@ -40,15 +41,36 @@ Panic() makes any sense instead.
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 #include <unistd.h>
 
+#include <poll.h>
 #include <signal.h>
 #include <syslog.h>
 
+#include "childspawn.h"
+#include "linebatch.h"
+#include "follow.h"
+#include "multiline.h"
+#include "linearena.h"
+#include "logframe.h"
+#include "logparse.h"
+#include "shmring.h"
+#include "uring.h"
+#include "logset.h"
+#include "ratelimit.h"
+#include "sample.h"
+#include "dedup.h"
+#include "counter.h"
+#include "correlate.h"
+#include "replay.h"
+#include "plugin.h"
+#include "logindex.h"
+
 /* ====================================================================== */
 
 #define USAGE \
-"usage: %s {options} FILE" \
+"usage: %s {options} [FILE]" \
 "\n\n(C) Marian Eichholz at freenet.de AG 2001"\
 "\n\noptions:"\
 "\n\t-V : tell version"\
@@ -58,6 +80,14 @@ Panic() makes any sense instead.
 "\n\t-c : use config file <CONFIGFILE>"\
 "\n\t-t : allow monitored file to be <SECONDS> unavailable"\
 "\n\t-r : restart broken destinations (or die)"\
+"\n\t-F : replay FILE from the offset or time <FROM>, then exit"\
+"\n\t-T : replay FILE up to the offset or time <TO>, then exit"\
+"\n\t-R : replay the rotated FILE.N ... FILE.1 before FILE, then exit"\
+"\n\t-A : start FILE at the time <TIME>, if there is no checkpoint"\
+"\n\t-n : start FILE <LINES> before its end, if there is no checkpoint"\
+"\n\nFILE is not given, if the configuration has a path_glob"\
+" (except for a replay)."\
+"\n\nSIGUSR1 logs statistics, SIGUSR2 hands over to a new binary."\
 "\n\n"
 
 #define DEBUG_CONFIG     0x0001
@@ -80,6 +110,8 @@ Panic() makes any sense instead.
 #define DEF_CONFIG_FILE_NAME    "/etc/tailfd.conf"
 #define DEF_STATUS_FILE_NAME    "/var/run/tailfd.status"
 
+#define HANDOVER_ENV            "TAILFDX_HANDOVER" /* fd of the state */
+
 #ifndef RUN_DIR
 #define RUN_DIR                 "/var/run"
 #endif
@@ -88,6 +120,8 @@ Panic() makes any sense instead.
 
 /* some types */
 
+typedef enum { false, true } TBool;
+
 struct TDestination {
   char           *szAlias;          /* logical name, guaranteed to exist */
                                     /* everything else can be NULL or -1 */
@@ -107,10 +141,34 @@ struct TDestination {
   char           *szCommandline;    /* path to binary */
   char          **aszArgs;          /* pointers to arguments */
   char           *szOutputFile;     /* connected to STDOUT */
+  TBool           bBinary;          /* framing="binary", see logframe.h */
+  TLogFormat      format;           /* format and fields, see logparse.h */
+  TBool           bShm;             /* transport="shm", see shmring.h */
+  long            cbShmSize;        /* data bytes of the ring */
+  TShmRing       *pRing;            /* ring behind hPipe, or NULL */
+  TShmRing       *pSpareRing;       /* ring behind hSparePipe, or NULL */
+  TBool           bStandby;         /* keep a spare process ready */
+  int             hSparePipe;       /* pipe handle of the spare */
+  pid_t           idSpareProcess;   /* pid of the spare */
+  volatile TBool  bSpareBroken;     /* the spare died while waiting */
+  int             cchBatchMaxBytes; /* batch bounds from configuration */
+  int             cBatchMaxLines;
+  long            msBatchMaxDelay;
+  TLineBatch      batch;            /* lines not yet written */
+  long            lBatchPosition;   /* file position of first line in batch */
+  TRateLimit      rate;             /* rate_limit, see ratelimit.h */
+  TSample         sample;           /* sample, see sample.h */
+  TCorrelate      correlate;        /* correlate_*, see correlate.h */
+  TDedup          dedup;            /* dedup, see dedup.h */
+  TBool           bCounter;         /* type="counter", see counter.h */
+  TCounter        counter;
+  TBool           bPlugin;          /* type="plugin", see plugin.h */
+  char           *szPluginPath;     /* the shared object */
+  TPlugin         plugin;
+  unsigned long   ulLines;          /* statistics: lines queued */
+  unsigned long   ulRestarts;       /* statistics: restarts */
 };
 
-typedef enum { false, true } TBool;
-
 /* options */
 
 static unsigned long      ulDebugMask;
@@ -118,23 +176,76 @@ static TBool              bVerbose=true;
 static TBool              bDaemonMode=true;
 static int                cSecondsForTakeover=5;
 static TBool              bRestartBrokenDestinations;
+static char *             szReplayFrom;        /* replay bounds */
+static char *             szReplayTo;
+static TBool              bReplayRotated;
+static char *             szStartAt;           /* start time, if new */
+static time_t             tiStartAt;
+static long               cStartLines=-1;      /* lines before the end */
 
 /* from configuration file */
 static char *             szStatusFile;
 static char *             szMonitoredFile;     /* and name */
 static char *             szPidFile;           /* name for PID file */
 static char *             szWorkDir;           /* standard directory */
+static char *             szMultiline;         /* record rule */
+static char *             szMultilineStart;    /* record start pattern */
+static long               msMultilineTimeout;
+static int                cchMaxLine;          /* lines are cut here */
+static TBool              bURing;              /* io_engine="uring" */
+static char *             szPathGlob;          /* files to discover */
+static long               msPathIdle;          /* until fds are closed */
+static long               cchIndexInterval;    /* index_kb, 0 = none */
 
 /* flags for Signalling */
 static volatile TBool     bAbortRequest = false;
 static volatile TBool     bHUPRequest   = false;
 static volatile TBool     bPipeDied     = false;
+static volatile TBool     bStatsRequest = false;
+static volatile TBool     bUpgradeRequest = false;
 
 /* some states */
 static TBool              bWriteStatus  = false;
+static TBool              bNoCheckpoint = false; /* for -A and -n */
 static int                iFirstDest;      /* destination to be repeated */
 static int                hMonitoredFile;  /* the watched file's handle */
 static long               lReadPosition;   /* current reading position */
+static int                hWatch=ID_NOFILE; /* change notification */
+static char               achReadBuffer[FOLLOW_CATCHUP_READ];
+static TMultiline         mlRecord;        /* record being assembled */
+static TLineArena         arenaLines;      /* lines of the current block */
+static ino_t              iMonitoredInode; /* for binary frames */
+static uint64_t           ullReceiveTime;  /* of the current block, in us */
+static char              *pchFrame;        /* scratch for binary frames */
+static int                cchFrameAlloc;
+static TLogParse          parsed;          /* header of the current line */
+static const char        *pchParsed;       /* the line parsed, or NULL */
+static int                cchParsed;
+static char              *pchFormat;       /* scratch for formatted lines */
+static int                cchFormatAlloc;
+static TLogSet            logset={ .hNotify=-1 }; /* files of path_glob */
+static TLogFile          *plfCurrent;      /* the one read last */
+static TBool              bHeld;           /* a file has a held checkpoint */
+static TURing             uring={ .hRing=-1 }; /* batch writes (uring.h) */
+static TReplay            replay;          /* range and files of -F/-T/-R */
+static TLogIndex          indexFile={ .hIndex=-1 }; /* sidecar of FILE */
+static int                cURingSlots;     /* size of the arrays below */
+static struct TDestination **apdestWrite;  /* arguments for URingWriteAll() */
+static int               *ahWrite;
+static const char       **apchWrite;
+static int               *acchWrite;
+static int               *acchWritten;
+
+/* statistics */
+static TFollowMode        idFollowMode=FOLLOW_LIVE;
+static time_t             tiModeSince;
+static unsigned long      ulModeSwitches;
+static unsigned long      ulLinesRead;
+static unsigned long      ulRecords;
+static long long          llBytesRead;
+static unsigned long      ulLinesParsed;
+static unsigned long      ulHeadersParsed;
+static long               lLastGap;
 
 static struct TDestination *pdestFirst;
 
@@ -281,6 +392,17 @@ void CatchAbortRequest(int idSignal, siginfo_t * psi, void * pDummy2)
 #endif
 	      }
 	  }
+      for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+	if (pdest->idSpareProcess>0)
+	  {
+	    pid_t id=waitpid(pdest->idSpareProcess,NULL,WNOHANG);
+	    if (id>0)
+	      {
+		pdest->bSpareBroken=true;
+		dprintf(DEBUG_SIGNALS,"spare process %d [%s] died!\n",
+			id,pdest->szAlias);
+	      }
+	  }
       break;
     case SIGPIPE:
       bPipeDied=true;
@@ -292,6 +414,13 @@ void CatchAbortRequest(int idSignal, siginfo_t * psi, void * pDummy2)
     case SIGHUP:
       bHUPRequest=true;
       break;
+    case SIGUSR1:
+      bStatsRequest=true;
+      break;
+    case SIGUSR2:
+      bUpgradeRequest=true;
+      bHUPRequest=true; /* leave the reading loops like a HUP */
+      break;
     default:
       Panic(PANIC_INTERNAL,"illegal signal %d caught",idSignal);
     }
@@ -302,7 +431,7 @@ void CatchAbortRequest(int idSignal, siginfo_t * psi, void * pDummy2)
 
 SetSignalHandler(bSet)
 
-Install or deinstall the signal handler for HUP, INT, TERM.
+Install or deinstall the signal handler for HUP, INT, TERM, USR1, USR2.
 
 ********************************************************************** */
 
@@ -329,6 +458,8 @@ void SetSignalHandler(TBool bSetit)
       sigaction(SIGINT,  &sigCatcher, NULL);
       sigaction(SIGTERM, &sigCatcher, NULL);
       sigaction(SIGPIPE, &sigCatcher, NULL);
+      sigaction(SIGUSR1, &sigCatcher, NULL);
+      sigaction(SIGUSR2, &sigCatcher, NULL);
     }
 }
 
@@ -499,6 +630,12 @@ void FreeDestination(struct TDestination *pdest)
   if (pdest->szAlias) free(pdest->szAlias);
   if (pdest->szCommandline) free(pdest->szCommandline);
   if (pdest->szOutputFile) free(pdest->szOutputFile);
+  if (pdest->szPluginPath) free(pdest->szPluginPath);
+  LineBatchFree(&pdest->batch);
+  RateLimitFree(&pdest->rate);
+  SampleFree(&pdest->sample);
+  CorrelateFree(&pdest->correlate);
+  CounterFree(&pdest->counter);
   FreeArgTokens(pdest->aszArgs);   /* free memory 1 */
   free(pdest);                      /* free memory 2 */
 }
@@ -517,10 +654,14 @@ Return code: Always 0.
 
 int ShutdownDestination(struct TDestination *pdest)
 {
+  PluginClose(&pdest->plugin); /* after the pending lines */
   if (pdest->hPipe>=0) /* standard descriptors are ok */
     {
       dprintf(DEBUG_PIPES,"closing fd %d\n",pdest->hPipe);
-      close(pdest->hPipe);
+      if (pdest->pRing)
+	ShmRingClose(pdest->pRing); /* closes hPipe as well */
+      else
+	close(pdest->hPipe);
       if (pdest->idProcess>0 && pdest->status!=broken)
 	{
 	  pid_t idProcess=pdest->idProcess;
@@ -532,14 +673,129 @@ int ShutdownDestination(struct TDestination *pdest)
   pdest->status    = dead;
   pdest->idProcess = ID_NOPROCESS;
   pdest->hPipe     = ID_NOFILE;
+  pdest->pRing     = NULL;
+  return 0;
+}
+
+/* **********************************************************************
+
+ShutdownSpare(pdest)
+
+The warm standby process of a destination is shut down. Like
+ShutdownDestination() this function must be repeatable.
+
+Return code: Always 0.
+
+********************************************************************** */
+
+int ShutdownSpare(struct TDestination *pdest)
+{
+  if (pdest->hSparePipe>=0)
+    {
+      dprintf(DEBUG_PIPES,"closing spare fd %d\n",pdest->hSparePipe);
+      if (pdest->pSpareRing)
+	ShmRingClose(pdest->pSpareRing);
+      else
+	close(pdest->hSparePipe);
+    }
+  if (pdest->idSpareProcess>0)
+    {
+      pid_t idProcess=pdest->idSpareProcess;
+      pdest->idSpareProcess=ID_NOPROCESS; /* disable flagging by racing signal */
+      if (!pdest->bSpareBroken)
+	{
+	  kill(idProcess,SIGTERM);
+	  waitpid(idProcess,NULL,0); /* blocking wait */
+	}
+    }
+  pdest->idSpareProcess = ID_NOPROCESS;
+  pdest->hSparePipe     = ID_NOFILE;
+  pdest->pSpareRing     = NULL;
+  pdest->bSpareBroken   = false;
   return 0;
 }
 
 /* **********************************************************************
 
+CheckpointPosition()
+
+Lines waiting in a batch or behind a rate limit have not been
+delivered yet, neither have unreported repeats or a record in
+assembly. So the position to recap from is the oldest pending line of
+any destination or the start of the record. With a path_glob, rate
+limited lines may come from other files, so they are held back per
+file instead (see HoldCheckpoint()).
+
+Return code: The file position safe to be written to the status file.
+
+********************************************************************** */
+
+long CheckpointPosition(void)
+{
+  struct TDestination *pdest;
+  long lPosition=lReadPosition;
+  if (mlRecord.cLines && mlRecord.lPosition<lPosition)
+    lPosition=mlRecord.lPosition;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    {
+      long lQueued=szPathGlob ? -1 : RateLimitOldest(&pdest->rate);
+      long lRepeat=DedupOldest(&pdest->dedup);
+      if (pdest->batch.cchBuffer && pdest->lBatchPosition<lPosition)
+	lPosition=pdest->lBatchPosition;
+      if (lQueued>=0 && lQueued<lPosition)
+	lPosition=lQueued;
+      if (lRepeat>=0 && lRepeat<lPosition)
+	lPosition=lRepeat;
+    }
+  return lPosition;
+}
+
+/* **********************************************************************
+
+HoldCheckpoint(lPosition)
+
+With a path_glob, keep the checkpoint of the current file at or
+before a line, which has been queued behind a rate limit. The queues
+do not tell the file of a line, so the hold is released only when all
+of them are empty (see WriteStatusFile()). Until then a crash may send
+lines again, but loses none.
+
+********************************************************************** */
+
+void HoldCheckpoint(long lPosition)
+{
+  if (plfCurrent && (plfCurrent->lHeld<0 || lPosition<plfCurrent->lHeld))
+    {
+      plfCurrent->lHeld=lPosition;
+      bHeld=true;
+    }
+}
+
+/* **********************************************************************
+
+RateLimited()
+
+Return code: true, if any destination has lines behind its rate
+limit.
+
+********************************************************************** */
+
+TBool RateLimited(void)
+{
+  struct TDestination *pdest;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (pdest->rate.cQueued || pdest->rate.cSpooled)
+      return true;
+  return false;
+}
+
+/* **********************************************************************
+
 WriteStatusFile()
 
-Write the Status File.
+Write the Status File. With a path_glob, there is an entry with inode
+and position for every file instead of the single position, which is
+held back to its oldest rate limited line (see HoldCheckpoint()).
 
 Return code: Always 0.
 
@@ -553,7 +809,25 @@ int WriteStatusFile(void)
   fh=fopen(szFile,"w");
   if (!fh) Panic(PANIC_RUN,"cannot create status file \"%s\"",szFile);
   fprintf(fh,"firstpipe:%d\n",iFirstDest);
-  fprintf(fh,"position:%ld\n",lReadPosition);
+  if (szPathGlob)
+    {
+      TLogFile *plf;
+      bHeld=bHeld && RateLimited();
+      for (plf=logset.plfFirst; plf; plf=plf->pNext)
+	{
+	  long lPosition=plf==plfCurrent ? CheckpointPosition()
+	    : plf->lPosition;
+	  if (!bHeld)
+	    plf->lHeld=-1; /* all delivered */
+	  else if (plf->lHeld>=0 && plf->lHeld<lPosition)
+	    lPosition=plf->lHeld;
+	  if (!plf->bGone)
+	    fprintf(fh,"file:%lu:%ld:%s\n",(unsigned long)plf->iNode,
+		    lPosition,plf->szPath);
+	}
+    }
+  else
+    fprintf(fh,"position:%ld\n",CheckpointPosition());
   fflush(fh);
   if (ferror(fh) || fclose(fh))
     {
@@ -582,13 +856,14 @@ The RV is currently not used.
 int ReadStatusFile(void)
 {
   FILE *fh;
-  char  achLine[128];
+  char  achLine[PATH_MAX+64];
   fh=fopen(szStatusFile,"r");
   if (!fh)
     {
       if (bVerbose)
 	lprintf("file %s not found, using defaults.",szStatusFile);
       lReadPosition=0;
+      bNoCheckpoint=true;
       return -1;
     }
   while (!feof(fh))
@@ -605,6 +880,17 @@ int ReadStatusFile(void)
 	lReadPosition=atol(szVal);
       else if (!strcmp(szKey,"firstpipe"))
 	iFirstDest=atoi(szVal);
+      else if (!strcmp(szKey,"file"))
+	{
+	  char *szPosition=strtok(NULL,":");
+	  char *szPath=strtok(NULL,"");
+	  if (!szPosition || !szPath)
+	    Panic(PANIC_RUN,"bad file entry in %s",szStatusFile);
+	  if (szPathGlob
+	      && !LogSetAdd(&logset,szPath,(ino_t)strtoul(szVal,NULL,10),
+			    atol(szPosition)))
+	    Panic(PANIC_RUN,"out of memory for file list");
+	}
       else
 	Panic(PANIC_RUN,"unknown token %s (%s)",szKey,szVal);
 	
@@ -622,6 +908,8 @@ closed and shut down.
 
 ********************************************************************** */
 
+void EmitCounts(struct TDestination *pdest);
+
 void CloseAllFilesAndPipes(void)
 {
   struct TDestination *pdest;
@@ -634,9 +922,146 @@ void CloseAllFilesAndPipes(void)
   for (pdest=pdestFirst;
        pdest;
        pdest=pdest->pNext)
+    {
+      if (pdest->bCounter)
+	EmitCounts(pdest); /* the interval so far */
       ShutdownDestination(pdest);
+      ShutdownSpare(pdest);
+    }
   if (hMonitoredFile>=0) close(hMonitoredFile);
   hMonitoredFile=0;
+  LogSetFree(&logset);
+  plfCurrent=NULL;
+}
+
+/* **********************************************************************
+
+id=LaunchProcess(pdest, bSpare, &hPipe, &pRing)
+
+Open the output file (if any) and spawn the command of the destination
+with a fresh pipe on its STDIN. The spare of a destination opens a
+truncating output file in append mode, because the active process is
+still writing to it.
+
+With transport="shm" the child gets a fresh shared memory ring on its
+STDIN instead, and *pRing is set. If the ring cannot be created, the
+destination falls back to a pipe for good.
+
+All descriptors of the daemon are close-on-exec, so the child only
+gets the pipe (or ring) on 0 and the output file on 1.
+
+Return code: The pid of the child, or ID_NOPROCESS if it cannot be
+started. *phPipe receives the writing end in both cases, so a failed
+start is handled like any breaking destination.
+
+********************************************************************** */
+
+pid_t LaunchProcess(struct TDestination *pdest, TBool bSpare, int *phPipe,
+		    TShmRing **ppRing)
+{
+  int   hStdOut = ID_NOFILE;
+  int   hIn,hOut;
+  pid_t idProcess;
+  char *aszDefaultArgs[2];
+  char **aszArgs;
+
+  if (pdest->szOutputFile)
+    {
+      int nAppendFlag=bSpare ? O_APPEND : O_TRUNC;
+      char *sz=pdest->szOutputFile;
+      if (*sz == '>')
+	{
+	  sz++;
+	  nAppendFlag=O_APPEND;
+	}
+      hStdOut = SpawnCloseOnExec(open(sz, O_CREAT|O_WRONLY|nAppendFlag|O_CLOEXEC,
+				      00666));
+      dprintf(DEBUG_PIPES,"created fd %d from file %s\n",
+	      hStdOut,sz);
+      if (hStdOut<3)
+	Panic(PANIC_RUN,"cannot create output file for \"%s\"",pdest->szAlias);
+    }
+  *ppRing=NULL;
+  if (pdest->bShm)
+    {
+      *ppRing=ShmRingCreate(pdest->szAlias,pdest->cbShmSize);
+      if (!*ppRing)
+	{
+	  lprintf("cannot create shm ring for [%s], using a pipe: %m",
+		  pdest->szAlias);
+	  pdest->bShm=false;
+	}
+    }
+  if (*ppRing)
+    hIn=hOut=(*ppRing)->hRing;
+  else if (SpawnPipe(&hIn,&hOut)<0)
+    Panic(PANIC_RUN,"cannot create pipe fds [%s] %m",pdest->szAlias);
+  dprintf(DEBUG_PIPES,"got %d[r] and %d[w]%s\n",hIn,hOut,
+	  bSpare ? " for spare" : "");
+
+  /* TokenizeArgs() leaves the first slot for the program name */
+  aszArgs=pdest->aszArgs;
+  if (!aszArgs)
+    {
+      aszDefaultArgs[1]=NULL;
+      aszArgs=aszDefaultArgs;
+    }
+  aszArgs[0]=pdest->szCommandline;
+
+  idProcess = SpawnProcess(pdest->szCommandline, aszArgs, hIn, hStdOut);
+  if (idProcess<0)
+    {
+      syslog(LOG_DAEMON|LOG_ERR,"error: [%s] cannot exec %s: %m",
+	     pdest->szAlias,pdest->szCommandline);
+      idProcess=ID_NOPROCESS;
+    }
+
+  if (!*ppRing)
+    close(hIn);            /* read direction not needed */
+  if (hStdOut>=0)
+    close(hStdOut);        /* output file no longer used */
+  *phPipe = hOut;          /* writing */
+  return idProcess;
+}
+
+/* **********************************************************************
+
+StartSpare(pdest)
+
+Start the warm standby process of a destination, if it wants one and
+does not have a living one.
+
+********************************************************************** */
+
+void StartSpare(struct TDestination *pdest)
+{
+  if (!pdest->bStandby || !pdest->szCommandline) return;
+  if (pdest->bSpareBroken) ShutdownSpare(pdest); /* reap the remains */
+  if (pdest->idSpareProcess>0) return;
+  pdest->idSpareProcess=LaunchProcess(pdest,true,&pdest->hSparePipe,
+				      &pdest->pSpareRing);
+  if (pdest->idSpareProcess<=0)
+    {
+      lprintf("cannot start spare for [%s], standby disabled",pdest->szAlias);
+      ShutdownSpare(pdest);
+      pdest->bStandby=false;
+      return;
+    }
+  dprintf(DEBUG_PIPES,"spare %d ready for [%s]\n",
+	  (int)pdest->idSpareProcess,pdest->szAlias);
+}
+
+/* **********************************************************************
+
+SpareReady(pdest)
+
+Return code: true, if a living spare waits to take over.
+
+********************************************************************** */
+
+TBool SpareReady(struct TDestination *pdest)
+{
+  return pdest->idSpareProcess>0 && !pdest->bSpareBroken;
 }
 
 /* **********************************************************************
@@ -646,9 +1071,14 @@ RestartDestination(pdest)
 The specified client is broken or unconnected to a pipe. So we shut it
 down, if necessary, and (re)open it.
 
+With a warm standby process, the spare takes over immediately and a
+new spare is started in its place.
+
 Return code:
   -1 : The shutdown failed.
-   0 : Otherwise.
+   0 : A new process or file has been started.
+   1 : A spare, which is already running, has taken over, or a plugin
+       has been loaded.
 
 ********************************************************************** */
   
@@ -659,101 +1089,82 @@ int RestartDestination(struct TDestination *pdest)
   if (ShutdownDestination(pdest)<0)
     return -1;
   dprintf(DEBUG_PIPES,"restarting [%s]\n",pdest->szAlias);
+  pdest->ulRestarts++;
 
-  if (pdest->szOutputFile)
+  if (pdest->bPlugin)
     {
-      int hTemp; /* open()-handle, will be transferred to fd>2 */
-      int nAppendFlag=O_TRUNC;
-      char *sz=pdest->szOutputFile;
-      if (*sz == '>')
+      char  *aszDefaultArgs[2];
+      char **aszArgs=pdest->aszArgs;
+      int    cArgs=1;
+      if (!aszArgs)
 	{
-	  sz++;
-	  nAppendFlag=O_APPEND;
+	  aszDefaultArgs[1]=NULL;
+	  aszArgs=aszDefaultArgs;
 	}
-      hTemp = open(sz, O_CREAT|O_WRONLY|nAppendFlag, 00666);
-      if (hTemp>=0)
+      aszArgs[0]=pdest->szPluginPath; /* like argv[0] */
+      while (aszArgs[cArgs]) cArgs++;
+      if (PluginOpen(&pdest->plugin,pdest->szPluginPath,pdest->szAlias,
+		     cArgs,aszArgs)<0)
 	{
-	  hStdOut=fcntl(hTemp,F_DUPFD,3);
-	  close(hTemp);
+	  lprintf("error: [%s] cannot load plugin: %s",pdest->szAlias,
+		  pdest->plugin.achError);
+	  pdest->status = broken;
 	}
       else
-	hStdOut=0;
-      dprintf(DEBUG_PIPES,"created fd %d from file %s\n",
-	      hStdOut,sz);
-      if (hStdOut<3)
-	Panic(PANIC_RUN,"cannot create output file for \"%s\"",pdest->szAlias);
+	pdest->status = running;
+      return 1; /* no process to wait for */
     }
   if (pdest->szCommandline)
     {
-      int   hIn,hOut;
-      {
-	int   afdPipe[2];
-	if (pipe(afdPipe)<0)
-	  Panic(PANIC_RUN,"cannot create pipe fds [%s] %m",pdest->szAlias);
-	hIn =fcntl(afdPipe[0],F_DUPFD,3);
-	hOut=fcntl(afdPipe[1],F_DUPFD,3);
-	close(afdPipe[0]);
-	close(afdPipe[1]);
-      }
-      if (hIn<0 || hOut<0)
-	Panic(PANIC_RUN,"cannot dupe pipe fds [%s] %m",pdest->szAlias);
-      dprintf(DEBUG_PIPES,"got %d[r] and %d[w]\n",hIn,hOut);
-
-      pdest->idProcess = fork();
-
-      if (pdest->idProcess < 0)                     /* fork failed */
-	Panic(PANIC_RUN,"fork failed [%m]");
-
-      else if (!pdest->idProcess)                 /* child trunk */
+      if (SpareReady(pdest))
+	{
+	  dprintf(DEBUG_PIPES,"spare %d takes over [%s]\n",
+		  (int)pdest->idSpareProcess,pdest->szAlias);
+	  pdest->idProcess      = pdest->idSpareProcess;
+	  pdest->hPipe          = pdest->hSparePipe;
+	  pdest->pRing          = pdest->pSpareRing;
+	  pdest->pSpareRing     = NULL;
+	  pdest->idSpareProcess = ID_NOPROCESS;
+	  pdest->hSparePipe     = ID_NOFILE;
+	  pdest->status         = running;
+	  StartSpare(pdest);
+	  return 1;
+	}
+      pdest->idProcess = LaunchProcess(pdest,false,&pdest->hPipe,
+				       &pdest->pRing);
+      pdest->status    = (pdest->idProcess>0) ? running : broken;
+      StartSpare(pdest);
+    } /* if pipe */
+  else
+    { /* direct file connection */
+      if (pdest->szOutputFile)
 	{
-	  struct TDestination *pIter;
-	  if (hMonitoredFile>0) close(hMonitoredFile);
-	  if (dup2(hIn,0)<0)
+	  int hTemp; /* open()-handle, will be transferred to fd>2 */
+	  int nAppendFlag=pdest->bCounter ? O_APPEND : O_TRUNC;
+	  char *sz=pdest->szOutputFile;
+	  if (*sz == '>')
 	    {
-	      syslog(LOG_DAEMON|LOG_ERR,"dup for 0 [%s] %m",pdest->szAlias);
-	      _exit(PANIC_CHILD);
+	      sz++;
+	      nAppendFlag=O_APPEND;
 	    }
-	  if (pdest->szOutputFile)       /* forces some checks on handle */
+	  hTemp = open(sz, O_CREAT|O_WRONLY|nAppendFlag|O_CLOEXEC, 00666);
+	  if (hTemp>=0)
 	    {
-	      if (dup2(hStdOut,1)<0)     /* connect FILE to STDOUT */
-		{
-		  syslog(LOG_DAEMON|LOG_ERR,"dup for 1 [%s] %m",
-			 pdest->szAlias);
-		  _exit(PANIC_CHILD);
-		}
+	      hStdOut=fcntl(hTemp,F_DUPFD_CLOEXEC,3);
+	      close(hTemp);
 	    }
-	  /* close all siblings FD */
-	  for (pIter=pdestFirst; pIter; pIter=pIter->pNext)
-	    if (pIter->hPipe>2)
-	      close(pIter->hPipe);
-	  close(hOut);            /* write direction not needed */
-	  close(hIn);             /* duped */
-	  close(hStdOut);         /* duped */
-	  /*
-	    Now there shall be only ONE pipe, on FD 0.
-	    Max. TWO FD on 1 and 2 are referring a device or file.
-	  */
-	  execvp(pdest->szCommandline, pdest->aszArgs);
-	  syslog(LOG_DAEMON|LOG_ERR,"error: [%s] cannot exec %s: %m",
-		 pdest->szAlias,pdest->szCommandline);
-	  _exit(PANIC_CHILD); /* used for SIGCHLD handler */
+	  dprintf(DEBUG_PIPES,"created fd %d from file %s\n",
+		  hStdOut,sz);
+	  if (hStdOut<3)
+	    Panic(PANIC_RUN,"cannot create output file for \"%s\"",pdest->szAlias);
 	}
-
-      else                               /* parent trunk */
-	{
-	  pdest->status    = running;
-	  pdest->hPipe     = hOut; /* writing */
-	  close(hIn);              /* read direction not needed */
-	  close(hStdOut);          /* output file no longer used */
-	} /* forking */
-    } /* if pipe */
-  else
-    { /* direct file connection */
       if (hStdOut>=0)
 	{
 	  pdest->hPipe=hStdOut;
 	  pdest->status = running;
 	}
+      else if (pdest->bCounter)
+	pdest->status = running; /* counts on the statistics only */
       else
 	{
 	  if (bVerbose)
@@ -766,7 +1177,58 @@ int RestartDestination(struct TDestination *pdest)
 
 /* **********************************************************************
 
-EchoToDestination(szLine, pdest)
+cchWritten=WriteFully(h, pch, cch)
+
+write() the whole buffer. Pipes may take a big buffer in pieces, and
+a signal (SIGCHLD, SIGUSR1) may interrupt a blocking write.
+
+Return code: The number of bytes written, like write().
+
+********************************************************************** */
+
+int WriteFully(int h, const char *pch, int cch)
+{
+  int cchDone=0;
+  while (cchDone<cch)
+    {
+      int cchWritten=write(h,pch+cchDone,cch-cchDone);
+      if (cchWritten<0 && errno==EINTR && !bPipeDied)
+	continue;
+      if (cchWritten<=0)
+	return cchDone ? cchDone : cchWritten;
+      cchDone+=cchWritten;
+    }
+  return cchDone;
+}
+
+/* **********************************************************************
+
+cchWritten=WriteToDestination(pdest, pch, cch)
+
+Write the buffer to the pipe, file, ring or plugin of a destination. A
+full ring is waited for, as long as the consumer is alive.
+
+Return code: The number of bytes written, like write().
+
+********************************************************************** */
+
+int WriteToDestination(struct TDestination *pdest, const char *pch, int cch)
+{
+  int cchDone=0;
+  if (pdest->bPlugin)
+    return PluginWrite(&pdest->plugin,pch,cch);
+  if (!pdest->pRing)
+    return WriteFully(pdest->hPipe,pch,cch);
+  while (cchDone<cch && pdest->status!=broken)
+    cchDone+=ShmRingWrite(pdest->pRing,pch+cchDone,cch-cchDone,1000);
+  if (cchDone<cch)
+    errno=EPIPE;
+  return cchDone;
+}
+
+/* **********************************************************************
+
+EchoToDestination(pchLine, cch, pdest)
 
 Echo line to destination, using it's internal or pipe interface
 
@@ -781,20 +1243,22 @@ Return code: Always 0
 
 ********************************************************************** */
 
-int EchoToDestination(const char *szLine, struct TDestination *pdest)
+int EchoToDestination(const char *szLine, int cch, struct TDestination *pdest)
 {
-  int   cch,cchWritten,cRetries,idError;
+  int   cchWritten,cRetries,idError;
   char *pchError;
   if (pdest->status==dead) return 0; /* inactive destination */
-  if (pdest->hPipe<0) return 0;      /* inactive Pipe handle */
-  cch=strlen(szLine);
+  if (pdest->hPipe<0 && !pdest->bPlugin) return 0; /* inactive Pipe handle */
   cRetries=1;
   idError=0;
   bPipeDied=false; /* raised by SIGPIPE */
+
+  if (pdest->bSpareBroken)
+    StartSpare(pdest); /* replace a died spare in the background */
   
   if (pdest->status==broken)
     {
-      if (bRestartBrokenDestinations)
+      if (bRestartBrokenDestinations || SpareReady(pdest))
 	{
 	  dprintf(DEBUG_PIPES,"BROKEN detected for %d, restarting\n",
 		  (int)pdest->hPipe);
@@ -805,16 +1269,17 @@ int EchoToDestination(const char *szLine, struct TDestination *pdest)
 	  lprintf("disabling died destination [%s]",
 		  pdest->szAlias);
 	  pdest->status=dead;
+	  ShutdownSpare(pdest);
 	  return 0;
 	}
     }
-  cchWritten = write(pdest->hPipe, szLine, cch);
+  cchWritten = WriteToDestination(pdest, szLine, cch);
   dprintf(DEBUG_PIPES,"%d from %d byte(s) written to %d (errno=%d)\n",
 	  cchWritten,cch,(int)pdest->hPipe,(int)errno);
   pchError="N.N.";
   while ((bPipeDied || cchWritten!=cch || pdest->status==broken) && cRetries>0)
     {
-      if (bRestartBrokenDestinations)
+      if (bRestartBrokenDestinations || SpareReady(pdest))
 	{
 	  if (pdest->status==broken)
 	    {
@@ -838,9 +1303,9 @@ int EchoToDestination(const char *szLine, struct TDestination *pdest)
 	      pchError=strerror(idError);
 	    }
 	  bPipeDied=false;
-	  RestartDestination(pdest);
-	  sleep(1); /* give pipe a chance to crash */
-	  cchWritten = write(pdest->hPipe, szLine, cch);
+	  if (RestartDestination(pdest)!=1)
+	    sleep(1); /* give pipe a chance to crash, spares have had it */
+	  cchWritten = WriteToDestination(pdest, szLine, cch);
 	  if (cchWritten==cch && !bPipeDied && pdest->status!=broken)
 	    break;
 	  cRetries--;
@@ -848,6 +1313,7 @@ int EchoToDestination(const char *szLine, struct TDestination *pdest)
       else
 	{
 	  pdest->status=dead; /* disable further output to destination */
+	  ShutdownSpare(pdest);
 	  lprintf("disabling broken pipe [%s]...",
 		  pdest->szAlias);
 	  return 0;
@@ -861,67 +1327,877 @@ int EchoToDestination(const char *szLine, struct TDestination *pdest)
 
 /* **********************************************************************
 
-MonitorFile()
+FlushDestination(pdest)
 
-Seek to the last position of the open file and watch it changing :-)
+Write the pending batch of a destination, if there is one.
 
 ********************************************************************** */
 
-void MonitorFile(void)
+void FlushDestination(struct TDestination *pdest)
 {
-  char        achLine[1024];
-  int         i;
-  long        lFileIndex;
-  ino_t       iNode;          /* inode of open file */
-  struct stat statFD;
+  if (!pdest->batch.cchBuffer) return;
+  dprintf(DEBUG_PIPES,"flushing %d line(s) to [%s]\n",
+	  pdest->batch.cLines,pdest->szAlias);
+  EchoToDestination(pdest->batch.pchBuffer,pdest->batch.cchBuffer,pdest);
+  LineBatchClear(&pdest->batch);
+}
 
-  /*
-    since lseek allows for seeking beyond EOF, we have do to the bounds
-    check manually.
-  */
-  if (fstat(hMonitoredFile,&statFD)<0)
-    Panic(PANIC_RUN,"cannot fstat monitored fd: %m");
-  lFileIndex=statFD.st_size;
-  iNode=statFD.st_ino;
-  if (lFileIndex<lReadPosition)
+/* **********************************************************************
+
+pchFrame=BuildFrame(szLine, &cch, lPosition)
+
+Put a line into a binary frame (see logframe.h). The final newline is
+not part of the payload. The frame is valid until the next call.
+
+Return code: The frame, cch is updated to its size.
+
+********************************************************************** */
+
+const char *BuildFrame(const char *szLine, int *pcch, long lPosition)
+{
+  TLogFrameHeader hdr;
+  int cchPayload=*pcch;
+  if (cchPayload && szLine[cchPayload-1]=='\n') cchPayload--;
+  if (LOGFRAME_HEADER_SIZE+cchPayload+1>cchFrameAlloc)
     {
-      if (bVerbose)
-	lprintf("file size<lastpos, restarting at beginning");
-      lReadPosition=lseek(hMonitoredFile, 0, SEEK_SET);
+      int   cchAlloc=cchFrameAlloc ? cchFrameAlloc : 4096;
+      char *pch;
+      while (LOGFRAME_HEADER_SIZE+cchPayload+1>cchAlloc) cchAlloc*=2;
+      pch=realloc(pchFrame,cchAlloc);
+      if (!pch) Panic(PANIC_RUN,"out of memory for binary frame");
+      pchFrame=pch;
+      cchFrameAlloc=cchAlloc;
     }
-  else if (lseek(hMonitoredFile, lReadPosition, SEEK_SET)!=lReadPosition)
-    Panic(PANIC_RUN,"cannot seek to %ld",lReadPosition);
-  i=0;
-  /* we cannot update lReadPosition bytewise, because we probably want
-     to recap the line, if a destination crashes.
-     So we update it linewise. */
-  lFileIndex=lReadPosition;
+  LogFrameEncode(&hdr,cchPayload,(uint64_t)lPosition,
+		 (uint64_t)iMonitoredInode,ullReceiveTime);
+  memcpy(pchFrame,&hdr,LOGFRAME_HEADER_SIZE);
+  memcpy(pchFrame+LOGFRAME_HEADER_SIZE,szLine,cchPayload);
+  *pcch=LOGFRAME_HEADER_SIZE+cchPayload;
+  return pchFrame;
+}
 
-  bWriteStatus=true;
+/* **********************************************************************
+
+pchOut=FormatLine(szLine, &cch, lPosition, pdest)
+
+Write the fields of a line in the format of a destination (see
+logparse.h). The header is parsed once per line, for all destinations.
+Binary formats and framing get a frame (see BuildFrame()). The result
+is valid until the next call.
 
-  while (i<sizeof(achLine)-1 && !bAbortRequest && !bHUPRequest)
+Return code: The formatted line, cch is updated to its size.
+
+********************************************************************** */
+
+const char *FormatLine(const char *szLine, int *pcch, long lPosition,
+		       struct TDestination *pdest)
+{
+  TLogFrameHeader hdr;
+  int             cch;
+  if (szLine!=pchParsed || *pcch!=cchParsed)
     {
-      struct TDestination *pdest;
-      int cch=read(hMonitoredFile,achLine+i,1); /* non blocking */
-      if (cch<=0)
-	{
-	  int   cRetries;
-	  TBool bReopen=false;
-	  for (cRetries=2; cRetries && !bHUPRequest; cRetries--)
-	      sleep(1);
-	  if (bHUPRequest) break; /* break whole master loop */
+      LogParseLine(&parsed,szLine,*pcch);
+      pchParsed=szLine;
+      cchParsed=*pcch;
+      ulLinesParsed++;
+      if (parsed.idSyntax!=LOGPARSE_NONE) ulHeadersParsed++;
+    }
+  cch=LOGFRAME_HEADER_SIZE+LogFormatSize(&pdest->format,&parsed);
+  if (cch>cchFormatAlloc)
+    {
+      int   cchAlloc=cchFormatAlloc ? cchFormatAlloc : 4096;
+      char *pch;
+      while (cch>cchAlloc) cchAlloc*=2;
+      pch=realloc(pchFormat,cchAlloc);
+      if (!pch) Panic(PANIC_RUN,"out of memory for formatted line");
+      pchFormat=pch;
+      cchFormatAlloc=cchAlloc;
+    }
+  cch=LogFormatWrite(&pdest->format,&parsed,pchFormat+LOGFRAME_HEADER_SIZE);
+  if (pdest->format.idFormat!=LOGFORMAT_BINARY && !pdest->bBinary)
+    {
+      *pcch=cch;
+      return pchFormat+LOGFRAME_HEADER_SIZE;
+    }
+  if (pdest->format.idFormat!=LOGFORMAT_BINARY)
+    cch--; /* the newline, as in BuildFrame() */
+  LogFrameEncode(&hdr,cch,(uint64_t)lPosition,(uint64_t)iMonitoredInode,
+		 ullReceiveTime);
+  if (pdest->format.idFormat==LOGFORMAT_BINARY)
+    hdr.usVersion=LOGFRAME_VERSION_FIELDS;
+  memcpy(pchFormat,&hdr,LOGFRAME_HEADER_SIZE);
+  *pcch=LOGFRAME_HEADER_SIZE+cch;
+  return pchFormat;
+}
 
-	  cRetries=cSecondsForTakeover;
-	  while (stat(szMonitoredFile,&statFD)<0)
-	    {
-	      sleep(1);
-	      if (!cRetries--)
-		Panic(PANIC_RUN,"cannot restat \"%s\": %m",
-		      szMonitoredFile);
-	    }
-	  if (statFD.st_ino!=iNode)
-	    {
-	      if (bVerbose)
+/* **********************************************************************
+
+DeliverToDestination(szLine, cch, lPosition, pdest)
+
+Add a line to the batch of a destination and flush the batch, when
+one of its bounds is hit. Destinations without batch bounds get the
+line at once. lPosition is the file position of the line.
+
+Return code: Always 0
+
+********************************************************************** */
+
+int DeliverToDestination(const char *szLine, int cch, long lPosition,
+			 struct TDestination *pdest)
+{
+  if (!LineBatchEnabled(&pdest->batch))
+    return EchoToDestination(szLine,cch,pdest);
+  if (pdest->status==dead) return 0; /* inactive destination */
+  if (!LineBatchFits(&pdest->batch,cch))
+    FlushDestination(pdest);
+  if (!LineBatchFits(&pdest->batch,cch)) /* longer than any batch */
+    return EchoToDestination(szLine,cch,pdest);
+  if (!pdest->batch.cchBuffer)
+    pdest->lBatchPosition=lPosition;
+  if (LineBatchAppend(&pdest->batch,szLine,cch))
+    FlushDestination(pdest);
+  return 0;
+}
+
+/* **********************************************************************
+
+DrainRateLimit(pdest)
+
+Deliver the queued lines of a rate limited destination, as far as
+there are tokens.
+
+********************************************************************** */
+
+void DrainRateLimit(struct TDestination *pdest)
+{
+  const char *pchLine;
+  int         cch;
+  long        lPosition;
+  while ((pchLine=RateLimitNext(&pdest->rate,&cch,&lPosition))!=NULL)
+    DeliverToDestination(pchLine,cch,lPosition,pdest);
+}
+
+/* **********************************************************************
+
+PassToDestination(szLine, cch, lPosition, pdest)
+
+Pass a line to a destination. Binary destinations get the line in a
+frame, and a frame counts as a line in the batch. Destinations with a
+format get its fields instead (see FormatLine()). A line without a
+token of the rate limit waits in its queue (see ratelimit.h).
+
+Return code: Always 0
+
+********************************************************************** */
+
+int PassToDestination(const char *szLine, int cch, long lPosition,
+		      struct TDestination *pdest)
+{
+  pdest->ulLines++;
+  if (pdest->format.idFormat!=LOGFORMAT_LINE)
+    szLine=FormatLine(szLine,&cch,lPosition,pdest);
+  else if (pdest->bBinary)
+    szLine=BuildFrame(szLine,&cch,lPosition);
+  if (RateLimitEnabled(&pdest->rate))
+    {
+      if (pdest->status==dead) return 0; /* inactive destination */
+      DrainRateLimit(pdest);
+      if (!RateLimitTake(&pdest->rate))
+	{
+	  int rc=RateLimitQueue(&pdest->rate,szLine,cch,lPosition);
+	  if (rc<0)
+	    Panic(PANIC_RUN,"cannot queue for [%s]: %m",pdest->szAlias);
+	  if (!rc)
+	    HoldCheckpoint(lPosition);
+	  return 0;
+	}
+    }
+  return DeliverToDestination(szLine,cch,lPosition,pdest);
+}
+
+/* **********************************************************************
+
+ReportRepeats(pdest, cRepeats, lPosition)
+
+Pass the summary line for collapsed repeats (see dedup.h).
+
+********************************************************************** */
+
+void ReportRepeats(struct TDestination *pdest, unsigned long cRepeats,
+		   long lPosition)
+{
+  char ach[64];
+  int  cch;
+  if (!cRepeats) return;
+  cch=snprintf(ach,sizeof(ach),DEDUP_FORMAT,cRepeats,
+	       cRepeats==1 ? "" : "s");
+  PassToDestination(ach,cch,lPosition,pdest);
+  pchParsed=NULL; /* ach is gone, see FormatLine() */
+}
+
+/* **********************************************************************
+
+QueueToDestination(szLine, cch, lPosition, pdest)
+
+Pass a line to a destination. A correlating destination gets only
+the lines of its active ids (see correlate.h). It sees every line
+first, so a trigger starts its id even if the sample drops the line.
+A sampled destination gets only the lines chosen by the sample (see
+sample.h), the others never touch its pipe. With dedup, a repeated
+line is only counted, and the count is reported before the next
+different line. A counter only counts the line (see counter.h).
+
+Return code: Always 0
+
+********************************************************************** */
+
+int QueueToDestination(const char *szLine, int cch, long lPosition,
+		       struct TDestination *pdest)
+{
+  unsigned long cRepeats;
+  if (!CorrelateKeep(&pdest->correlate,szLine)
+      || !SampleKeep(&pdest->sample,szLine,cch))
+    return 0;
+  if (pdest->bCounter)
+    {
+      if (pdest->status!=dead)
+	{
+	  pdest->ulLines++;
+	  CounterFeed(&pdest->counter,szLine);
+	}
+      return 0;
+    }
+  if (DedupCheck(&pdest->dedup,szLine,cch,lPosition,&cRepeats))
+    return 0;
+  ReportRepeats(pdest,cRepeats,lPosition);
+  return PassToDestination(szLine,cch,lPosition,pdest);
+}
+
+/* **********************************************************************
+
+StartURing()
+
+Set up the io_uring engine for the current destinations. The pipes
+are not registered as fixed files, because a restart or a takeover
+replaces them, and a registered pipe would never see its EOF. If the
+kernel cannot do it, the classic write() path stays.
+
+********************************************************************** */
+
+void StartURing(void)
+{
+  struct TDestination *pdest;
+  int c=0;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    c++;
+  if (!c) return;
+  if (URingInit(&uring,c,0)<0)
+    {
+      lprintf("notice: no io_uring (%m), using write()");
+      return;
+    }
+  if (c>cURingSlots)
+    {
+      apdestWrite=realloc(apdestWrite,c*sizeof(struct TDestination*));
+      ahWrite=realloc(ahWrite,c*sizeof(int));
+      apchWrite=realloc(apchWrite,c*sizeof(char*));
+      acchWrite=realloc(acchWrite,c*sizeof(int));
+      acchWritten=realloc(acchWritten,c*sizeof(int));
+      if (!apdestWrite || !ahWrite || !apchWrite || !acchWrite || !acchWritten)
+	Panic(PANIC_RUN,"out of memory for io_uring");
+      cURingSlots=c;
+    }
+  dprintf(DEBUG_CONFIG,"io_uring ready for %d destination(s)\n",c);
+}
+
+/* **********************************************************************
+
+FlushDestinationsURing(bAll)
+
+Like FlushDestinations(), but the batches of all healthy pipe
+destinations go to the kernel in one submission. A failed write is
+repeated on the classic path, which restarts the destination and
+gives it the whole batch, as FlushDestination() would do.
+
+********************************************************************** */
+
+void FlushDestinationsURing(TBool bAll)
+{
+  struct TDestination *pdest;
+  int i,c=0,cFailed;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    {
+      if (!pdest->batch.cchBuffer)
+	continue;
+      if (!bAll && LineBatchMsLeft(&pdest->batch))
+	continue;
+      if (pdest->status!=running || pdest->hPipe<0 || pdest->pRing
+	  || pdest->bSpareBroken || c>=cURingSlots)
+	{
+	  FlushDestination(pdest); /* with all the special cases */
+	  continue;
+	}
+      dprintf(DEBUG_PIPES,"flushing %d line(s) to [%s]\n",
+	      pdest->batch.cLines,pdest->szAlias);
+      apdestWrite[c]=pdest;
+      ahWrite[c]=pdest->hPipe;
+      apchWrite[c]=pdest->batch.pchBuffer;
+      acchWrite[c]=pdest->batch.cchBuffer;
+      c++;
+    }
+  if (!c) return;
+  bPipeDied=false;
+  cFailed=URingWriteAll(&uring,c,ahWrite,apchWrite,acchWrite,acchWritten);
+  if (cFailed<0)
+    {
+      lprintf("warning: io_uring failed (%m), using write()");
+      URingExit(&uring);
+    }
+  for (i=0; i<c; i++)
+    {
+      pdest=apdestWrite[i];
+      if (acchWritten[i]<acchWrite[i])
+	{
+	  if (cFailed<0) /* not finished, but the pipe is fine */
+	    EchoToDestination(apchWrite[i]+acchWritten[i],
+			      acchWrite[i]-acchWritten[i],pdest);
+	  else
+	    EchoToDestination(apchWrite[i],acchWrite[i],pdest);
+	}
+      LineBatchClear(&pdest->batch);
+    }
+}
+
+/* **********************************************************************
+
+EmitCounts(pdest)
+
+Append the result line of a counter to its file, after the snapshots
+of its sketches, if it wants them, and start the next interval.
+Without a file, the counts of the interval are dropped, the
+statistics have shown them.
+
+********************************************************************** */
+
+void EmitCounts(struct TDestination *pdest)
+{
+  char *pchLine;
+  int   cch,i;
+  TBool bFile=pdest->status!=dead && pdest->hPipe>=0;
+  for (i=0; bFile && pdest->counter.bSnapshot
+	 && i<pdest->counter.cSketches; i++)
+    {
+      char *pch=CounterSnapshot(&pdest->counter,pdest->szAlias,i,&cch);
+      if (!pch || WriteFully(pdest->hPipe,pch,cch)!=cch)
+	lprintf("warning: cannot write snapshot of [%s]: %m",pdest->szAlias);
+      free(pch);
+    }
+  cch=CounterFormatSize(&pdest->counter,pdest->szAlias);
+  pchLine=malloc(cch);
+  if (!pchLine)
+    Panic(PANIC_RUN,"out of memory for the counts of [%s]",pdest->szAlias);
+  cch=CounterFormat(&pdest->counter,pdest->szAlias,pchLine,cch,true);
+  if (bFile && WriteFully(pdest->hPipe,pchLine,cch)!=cch)
+    lprintf("warning: cannot write counts of [%s]: %m",pdest->szAlias);
+  free(pchLine);
+}
+
+/* **********************************************************************
+
+FlushBatches(bAll)
+
+Flush the batches, which are due (or all of them with bAll).
+
+********************************************************************** */
+
+void FlushBatches(TBool bAll)
+{
+  struct TDestination *pdest;
+  if (URingActive(&uring))
+    {
+      FlushDestinationsURing(bAll);
+      return;
+    }
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (bAll || !LineBatchMsLeft(&pdest->batch))
+      FlushDestination(pdest);
+}
+
+/* **********************************************************************
+
+FlushDestinations(bAll)
+
+Report the repeats, whose window is over, deliver the rate limited
+lines, which have got their tokens, and flush the batches, which are
+due (or everything with bAll). Counters report at the end of their
+interval only.
+
+********************************************************************** */
+
+void FlushDestinations(TBool bAll)
+{
+  struct TDestination *pdest;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    {
+      if (bAll || !DedupMsLeft(&pdest->dedup))
+	{
+	  long          lPosition;
+	  unsigned long cRepeats=DedupFlush(&pdest->dedup,&lPosition);
+	  ReportRepeats(pdest,cRepeats,lPosition);
+	}
+      if (pdest->status!=dead)
+	DrainRateLimit(pdest);
+      if (pdest->bCounter && !CounterMsLeft(&pdest->counter))
+	EmitCounts(pdest);
+    }
+  FlushBatches(bAll);
+}
+
+/* **********************************************************************
+
+DispatchLine(szLine, cch, lPosition)
+
+Queue a line (or a whole record) to all destinations. After a restart
+the destinations before iFirstDest have already got it.
+
+********************************************************************** */
+
+void DispatchLine(const char *szLine, int cch, long lPosition)
+{
+  struct TDestination *pdest;
+  int iDestination;
+  pchParsed=NULL; /* a new line, see FormatLine() */
+  for (pdest=pdestFirst, iDestination=0;
+       pdest;
+       iDestination++, pdest=pdest->pNext)
+    if (iDestination>=iFirstDest)
+      QueueToDestination(szLine,cch,lPosition,pdest);
+  iFirstDest=0;           /* no more "rewinding" necessary */
+}
+
+/* **********************************************************************
+
+DispatchRecord()
+
+Deliver the assembled record, if there is one, as a single unit.
+
+********************************************************************** */
+
+void DispatchRecord(void)
+{
+  if (!mlRecord.cLines) return;
+  DispatchLine(mlRecord.pchBuffer,mlRecord.cchBuffer,mlRecord.lPosition);
+  ulRecords++;
+  MultilineClear(&mlRecord);
+}
+
+/* **********************************************************************
+
+AssembleLine(szLine, cch, lPosition)
+
+Pass a complete line to the record assembly, or directly to the
+destinations, if there is no multiline rule.
+
+********************************************************************** */
+
+void AssembleLine(const char *szLine, int cch, long lPosition)
+{
+  if (!MultilineEnabled(&mlRecord))
+    {
+      DispatchLine(szLine,cch,lPosition);
+      return;
+    }
+  if (MultilineStarts(&mlRecord,szLine,cch))
+    DispatchRecord();
+  if (MultilineAppend(&mlRecord,szLine,cch,lPosition)<0)
+    Panic(PANIC_RUN,"out of memory for multiline record");
+}
+
+/* **********************************************************************
+
+ConfigureBatches(idMode)
+
+(Re)initialise the batches of all destinations. In catch-up mode,
+destinations without own batch bounds get big batches with a bounded
+delay, instead of one write per line.
+
+********************************************************************** */
+
+void ConfigureBatches(TFollowMode idMode)
+{
+  struct TDestination *pdest;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    {
+      int rc;
+      FlushDestination(pdest);
+      LineBatchFree(&pdest->batch);
+      if (idMode==FOLLOW_CATCHUP && !pdest->cchBatchMaxBytes
+	  && !pdest->cBatchMaxLines && !pdest->msBatchMaxDelay)
+	rc=LineBatchInit(&pdest->batch,FOLLOW_CATCHUP_BATCH,0,
+			 FOLLOW_CATCHUP_DELAY);
+      else
+	rc=LineBatchInit(&pdest->batch,pdest->cchBatchMaxBytes,
+			 pdest->cBatchMaxLines,pdest->msBatchMaxDelay);
+      if (rc<0)
+	Panic(PANIC_RUN,"no memory for batch of [%s]",pdest->szAlias);
+    }
+}
+
+/* **********************************************************************
+
+SwitchMode(idMode)
+
+Change between live and catch-up mode.
+
+********************************************************************** */
+
+void SwitchMode(TFollowMode idMode)
+{
+  if (idMode==idFollowMode) return;
+  if (bVerbose)
+    lprintf("switching to %s mode, %ld byte(s) behind",
+	    FollowModeName(idMode),lLastGap);
+  idFollowMode=idMode;
+  tiModeSince=time(NULL);
+  ulModeSwitches++;
+  ConfigureBatches(idMode);
+}
+
+/* **********************************************************************
+
+DumpStatistics()
+
+Log the counters, on request by SIGUSR1.
+
+********************************************************************** */
+
+void DumpStatistics(void)
+{
+  struct TDestination *pdest;
+  bStatsRequest=false;
+  lprintf("statistics: mode=%s for %lds, switches=%lu, lines=%lu, "
+	  "records=%lu, truncated=%lu, bytes=%lld, position=%ld, gap=%ld",
+	  FollowModeName(idFollowMode),(long)(time(NULL)-tiModeSince),
+	  ulModeSwitches,ulLinesRead,ulRecords,arenaLines.ulTruncated,
+	  llBytesRead,lReadPosition,lLastGap);
+  if (szPathGlob)
+    lprintf("statistics: path_glob files=%d, open=%d",
+	    logset.cFiles,logset.cOpen);
+  if (indexFile.hIndex>=0)
+    lprintf("statistics: index records=%lu, lines=%lld",
+	    indexFile.ulRecords,indexFile.llLines);
+  if (ulLinesParsed)
+    lprintf("statistics: parsed lines=%lu, syslog headers=%lu",
+	    ulLinesParsed,ulHeadersParsed);
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    {
+      lprintf("statistics: [%s] status=%d, lines=%lu, restarts=%lu, pending=%d",
+	      pdest->szAlias,(int)pdest->status,pdest->ulLines,
+	      pdest->ulRestarts,pdest->batch.cLines);
+      if (pdest->bCounter)
+	{
+	  int   cch=CounterFormatSize(&pdest->counter,pdest->szAlias);
+	  char *pch=malloc(cch);
+	  if (pch)
+	    {
+	      CounterFormat(&pdest->counter,pdest->szAlias,pch,cch,false);
+	      ChopLine(pch);
+	      lprintf("statistics: counter %s",pch);
+	      free(pch);
+	    }
+	}
+      if (pdest->bPlugin)
+	{
+	  unsigned long ulBatches,ulLines;
+	  int           cchPending;
+	  PluginStatistics(&pdest->plugin,&ulBatches,&ulLines,&cchPending);
+	  lprintf("statistics: [%s] plugin batches=%lu, lines=%lu, "
+		  "pending=%d byte(s)",pdest->szAlias,ulBatches,ulLines,
+		  cchPending);
+	}
+      if (DedupEnabled(&pdest->dedup))
+	lprintf("statistics: [%s] dedup suppressed=%lu",
+		pdest->szAlias,pdest->dedup.ulSuppressed);
+      if (CorrelateEnabled(&pdest->correlate))
+	lprintf("statistics: [%s] correlate ids=%ld, triggered=%lu, "
+		"kept=%lu, rejected=%lu, evicted=%lu",pdest->szAlias,
+		pdest->correlate.cUsed,pdest->correlate.ulTriggered,
+		pdest->correlate.ulKept,pdest->correlate.ulRejected,
+		pdest->correlate.ulEvicted);
+      if (SampleEnabled(&pdest->sample))
+	lprintf("statistics: [%s] sample=1/%lu, kept=%lu, rejected=%lu",
+		pdest->szAlias,pdest->sample.ulModulus,
+		pdest->sample.ulKept,pdest->sample.ulRejected);
+      if (pdest->rate.dRate>0)
+	lprintf("statistics: [%s] rate=%g/s, throttled=%lu, dropped=%lu, "
+		"queued=%d, spooled=%lu",pdest->szAlias,pdest->rate.dRate,
+		pdest->rate.ulThrottled,pdest->rate.ulDropped,
+		pdest->rate.cQueued,pdest->rate.cSpooled);
+    }
+}
+
+/* **********************************************************************
+
+WaitForInput(ms)
+
+Sleep for ms milliseconds, while there is nothing to read, or until
+the monitored file (or a file of the path_glob) changes. Batches and
+a record getting due in the meantime are flushed in time.
+
+********************************************************************** */
+
+void WaitForInput(long msTotal)
+{
+  while (msTotal>0 && !bAbortRequest && !bHUPRequest)
+    {
+      struct TDestination *pdest;
+      long ms=msTotal;
+      TBool bChanged=false;
+      for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+	{
+	  long msLeft=LineBatchMsLeft(&pdest->batch);
+	  if (msLeft>=0 && msLeft<ms) ms=msLeft;
+	  msLeft=pdest->status==dead ? -1 : RateLimitMsLeft(&pdest->rate);
+	  if (msLeft>=0 && msLeft<ms) ms=msLeft;
+	  msLeft=DedupMsLeft(&pdest->dedup);
+	  if (msLeft>=0 && msLeft<ms) ms=msLeft;
+	  msLeft=pdest->bCounter ? CounterMsLeft(&pdest->counter) : -1;
+	  if (msLeft>=0 && msLeft<ms) ms=msLeft;
+	}
+      if (MultilineMsLeft(&mlRecord)>=0 && MultilineMsLeft(&mlRecord)<ms)
+	ms=MultilineMsLeft(&mlRecord);
+      if (ms>0 && szPathGlob)
+	bChanged=LogSetWait(&logset,ms);
+      else if (ms>0)
+	bChanged=FollowWait(hWatch,ms); /* interrupted by signals */
+      msTotal-=ms;
+      if (!MultilineMsLeft(&mlRecord))
+	DispatchRecord();
+      FlushDestinations(false);
+      if (bStatsRequest) DumpStatistics();
+      if (bChanged) break;
+    }
+}
+
+/* **********************************************************************
+
+AppendSegment(pch, cch)
+
+Add a piece of a line to the arena, skipping CR characters.
+
+********************************************************************** */
+
+void AppendSegment(const char *pch, int cch)
+{
+  while (cch>0)
+    {
+      const char *pchCR=memchr(pch,'\r',cch);
+      int cchCopy=pchCR ? pchCR-pch : cch;
+      if (LineArenaAppend(&arenaLines,pch,cchCopy)<0)
+	Panic(PANIC_RUN,"out of memory for line buffer");
+      if (pchCR) cchCopy++; /* skip CR */
+      pch+=cchCopy;
+      cch-=cchCopy;
+    }
+}
+
+/* **********************************************************************
+
+DispatchOpenLine()
+
+Close the line in the arena and pass it on. Lines of FILE are shown
+to the index, if there is one.
+
+********************************************************************** */
+
+void DispatchOpenLine(void)
+{
+  const char *pchLine;
+  int         cchLine;
+  pchLine=LineArenaClose(&arenaLines,&cchLine,NULL);
+  if (!pchLine)
+    Panic(PANIC_RUN,"out of memory for line buffer");
+  if (ReplayEnabled(&replay)
+      && ReplayCheck(&replay,pchLine,cchLine,replay.llBase+lReadPosition)
+      !=REPLAY_PASS)
+    return; /* outside the replayed range */
+  if (LogIndexLine(&indexFile,pchLine,cchLine,lReadPosition)<0)
+    lprintf("cannot write index of \"%s\", giving it up (%m)",
+	    szMonitoredFile);
+  AssembleLine(pchLine,cchLine,lReadPosition);
+}
+
+/* **********************************************************************
+
+SplitBlock(cch, &lFileIndex)
+
+Split the first cch bytes of the read buffer into lines and pass the
+complete ones on. lFileIndex is the file position of the block and is
+moved past it, lReadPosition follows the last complete line.
+
+********************************************************************** */
+
+void SplitBlock(int cch, long *plFileIndex)
+{
+  int iRead;
+  for (iRead=0; iRead<cch && !bAbortRequest && !bHUPRequest; )
+    {
+      const char *pchNL=memchr(achReadBuffer+iRead,'\n',cch-iRead);
+      int iEnd=pchNL ? pchNL-achReadBuffer : cch;
+      AppendSegment(achReadBuffer+iRead,iEnd-iRead);
+      *plFileIndex+=iEnd-iRead;
+      iRead=iEnd;
+      if (pchNL)
+	{
+	  iRead++;
+	  (*plFileIndex)++;
+	  DispatchOpenLine();
+	  lReadPosition=*plFileIndex; /* update line status */
+	  ulLinesRead++;
+	}
+    }
+}
+
+/* **********************************************************************
+
+StartWithoutCheckpoint()
+
+Set the read position of FILE without a checkpoint by -A to the first
+line at the time (see ReplaySeekTime()), or by -n to the last lines
+(see ReplaySeekLines()). On failure it stays at the start.
+
+********************************************************************** */
+
+void StartWithoutCheckpoint(void)
+{
+  long long   ll;
+  struct stat statFD;
+  if (tiStartAt)
+    {
+      long long llLow=0;
+      if (fstat(hMonitoredFile,&statFD)<0
+	  || LogIndexFind(szMonitoredFile,statFD.st_ino,tiStartAt,&llLow)<0)
+	llLow=0;
+      ll=ReplaySeekTime(hMonitoredFile,llLow,tiStartAt);
+    }
+  else
+    ll=ReplaySeekLines(hMonitoredFile,cStartLines);
+  if (ll<0)
+    {
+      lprintf("cannot search \"%s\" for the start, starting at 0 (%m)",
+	      szMonitoredFile);
+      return;
+    }
+  lReadPosition=(long)ll;
+  if (bVerbose)
+    lprintf("no checkpoint, starting at %ld",lReadPosition);
+}
+
+/* **********************************************************************
+
+OpenIndex()
+
+Open the index of FILE at the read position, if index_kb asks for
+one. Without it, following goes on.
+
+********************************************************************** */
+
+void OpenIndex(void)
+{
+  if (cchIndexInterval<=0) return;
+  if (LogIndexOpen(&indexFile,szMonitoredFile,hMonitoredFile,
+		   cchIndexInterval,lReadPosition)<0)
+    lprintf("cannot open index of \"%s\", going on without (%m)",
+	    szMonitoredFile);
+}
+
+/* **********************************************************************
+
+MonitorFile()
+
+Seek to the last position of the open file and watch it changing :-)
+
+The file is read in blocks. Their size, the batching and the
+checkpoint frequency follow the mode (see follow.h): Far behind, the
+status file is written every FOLLOW_CATCHUP_STATUS seconds, live it
+is written after every block.
+
+Lines are built in the arena, which is reset after every block, when
+the lines have been copied to the batches (see linearena.h). With a
+multiline rule, the lines are assembled to records first (see
+multiline.h). A record still in assembly at the end is not lost, the
+checkpoint points to its start.
+
+********************************************************************** */
+
+void MonitorFile(void)
+{
+  long        lFileIndex;
+  ino_t       iNode;          /* inode of open file */
+  struct stat statFD;
+  time_t      tiLastStatus;
+  struct timeval tvReceived;
+
+  /*
+    since lseek allows for seeking beyond EOF, we have do to the bounds
+    check manually.
+  */
+  if (fstat(hMonitoredFile,&statFD)<0)
+    Panic(PANIC_RUN,"cannot fstat monitored fd: %m");
+  lFileIndex=statFD.st_size;
+  iNode=iMonitoredInode=statFD.st_ino;
+  if (lFileIndex<lReadPosition)
+    {
+      if (bVerbose)
+	lprintf("file size<lastpos, restarting at beginning");
+      lReadPosition=lseek(hMonitoredFile, 0, SEEK_SET);
+      bNoCheckpoint=true;
+    }
+  if (bNoCheckpoint && (tiStartAt || cStartLines>=0))
+    StartWithoutCheckpoint();
+  bNoCheckpoint=false;
+  if (lseek(hMonitoredFile, lReadPosition, SEEK_SET)!=lReadPosition)
+    Panic(PANIC_RUN,"cannot seek to %ld",lReadPosition);
+  LineArenaClear(&arenaLines);
+  /* we cannot update lReadPosition bytewise, because we probably want
+     to recap the line, if a destination crashes.
+     So we update it linewise. */
+  lLastGap=statFD.st_size-lReadPosition;
+  lFileIndex=lReadPosition;
+  OpenIndex();
+  hWatch=FollowWatch(szMonitoredFile);
+  tiModeSince=tiLastStatus=time(NULL);
+  SwitchMode(FollowMode(idFollowMode,lLastGap));
+
+  bWriteStatus=true;
+
+  while (!bAbortRequest && !bHUPRequest)
+    {
+      int cchWanted,cch;
+      if (bStatsRequest) DumpStatistics();
+      cchWanted=(idFollowMode==FOLLOW_CATCHUP)
+	? FOLLOW_CATCHUP_READ : FOLLOW_LIVE_READ;
+      cch=read(hMonitoredFile,achReadBuffer,cchWanted); /* non blocking */
+      if (cch<=0)
+	{
+	  int   cRetries;
+	  TBool bReopen=false;
+	  lLastGap=0;
+	  SwitchMode(FOLLOW_LIVE);
+	  WaitForInput(2000);
+	  if (bHUPRequest) break; /* break whole master loop */
+
+	  cRetries=cSecondsForTakeover;
+	  while (stat(szMonitoredFile,&statFD)<0)
+	    {
+	      sleep(1);
+	      if (!cRetries--)
+		Panic(PANIC_RUN,"cannot restat \"%s\": %m",
+		      szMonitoredFile);
+	    }
+	  if (statFD.st_ino!=iNode)
+	    {
+	      if (bVerbose)
 		lprintf("inode of %s changed, restarting",szMonitoredFile);
 	      bReopen=true;
 	      iNode=statFD.st_ino;
@@ -938,55 +2214,317 @@ void MonitorFile(void)
 	    In this single output line, the destinations
 	    are vulnerable, thus losing a line if they crash.
 	  */
-	  if (i)
-	    {
-	      achLine[i++]='\n'; achLine[i]='\0';
-	      bWriteStatus=false; /* no log of inconsistent data */
-	      for (pdest=pdestFirst;
-		   pdest;
-		   pdest=pdest->pNext)
-		EchoToDestination(achLine,pdest);
-	      bWriteStatus=true;
-	    }
+	  bWriteStatus=false; /* no log of inconsistent data */
+	  if (LineArenaOpen(&arenaLines))
+	    DispatchOpenLine();
+	  LineArenaClear(&arenaLines);
+	  DispatchRecord();
+	  FlushDestinations(true); /* nothing may refer to the old file */
+	  bWriteStatus=true;
 	  close(hMonitoredFile);
-	  hMonitoredFile=open(szMonitoredFile,O_RDONLY);
+	  hMonitoredFile=open(szMonitoredFile,O_RDONLY|O_CLOEXEC);
 	  if (hMonitoredFile<0)
 	    Panic(PANIC_RUN,"cannot open continuation log \"%s\"",
 		  szMonitoredFile);
+	  FollowUnwatch(hWatch);
+	  hWatch=FollowWatch(szMonitoredFile);
+	  iMonitoredInode=iNode;
 	  lFileIndex=lReadPosition=0; /* update line status */
+	  LogIndexClose(&indexFile);
+	  OpenIndex();
 	  WriteStatusFile();
-	  i=0;
 	  continue; /* and restart reading from scratch */
 	}
-      lFileIndex++;
-      if (achLine[i]=='\r') i--; /* skip CR */
-      else if (achLine[i]=='\n') 
+      llBytesRead+=cch;
+      gettimeofday(&tvReceived,NULL);
+      ullReceiveTime=(uint64_t)tvReceived.tv_sec*1000000+tvReceived.tv_usec;
+
+      /* a full block may mean, that we are far behind */
+      if (cch==cchWanted || idFollowMode==FOLLOW_CATCHUP)
 	{
-	  int iDestination;
-	  achLine[++i]='\0';
-	  for (pdest=pdestFirst, iDestination=0;
-	       pdest;
-	       iDestination++, pdest=pdest->pNext)
-	    if (iDestination>=iFirstDest)
-	      EchoToDestination(achLine,pdest);
-	  iFirstDest=0;           /* no more "rewinding" necessary */
-	  lReadPosition=lFileIndex; /* update line status */
-	  WriteStatusFile();
-	  i=0;
+	  if (fstat(hMonitoredFile,&statFD)==0)
+	    {
+	      lLastGap=statFD.st_size-(lFileIndex+cch);
+	      SwitchMode(FollowMode(idFollowMode,lLastGap));
+	    }
 	}
-      else
+
+      LogIndexTick(&indexFile);
+      SplitBlock(cch,&lFileIndex);
+      if (!MultilineMsLeft(&mlRecord))
+	DispatchRecord();
+      FlushDestinations(false);
+      LineArenaReset(&arenaLines); /* all closed lines are copied */
+      if (idFollowMode==FOLLOW_LIVE
+	  || tiLastStatus+FOLLOW_CATCHUP_STATUS<=time(NULL))
 	{
-	  i++;
-	  if (i+1>=sizeof(achLine))
-	    i--; /* forget the trailing garbage */
+	  WriteStatusFile();
+	  tiLastStatus=time(NULL);
 	}
     }
   /* test abort request */
   if (!bAbortRequest && !bHUPRequest)
     Panic(PANIC_INTERNAL,"internal error: line buffer overflowed");
 
+  FlushDestinations(true);
   WriteStatusFile();
   bWriteStatus=false;
+  if (mlRecord.cLines)
+    lReadPosition=mlRecord.lPosition; /* a HUP goes on from here */
+  MultilineClear(&mlRecord); /* to be read again from the checkpoint */
+  LogIndexClose(&indexFile);
+  FollowUnwatch(hWatch);
+  hWatch=ID_NOFILE;
+}
+
+/* **********************************************************************
+
+FinishLogFile(bRecord)
+
+Records and runs of repeats do not span files, but they do span the
+writes to a file: They stay open after a round, until another file is
+read (or the record times out, see WaitForInput()). Then the record is
+delivered (or left to be read again, without bRecord), everything is
+flushed, and the position of the file is its checkpoint again.
+
+********************************************************************** */
+
+void FinishLogFile(TBool bRecord)
+{
+  if (!plfCurrent) return;
+  if (bRecord) DispatchRecord();
+  FlushDestinations(true);
+  plfCurrent->lPosition=CheckpointPosition();
+  MultilineClear(&mlRecord);
+  plfCurrent=NULL;
+}
+
+/* **********************************************************************
+
+cchRead=ReadLogFile(plf)
+
+Read what is new in one file of the path_glob. A record or a run of
+repeats still open for another file is finished first (see
+FinishLogFile()), those of this file go on. The batches are flushed
+at the end. An unfinished last line is read again next time. A file
+with more than FOLLOW_CATCHUP_ENTER new bytes stays changed and gets
+the rest in the next round, so one big file cannot starve the others.
+
+Return code: The number of bytes read.
+
+********************************************************************** */
+
+long ReadLogFile(TLogFile *plf)
+{
+  struct stat    statFD;
+  struct timeval tvReceived;
+  long           lFileIndex,cchTotal=0;
+  int            rc;
+  plf->bChanged=false;
+  if (plfCurrent!=plf)
+    FinishLogFile(true);
+  rc=LogSetOpen(&logset,plf);
+  if (rc<0)
+    {
+      if (errno!=ENOENT)
+	lprintf("warning: cannot read \"%s\": %m",plf->szPath);
+      if (plfCurrent==plf)
+	FinishLogFile(true);
+      plf->bGone=true;
+      LogSetClose(&logset,plf);
+      return 0;
+    }
+  if (rc>0)
+    {
+      if (bVerbose)
+	lprintf("%s was replaced or truncated, restarting",plf->szPath);
+      if (plfCurrent)
+	{
+	  FinishLogFile(true); /* the old contents */
+	  plf->lPosition=0;
+	  plf->lHeld=-1;
+	}
+    }
+  plfCurrent=plf;
+  iMonitoredInode=plf->iNode;
+  lFileIndex=lReadPosition=plf->lPosition;
+  LineArenaClear(&arenaLines);
+  if (fstat(plf->hFile,&statFD)==0)
+    {
+      lLastGap=statFD.st_size-lReadPosition;
+      SwitchMode(FollowMode(idFollowMode,lLastGap));
+    }
+  while (!bAbortRequest && !bHUPRequest)
+    {
+      int cch,cchWanted=(idFollowMode==FOLLOW_CATCHUP)
+	? FOLLOW_CATCHUP_READ : FOLLOW_LIVE_READ;
+      if (cchTotal>=FOLLOW_CATCHUP_ENTER)
+	{
+	  plf->bChanged=true; /* the others first */
+	  break;
+	}
+      cch=read(plf->hFile,achReadBuffer,cchWanted);
+      if (cch<=0) break;
+      cchTotal+=cch;
+      llBytesRead+=cch;
+      gettimeofday(&tvReceived,NULL);
+      ullReceiveTime=(uint64_t)tvReceived.tv_sec*1000000+tvReceived.tv_usec;
+      SplitBlock(cch,&lFileIndex);
+      FlushDestinations(false);
+      LineArenaReset(&arenaLines);
+    }
+  LineArenaClear(&arenaLines); /* read again from lReadPosition */
+  FlushBatches(true);
+  plf->lPosition=lReadPosition; /* the checkpoint is CheckpointPosition() */
+  if (cchTotal)
+    plf->tiActive=time(NULL);
+  return cchTotal;
+}
+
+/* **********************************************************************
+
+MonitorGlob()
+
+Follow all files of the path_glob: Discover new ones, read the changed
+ones in turn, and close the handles of idle and gone files after
+msPathIdle (see logset.h). The status file has a position per file.
+
+********************************************************************** */
+
+void MonitorGlob(void)
+{
+  time_t tiLastStatus=time(NULL);
+  if (LogSetScan(&logset)<0)
+    Panic(PANIC_RUN,"cannot read directory %s: %m",logset.szDir);
+  tiModeSince=tiLastStatus;
+  bWriteStatus=true;
+  WriteStatusFile(); /* forget files, which are not there any more */
+  while (!bAbortRequest && !bHUPRequest)
+    {
+      TLogFile *plf;
+      long      cchRound=0;
+      if (bStatsRequest) DumpStatistics();
+      LogSetWait(&logset,0);
+      for (plf=logset.plfFirst;
+	   plf && !bAbortRequest && !bHUPRequest;
+	   plf=plf->pNext)
+	if (plf->bChanged || (plf->bGone && plf->hFile>=0))
+	  cchRound+=ReadLogFile(plf);
+      if (plfCurrent && plfCurrent->bGone)
+	FinishLogFile(true); /* it is dropped now */
+      LogSetExpire(&logset,msPathIdle);
+      if ((cchRound
+	   && (idFollowMode==FOLLOW_LIVE
+	       || tiLastStatus+FOLLOW_CATCHUP_STATUS<=time(NULL)))
+	  || (bHeld && !RateLimited())) /* release the holds */
+	{
+	  WriteStatusFile();
+	  tiLastStatus=time(NULL);
+	}
+      if (!cchRound)
+	{
+	  lLastGap=0;
+	  SwitchMode(FOLLOW_LIVE);
+	  WaitForInput(2000);
+	}
+    }
+  FinishLogFile(false); /* a record is read again from the checkpoint */
+  WriteStatusFile();
+  bWriteStatus=false;
+}
+
+/* **********************************************************************
+
+FinishDestinations()
+
+At the end of a replay, let the destinations consume everything: the
+pipes are closed and the processes are waited for, not terminated.
+Counters write the counts of their last interval.
+
+********************************************************************** */
+
+void FinishDestinations(void)
+{
+  struct TDestination *pdest;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    {
+      pid_t idProcess=pdest->idProcess;
+      if (pdest->bCounter)
+	EmitCounts(pdest);
+      pdest->idProcess=ID_NOPROCESS; /* no SIGTERM by the shutdown */
+      ShutdownDestination(pdest);
+      ShutdownSpare(pdest);
+      if (idProcess>0)
+	waitpid(idProcess,NULL,0); /* may be reaped by SIGCHLD already */
+    }
+}
+
+/* **********************************************************************
+
+ReplayRange()
+
+Read the files of the replay with big blocks (see replay.h) and
+dispatch the lines in the range, until its end or the end of the last
+file. Rate limited lines are waited for. There is no status file in a
+replay, so the checkpoint of the daemon stays as it is.
+
+********************************************************************** */
+
+void ReplayRange(void)
+{
+  struct TDestination *pdest;
+  struct timeval       tvReceived;
+  TBool                bPending;
+  int                  h;
+  SwitchMode(FOLLOW_CATCHUP); /* big batches */
+  while (!bAbortRequest && (h=ReplayOpen(&replay))>=0)
+    {
+      struct stat statFD;
+      long        lFileIndex;
+      int         cch=0;
+      hMonitoredFile=h;
+      if (fstat(h,&statFD)==0)
+	iMonitoredInode=statFD.st_ino;
+      lFileIndex=lReadPosition=replay.lStart;
+      LineArenaClear(&arenaLines);
+      while (!bAbortRequest && !replay.bDone
+	     && (cch=read(h,achReadBuffer,sizeof(achReadBuffer)))>0)
+	{
+	  llBytesRead+=cch;
+	  gettimeofday(&tvReceived,NULL);
+	  ullReceiveTime=(uint64_t)tvReceived.tv_sec*1000000
+	    +tvReceived.tv_usec;
+	  SplitBlock(cch,&lFileIndex);
+	  FlushDestinations(false);
+	  LineArenaReset(&arenaLines);
+	  if (bStatsRequest) DumpStatistics();
+	}
+      if (cch<0)
+	Panic(PANIC_RUN,"cannot read replayed file: %m");
+      if (LineArenaOpen(&arenaLines) && !replay.bDone)
+	DispatchOpenLine(); /* unterminated last line */
+      LineArenaClear(&arenaLines);
+      close(h);
+      hMonitoredFile=ID_NOFILE;
+    }
+  if (errno && !bAbortRequest)
+    Panic(PANIC_RUN,"cannot open replayed file: %m");
+  DispatchRecord();
+  do
+    {
+      FlushDestinations(true);
+      bPending=false;
+      for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+	if (pdest->status!=dead && RateLimitMsLeft(&pdest->rate)>=0)
+	  bPending=true;
+      if (bPending)
+	WaitForInput(1000);
+    }
+  while (bPending && !bAbortRequest);
+  if (bVerbose)
+    lprintf("replay %s: %lu line(s) replayed, %lu skipped",
+	    bAbortRequest ? "aborted" : "done",replay.ulPassed,
+	    replay.ulSkipped);
 }
 
 /* **********************************************************************
@@ -1024,6 +2562,14 @@ int ReadConfigurationFile(const char *szName)
   SetString(&szStatusFile,NULL);
   SetString(&szPidFile,NULL);
   SetString(&szWorkDir,"/");
+  SetString(&szMultiline,NULL);
+  SetString(&szMultilineStart,NULL);
+  msMultilineTimeout=0;
+  cchMaxLine=0;
+  bURing=false;
+  SetString(&szPathGlob,NULL);
+  msPathIdle=LOGSET_DEFAULT_IDLE;
+  cchIndexInterval=0;
   
   while (!feof(fh))
     {
@@ -1072,6 +2618,16 @@ int ReadConfigurationFile(const char *szName)
 	  pdest=pdestNew;
 	  pdest->szAlias=strdup(achAlias);
 	  pdest->hPipe = ID_NOFILE;
+	  pdest->idProcess = ID_NOPROCESS;
+	  pdest->hSparePipe = ID_NOFILE;
+	  pdest->cbShmSize = SHMRING_DEFAULT_SIZE;
+	  RateLimitInit(&pdest->rate);
+	  SampleInit(&pdest->sample);
+	  CorrelateInit(&pdest->correlate);
+	  LogFormatInit(&pdest->format);
+	  DedupInit(&pdest->dedup);
+	  CounterInit(&pdest->counter);
+	  pdest->idSpareProcess = ID_NOPROCESS;
 	  if (pdest->aszArgs)
 	    pdest->aszArgs[0]=(pdest->szCommandline)
 	      ? pdest->szCommandline
@@ -1103,7 +2659,7 @@ int ReadConfigurationFile(const char *szName)
 		  nLine,szName);
 	}
       while (*pchValue && isspace(*pchValue)) pchValue++;
-      bNumerical=isdigit(pchValue);
+      bNumerical=(isdigit(*pchValue)!=0);
       if (bNumerical)
 	{
 	  /* check rest of the number */
@@ -1143,6 +2699,29 @@ int ReadConfigurationFile(const char *szName)
 	    SetString(&szPidFile,pchValue);
 	  else if (!strcmp(pchKey,"workdir"))
 	    SetString(&szWorkDir,pchValue);
+	  else if (!strcmp(pchKey,"multiline"))
+	    SetString(&szMultiline,pchValue);
+	  else if (!strcmp(pchKey,"multiline_start"))
+	    SetString(&szMultilineStart,pchValue);
+	  else if (!strcmp(pchKey,"multiline_timeout_ms"))
+	    msMultilineTimeout=atol(pchValue);
+	  else if (!strcmp(pchKey,"max_line"))
+	    cchMaxLine=atoi(pchValue);
+	  else if (!strcmp(pchKey,"path_glob"))
+	    SetString(&szPathGlob,pchValue);
+	  else if (!strcmp(pchKey,"path_idle_timeout_ms"))
+	    msPathIdle=atol(pchValue);
+	  else if (!strcmp(pchKey,"index_kb"))
+	    cchIndexInterval=atol(pchValue)*1024;
+	  else if (!strcmp(pchKey,"io_engine"))
+	    {
+	      if (!strcmp(pchValue,"uring"))
+		bURing=true;
+	      else if (!strcmp(pchValue,"classic"))
+		bURing=false;
+	      else Panic(PANIC_CONFIG,"unknown io_engine %s in line %d of %s\n",
+			 pchValue,nLine,szName);
+	    }
 	  else Panic(PANIC_CONFIG,"unknown key %s in line %d of %s\n",
 		     pchKey,nLine,szName);
 	  break;
@@ -1156,8 +2735,138 @@ int ReadConfigurationFile(const char *szName)
 	      FreeArgTokens(pdest->aszArgs);
 	      pdest->aszArgs=TokenizeArgs(pchValue);
 	    }
+	  else if (!strcmp(pchKey,"framing"))
+	    {
+	      if (!strcmp(pchValue,"binary"))
+		pdest->bBinary=true;
+	      else if (!strcmp(pchValue,"text"))
+		pdest->bBinary=false;
+	      else Panic(PANIC_CONFIG,"unknown framing %s in line %d of %s\n",
+			 pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"format"))
+	    {
+	      if (LogFormatKind(&pdest->format,pchValue)<0)
+		Panic(PANIC_CONFIG,"unknown format %s in line %d of %s\n",
+		      pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"fields"))
+	    {
+	      if (LogFormatFields(&pdest->format,pchValue)<0)
+		Panic(PANIC_CONFIG,"bad fields %s in line %d of %s\n",
+		      pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"transport"))
+	    {
+	      if (!strcmp(pchValue,"shm"))
+		pdest->bShm=true;
+	      else if (!strcmp(pchValue,"pipe"))
+		pdest->bShm=false;
+	      else Panic(PANIC_CONFIG,"unknown transport %s in line %d of %s\n",
+			 pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"shm_size"))
+	    pdest->cbShmSize=atol(pchValue);
+	  else if (!strcmp(pchKey,"standby"))
+	    pdest->bStandby=(atoi(pchValue)!=0);
+	  else if (!strcmp(pchKey,"batch_max_bytes"))
+	    pdest->cchBatchMaxBytes=atoi(pchValue);
+	  else if (!strcmp(pchKey,"batch_max_lines"))
+	    pdest->cBatchMaxLines=atoi(pchValue);
+	  else if (!strcmp(pchKey,"batch_max_delay_ms"))
+	    pdest->msBatchMaxDelay=atol(pchValue);
+	  else if (!strcmp(pchKey,"rate_limit"))
+	    {
+	      if (RateLimitParse(&pdest->rate,pchValue)<0)
+		Panic(PANIC_CONFIG,"bad rate_limit %s in line %d of %s\n",
+		      pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"sample"))
+	    {
+	      if (SampleParse(&pdest->sample,pchValue)<0)
+		Panic(PANIC_CONFIG,"bad sample %s in line %d of %s\n",
+		      pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"sample_key"))
+	    {
+	      if (SampleKey(&pdest->sample,pchValue)<0)
+		Panic(PANIC_CONFIG,"bad sample_key in line %d of %s\n",
+		      nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"correlate_trigger")
+		   || !strcmp(pchKey,"correlate_id"))
+	    {
+	      if ((strcmp(pchKey,"correlate_id")
+		   ? CorrelateTrigger(&pdest->correlate,pchValue)
+		   : CorrelateId(&pdest->correlate,pchValue))<0)
+		Panic(PANIC_CONFIG,"bad %s in line %d of %s\n",
+		      pchKey,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"correlate_ttl_s"))
+	    pdest->correlate.sTTL=atol(pchValue);
+	  else if (!strcmp(pchKey,"correlate_max"))
+	    pdest->correlate.cMax=atol(pchValue);
+	  else if (!strcmp(pchKey,"dedup"))
+	    {
+	      if (DedupParse(&pdest->dedup,pchValue)<0)
+		Panic(PANIC_CONFIG,"unknown dedup %s in line %d of %s\n",
+		      pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"dedup_window_ms"))
+	    pdest->dedup.msWindow=atol(pchValue);
+	  else if (!strcmp(pchKey,"type"))
+	    {
+	      pdest->bCounter=!strcmp(pchValue,"counter");
+	      pdest->bPlugin=!strcmp(pchValue,"plugin");
+	      if (!pdest->bCounter && !pdest->bPlugin
+		  && strcmp(pchValue,"process"))
+		Panic(PANIC_CONFIG,"unknown type %s in line %d of %s\n",
+		      pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"path"))
+	    SetString(&(pdest->szPluginPath),pchValue);
+	  else if (!strcmp(pchKey,"pattern"))
+	    {
+	      if (CounterAddPattern(&pdest->counter,pchValue)<0)
+		Panic(PANIC_CONFIG,"bad pattern %s in line %d of %s\n",
+		      pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"interval_s"))
+	    pdest->counter.sInterval=atol(pchValue);
+	  else if (!strcmp(pchKey,"topk") || !strcmp(pchKey,"distinct"))
+	    {
+	      if (CounterAddSketch(&pdest->counter,
+				   strcmp(pchKey,"topk")
+				   ? SKETCH_DISTINCT : SKETCH_TOPK,
+				   pchValue)<0)
+		Panic(PANIC_CONFIG,"bad %s %s in line %d of %s\n",
+		      pchKey,pchValue,nLine,szName);
+	    }
+	  else if (!strcmp(pchKey,"topk_size"))
+	    pdest->counter.cSketchTop=atoi(pchValue);
+	  else if (!strcmp(pchKey,"sketch_width"))
+	    pdest->counter.cSketchWidth=atoi(pchValue);
+	  else if (!strcmp(pchKey,"sketch_depth"))
+	    pdest->counter.cSketchDepth=atoi(pchValue);
+	  else if (!strcmp(pchKey,"hll_bits"))
+	    pdest->counter.cSketchBits=atoi(pchValue);
+	  else if (!strcmp(pchKey,"snapshot"))
+	    pdest->counter.bSnapshot=atoi(pchValue);
+	  else if (!strcmp(pchKey,"merge"))
+	    pdest->counter.bMerge=atoi(pchValue);
+	  else if (!strcmp(pchKey,"rate_queue"))
+	    pdest->rate.cMaxQueued=atoi(pchValue);
+	  else if (!strcmp(pchKey,"rate_policy"))
+	    {
+	      if (!strcmp(pchValue,"spool"))
+		pdest->rate.bSpool=true;
+	      else if (!strcmp(pchValue,"drop"))
+		pdest->rate.bSpool=false;
+	      else Panic(PANIC_CONFIG,"unknown rate_policy %s in line %d of %s\n",
+			 pchValue,nLine,szName);
+	    }
 	  else Panic(PANIC_CONFIG,"unknown key %s in line %d of %s\n",
-		     nLine,szName);
+		     pchKey,nLine,szName);
 	  break;
 	default:
 	  Panic(PANIC_CONFIG,"value not allowed outside section in line %d of %s\n",
@@ -1165,6 +2874,34 @@ int ReadConfigurationFile(const char *szName)
 	}
     }
   fclose(fh);
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (CorrelateAllocate(&pdest->correlate)<0)
+      Panic(PANIC_CONFIG,"[%s] needs correlate_trigger and correlate_id "
+	    "and sane sizes in %s (or there is no memory)",
+	    pdest->szAlias,szName);
+    else if (pdest->bCounter && pdest->szCommandline)
+      Panic(PANIC_CONFIG,"counter [%s] cannot have a command in %s",
+	    pdest->szAlias,szName);
+    else if (pdest->bCounter && pdest->format.idFormat!=LOGFORMAT_LINE)
+      Panic(PANIC_CONFIG,"counter [%s] cannot have a format in %s",
+	    pdest->szAlias,szName);
+    else if (pdest->bCounter && CounterAllocate(&pdest->counter)<0)
+      Panic(PANIC_CONFIG,"bad sketch sizes of [%s] in %s (or no memory)",
+	    pdest->szAlias,szName);
+    else if (pdest->bPlugin)
+      {
+	if (!pdest->szPluginPath || pdest->szCommandline)
+	  Panic(PANIC_CONFIG,"plugin [%s] needs a path and no command in %s",
+		pdest->szAlias,szName);
+	pdest->bBinary=true; /* plugins get frames, see plugin.h */
+      }
+  ConfigureBatches(idFollowMode);
+  MultilineFree(&mlRecord);
+  if (MultilineInit(&mlRecord,szMultiline,szMultilineStart,
+		    msMultilineTimeout)<0)
+    Panic(PANIC_CONFIG,"invalid multiline rule in %s",szName);
+  LineArenaFree(&arenaLines);
+  LineArenaInit(&arenaLines,cchMaxLine);
   return 0;
 }
 
@@ -1213,17 +2950,25 @@ void WritePidFile(TBool bCreate)
 OpenMonitoredFile()
 
 This little helper is just for the juggling with teh file handles to get
-an fd > 2.
+an fd > 2. With a path_glob, the directory watch is set up instead.
 
 ********************************************************************** */
 
 void OpenMonitoredFile(void)
 {
-  int hTemp=open(szMonitoredFile,O_RDONLY);
+  int hTemp;
+  if (szPathGlob)
+    {
+      hMonitoredFile=ID_NOFILE;
+      if (LogSetInit(&logset,szPathGlob)<0)
+	Panic(PANIC_CONFIG,"cannot watch \"%s\" [%m]",szPathGlob);
+      return;
+    }
+  hTemp=open(szMonitoredFile,O_RDONLY);
   hMonitoredFile=-1;
   if (hTemp<0)
     Panic(PANIC_RUN,"cannot open \"%s\" [%m]",szMonitoredFile);
-  hMonitoredFile=fcntl(hTemp,F_DUPFD,3);
+  hMonitoredFile=fcntl(hTemp,F_DUPFD_CLOEXEC,3);
   close(hTemp);
   if (hMonitoredFile<0)
     Panic(PANIC_RUN,"cannot fdup \"%s\" [%m]",szMonitoredFile);
@@ -1231,6 +2976,210 @@ void OpenMonitoredFile(void)
 
 /* **********************************************************************
 
+SameString(sz1, sz2)
+
+Return code: true, if both strings are equal or both are NULL.
+
+********************************************************************** */
+
+TBool SameString(const char *sz1, const char *sz2)
+{
+  if (!sz1 || !sz2)
+    return sz1==sz2;
+  return !strcmp(sz1,sz2);
+}
+
+/* **********************************************************************
+
+SameDestination(pdest1, pdest2)
+
+Compare everything, that is needed to start a destination, and the
+patterns of a counter, which keeps its counts only if they stay the
+same. Batch bounds are not, because they can be changed on the fly.
+
+Return code: true, if a running pdest1 can stay as pdest2.
+
+********************************************************************** */
+
+TBool SameDestination(const struct TDestination *pdest1,
+		      const struct TDestination *pdest2)
+{
+  char **ppch1=pdest1->aszArgs,**ppch2=pdest2->aszArgs;
+  if (!SameString(pdest1->szCommandline,pdest2->szCommandline)
+      || !SameString(pdest1->szOutputFile,pdest2->szOutputFile)
+      || pdest1->bBinary!=pdest2->bBinary
+      || !LogFormatSame(&pdest1->format,&pdest2->format)
+      || pdest1->bShm!=pdest2->bShm
+      || pdest1->cbShmSize!=pdest2->cbShmSize
+      || pdest1->bStandby!=pdest2->bStandby
+      || pdest1->bCounter!=pdest2->bCounter
+      || pdest1->bPlugin!=pdest2->bPlugin
+      || !SameString(pdest1->szPluginPath,pdest2->szPluginPath)
+      || !CounterSame(&pdest1->counter,&pdest2->counter))
+    return false;
+  if (!ppch1 || !ppch2)
+    return ppch1==ppch2;
+  ppch1++; /* the first slot is set to the program by a start */
+  ppch2++;
+  while (*ppch1 && *ppch2)
+    if (strcmp(*ppch1++,*ppch2++))
+      return false;
+  return *ppch1==*ppch2;
+}
+
+/* **********************************************************************
+
+MoveRateQueue(pdestOld)
+
+Hand the rate limited lines of a stopped destination to the new one of
+the same alias, through a temporary file as for an upgrade. The lines
+are written already, so the new one must want them in the same shape
+(framing and format). Otherwise they are dropped, and that is logged.
+
+********************************************************************** */
+
+void MoveRateQueue(struct TDestination *pdestOld)
+{
+  struct TDestination *pdest;
+  long  cLines=pdestOld->rate.cQueued+(long)pdestOld->rate.cSpooled;
+  FILE *fh;
+  TRateLimit rateNew;
+  if (!cLines) return;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (!strcmp(pdest->szAlias,pdestOld->szAlias))
+      break;
+  if (pdest && !pdest->bCounter && pdest->bBinary==pdestOld->bBinary
+      && LogFormatSame(&pdest->format,&pdestOld->format)
+      && (fh=tmpfile())!=NULL)
+    {
+      long c=RateLimitSave(&pdestOld->rate,fh);
+      rateNew=pdest->rate; /* the settings, if the loading fails */
+      rewind(fh);
+      if (c==cLines && RateLimitLoad(&pdest->rate,fh,c)==0)
+	{
+	  fclose(fh);
+	  if (bVerbose)
+	    lprintf("[%s] takes over %ld rate limited line(s)",
+		    pdest->szAlias,cLines);
+	  return;
+	}
+      fclose(fh);
+      RateLimitFree(&pdest->rate); /* whatever got loaded */
+      RateLimitAdopt(&pdest->rate,&rateNew);
+    }
+  lprintf("warning: [%s] stopped, %ld rate limited line(s) dropped",
+	  pdestOld->szAlias,cLines);
+}
+
+/* **********************************************************************
+
+ReloadConfiguration(szName)
+
+Read the configuration again, on SIGHUP, and compare the destinations
+with the running ones by their alias. Unchanged destinations keep
+their processes, pipes, files, queued lines and counts, and only take
+over new batch bounds, rate limits, samples and dedup settings. Only
+new and changed destinations are started, and only the removed and
+changed ones are stopped, where counters write their counts so far.
+The monitored file stays open, so reading goes on where it has
+stopped. A destination disabled after a failure is started again.
+The rate limited lines of a changed destination go to the new one
+(see MoveRateQueue()).
+
+********************************************************************** */
+
+void ReloadConfiguration(const char *szName)
+{
+  struct TDestination *pdestOld=pdestFirst,*pdest,*pNext,**ppdest;
+  char *szOldGlob=szPathGlob ? strdup(szPathGlob) : NULL;
+  int   cKept=0,cStarted=0,cStopped=0;
+
+  URingExit(&uring);
+  WritePidFile(false); /* PID file name may change */
+
+  pdestFirst=NULL;
+  ReadConfigurationFile(szName);
+  if (!szPathGlob!=(szMonitoredFile!=NULL))
+    Panic(PANIC_CONFIG,"path_glob and FILE cannot be swapped by a HUP");
+  if (chdir(szWorkDir)<0)
+    Panic(PANIC_CONFIG,"cannot chdir to %s [%m]",szWorkDir);
+  WritePidFile(true);
+
+  /* put the unchanged running destinations into the new list */
+  for (ppdest=&pdestFirst; *ppdest; ppdest=&(*ppdest)->pNext)
+    {
+      struct TDestination *pdestNew=*ppdest,**ppdestOld;
+      for (ppdestOld=&pdestOld; *ppdestOld; ppdestOld=&(*ppdestOld)->pNext)
+	if (!strcmp((*ppdestOld)->szAlias,pdestNew->szAlias))
+	  break;
+      if (!*ppdestOld || !SameDestination(*ppdestOld,pdestNew))
+	continue;
+      pdest=*ppdestOld;
+      *ppdestOld=pdest->pNext;
+      pdest->pNext=pdestNew->pNext;
+      pdest->cchBatchMaxBytes=pdestNew->cchBatchMaxBytes;
+      pdest->cBatchMaxLines=pdestNew->cBatchMaxLines;
+      pdest->msBatchMaxDelay=pdestNew->msBatchMaxDelay;
+      RateLimitAdopt(&pdest->rate,&pdestNew->rate);
+      SampleFree(&pdest->sample);
+      pdest->sample=pdestNew->sample; /* the new one owns nothing now */
+      SampleInit(&pdestNew->sample);
+      if (!CorrelateSame(&pdest->correlate,&pdestNew->correlate))
+	{
+	  CorrelateFree(&pdest->correlate);
+	  pdest->correlate=pdestNew->correlate; /* the active ids are gone */
+	  CorrelateInit(&pdestNew->correlate);
+	}
+      pdest->dedup.idMode=pdestNew->dedup.idMode;
+      pdest->dedup.msWindow=pdestNew->dedup.msWindow;
+      *ppdest=pdest;
+      FreeDestination(pdestNew);
+      dprintf(DEBUG_CONFIG,"keeping [%s]\n",pdest->szAlias);
+      cKept++;
+    }
+
+  /* the rest of the old ones is removed or changed */
+  for (pdest=pdestOld; pdest; pdest=pNext)
+    {
+      pNext=pdest->pNext;
+      if (bVerbose)
+	lprintf("stopping destination [%s]",pdest->szAlias);
+      FlushDestination(pdest); /* empty anyway */
+      if (pdest->bCounter)
+	EmitCounts(pdest);
+      MoveRateQueue(pdest);
+      ShutdownDestination(pdest);
+      ShutdownSpare(pdest);
+      FreeDestination(pdest);
+      cStopped++;
+    }
+
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (pdest->status==dead)
+      {
+	if (bVerbose)
+	  lprintf("starting destination [%s]",pdest->szAlias);
+	RestartDestination(pdest);
+	cStarted++;
+      }
+  ConfigureBatches(idFollowMode);
+  if (bURing)
+    StartURing();
+
+  if (!SameString(szOldGlob,szPathGlob))
+    {
+      LogSetFree(&logset);
+      OpenMonitoredFile(); /* before the status, which fills the set */
+      ReadStatusFile();
+    }
+  free(szOldGlob);
+  if (bVerbose)
+    lprintf("configuration reloaded: %d destination(s) kept, "
+	    "%d started, %d stopped",cKept,cStarted,cStopped);
+}
+
+/* **********************************************************************
+
 Daemonize()
 
 Do everything, that makes a nice daemon from a normal process
@@ -1253,12 +3202,429 @@ void Daemonize(void)
   else if (rc>0) _exit(0); /* parent path */
 }
 
+/* **********************************************************************
+
+KeepHandles(bKeep)
+
+Let the handles of the monitored file and of the handed over
+destinations (see WriteHandover()) survive the exec() of an upgrade,
+or not any more.
+
+********************************************************************** */
+
+void KeepHandles(TBool bKeep)
+{
+  struct TDestination *pdest;
+  int nFlags=bKeep ? 0 : FD_CLOEXEC;
+  if (!szPathGlob && hMonitoredFile>=0)
+    fcntl(hMonitoredFile,F_SETFD,nFlags);
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (pdest->status==running && !pdest->bPlugin)
+      {
+	if (pdest->hPipe>=0)
+	  fcntl(pdest->hPipe,F_SETFD,nFlags);
+	if (pdest->hSparePipe>=0)
+	  fcntl(pdest->hSparePipe,F_SETFD,nFlags);
+      }
+}
+
+/* **********************************************************************
+
+WriteHandover(fh)
+
+Write the state for the new binary of an upgrade (see Upgrade()), in
+the manner of the status file: the read position with the handle of
+the monitored file (with a path_glob, the read positions of the files
+held back in the status file), the running destinations with their
+handles, processes and spares, the counts of the counters, the
+snapshots of their sketches, the active ids of correlating
+destinations and the rate limited lines, which follow their "sketch",
+"correlate" or "queue" entry. The aliases come last, so they may
+contain anything.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+int WriteHandover(FILE *fh)
+{
+  struct TDestination *pdest;
+  fprintf(fh,"firstpipe:%d\n",iFirstDest);
+  if (!szPathGlob)
+    fprintf(fh,"file:%d:%ld\n",hMonitoredFile,lReadPosition);
+  else
+    {
+      TLogFile *plf;
+      for (plf=logset.plfFirst; plf; plf=plf->pNext)
+	if (!plf->bGone && plf->lHeld>=0)
+	  fprintf(fh,"held:%lu:%ld\n",(unsigned long)plf->iNode,
+		  plf==plfCurrent ? CheckpointPosition() : plf->lPosition);
+    }
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    {
+      if (pdest->status==running && !pdest->bPlugin)
+	{
+	  TBool bSpare=pdest->idSpareProcess>0 && !pdest->bSpareBroken
+	    && (pdest->pSpareRing!=NULL)==(pdest->pRing!=NULL);
+	  fprintf(fh,"dest:%d:%d:%d:%d:%d:%lu:%lu:%s\n",pdest->pRing!=NULL,
+		  pdest->hPipe,(int)pdest->idProcess,
+		  bSpare ? pdest->hSparePipe : ID_NOFILE,
+		  bSpare ? (int)pdest->idSpareProcess : ID_NOPROCESS,
+		  pdest->ulLines,pdest->ulRestarts,pdest->szAlias);
+	}
+      if (pdest->bCounter)
+	{
+	  int i;
+	  fprintf(fh,"counter:%ld:%lu:%d",(long)pdest->counter.tiStart,
+		  pdest->counter.ulLines,pdest->counter.cPatterns);
+	  for (i=0; i<pdest->counter.cPatterns; i++)
+	    fprintf(fh,":%lu",pdest->counter.apat[i].ulCount);
+	  fprintf(fh,":%s\n",pdest->szAlias);
+	  for (i=0; i<pdest->counter.cSketches; i++)
+	    {
+	      int   cch;
+	      char *pch=CounterSnapshot(&pdest->counter,pdest->szAlias,i,&cch);
+	      if (!pch) return -1;
+	      fprintf(fh,"sketch:%d:%s\n",cch,pdest->szAlias);
+	      fwrite(pch,cch,1,fh);
+	      free(pch);
+	    }
+	}
+      if (pdest->correlate.cUsed)
+	{
+	  fprintf(fh,"correlate:%ld:%s\n",pdest->correlate.cUsed,
+		  pdest->szAlias);
+	  if (CorrelateSave(&pdest->correlate,fh)!=pdest->correlate.cUsed)
+	    return -1;
+	}
+      if (pdest->rate.cQueued || pdest->rate.cSpooled)
+	{
+	  fprintf(fh,"queue:%ld:%lu:%lu:%s\n",
+		  pdest->rate.cQueued+(long)pdest->rate.cSpooled,
+		  pdest->rate.ulThrottled,pdest->rate.ulDropped,
+		  pdest->szAlias);
+	  if (RateLimitSave(&pdest->rate,fh)<0)
+	    return -1;
+	}
+    }
+  if (fflush(fh) || ferror(fh))
+    return -1;
+  return 0;
+}
+
+/* **********************************************************************
+
+FindDestination(szAlias)
+
+Return code: The destination with that alias, or NULL.
+
+********************************************************************** */
+
+struct TDestination *FindDestination(const char *szAlias)
+{
+  struct TDestination *pdest;
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (!strcmp(pdest->szAlias,szAlias))
+      break;
+  return pdest;
+}
+
+/* **********************************************************************
+
+AbandonProcess(h, idProcess)
+
+Close a handed over handle and stop its process, if the destination
+cannot be adopted.
+
+********************************************************************** */
+
+void AbandonProcess(int h, pid_t idProcess)
+{
+  if (h>=0) close(h);
+  if (idProcess>0)
+    {
+      kill(idProcess,SIGTERM);
+      waitpid(idProcess,NULL,0); /* still our child */
+    }
+}
+
+/* **********************************************************************
+
+AdoptDestination(szAlias, bShm, hPipe, idProcess, hSparePipe,
+		 idSpareProcess)
+
+Take over a running destination of the old binary by its alias. It
+must still be there, and be of the same kind, else its process is
+stopped, and it is started like a new one.
+
+Return code: true, if the destination has been adopted.
+
+********************************************************************** */
+
+TBool AdoptDestination(const char *szAlias, TBool bShm, int hPipe,
+		       pid_t idProcess, int hSparePipe, pid_t idSpareProcess)
+{
+  struct TDestination *pdest=FindDestination(szAlias);
+  if (hPipe>=0) fcntl(hPipe,F_SETFD,FD_CLOEXEC);
+  if (hSparePipe>=0) fcntl(hSparePipe,F_SETFD,FD_CLOEXEC);
+  if (pdest && pdest->status==dead && !pdest->bPlugin
+      && bShm==pdest->bShm
+      && (idProcess>0)==(pdest->szCommandline!=NULL))
+    {
+      pdest->pRing=bShm ? ShmRingAttach(hPipe) : NULL;
+      if (bShm && !pdest->pRing)
+	lprintf("cannot attach shm ring of [%s] [%m]",szAlias);
+      else
+	{
+	  pdest->hPipe=hPipe;
+	  pdest->idProcess=idProcess;
+	  pdest->status=running;
+	  if (hSparePipe>=0
+	      && (!bShm || (pdest->pSpareRing=ShmRingAttach(hSparePipe))))
+	    {
+	      pdest->hSparePipe=hSparePipe;
+	      pdest->idSpareProcess=idSpareProcess;
+	    }
+	  else
+	    AbandonProcess(hSparePipe,idSpareProcess);
+	  dprintf(DEBUG_PIPES,"adopted [%s] on fd %d\n",szAlias,hPipe);
+	  return true;
+	}
+    }
+  if (bVerbose)
+    lprintf("stopping handed over destination [%s]",szAlias);
+  AbandonProcess(hPipe,idProcess);
+  AbandonProcess(hSparePipe,idSpareProcess);
+  return false;
+}
+
+/* **********************************************************************
+
+ReadHandover()
+
+Read the state of an upgrade (see WriteHandover()), if we have been
+started by Upgrade(), after the configuration. It replaces opening
+FILE and reading the status file, which is still read before for the
+positions of a path_glob. A file held back there is read on from its
+handed over position, and keeps the hold.
+
+Return code: true, if there has been a state.
+
+********************************************************************** */
+
+TBool ReadHandover(void)
+{
+  FILE *fh;
+  char  achLine[PATH_MAX+64];
+  char *szHandover=getenv(HANDOVER_ENV);
+  int   h,cAdopted=0;
+  if (!szHandover) return false;
+  h=atoi(szHandover);
+  unsetenv(HANDOVER_ENV); /* not for the children */
+  fh=fdopen(h,"r");
+  if (!fh)
+    Panic(PANIC_RUN,"cannot read the handover state [%m]");
+  hMonitoredFile=ID_NOFILE;
+  while (fgets(achLine,sizeof(achLine),fh))
+    {
+      char *szKey,*szRest;
+      int   cch=0;
+      STRING_TERMINATE(achLine);
+      ChopLine(achLine);
+      szKey=strtok(achLine,":");
+      szRest=strtok(NULL,"");
+      if (!szKey || !szRest)
+	Panic(PANIC_RUN,"bad handover state");
+      if (!strcmp(szKey,"firstpipe"))
+	iFirstDest=atoi(szRest);
+      else if (!strcmp(szKey,"file"))
+	{
+	  if (sscanf(szRest,"%d:%ld",&hMonitoredFile,&lReadPosition)!=2)
+	    Panic(PANIC_RUN,"bad handover file entry");
+	  fcntl(hMonitoredFile,F_SETFD,FD_CLOEXEC);
+	}
+      else if (!strcmp(szKey,"held"))
+	{
+	  unsigned long ulNode;
+	  long          lPosition;
+	  TLogFile     *plf;
+	  if (sscanf(szRest,"%lu:%ld",&ulNode,&lPosition)!=2)
+	    Panic(PANIC_RUN,"bad handover held entry");
+	  for (plf=logset.plfFirst; plf; plf=plf->pNext)
+	    if ((unsigned long)plf->iNode==ulNode
+		&& plf->lPosition<lPosition)
+	      {
+		plf->lHeld=plf->lPosition;
+		plf->lPosition=lPosition;
+		bHeld=true;
+	      }
+	}
+      else if (!strcmp(szKey,"dest"))
+	{
+	  int           bShm,hPipe,idProcess,hSparePipe,idSpareProcess;
+	  unsigned long ulLines,ulRestarts;
+	  if (sscanf(szRest,"%d:%d:%d:%d:%d:%lu:%lu:%n",&bShm,&hPipe,
+		     &idProcess,&hSparePipe,&idSpareProcess,&ulLines,
+		     &ulRestarts,&cch)!=7 || !cch)
+	    Panic(PANIC_RUN,"bad handover destination entry");
+	  if (AdoptDestination(szRest+cch,bShm,hPipe,idProcess,hSparePipe,
+			       idSpareProcess))
+	    {
+	      struct TDestination *pdest=FindDestination(szRest+cch);
+	      pdest->ulLines=ulLines;
+	      pdest->ulRestarts=ulRestarts;
+	      cAdopted++;
+	    }
+	}
+      else if (!strcmp(szKey,"counter"))
+	{
+	  long                 tiStart;
+	  unsigned long        ulLines;
+	  int                  cPatterns,i;
+	  char                *pch;
+	  struct TDestination *pdest;
+	  if (sscanf(szRest,"%ld:%lu:%d:%n",&tiStart,&ulLines,&cPatterns,
+		     &cch)!=3 || !cch || cPatterns<0)
+	    Panic(PANIC_RUN,"bad handover counter entry");
+	  for (pch=szRest+cch,i=0; i<cPatterns; i++)
+	    if (strtoul(pch,&pch,10),*pch++!=':')
+	      Panic(PANIC_RUN,"bad handover counter entry");
+	  pdest=FindDestination(pch); /* behind the counts */
+	  if (pdest && pdest->bCounter && pdest->counter.cPatterns==cPatterns)
+	    {
+	      pdest->counter.tiStart=tiStart;
+	      pdest->counter.ulLines=ulLines;
+	      for (pch=szRest+cch,i=0; i<cPatterns; i++,pch++)
+		pdest->counter.apat[i].ulCount=strtoul(pch,&pch,10);
+	    }
+	}
+      else if (!strcmp(szKey,"sketch"))
+	{
+	  struct TDestination *pdest;
+	  char                *pch=NULL;
+	  int                  cchSnapshot;
+	  if (sscanf(szRest,"%d:%n",&cchSnapshot,&cch)!=1 || !cch
+	      || cchSnapshot<=0 || !(pch=malloc(cchSnapshot+1)))
+	    Panic(PANIC_RUN,"bad handover sketch entry");
+	  if (fread(pch,cchSnapshot,1,fh)!=1)
+	    Panic(PANIC_RUN,"cannot read the sketch of [%s]",szRest+cch);
+	  pch[cchSnapshot]='\0';
+	  pdest=FindDestination(szRest+cch);
+	  if (pdest && pdest->bCounter)
+	    CounterMerge(&pdest->counter,pch); /* into the empty sketch */
+	  free(pch);
+	}
+      else if (!strcmp(szKey,"correlate"))
+	{
+	  struct TDestination *pdest;
+	  TCorrelate           correlate;
+	  long                 cIds;
+	  if (sscanf(szRest,"%ld:%n",&cIds,&cch)!=1 || !cch)
+	    Panic(PANIC_RUN,"bad handover correlate entry");
+	  pdest=FindDestination(szRest+cch);
+	  CorrelateInit(&correlate); /* skips them */
+	  if (CorrelateLoad(pdest ? &pdest->correlate : &correlate,fh,cIds)<0)
+	    Panic(PANIC_RUN,"cannot load the ids of [%s] [%m]",szRest+cch);
+	}
+      else if (!strcmp(szKey,"queue"))
+	{
+	  long                 cLines;
+	  unsigned long        ulThrottled,ulDropped;
+	  struct TDestination *pdest;
+	  TRateLimit           rate;
+	  if (sscanf(szRest,"%ld:%lu:%lu:%n",&cLines,&ulThrottled,&ulDropped,
+		     &cch)!=3 || !cch)
+	    Panic(PANIC_RUN,"bad handover queue entry");
+	  pdest=FindDestination(szRest+cch);
+	  RateLimitInit(&rate);
+	  if (RateLimitLoad(pdest ? &pdest->rate : &rate,fh,cLines)<0)
+	    Panic(PANIC_RUN,"cannot load the queue of [%s] [%m]",
+		  szRest+cch);
+	  if (pdest)
+	    {
+	      pdest->rate.ulThrottled=ulThrottled;
+	      pdest->rate.ulDropped=ulDropped;
+	    }
+	  else
+	    lprintf("warning: %ld queued line(s) of [%s] dropped",cLines,
+		    szRest+cch);
+	  RateLimitFree(&rate);
+	}
+      else
+	Panic(PANIC_RUN,"unknown handover token %s",szKey);
+    }
+  fclose(fh);
+  if (!szPathGlob && hMonitoredFile<0)
+    Panic(PANIC_RUN,"no monitored file in the handover state");
+  if (bVerbose)
+    lprintf("daemon upgraded, %d destination(s) adopted",cAdopted);
+  return true;
+}
+
+/* **********************************************************************
+
+Upgrade(ppchArg)
+
+Hand the daemon over to the binary at its own path (e.g. a new version
+just installed there) on SIGUSR2, with the same arguments. Reading has
+stopped like for a HUP, and everything has been flushed. The state
+goes to an anonymous file (see WriteHandover()), and the handles are
+kept open across the exec(). The pid stays the same, so the processes
+of the destinations stay our children, and none is restarted. Plugins
+are closed, because their threads cannot survive the exec(), and
+loaded again by the new binary.
+
+Return code: None on success. On failure the daemon goes on with the
+old binary.
+
+********************************************************************** */
+
+void Upgrade(char * const ppchArg[])
+{
+  char     achSelf[PATH_MAX],achHandover[16];
+  FILE    *fh;
+  ssize_t  cch=readlink("/proc/self/exe",achSelf,sizeof(achSelf)-1);
+  struct TDestination *pdest;
+  if (cch<=0)
+    {
+      lprintf("error: cannot find the binary to upgrade to [%m]");
+      return;
+    }
+  achSelf[cch]='\0';
+  if (cch>10 && !strcmp(achSelf+cch-10," (deleted)"))
+    achSelf[cch-10]='\0'; /* replaced by the new one, as expected */
+  URingExit(&uring);
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    PluginClose(&pdest->plugin); /* after the pending lines */
+  fh=tmpfile();
+  if (fh && WriteHandover(fh)==0)
+    {
+      rewind(fh);
+      snprintf(achHandover,sizeof(achHandover),"%d",fileno(fh));
+      setenv(HANDOVER_ENV,achHandover,1);
+      KeepHandles(true);
+      if (bVerbose)
+	lprintf("upgrading to %s",achSelf);
+      execv(achSelf,ppchArg);
+      KeepHandles(false);
+      unsetenv(HANDOVER_ENV);
+    }
+  lprintf("error: cannot upgrade to %s, going on [%m]",achSelf);
+  if (fh) fclose(fh);
+  for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+    if (pdest->bPlugin && pdest->status==running)
+      RestartDestination(pdest);
+  if (bURing)
+    StartURing();
+}
+
 /* ============================== MAIN ============================== */
 
 int main(int cArg, char * const ppchArg[])
 {
-  char achConfigName[256];
-  char chOpt;
+  char  achConfigName[256];
+  char  chOpt;
+  TBool bHandover;
   
 /*
 DDD param:        -d 1 -f -c tailfd.conf testlog
@@ -1266,7 +3632,7 @@ DDD param:        -d 1 -f -c tailfd.conf testlog
 
   strcpy(achConfigName,DEF_CONFIG_FILE_NAME);
   
-  while (EOF!=(chOpt=getopt(cArg,ppchArg,"Vqfhd:c:t:r")))
+  while (EOF!=(chOpt=getopt(cArg,ppchArg,"Vqfhd:c:t:rF:T:RA:n:")))
     {
       switch (chOpt)
 	{
@@ -1285,17 +3651,27 @@ DDD param:        -d 1 -f -c tailfd.conf testlog
 	  break;
 	case 't': cSecondsForTakeover = atoi(optarg); break;
 	case 'r': bRestartBrokenDestinations=true; break;
+	case 'F': szReplayFrom = optarg; break;
+	case 'T': szReplayTo = optarg; break;
+	case 'R': bReplayRotated = true; break;
+	case 'A': szStartAt = optarg; break;
+	case 'n': cStartLines = atol(optarg); break;
 	}
     }
   
+  if (szReplayFrom || szReplayTo || bReplayRotated)
+    bDaemonMode = false; /* a replay is a run to completion */
+
   /* prepare logger */
   openlog(PROG_NAME,
 	  bDaemonMode ? LOG_PID : LOG_PERROR,
 	  LOG_DAEMON);
 
   ReadConfigurationFile(achConfigName);
+  if (!bDaemonMode && (szReplayFrom || szReplayTo || bReplayRotated))
+    SetString(&szPathGlob,NULL); /* a replay reads FILE */
 
-  if (optind!=cArg-1)
+  if (optind!=cArg-(szPathGlob ? 0 : 1))
     {
       printf(USAGE,PROG_NAME);
       exit(PANIC_USAGE);
@@ -1305,64 +3681,103 @@ DDD param:        -d 1 -f -c tailfd.conf testlog
     Panic(PANIC_CONFIG,"cannot chdir to %s [%m]",szWorkDir);
 
   /* open loggable file */
-  szMonitoredFile=ppchArg[optind];
+  if (!szPathGlob)
+    szMonitoredFile=ppchArg[optind];
+
+  ReplayInit(&replay);
+  LogParseInit(&parsed);
+  if (szStartAt && ReplayParseTime(szStartAt,&tiStartAt)<0)
+    Panic(PANIC_USAGE,"bad start time %s",szStartAt);
+  if (szStartAt && cStartLines>=0)
+    Panic(PANIC_USAGE,"-A and -n exclude each other");
+  if (szReplayFrom || szReplayTo || bReplayRotated)
+    {
+      struct TDestination *pdest;
+      if (ReplayBounds(&replay,szReplayFrom,szReplayTo)<0)
+	Panic(PANIC_USAGE,"bad replay range %s..%s",
+	      szReplayFrom ? szReplayFrom : "",szReplayTo ? szReplayTo : "");
+      if (ReplayFiles(&replay,szMonitoredFile,bReplayRotated)<0)
+	Panic(PANIC_CONFIG,"no memory");
+      hMonitoredFile=ID_NOFILE;
+      SetSignalHandler(true);
+      signal(SIGHUP,SIG_IGN); /* no reload in a replay */
+      signal(SIGUSR2,SIG_IGN); /* nor an upgrade */
+      for (pdest=pdestFirst; pdest; pdest=pdest->pNext)
+	RestartDestination(pdest);
+      if (bURing)
+	StartURing();
+      ReplayRange();
+      SetSignalHandler(false);
+      if (bAbortRequest)
+	Panic(PANIC_RUN,"replay aborted");
+      FinishDestinations();
+      CloseAllFilesAndPipes();
+      closelog();
+      return 0;
+    }
 
-  OpenMonitoredFile();
+  /* after an upgrade, FILE, the position and the destinations are
+     handed over, the positions of a path_glob are taken from the
+     status file first */
+  if (szPathGlob)
+    {
+      OpenMonitoredFile();
+      ReadStatusFile();
+    }
+  bHandover=ReadHandover();
 
-  if (bVerbose)
-    lprintf("daemon started");
+  if (!bHandover && !szPathGlob)
+    {
+      OpenMonitoredFile();
 
-  /* recap lReadPosition */
-  ReadStatusFile();
+      /* recap lReadPosition */
+      ReadStatusFile();
+    }
+  if (bVerbose && !bHandover)
+    lprintf("daemon started");
 
   SetSignalHandler(true);
+  if (bHandover)
+    raise(SIGCHLD); /* reap what has died during the exec() */
 
-  while (1)
-    {
-      struct TDestination *pdest,*pNext;
-      
-      if (bDaemonMode) Daemonize(); /* again and again */
+  if (bDaemonMode && !bHandover) Daemonize();
 
-      WritePidFile(true);
+  WritePidFile(true);
 
-      /* set up destinations, with detached FDs */
-      for (pdest=pdestFirst;
-	   pdest;
-	   pdest=pdest->pNext)
+  /* set up destinations, with detached FDs */
+  {
+    struct TDestination *pdest;
+    for (pdest=pdestFirst;
+	 pdest;
+	 pdest=pdest->pNext)
+      if (pdest->status==dead) /* not adopted */
 	RestartDestination(pdest);
+  }
+  if (bURing)
+    StartURing();
 
-      sleep(1); /* give childs a moment to crash :-) */
-      MonitorFile();
+  if (!bHandover)
+    sleep(1); /* give childs a moment to crash :-) */
 
+  while (1)
+    {
+      if (szPathGlob)
+	MonitorGlob();
+      else
+	MonitorFile();
+
+      if (bUpgradeRequest)
+	{
+	  bUpgradeRequest=bHUPRequest=false; /* clear signals */
+	  Upgrade(ppchArg); /* returns on failure only */
+	  continue;
+	}
       if (!bHUPRequest)
 	break;
       if (bVerbose)
 	lprintf("got a HUP request, rereading configuration...");
       bHUPRequest=false; /* clear signal */
-
-      /* shut down as much as possible */
-      for (pdest=pdestFirst;
-	   pdest;
-	   pdest=pNext)
-	{
-	  pNext=pdest->pNext;           /* pdest will be trashed */
-	  ShutdownDestination(pdest);   /* close pipes and childs */
-	  FreeDestination(pdest);       /* free node */
-	}
-      pdestFirst=NULL;
-      close(hMonitoredFile); hMonitoredFile = ID_NOFILE;
-
-      WritePidFile(false); /* PID file name may change */
-
-      /* redefine the whole world */
-      ReadConfigurationFile(achConfigName);
-
-      /* restart as much much as possible */
-      if (chdir(szWorkDir)<0)
-	Panic(PANIC_CONFIG,"cannot chdir to %s [%m]",szWorkDir);
-      ReadStatusFile();
-
-      OpenMonitoredFile();
+      ReloadConfiguration(achConfigName);
     }
 
   SetSignalHandler(false);
@@ -49,8 +49,16 @@ Panic() makes any sense instead.
 
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <poll.h>
 #include <unistd.h>
 
+#include "childspawn.h"
+#include "linebatch.h"
+#include "linearena.h"
+#include "uring.h"
+
 /* ====================================================================== */
 
 #define REVISION "Revision: 1.5 $"
@@ -61,6 +69,12 @@ Panic() makes any sense instead.
 "\n\noptions:"\
 "\n\t-V : tell version"\
 "\n\t-d : set debugging mask <MASK>"\
+"\n\t-S : always start slaves through /bin/sh"\
+"\n\t-b <bytes> : batch up to <bytes> before writing"\
+"\n\t-l <lines> : batch up to <lines> before writing"\
+"\n\t-w <ms> : write batched lines after <ms> at the latest"\
+"\n\t-m <bytes> : cut lines longer than <bytes> (default 1 MB)"\
+"\n\t-u : write through io_uring, if the kernel supports it"\
 "\n\n"
 
 #define DEBUG_CONFIG     0x0001
@@ -86,11 +100,24 @@ typedef enum { false, true } TBool;
 
 static unsigned long      ulDebugMask;
 
-static FILE             **afhDestinations;
+static pid_t             *aidDestinations;
 static int               *afdDestinations;
+static int                nShellMode=SPAWN_SHELL_AUTO;
+static int                cchBatchMaxBytes;
+static int                cBatchMaxLines;
+static long               msBatchMaxDelay;
+static int                cchMaxLine;
 
 #define                   LOG_BUFFER_SIZE 8192
 static char               achLogBuffer[LOG_BUFFER_SIZE];
+static TLineBatch         batchAll;        /* lines not yet written */
+static TLineArena         arenaLines;      /* lines spanning two reads */
+static TBool              bURing;          /* -u given */
+static TURing             uring={ .hRing=-1 }; /* the io_uring engine */
+static int                cDestinations;
+static const char       **apchWrite;       /* arguments for URingWriteAll() */
+static int               *acchWrite;
+static int               *acchWritten;
 
 /* **********************************************************************
 
@@ -123,14 +150,18 @@ Close all pipes and files and ...
 
 static void CloseAll(void)
 {
-  FILE **pfh;
-  if (afhDestinations)
+  int i;
+  URingExit(&uring); /* the ring holds references to the pipes */
+  if (afdDestinations)
     {
-      for (pfh=afhDestinations; *pfh; pfh++)
+      for (i=0; afdDestinations[i]>=0; i++)
 	{
 	  dprintf(DEBUG_PIPES,"closing child FD");
-	  pclose(*pfh);
-	  *pfh=NULL;
+	  close(afdDestinations[i]);
+	  afdDestinations[i]=-1;
+	  if (aidDestinations[i]>0)
+	    waitpid(aidDestinations[i],NULL,0);
+	  aidDestinations[i]=-1;
 	}
     }
 }
@@ -246,23 +277,89 @@ static int ReadFromFile(int fdFile, char *pchTo, int cchMax)
 
 /* **********************************************************************
 
-i=SearchNewLine(achBuffer,cch)
+WriteToAll(pchBuffer,cch)
+
+Write the buffer to every destination. Panics on error. With the
+io_uring engine, all writes go to the kernel in one submission.
+
+********************************************************************** */
+
+static void WriteToAll(const char *pchBuffer, int cch)
+{
+  int *pfd;
+  if (URingActive(&uring))
+    {
+      int i;
+      for (i=0; i<cDestinations; i++)
+	{
+	  apchWrite[i]=pchBuffer;
+	  acchWrite[i]=cch;
+	}
+      i=URingWriteAll(&uring,cDestinations,afdDestinations,
+		      apchWrite,acchWrite,acchWritten);
+      if (i<0)
+	Panic(PANIC_RUN,"io_uring failed: %s",strerror(errno));
+      if (i>0)
+	Panic(PANIC_RUN,"Broken Pipe: %s",strerror(errno));
+      return;
+    }
+  for (pfd=afdDestinations; *pfd>=0; pfd++)
+    if (WriteToDestination(*pfd,pchBuffer,cch)!=0)
+      Panic(PANIC_RUN,"Broken Pipe %d",*pfd);
+}
+
+/* **********************************************************************
+
+FlushBatch()
 
-returns first index of a NL in a buffer.
-returns -1 if there is no NL
+Write the pending batch, if there is one.
 
 ********************************************************************** */
 
-static int SearchNewLine(const char *pchBuffer, int cch)
+static void FlushBatch(void)
 {
-  int i,iLast;
-  iLast=-1;
-  for (i=0; i<cch; i++)
-    if (pchBuffer[i]=='\n')
-      iLast=i;
-  return iLast;
+  if (!batchAll.cchBuffer) return;
+  dprintf(DEBUG_BUFFER,"flushing %d line(s)",batchAll.cLines);
+  WriteToAll(batchAll.pchBuffer,batchAll.cchBuffer);
+  LineBatchClear(&batchAll);
+}
+
+/* **********************************************************************
+
+QueueLines(pchBuffer,cch,cchRaw)
+
+Hand complete lines to the destinations. Without batch bounds they are
+written at once, otherwise they are collected line by line until a
+bound is hit. This is the sink of LineArenaFeed(). cchRaw differs
+from cch only for truncated lines, which are traced.
+
+********************************************************************** */
+
+static void QueueLines(const char *pchBuffer, int cch, long cchRaw)
+{
+  if (cchRaw!=cch)
+    dprintf(DEBUG_BUFFER,"buffer: %ld byte(s) read cut to %d byte(s)",
+	    cchRaw,cch);
+  if (!LineBatchEnabled(&batchAll))
+    {
+      WriteToAll(pchBuffer,cch);
+      return;
+    }
+  while (cch>0)
+    {
+      const char *pchNL=memchr(pchBuffer,'\n',cch);
+      int cchLine=pchNL ? pchNL-pchBuffer+1 : cch;
+      if (!LineBatchFits(&batchAll,cchLine))
+	FlushBatch();
+      if (!LineBatchFits(&batchAll,cchLine))
+	WriteToAll(pchBuffer,cchLine); /* longer than any batch */
+      else if (LineBatchAppend(&batchAll,pchBuffer,cchLine))
+	FlushBatch();
+      pchBuffer+=cchLine;
+      cch-=cchLine;
+    }
 }
-                  
+
 /* **********************************************************************
 
 MonitorStream()
@@ -277,33 +374,34 @@ return code:
 
 static int MonitorStream(void)
 {
-  int cchRead,iEOB;
-  iEOB=0;
+  int cchRead;
   while (1)
     {
-      cchRead=ReadFromFile(STDIN,achLogBuffer+iEOB,LOG_BUFFER_SIZE-iEOB); /* blocking */
-      if (cchRead>0)
+      long msLeft=LineBatchMsLeft(&batchAll);
+      if (msLeft>=0)
 	{
-	  int iNL;
-	  int *pfd;
-	  iEOB+=cchRead;
-	  while (
-		 ((iNL=SearchNewLine(achLogBuffer,iEOB))>=0 || iEOB==LOG_BUFFER_SIZE)
-		 )
+	  /* do not block longer than the pending batch may wait */
+	  struct pollfd pfdIn;
+	  pfdIn.fd=STDIN;
+	  pfdIn.events=POLLIN;
+	  if (poll(&pfdIn,1,(int)msLeft)==0)
 	    {
-	      int i;
-	      if (iNL<0) iNL=iEOB-1; /* if no NL and full buffer, flush whole buffer */
-	      for (pfd=afdDestinations; *pfd>=0; pfd++)
-		if (WriteToDestination(*pfd,achLogBuffer,iNL+1)!=0)
-		  Panic(PANIC_RUN,"Broken Pipe %d",*pfd);
-	      /* delete the line(s) */
-	      for (i=0; i<iEOB-iNL-1; i++)
-		achLogBuffer[i]=achLogBuffer[i+iNL+1]; /* or just memmove()? */
-	      iEOB-=iNL+1;
+	      FlushBatch();
+	      continue;
 	    }
 	}
+      cchRead=ReadFromFile(STDIN,achLogBuffer,LOG_BUFFER_SIZE); /* blocking */
+      if (cchRead>0)
+	{
+	  if (LineArenaFeed(&arenaLines,achLogBuffer,cchRead,QueueLines)<0)
+	    Panic(PANIC_RUN,"memory error");
+	}
       else /* end of pipe :-) */
 	{
+	  FlushBatch();
+	  if (arenaLines.ulTruncated)
+	    fprintf(stderr,"%s: notice: %lu line(s) truncated\n",
+		    PROG_NAME,arenaLines.ulTruncated);
 	  dprintf(DEBUG_PIPES,"errno for STDIN: %d/%s",errno,strerror(errno));
 	  return 1;
 	}
@@ -311,6 +409,45 @@ static int MonitorStream(void)
   /* not reached */ return 0;
 }
 
+/* **********************************************************************
+
+StartURing()
+
+Set up the io_uring engine for the destinations, with the pipes as
+fixed files and the read and batch buffers as fixed buffers. If the
+kernel cannot do it, the classic write() path stays.
+
+********************************************************************** */
+
+static void StartURing(void)
+{
+  struct iovec aiov[2];
+  int i,cBuffers=0;
+  if (URingInit(&uring,cDestinations,cDestinations)<0)
+    {
+      fprintf(stderr,"%s: notice: no io_uring (%s), using write()\n",
+	      PROG_NAME,strerror(errno));
+      return;
+    }
+  for (i=0; i<cDestinations; i++)
+    if (URingSetFile(&uring,i,afdDestinations[i])<0)
+      Panic(PANIC_RUN,"cannot register pipe: %s",strerror(errno));
+  aiov[cBuffers].iov_base=achLogBuffer;
+  aiov[cBuffers++].iov_len=sizeof(achLogBuffer);
+  if (LineBatchEnabled(&batchAll))
+    {
+      aiov[cBuffers].iov_base=batchAll.pchBuffer;
+      aiov[cBuffers++].iov_len=batchAll.cchMaxBytes;
+    }
+  if (URingRegisterBuffers(&uring,aiov,cBuffers)<0)
+    dprintf(DEBUG_CONFIG,"no fixed buffers: %s",strerror(errno));
+  apchWrite=calloc(cDestinations,sizeof(char*));
+  acchWrite=calloc(cDestinations,sizeof(int));
+  acchWritten=calloc(cDestinations,sizeof(int));
+  if (!apchWrite || !acchWrite || !acchWritten)
+    Panic(PANIC_RUN,"memory error");
+}
+
 /* ============================== MAIN ============================== */
 
 int main(int cArg, char * const ppchArg[])
@@ -322,8 +459,8 @@ int main(int cArg, char * const ppchArg[])
 DDD param:
 */
 
-  afhDestinations=NULL;
-  while (EOF!=(chOpt=getopt(cArg,ppchArg,"Vhd:")))
+  afdDestinations=NULL;
+  while (EOF!=(chOpt=getopt(cArg,ppchArg,"VhSd:b:l:w:m:u")))
     {
       switch (chOpt)
 	{
@@ -334,6 +471,12 @@ DDD param:
 	  break;
 	case 'd': ulDebugMask = strtoul(optarg,NULL,10); break;
 	case 'V': TellRevision(); exit(0); break;
+	case 'S': nShellMode = SPAWN_SHELL_ALWAYS; break;
+	case 'b': cchBatchMaxBytes = atoi(optarg); break;
+	case 'l': cBatchMaxLines = atoi(optarg); break;
+	case 'w': msBatchMaxDelay = atol(optarg); break;
+	case 'm': cchMaxLine = atoi(optarg); break;
+	case 'u': bURing = true; break;
 	}
     }
   
@@ -345,22 +488,39 @@ DDD param:
       exit(PANIC_USAGE);
     }
 
-  afhDestinations=calloc(cPipes+1,sizeof(FILE*)); /* the last will be NULL */
+  aidDestinations=calloc(cPipes+1,sizeof(pid_t));
   afdDestinations=calloc(cPipes+1,sizeof(int));   /* the last will be -1 */
-  for (i=0; i<=cPipes; afdDestinations[i++]=-1);
+  if (!aidDestinations || !afdDestinations) Panic(PANIC_RUN,"memory error");
+  if (LineBatchInit(&batchAll,cchBatchMaxBytes,cBatchMaxLines,msBatchMaxDelay)<0)
+    Panic(PANIC_RUN,"memory error");
+  LineArenaInit(&arenaLines,cchMaxLine);
+  for (i=0; i<=cPipes; i++)
+    {
+      afdDestinations[i]=-1;
+      aidDestinations[i]=-1;
+    }
 
   for (i=0; i<cPipes; i++)
     {
+      int hRead,hWrite;
       dprintf(DEBUG_CONFIG,"starting %s\n",ppchArg[optind+i]);
-      afhDestinations[i]=popen(ppchArg[optind+i],"w");
-      if (afhDestinations[i])
-	  afdDestinations[i]=fileno(afhDestinations[i]);
-      else
-	Panic(PANIC_RUN,"cannot start '%s': %s",
-	      ppchArg[optind+i],strerror(errno));
+      if (SpawnPipe(&hRead,&hWrite)<0)
+	Panic(PANIC_RUN,"cannot create pipe: %s",strerror(errno));
+      aidDestinations[i]=SpawnCommand(ppchArg[optind+i],nShellMode,hRead,-1);
+      close(hRead);
+      if (aidDestinations[i]<0)
+	{
+	  close(hWrite);
+	  Panic(PANIC_RUN,"cannot start '%s': %s",
+		ppchArg[optind+i],strerror(errno));
+	}
+      afdDestinations[i]=hWrite;
     }
-  
-  if (!afhDestinations) Panic(PANIC_RUN,"memory error");
+
+  cDestinations=cPipes;
+  if (bURing)
+    StartURing();
+
   /* get and start all destinations */
 
   if (MonitorStream())
@@ -0,0 +1,390 @@
+/* ======================================================================
+
+uring.c
+
+Optional io_uring engine for the fan-out writes of tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+The engine talks to the kernel through the raw system calls, so there
+is no dependency on liburing. Without <linux/io_uring.h> at build time
+URingInit() always fails with ENOSYS, and the programs stay with the
+classic path. The header is found by __has_include, unless configure
+has defined HAVE_LINUX_IO_URING_H already.
+
+   ====================================================================== */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "uring.h"
+
+#ifndef HAVE_LINUX_IO_URING_H
+#ifdef __has_include
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_LINUX_IO_URING_H 1
+#endif
+#endif
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <linux/io_uring.h>
+
+/* **********************************************************************
+
+URingInit(pu, cEntries, cFiles)
+
+Set up a ring for cEntries writes in flight and a table of cFiles
+fixed files (all free). The kernel must support IORING_OP_WRITE and
+IORING_OP_WRITE_FIXED, which is probed.
+
+Return code: 0 on success, -1 if io_uring cannot be used (errno).
+
+********************************************************************** */
+
+int URingInit(TURing *pu, unsigned cEntries, int cFiles)
+{
+  struct io_uring_params params;
+  struct io_uring_probe *pprobe;
+  int    i,idError;
+  size_t cbProbe;
+
+  memset(pu,0,sizeof(*pu));
+  pu->hRing=-1;
+  if (!cEntries) cEntries=1;
+  memset(&params,0,sizeof(params));
+  pu->hRing=syscall(__NR_io_uring_setup,cEntries,&params);
+  if (pu->hRing<0) return -1;
+  pu->cEntries=params.sq_entries;
+
+  /* can it write? (kernel 5.6 and later) */
+  cbProbe=sizeof(*pprobe)+256*sizeof(struct io_uring_probe_op);
+  pprobe=calloc(1,cbProbe);
+  if (!pprobe) goto failed;
+  if (syscall(__NR_io_uring_register,pu->hRing,IORING_REGISTER_PROBE,
+	      pprobe,256)<0
+      || pprobe->last_op<IORING_OP_WRITE
+      || !(pprobe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)
+      || !(pprobe->ops[IORING_OP_WRITE_FIXED].flags & IO_URING_OP_SUPPORTED))
+    {
+      free(pprobe);
+      errno=ENOSYS;
+      goto failed;
+    }
+  free(pprobe);
+
+  pu->cbSqRing=params.sq_off.array+params.sq_entries*sizeof(unsigned);
+  pu->cbCqRing=params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (pu->cbCqRing>pu->cbSqRing) pu->cbSqRing=pu->cbCqRing;
+      pu->cbCqRing=0;
+    }
+  pu->pvSqRing=mmap(NULL,pu->cbSqRing,PROT_READ|PROT_WRITE,
+		    MAP_SHARED|MAP_POPULATE,pu->hRing,IORING_OFF_SQ_RING);
+  if (pu->pvSqRing==MAP_FAILED) { pu->pvSqRing=NULL; goto failed; }
+  if (pu->cbCqRing)
+    {
+      pu->pvCqRing=mmap(NULL,pu->cbCqRing,PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE,pu->hRing,IORING_OFF_CQ_RING);
+      if (pu->pvCqRing==MAP_FAILED) { pu->pvCqRing=NULL; goto failed; }
+    }
+  else
+    pu->pvCqRing=pu->pvSqRing;
+  pu->cbSqes=params.sq_entries*sizeof(struct io_uring_sqe);
+  pu->pvSqes=mmap(NULL,pu->cbSqes,PROT_READ|PROT_WRITE,
+		  MAP_SHARED|MAP_POPULATE,pu->hRing,IORING_OFF_SQES);
+  if (pu->pvSqes==MAP_FAILED) { pu->pvSqes=NULL; goto failed; }
+
+  pu->puSqHead =(unsigned*)((char*)pu->pvSqRing+params.sq_off.head);
+  pu->puSqTail =(unsigned*)((char*)pu->pvSqRing+params.sq_off.tail);
+  pu->puSqMask =(unsigned*)((char*)pu->pvSqRing+params.sq_off.ring_mask);
+  pu->puSqArray=(unsigned*)((char*)pu->pvSqRing+params.sq_off.array);
+  pu->puCqHead =(unsigned*)((char*)pu->pvCqRing+params.cq_off.head);
+  pu->puCqTail =(unsigned*)((char*)pu->pvCqRing+params.cq_off.tail);
+  pu->puCqMask =(unsigned*)((char*)pu->pvCqRing+params.cq_off.ring_mask);
+  pu->pvCqes   =(char*)pu->pvCqRing+params.cq_off.cqes;
+
+  if (cFiles>0)
+    {
+      pu->ahFiles=malloc(cFiles*sizeof(int));
+      if (!pu->ahFiles) goto failed;
+      for (i=0; i<cFiles; i++) pu->ahFiles[i]=-1;
+      if (syscall(__NR_io_uring_register,pu->hRing,IORING_REGISTER_FILES,
+		  pu->ahFiles,cFiles)<0)
+	goto failed;
+      pu->cFiles=cFiles;
+    }
+  return 0;
+
+ failed:
+  idError=errno;
+  URingExit(pu);
+  errno=idError;
+  return -1;
+}
+
+/* **********************************************************************
+
+URingExit(pu)
+
+Release the ring. Repeatable.
+
+********************************************************************** */
+
+void URingExit(TURing *pu)
+{
+  if (pu->pvSqes) munmap(pu->pvSqes,pu->cbSqes);
+  if (pu->pvCqRing && pu->pvCqRing!=pu->pvSqRing)
+    munmap(pu->pvCqRing,pu->cbCqRing);
+  if (pu->pvSqRing) munmap(pu->pvSqRing,pu->cbSqRing);
+  if (pu->hRing>=0) close(pu->hRing); /* drops the registrations */
+  free(pu->ahFiles);
+  free(pu->aiovBuffers);
+  memset(pu,0,sizeof(*pu));
+  pu->hRing=-1;
+}
+
+/* **********************************************************************
+
+URingSetFile(pu, iSlot, hFile)
+
+Put a descriptor into slot iSlot of the fixed file table (-1 clears
+the slot). Nothing happens, if the slot already has it.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+int URingSetFile(TURing *pu, int iSlot, int hFile)
+{
+  struct io_uring_files_update update;
+  if (iSlot<0 || iSlot>=pu->cFiles)
+    {
+      errno=EINVAL;
+      return -1;
+    }
+  if (pu->ahFiles[iSlot]==hFile) return 0;
+  memset(&update,0,sizeof(update));
+  update.offset=iSlot;
+  update.fds=(unsigned long)&hFile;
+  if (syscall(__NR_io_uring_register,pu->hRing,IORING_REGISTER_FILES_UPDATE,
+	      &update,1)<0)
+    return -1;
+  pu->ahFiles[iSlot]=hFile;
+  return 0;
+}
+
+/* **********************************************************************
+
+URingRegisterBuffers(pu, aiov, c)
+
+Register buffers, which stay at their address for the whole run.
+Writes from inside them use IORING_OP_WRITE_FIXED.
+
+Return code: 0 on success, -1 on failure (errno).
+
+********************************************************************** */
+
+int URingRegisterBuffers(TURing *pu, const struct iovec *aiov, int c)
+{
+  if (pu->cBuffers)
+    {
+      errno=EBUSY;
+      return -1;
+    }
+  pu->aiovBuffers=malloc(c*sizeof(struct iovec));
+  if (!pu->aiovBuffers) return -1;
+  memcpy(pu->aiovBuffers,aiov,c*sizeof(struct iovec));
+  if (syscall(__NR_io_uring_register,pu->hRing,IORING_REGISTER_BUFFERS,
+	      pu->aiovBuffers,c)<0)
+    {
+      int idError=errno;
+      free(pu->aiovBuffers);
+      pu->aiovBuffers=NULL;
+      errno=idError;
+      return -1;
+    }
+  pu->cBuffers=c;
+  return 0;
+}
+
+/* **********************************************************************
+
+PrepareWrite(pu, i, hFile, pch, cch)
+
+Queue a write for slot i of the current round. Fixed files and fixed
+buffers are used, where they are registered.
+
+********************************************************************** */
+
+static void PrepareWrite(TURing *pu, int i, int hFile,
+			 const char *pch, int cch)
+{
+  unsigned uTail=*pu->puSqTail;
+  unsigned iEntry=uTail & *pu->puSqMask;
+  struct io_uring_sqe *psqe=(struct io_uring_sqe*)pu->pvSqes+iEntry;
+  int k;
+  memset(psqe,0,sizeof(*psqe));
+  psqe->opcode=IORING_OP_WRITE;
+  psqe->fd=hFile;
+  for (k=0; k<pu->cFiles; k++)
+    if (pu->ahFiles[k]==hFile)
+      {
+	psqe->fd=k;
+	psqe->flags|=IOSQE_FIXED_FILE;
+	break;
+      }
+  for (k=0; k<pu->cBuffers; k++)
+    {
+      const char *pchBase=pu->aiovBuffers[k].iov_base;
+      if (pch>=pchBase && pch+cch<=pchBase+pu->aiovBuffers[k].iov_len)
+	{
+	  psqe->opcode=IORING_OP_WRITE_FIXED;
+	  psqe->buf_index=k;
+	  break;
+	}
+    }
+  psqe->addr=(unsigned long)pch;
+  psqe->len=cch;
+  psqe->off=(__u64)-1;    /* current position, pipes and O_APPEND */
+  psqe->user_data=i;
+  pu->puSqArray[iEntry]=iEntry;
+  __atomic_store_n(pu->puSqTail,uTail+1,__ATOMIC_RELEASE);
+}
+
+/* **********************************************************************
+
+cFailed=URingWriteAll(pu, c, ahFiles, apch, acch, acchDone)
+
+Write c buffers (apch[i], acch[i]) to c descriptors in as few
+submissions as possible. Short writes are continued, interrupted ones
+repeated. acchDone[i] receives the bytes written, it is less than
+acch[i] for a failed write (errno of the last failure).
+
+Return code: The number of failed writes, or -1 if the ring itself
+failed. Then the caller must write everything on the classic path.
+
+********************************************************************** */
+
+int URingWriteAll(TURing *pu, int c, const int *ahFiles,
+		  const char * const *apch, const int *acch, int *acchDone)
+{
+  int iBase,cFailed=0;
+  for (iBase=0; iBase<c; iBase+=pu->cEntries)
+    {
+      int i,cRound=c-iBase,cPending=0;
+      if (cRound>(int)pu->cEntries) cRound=pu->cEntries;
+      for (i=iBase; i<iBase+cRound; i++)
+	{
+	  acchDone[i]=0;
+	  if (acch[i]<=0) continue;
+	  PrepareWrite(pu,i,ahFiles[i],apch[i],acch[i]);
+	  cPending++;
+	}
+      while (cPending>0)
+	{
+	  unsigned uHead,uTail;
+	  unsigned cSubmit=*pu->puSqTail
+	    -__atomic_load_n(pu->puSqHead,__ATOMIC_ACQUIRE);
+	  if (syscall(__NR_io_uring_enter,pu->hRing,cSubmit,1,
+		      IORING_ENTER_GETEVENTS,NULL,0)<0
+	      && errno!=EINTR && errno!=EAGAIN && errno!=EBUSY)
+	    return -1;
+	  uHead=*pu->puCqHead;
+	  uTail=__atomic_load_n(pu->puCqTail,__ATOMIC_ACQUIRE);
+	  for (; uHead!=uTail; uHead++)
+	    {
+	      struct io_uring_cqe *pcqe=(struct io_uring_cqe*)pu->pvCqes
+		+(uHead & *pu->puCqMask);
+	      int iWrite=(int)pcqe->user_data;
+	      int nResult=pcqe->res;
+	      if (nResult>0)
+		{
+		  acchDone[iWrite]+=nResult;
+		  if (acchDone[iWrite]<acch[iWrite])
+		    PrepareWrite(pu,iWrite,ahFiles[iWrite],
+				 apch[iWrite]+acchDone[iWrite],
+				 acch[iWrite]-acchDone[iWrite]);
+		  else
+		    cPending--;
+		}
+	      else if (nResult==-EINTR || nResult==-EAGAIN)
+		PrepareWrite(pu,iWrite,ahFiles[iWrite],
+			     apch[iWrite]+acchDone[iWrite],
+			     acch[iWrite]-acchDone[iWrite]);
+	      else
+		{
+		  errno=nResult ? -nResult : EIO;
+		  cFailed++;
+		  cPending--;
+		}
+	    }
+	  __atomic_store_n(pu->puCqHead,uHead,__ATOMIC_RELEASE);
+	}
+    }
+  return cFailed;
+}
+
+#else /* no <linux/io_uring.h> */
+
+int URingInit(TURing *pu, unsigned cEntries, int cFiles)
+{
+  memset(pu,0,sizeof(*pu));
+  pu->hRing=-1;
+  errno=ENOSYS;
+  return -1;
+}
+
+void URingExit(TURing *pu)
+{
+  memset(pu,0,sizeof(*pu));
+  pu->hRing=-1;
+}
+
+int URingSetFile(TURing *pu, int iSlot, int hFile)
+{
+  errno=ENOSYS;
+  return -1;
+}
+
+int URingRegisterBuffers(TURing *pu, const struct iovec *aiov, int c)
+{
+  errno=ENOSYS;
+  return -1;
+}
+
+int URingWriteAll(TURing *pu, int c, const int *ahFiles,
+		  const char * const *apch, const int *acch, int *acchDone)
+{
+  errno=ENOSYS;
+  return -1;
+}
+
+#endif
+
+/* **********************************************************************
+
+URingActive(pu)
+
+Return code: true, if the engine is set up and in use.
+
+********************************************************************** */
+
+int URingActive(const TURing *pu)
+{
+  return pu->hRing>=0;
+}
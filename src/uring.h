@@ -0,0 +1,54 @@
+/* ======================================================================
+
+uring.h
+
+Optional io_uring engine for the fan-out writes of tailfdx and teepee.
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2, or (at your option)
+any later version.
+
+======================================================================
+
+Writing the same block to many pipes costs one write() per pipe. With
+the engine, all writes of a round go to the kernel in one submission,
+and the completions drive the rest: a short write is resubmitted for
+its remainder, until every write is done or has failed.
+
+The destination descriptors are registered as fixed files, and the
+static buffers of a program as fixed buffers. URingInit() probes the
+kernel; if it fails, the caller keeps the classic write() path.
+
+   ====================================================================== */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+typedef struct {
+  int              hRing;           /* io_uring fd, -1 if not active */
+  unsigned         cEntries;        /* submission queue size */
+  unsigned        *puSqHead, *puSqTail, *puSqMask, *puSqArray;
+  unsigned        *puCqHead, *puCqTail, *puCqMask;
+  void            *pvSqes;          /* struct io_uring_sqe[] */
+  void            *pvCqes;          /* struct io_uring_cqe[] */
+  void            *pvSqRing, *pvCqRing;
+  size_t           cbSqRing, cbCqRing, cbSqes;
+  int             *ahFiles;         /* registered files, -1 = free slot */
+  int              cFiles;
+  struct iovec    *aiovBuffers;     /* registered buffers */
+  int              cBuffers;
+} TURing;
+
+int   URingInit(TURing *pu, unsigned cEntries, int cFiles);
+void  URingExit(TURing *pu);
+int   URingActive(const TURing *pu);
+int   URingSetFile(TURing *pu, int iSlot, int hFile);
+int   URingRegisterBuffers(TURing *pu, const struct iovec *aiov, int c);
+int   URingWriteAll(TURing *pu, int c, const int *ahFiles,
+		    const char * const *apch, const int *acch, int *acchDone);
+
+#endif